@@ -0,0 +1,710 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Reading of plain, bgzip-compressed (BGZF) and gzip-compressed VCF files. See bgzf.h.
+
+ BGZF files are a series of gzip members ("blocks") holding at most 64 kb of data each, so every block can be
+ inflated on its own. With threadBgzf, the reading thread loads the compressed blocks ahead into a ring of slots,
+ the pool threads inflate them in any order, and the blocks are taken back from the ring in file order.
+ queryIndex reads the binning and linear index of a .tbi or .csi file and returns the range of virtual offsets
+ that holds the records of a region.
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "bgzf.h"
+#define merror "\nERROR: System out of memory\n\n"
+#define cerror "\nERROR: Corrupted BGZF block in the VCF or index file\n\n"
+#define BLOCK_MAX 65536
+
+enum { MODE_PLAIN, MODE_BGZF, MODE_GZIP };
+
+typedef struct {
+    int state, raw_n, buf_n;
+    long int block, next;
+    unsigned char *raw, *buf;
+} Slot_s;
+
+typedef struct {
+    int slot_n, head, used, eof, stop, thread_n;
+    long int next;
+    Slot_s *slots;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} Pool_s;
+
+static size_t readRaw(Bgzf_s *fp, unsigned char *data, size_t n) {
+    size_t k = 0;
+    while(k < n && fp->peek_i < fp->peek_n)
+        data[k++] = fp->peek[fp->peek_i++];
+    if(k < n)
+        k += fread(data + k, 1, n - k, fp->file);
+    return k;
+}
+
+static int readBlock(Bgzf_s *fp, unsigned char *raw) {
+    int i, n, xlen, slen, bsize = 0;
+
+    if((n = readRaw(fp, raw, 12)) == 0)
+        return 0;
+    if(n < 12 || raw[0] != 31 || raw[1] != 139 || raw[2] != 8 || (raw[3] & 4) == 0) {
+        fprintf(stderr, cerror);
+        exit(EXIT_FAILURE);
+    }
+    xlen = raw[10] | raw[11] << 8;
+    if((int)readRaw(fp, raw + 12, xlen) != xlen) {
+        fprintf(stderr, cerror);
+        exit(EXIT_FAILURE);
+    }
+    for(i = 12; i + 4 <= 12 + xlen; i += 4 + slen) {
+        slen = raw[i + 2] | raw[i + 3] << 8;
+        if(raw[i] == 'B' && raw[i + 1] == 'C' && slen == 2 && i + 6 <= 12 + xlen)
+            bsize = (raw[i + 4] | raw[i + 5] << 8) + 1;
+    }
+    if(bsize < 12 + xlen + 8 || (int)readRaw(fp, raw + 12 + xlen, bsize - 12 - xlen) != bsize - 12 - xlen) {
+        fprintf(stderr, cerror);
+        exit(EXIT_FAILURE);
+    }
+
+    return bsize;
+}
+
+static int inflateBlock(z_stream *zs, unsigned char *raw, int bsize, unsigned char *buf) {
+    int xlen = raw[10] | raw[11] << 8;
+    unsigned long int crc = 0, isize = 0;
+
+    crc = raw[bsize - 8] | raw[bsize - 7] << 8 | raw[bsize - 6] << 16 | (unsigned long int)raw[bsize - 5] << 24;
+    isize = raw[bsize - 4] | raw[bsize - 3] << 8 | raw[bsize - 2] << 16 | (unsigned long int)raw[bsize - 1] << 24;
+    if(isize > BLOCK_MAX || inflateReset(zs) != Z_OK) {
+        fprintf(stderr, cerror);
+        exit(EXIT_FAILURE);
+    }
+    zs->next_in = raw + 12 + xlen;
+    zs->avail_in = bsize - 12 - xlen - 8;
+    zs->next_out = buf;
+    zs->avail_out = BLOCK_MAX;
+    if(inflate(zs, Z_FINISH) != Z_STREAM_END || zs->total_out != isize || crc32(0, buf, isize) != crc) {
+        fprintf(stderr, cerror);
+        exit(EXIT_FAILURE);
+    }
+
+    return isize;
+}
+
+static void *runInflate(void *arg) {
+    int i;
+    z_stream zs = {0};
+    Pool_s *pool = arg;
+    Slot_s *slot = NULL;
+
+    if(inflateInit2(&zs, -15) != Z_OK) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_lock(&pool->lock);
+    while(1) {
+        slot = NULL;
+        for(i = 0; i < pool->used; i++) {
+            if(pool->slots[(pool->head + i) % pool->slot_n].state == 1) {
+                slot = &pool->slots[(pool->head + i) % pool->slot_n];
+                break;
+            }
+        }
+        if(slot == NULL) {
+            if(pool->stop)
+                break;
+            pthread_cond_wait(&pool->cond, &pool->lock);
+            continue;
+        }
+        slot->state = 2;
+        pthread_mutex_unlock(&pool->lock);
+        slot->buf_n = inflateBlock(&zs, slot->raw, slot->raw_n, slot->buf);
+        pthread_mutex_lock(&pool->lock);
+        slot->state = 3;
+        pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    inflateEnd(&zs);
+
+    return NULL;
+}
+
+static void fillSlots(Bgzf_s *fp) {
+    int n;
+    Pool_s *pool = fp->pool;
+    Slot_s *slot = NULL;
+
+    while(pool->used < pool->slot_n && pool->eof == 0) {
+        slot = &pool->slots[(pool->head + pool->used) % pool->slot_n];
+        if((n = readBlock(fp, slot->raw)) == 0) {
+            pool->eof = 1;
+            break;
+        }
+        slot->raw_n = n;
+        slot->block = pool->next;
+        pool->next += n;
+        slot->next = pool->next;
+        pthread_mutex_lock(&pool->lock);
+        slot->state = 1;
+        pool->used++;
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+static int takeSlot(Bgzf_s *fp) {
+    int n = 0;
+    unsigned char *temp = NULL;
+    Pool_s *pool = fp->pool;
+    Slot_s *slot = NULL;
+
+    while(1) {
+        fillSlots(fp);
+        if(pool->used == 0) {
+            fp->block = fp->next = pool->next;
+            return 0;
+        }
+        slot = &pool->slots[pool->head];
+        pthread_mutex_lock(&pool->lock);
+        while(slot->state != 3)
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        temp = slot->buf;
+        slot->buf = fp->buf;
+        fp->buf = temp;
+        fp->block = slot->block;
+        fp->next = slot->next;
+        n = slot->buf_n;
+        slot->state = 0;
+        pool->head = (pool->head + 1) % pool->slot_n;
+        pool->used--;
+        pthread_mutex_unlock(&pool->lock);
+        if(n > 0)
+            return n;
+    }
+}
+
+static void resetPool(Bgzf_s *fp, long int next) {
+    int i;
+    Pool_s *pool = fp->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    for(i = 0; i < pool->slot_n; i++) {
+        while(pool->slots[i].state == 2)
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        pool->slots[i].state = 0;
+    }
+    pool->head = pool->used = pool->eof = 0;
+    pool->next = next;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static int loadBlock(Bgzf_s *fp) {
+    int n = 0;
+
+    fp->buf_i = fp->buf_n = 0;
+    if(fp->mode == MODE_PLAIN) {
+        fp->block = fp->next;
+        n = readRaw(fp, fp->buf, BLOCK_MAX);
+        fp->next += n;
+    } else if(fp->mode == MODE_GZIP) {
+        if((n = gzread(fp->gz, fp->buf, BLOCK_MAX)) < 0) {
+            fprintf(stderr, cerror);
+            exit(EXIT_FAILURE);
+        }
+        fp->block = fp->next;
+        fp->next += n;
+    } else if(fp->pool != NULL)
+        n = takeSlot(fp);
+    else {
+        do {
+            fp->block = fp->next;
+            if((n = readBlock(fp, fp->raw)) == 0)
+                break;
+            fp->next += n;
+            n = inflateBlock(fp->zs, fp->raw, n, fp->buf);
+        } while(n == 0);
+    }
+    fp->buf_n = n;
+
+    return n;
+}
+
+Bgzf_s *openBgzf(const char *name) {
+    struct stat st;
+    Bgzf_s *fp = NULL;
+
+    if((fp = calloc(1, sizeof(Bgzf_s))) == NULL || (fp->buf = malloc(BLOCK_MAX)) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    if((fp->file = fopen(name, "r")) == NULL) {
+        free(fp->buf);
+        free(fp);
+        return NULL;
+    }
+    fp->peek_n = fread(fp->peek, 1, sizeof(fp->peek), fp->file);
+    if(fp->peek_n >= 2 && fp->peek[0] == 31 && fp->peek[1] == 139) {
+        if(fp->peek_n == 18 && fp->peek[3] & 4 && fp->peek[12] == 'B' && fp->peek[13] == 'C')
+            fp->mode = MODE_BGZF;
+        else
+            fp->mode = MODE_GZIP;
+    }
+    if(fstat(fileno(fp->file), &st) == 0 && S_ISREG(st.st_mode) && fseek(fp->file, 0, SEEK_SET) == 0)
+        fp->peek_n = 0;
+    if(fp->mode == MODE_GZIP) {
+        if(fp->peek_n > 0) {
+            fprintf(stderr, "\nERROR: %s is gzip compressed, but not with bgzip. Use bgzip or a regular file\n\n", name);
+            exit(EXIT_FAILURE);
+        }
+        fclose(fp->file);
+        fp->file = NULL;
+        if((fp->gz = gzopen(name, "r")) == NULL) {
+            fprintf(stderr, "\nERROR: Cannot open file %s\n\n", name);
+            exit(EXIT_FAILURE);
+        }
+        gzbuffer(fp->gz, BLOCK_MAX);
+    } else if(fp->mode == MODE_BGZF) {
+        if((fp->raw = malloc(BLOCK_MAX)) == NULL || (fp->zs = calloc(1, sizeof(z_stream))) == NULL || inflateInit2((z_stream *)fp->zs, -15) != Z_OK) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return fp;
+}
+
+void threadBgzf(Bgzf_s *fp, int thread_n) {
+    int i;
+    Pool_s *pool = NULL;
+
+    if(fp->mode != MODE_BGZF || fp->pool != NULL || thread_n < 2)
+        return;
+    if((pool = calloc(1, sizeof(Pool_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    pool->thread_n = thread_n - 1;
+    pool->slot_n = thread_n * 4;
+    pool->next = fp->next;
+    if((pool->slots = calloc(pool->slot_n, sizeof(Slot_s))) == NULL || (pool->threads = malloc(pool->thread_n * sizeof(pthread_t))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < pool->slot_n; i++) {
+        if((pool->slots[i].raw = malloc(BLOCK_MAX)) == NULL || (pool->slots[i].buf = malloc(BLOCK_MAX)) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    for(i = 0; i < pool->thread_n; i++) {
+        if(pthread_create(&pool->threads[i], NULL, runInflate, pool) != 0) {
+            fprintf(stderr, "\nERROR: Cannot create threads\n\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    fp->pool = pool;
+}
+
+ssize_t getBgzfLine(Bgzf_s *fp, char **line, size_t *len) {
+    size_t n = 0, k = 0;
+    unsigned char *p = NULL;
+
+    while(1) {
+        if(fp->buf_i >= fp->buf_n && loadBlock(fp) == 0)
+            break;
+        p = memchr(fp->buf + fp->buf_i, '\n', fp->buf_n - fp->buf_i);
+        k = p != NULL ? (size_t)(p - fp->buf - fp->buf_i + 1) : (size_t)(fp->buf_n - fp->buf_i);
+        if(*line == NULL || n + k + 1 > *len) {
+            *len = (n + k + 1) * 2;
+            if((*line = realloc(*line, *len)) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+        }
+        memcpy(*line + n, fp->buf + fp->buf_i, k);
+        n += k;
+        fp->buf_i += k;
+        if(p != NULL)
+            break;
+    }
+    if(n == 0)
+        return -1;
+    (*line)[n] = '\0';
+
+    return n;
+}
+
+int readBgzf(Bgzf_s *fp, void *data, int n) {
+    int k = 0, m = 0;
+
+    while(k < n) {
+        if(fp->buf_i >= fp->buf_n && loadBlock(fp) == 0)
+            break;
+        m = fp->buf_n - fp->buf_i < n - k ? fp->buf_n - fp->buf_i : n - k;
+        memcpy((unsigned char *)data + k, fp->buf + fp->buf_i, m);
+        fp->buf_i += m;
+        k += m;
+    }
+
+    return k;
+}
+
+long int tellBgzf(Bgzf_s *fp) {
+    if(fp->mode == MODE_BGZF)
+        return fp->buf_i < fp->buf_n ? fp->block << 16 | fp->buf_i : fp->next << 16;
+    return fp->block + fp->buf_i;
+}
+
+int seekBgzf(Bgzf_s *fp, long int off) {
+    if(fp->mode == MODE_GZIP)
+        return -1;
+    if(fp->mode == MODE_PLAIN) {
+        if(fseek(fp->file, off, SEEK_SET) != 0)
+            return -1;
+        fp->peek_i = fp->peek_n;
+        fp->block = fp->next = off;
+        fp->buf_i = fp->buf_n = 0;
+        return 0;
+    }
+    if(fp->buf_n > 0 && fp->block == off >> 16 && (off & 0xffff) < fp->buf_n) {
+        fp->buf_i = off & 0xffff;
+        return 0;
+    }
+    if(fseek(fp->file, off >> 16, SEEK_SET) != 0)
+        return -1;
+    fp->peek_i = fp->peek_n;
+    if(fp->pool != NULL)
+        resetPool(fp, off >> 16);
+    fp->next = off >> 16;
+    if(loadBlock(fp) < (off & 0xffff))
+        return -1;
+    fp->buf_i = off & 0xffff;
+
+    return 0;
+}
+
+static long int findBlock(Bgzf_s *fp, long int off) {
+    int i, k, n;
+    long int pos = ftell(fp->file), found = -1;
+    unsigned char buf[BLOCK_MAX + 18];
+
+    while(found < 0 && fseek(fp->file, off, SEEK_SET) == 0 && (n = fread(buf, 1, sizeof(buf), fp->file)) >= 18) {
+        for(i = 0; i + 18 <= n; i++) {
+            if(buf[i] != 31 || buf[i + 1] != 139 || buf[i + 2] != 8 || (buf[i + 3] & 4) == 0 || buf[i + 12] != 'B' || buf[i + 13] != 'C' || buf[i + 14] != 2 || buf[i + 15] != 0)
+                continue;
+            k = i + (buf[i + 16] | buf[i + 17] << 8) + 1;
+            if(k + 2 > n || (buf[k] == 31 && buf[k + 1] == 139)) {
+                found = off + i;
+                break;
+            }
+        }
+        if(n < (int)sizeof(buf))
+            break;
+        off += n - 17;
+    }
+    fseek(fp->file, pos, SEEK_SET);
+
+    return found;
+}
+
+long int syncBgzf(Bgzf_s *fp, long int off) {
+    unsigned char *p = NULL;
+
+    if(fp->mode == MODE_BGZF) {
+        if((off = findBlock(fp, off)) < 0 || seekBgzf(fp, off << 16) != 0)
+            return -1;
+    } else if(off <= 0)
+        return seekBgzf(fp, 0);
+    else if(seekBgzf(fp, off - 1) != 0)
+        return -1;
+    while(1) {
+        if(fp->buf_i >= fp->buf_n && loadBlock(fp) == 0)
+            return -1;
+        if((p = memchr(fp->buf + fp->buf_i, '\n', fp->buf_n - fp->buf_i)) != NULL)
+            break;
+        fp->buf_i = fp->buf_n;
+    }
+    fp->buf_i = p - fp->buf + 1;
+
+    return tellBgzf(fp);
+}
+
+long int sizeBgzf(Bgzf_s *fp) {
+    struct stat st;
+
+    if(fp->mode == MODE_GZIP || fstat(fileno(fp->file), &st) != 0 || S_ISREG(st.st_mode) == 0)
+        return -1;
+    if(fp->mode == MODE_BGZF)
+        return (long int)st.st_size << 16;
+    return st.st_size;
+}
+
+int isBgzf(Bgzf_s *fp) {
+    return fp->mode == MODE_BGZF;
+}
+
+int peekBgzf(Bgzf_s *fp, void *data, int n) {
+    if(fp->buf_i >= fp->buf_n && loadBlock(fp) == 0)
+        return 0;
+    if(n > fp->buf_n - fp->buf_i)
+        n = fp->buf_n - fp->buf_i;
+    memcpy(data, fp->buf + fp->buf_i, n);
+
+    return n;
+}
+
+/* The same block layout as bgzip: an 18-byte gzip header with the BC extra field, raw deflate data, crc32 and size */
+int deflateBgzf(const void *data, int n, unsigned char *block) {
+    int k = 0;
+    unsigned long int crc = crc32(0, data, n);
+    z_stream zs = {0};
+    static const unsigned char head[18] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0, 0, 0};
+
+    if(n > BGZF_DATA || deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        fprintf(stderr, "\nERROR: Cannot compress the output\n\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(block, head, 18);
+    zs.next_in = (unsigned char *)data;
+    zs.avail_in = n;
+    zs.next_out = block + 18;
+    zs.avail_out = BLOCK_MAX - 26;
+    if(deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+        fprintf(stderr, "\nERROR: Cannot compress the output\n\n");
+        exit(EXIT_FAILURE);
+    }
+    k = 18 + zs.total_out;
+    deflateEnd(&zs);
+    block[k++] = crc;
+    block[k++] = crc >> 8;
+    block[k++] = crc >> 16;
+    block[k++] = crc >> 24;
+    block[k++] = n;
+    block[k++] = n >> 8;
+    block[k++] = n >> 16;
+    block[k++] = n >> 24;
+    block[16] = (k - 1) & 255;
+    block[17] = (k - 1) >> 8;
+
+    return k;
+}
+
+void closeBgzf(Bgzf_s *fp) {
+    int i;
+    Pool_s *pool = fp->pool;
+
+    if(pool != NULL) {
+        pthread_mutex_lock(&pool->lock);
+        pool->stop = 1;
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+        for(i = 0; i < pool->thread_n; i++)
+            pthread_join(pool->threads[i], NULL);
+        for(i = 0; i < pool->slot_n; i++) {
+            free(pool->slots[i].raw);
+            free(pool->slots[i].buf);
+        }
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->cond);
+        free(pool->slots);
+        free(pool->threads);
+        free(pool);
+    }
+    if(fp->zs != NULL) {
+        inflateEnd(fp->zs);
+        free(fp->zs);
+    }
+    if(fp->gz != NULL)
+        gzclose(fp->gz);
+    if(fp->file != NULL)
+        fclose(fp->file);
+    free(fp->raw);
+    free(fp->buf);
+    free(fp);
+}
+
+static long int getInt(unsigned char **p, unsigned char *end, int bytes) {
+    int i;
+    long int x = 0;
+
+    if(*p + bytes > end) {
+        fprintf(stderr, "\nERROR: Corrupted index file\n\n");
+        exit(EXIT_FAILURE);
+    }
+    for(i = bytes - 1; i >= 0; i--)
+        x = x << 8 | (*p)[i];
+    *p += bytes;
+
+    return x;
+}
+
+static int findRef(unsigned char *names, long int l_nm, const char *chr) {
+    int tid = 0;
+    long int i = 0;
+
+    while(i < l_nm) {
+        if(strcmp((char *)names + i, chr) == 0)
+            return tid;
+        i += strlen((char *)names + i) + 1;
+        tid++;
+    }
+
+    return -1;
+}
+
+int queryIndex(const char *vcf_name, const char *chr, int ref, long int beg, long int end, long int *first, long int *last) {
+    int i, j, k, l, csi = 0, n_ref = 0, n_bin = 0, n_chunk = 0, n_intv = 0, min_shift = 14, depth = 5, tid = ref, found = 0;
+    long int size = 0, max = 0, l_aux = 0, bin = 0, loff = 0, leaf = 0, min_off = 0, bin_beg = 0, cbeg = 0, cend = 0;
+    char name[strlen(vcf_name) + 5];
+    unsigned char *mem = NULL, *p = NULL, *q = NULL, *r = NULL, *limit = NULL;
+    Bgzf_s *fp = NULL;
+
+    sprintf(name, "%s.tbi", vcf_name);
+    if((fp = openBgzf(name)) == NULL) {
+        sprintf(name, "%s.csi", vcf_name);
+        if((fp = openBgzf(name)) == NULL)
+            return -1;
+    }
+    while(1) {
+        if(size == max) {
+            max += 1048576;
+            if((mem = realloc(mem, max)) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+        }
+        if((k = readBgzf(fp, mem + size, max - size)) == 0)
+            break;
+        size += k;
+    }
+    closeBgzf(fp);
+    p = mem;
+    limit = mem + size;
+    if(size < 4 || (memcmp(mem, "TBI\1", 4) != 0 && memcmp(mem, "CSI\1", 4) != 0)) {
+        fprintf(stderr, "\nERROR: %s is not a tabix or CSI index\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+    csi = mem[0] == 'C';
+    p += 4;
+    if(csi) {
+        min_shift = getInt(&p, limit, 4);
+        depth = getInt(&p, limit, 4);
+        l_aux = getInt(&p, limit, 4);
+        if(p + l_aux > limit) {
+            fprintf(stderr, "\nERROR: Corrupted index file\n\n");
+            exit(EXIT_FAILURE);
+        }
+        if(l_aux >= 28) {
+            q = p + 24;
+            k = getInt(&q, p + l_aux, 4);
+            if(q + k <= p + l_aux)
+                tid = findRef(q, k, chr);
+        }
+        p += l_aux;
+        n_ref = getInt(&p, limit, 4);
+    } else {
+        n_ref = getInt(&p, limit, 4);
+        p += 24;
+        k = getInt(&p, limit, 4);
+        if(p + k > limit) {
+            fprintf(stderr, "\nERROR: Corrupted index file\n\n");
+            exit(EXIT_FAILURE);
+        }
+        tid = findRef(p, k, chr);
+        p += k;
+    }
+    if(end > 1L << (min_shift + depth * 3))
+        end = 1L << (min_shift + depth * 3);
+    for(i = 0; i < n_ref && i <= tid; i++) {
+        n_bin = getInt(&p, limit, 4);
+        q = p;
+        for(j = 0; j < n_bin; j++) {
+            p += 4 + csi * 8;
+            n_chunk = getInt(&p, limit, 4);
+            p += n_chunk * 16;
+        }
+        if(csi == 0) {
+            n_intv = getInt(&p, limit, 4);
+            if(i == tid && n_intv > 0) {
+                r = p + (beg >> 14 < n_intv ? beg >> 14 : n_intv - 1) * 8;
+                min_off = getInt(&r, limit, 8);
+            }
+            p += n_intv * 8;
+        }
+        if(p > limit) {
+            fprintf(stderr, "\nERROR: Corrupted index file\n\n");
+            exit(EXIT_FAILURE);
+        }
+        if(i < tid)
+            continue;
+        /* The CSI linear index is stored as the loffset of each bin, taken from the lowest bin that exists */
+        if(csi) {
+            for(leaf = ((1L << depth * 3) - 1) / 7 + (beg >> min_shift); leaf >= 0 && min_off == 0; leaf = leaf > 0 ? (leaf - 1) >> 3 : -1) {
+                p = q;
+                for(j = 0; j < n_bin; j++) {
+                    bin = getInt(&p, limit, 4);
+                    loff = getInt(&p, limit, 8);
+                    n_chunk = getInt(&p, limit, 4);
+                    p += n_chunk * 16;
+                    if(bin == leaf) {
+                        min_off = loff;
+                        break;
+                    }
+                }
+            }
+        }
+        p = q;
+        for(j = 0; j < n_bin; j++) {
+            bin = getInt(&p, limit, 4);
+            if(csi)
+                p += 8;
+            n_chunk = getInt(&p, limit, 4);
+            for(l = 0; l <= depth; l++) {
+                if(bin < ((1L << (l + 1) * 3) - 1) / 7)
+                    break;
+            }
+            if(l > depth) {
+                p += n_chunk * 16;
+                continue;
+            }
+            bin_beg = (bin - ((1L << l * 3) - 1) / 7) << (min_shift + (depth - l) * 3);
+            for(k = 0; k < n_chunk; k++) {
+                cbeg = getInt(&p, limit, 8);
+                cend = getInt(&p, limit, 8);
+                if(bin_beg >= end || bin_beg + (1L << (min_shift + (depth - l) * 3)) <= beg || cend <= min_off)
+                    continue;
+                if(cbeg < min_off)
+                    cbeg = min_off;
+                if(found == 0 || cbeg < *first)
+                    *first = cbeg;
+                if(found == 0 || cend > *last)
+                    *last = cend;
+                found = 1;
+            }
+        }
+    }
+    free(mem);
+
+    return found;
+}
@@ -0,0 +1,59 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Reading of plain, bgzip-compressed (BGZF) and gzip-compressed VCF and BCF files used by prune_ld, poly_freq, poly_fst and poly_sfs.
+
+ The compression is detected from the first bytes of the file. Positions returned by tellBgzf are byte offsets in
+ plain files and virtual offsets (compressed block offset << 16 | offset within the block) in BGZF files, the same
+ offsets that .tbi and .csi indexes use. Plain gzip files can only be read from start to end.
+ threadBgzf starts a pool that inflates the next BGZF blocks in parallel while the current block is being read.
+ peekBgzf returns the next bytes without consuming them, so the BCF magic can be checked on pipes as well.
+ deflateBgzf compresses at most BGZF_DATA bytes into one BGZF block of the output (see vcf_write.h).
+ queryIndex finds the contig by its name in the index, or by its header index ref when the index has no names
+ (the .csi index of a BCF file).
+*/
+
+#ifndef BGZF_H
+#define BGZF_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#define BGZF_DATA 65280
+
+typedef struct {
+    int mode, buf_n, buf_i, peek_n, peek_i;
+    long int block, next;
+    unsigned char *buf, *raw, peek[18];
+    void *zs, *gz, *pool;
+    FILE *file;
+} Bgzf_s;
+
+Bgzf_s *openBgzf(const char *name);
+void threadBgzf(Bgzf_s *fp, int thread_n);
+ssize_t getBgzfLine(Bgzf_s *fp, char **line, size_t *len);
+int readBgzf(Bgzf_s *fp, void *data, int n);
+long int tellBgzf(Bgzf_s *fp);
+int seekBgzf(Bgzf_s *fp, long int off);
+long int syncBgzf(Bgzf_s *fp, long int off);
+long int sizeBgzf(Bgzf_s *fp);
+int isBgzf(Bgzf_s *fp);
+int peekBgzf(Bgzf_s *fp, void *data, int n);
+int deflateBgzf(const void *data, int n, unsigned char *block);
+void closeBgzf(Bgzf_s *fp);
+int queryIndex(const char *vcf_name, const char *chr, int ref, long int beg, long int end, long int *first, long int *last);
+
+#endif
@@ -0,0 +1,622 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Program for benchmarking the C programs on synthetic mixed ploidy VCF files.
+ Writes a reproducible VCF file with the given numbers of individuals and sites, together with pops, sites and genes files,
+ and then times prune_ld, poly_freq, poly_sfs, poly_fst, poly_pca and poly_sv on it over the given -r2, -window and -threads
+ values. Each run is reported as a tab delimited line with its throughput in sites/s and genotypes/s and its peak memory use.
+
+ Genotypes come from LD blocks: within a block, each haplotype is a copy of one of a few founder haplotypes, chosen with
+ weights that differ between populations, so that the data has both LD decaying between blocks and differentiation
+ between populations. Alternative allele frequencies of the founders are drawn from the -maf distribution, and each
+ site has its own proportion of missing genotypes.
+
+ Compiling: gcc poly_bench.c -o poly_bench -lm
+
+ Usage:
+ -dir [string] Directory for the generated files and the outputs of the programs. Created if it does not exist. Default 'poly_bench' in $TMPDIR, or in /tmp if TMPDIR is not set.
+ -bin [string] Directory containing the compiled programs. Programs that are not found are skipped. Default '.'.
+ -inds [int] Number of individuals. Default 100.
+ -sites [int] Number of sites. Default 100000.
+ -chr [int] Number of chromosomes the sites are divided over. Default 4.
+ -pops [int] Number of populations the individuals are divided over. Default 4.
+ -ploidy [string] Comma separated list of ploidies and their weights (for example 2:3,4:1). Allowed ploidies are 2, 4, 6, and 8. Default 2:1,4:1,6:1,8:1.
+ -mis [double] Average proportion of missing genotypes. The proportion of each site is drawn between 0 and twice this value. Default 0.05.
+ -maf [string] Distribution of alternative allele frequencies: 'uniform' or 'neutral' (density proportional to 1/p, as in a neutral SFS). Default 'neutral'.
+ -block [int] Length of the LD blocks in number of sites. Default 50.
+ -gene [int] Length of the genes in bp. A gene starts at every other gene length. Default 3000.
+ -r2 [string] Comma separated list of -r2 window sizes for prune_ld and poly_freq. The step is half of the window. Default 100,1000,5000.
+ -window [string] Comma separated list of -window sizes in bp for poly_fst. The step is a fifth of the window. Default 10000,100000.
+ -threads [string] Comma separated list of -threads values. Default 1.
+ -reps [int] Number of times each run is repeated. Default 1.
+ -seed [int] Seed number used for generating the data. Default 1.
+ -gen [int] Whether to generate the data and run the programs (0), only generate the data (1), or only run the programs on data generated earlier into -dir with the same settings (2). Default 0.
+
+ Example:
+ ./poly_bench -inds 200 -sites 500000 -ploidy 2:1,4:1 -r2 100,500,1000,5000 -threads 1,4 > bench.tsv
+*/
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#define merror "\nERROR: System out of memory\n\n"
+#define BENCH_FOUNDER 8
+#define BENCH_NOISE 0.01
+#define BENCH_GAP 200
+#define BENCH_ARG 32
+
+typedef struct {
+    int ind_n, site_n, chr_n, pop_n, block, gene, neutral;
+    int ploidy[4], weight[4];
+    double mis;
+    unsigned long int state;
+} Sim_s;
+
+typedef struct {
+    int site_n, ind_n, reps;
+    char dir[200], bin[200];
+} Bench_s;
+
+void openFiles(int argc, char *argv[]);
+int *readList(const char *s, const char *name, int *n);
+void readPloidy(const char *s, Sim_s *sim);
+void writeData(Sim_s *sim, const char *dir);
+double randUniform(unsigned long int *state);
+int drawIndex(const double *weights, int n, unsigned long int *state);
+double drawFreq(Sim_s *sim);
+void runAll(Bench_s *bench, const int *r2, int r2_n, const int *win, int win_n, const int *threads, int thread_n);
+void runTool(Bench_s *bench, const char *tool, const char *args, int thread_n);
+int isNumeric(const char *s);
+void printHelp(void);
+
+int main(int argc, char *argv[]) {
+    int second = 0, minute = 0, hour = 0;
+    time_t timer = 0;
+
+    timer = time(NULL);
+    openFiles(argc, argv);
+    second = time(NULL) - timer;
+    minute = second / 60;
+    hour = second / 3600;
+
+    fprintf(stderr, "Done!");
+    if(hour > 0)
+        fprintf(stderr, "\nElapsed time: %i h, %i min & %i sec\n\n", hour, minute - hour * 60, second - minute * 60);
+    else if(minute > 0)
+        fprintf(stderr, "\nElapset time: %i min & %i sec\n\n", minute, second - minute * 60);
+    else if(second > 5)
+        fprintf(stderr, "\nElapsed time: %i sec\n\n", second);
+    else
+        fprintf(stderr, "\n\n");
+
+    return 0;
+}
+
+void openFiles(int argc, char *argv[]) {
+    int i, gen = 0, r2_n = 0, win_n = 0, thread_n = 0, *r2 = NULL, *win = NULL, *threads = NULL;
+    char temp[10];
+    Sim_s sim = {100, 100000, 4, 4, 50, 3000, 1, {2, 4, 6, 8}, {1, 1, 1, 1}, 0.05, 1};
+    Bench_s bench = {0, 0, 1, "", "."};
+
+    if(argc == 1) {
+        printHelp();
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "\nParameters:\n");
+
+    for(i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-dir") == 0) {
+            strncpy(bench.dir, argv[++i], 199);
+            fprintf(stderr, "\t-dir %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-bin") == 0) {
+            strncpy(bench.bin, argv[++i], 199);
+            fprintf(stderr, "\t-bin %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-inds") == 0) {
+            if(isNumeric(argv[++i]))
+                sim.ind_n = atoi(argv[i]);
+            if(sim.ind_n < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -inds [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-inds %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-sites") == 0) {
+            if(isNumeric(argv[++i]))
+                sim.site_n = atoi(argv[i]);
+            if(sim.site_n < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -sites [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-sites %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-chr") == 0) {
+            if(isNumeric(argv[++i]))
+                sim.chr_n = atoi(argv[i]);
+            if(sim.chr_n < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -chr [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-chr %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-pops") == 0) {
+            if(isNumeric(argv[++i]))
+                sim.pop_n = atoi(argv[i]);
+            if(sim.pop_n < 2 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -pops [int]! At least two populations are needed.\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-pops %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-ploidy") == 0) {
+            readPloidy(argv[++i], &sim);
+            fprintf(stderr, "\t-ploidy %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-mis") == 0) {
+            if(isNumeric(argv[++i]))
+                sim.mis = atof(argv[i]);
+            if(sim.mis < 0 || sim.mis > 0.5 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -mis [double]! Allowed are values between 0 and 0.5.\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-mis %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-maf") == 0) {
+            strncpy(temp, argv[++i], 9);
+            temp[9] = '\0';
+            if(strcmp(temp, "uniform") == 0)
+                sim.neutral = 0;
+            else if(strcmp(temp, "neutral") == 0)
+                sim.neutral = 1;
+            else {
+                fprintf(stderr, "\nERROR: Invalid input for -maf [string]! Allowed are 'uniform' and 'neutral'\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-maf %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-block") == 0) {
+            if(isNumeric(argv[++i]))
+                sim.block = atoi(argv[i]);
+            if(sim.block < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -block [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-block %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-gene") == 0) {
+            if(isNumeric(argv[++i]))
+                sim.gene = atoi(argv[i]);
+            if(sim.gene < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -gene [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-gene %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-r2") == 0) {
+            free(r2);
+            r2 = readList(argv[++i], "-r2", &r2_n);
+            fprintf(stderr, "\t-r2 %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-window") == 0) {
+            free(win);
+            win = readList(argv[++i], "-window", &win_n);
+            fprintf(stderr, "\t-window %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-threads") == 0) {
+            free(threads);
+            threads = readList(argv[++i], "-threads", &thread_n);
+            fprintf(stderr, "\t-threads %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-reps") == 0) {
+            if(isNumeric(argv[++i]))
+                bench.reps = atoi(argv[i]);
+            if(bench.reps < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -reps [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-reps %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-seed") == 0) {
+            if(isNumeric(argv[++i]))
+                sim.state = (unsigned long int)atol(argv[i]);
+            else {
+                fprintf(stderr, "\nERROR: Invalid value for -seed [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-seed %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-gen") == 0) {
+            if(isNumeric(argv[++i]))
+                gen = atoi(argv[i]);
+            if(gen < 0 || gen > 2 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -gen [int]! Allowed are 0 (generate and run), 1 (only generate) and 2 (only run).\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-gen %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            fprintf(stderr, "\t%s\n", argv[i]);
+            printHelp();
+            exit(EXIT_FAILURE);
+        } else {
+            fprintf(stderr, "\nERROR: Unknown argument '%s'\n\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    fprintf(stderr, "\n");
+
+    if(r2 == NULL)
+        r2 = readList("100,1000,5000", "-r2", &r2_n);
+    if(win == NULL)
+        win = readList("10000,100000", "-window", &win_n);
+    if(threads == NULL)
+        threads = readList("1", "-threads", &thread_n);
+    if(bench.dir[0] == '\0') {
+        if(getenv("TMPDIR") != NULL && getenv("TMPDIR")[0] != '\0')
+            snprintf(bench.dir, sizeof(bench.dir), "%s/poly_bench", getenv("TMPDIR"));
+        else
+            snprintf(bench.dir, sizeof(bench.dir), "/tmp/poly_bench");
+        fprintf(stderr, "Writing the files into %s\n\n", bench.dir);
+    }
+    if(mkdir(bench.dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "\nERROR: Cannot create directory '%s'\n\n", bench.dir);
+        exit(EXIT_FAILURE);
+    }
+    bench.site_n = sim.site_n;
+    bench.ind_n = sim.ind_n;
+    if(gen < 2)
+        writeData(&sim, bench.dir);
+    if(gen != 1)
+        runAll(&bench, r2, r2_n, win, win_n, threads, thread_n);
+
+    free(r2);
+    free(win);
+    free(threads);
+}
+
+int *readList(const char *s, const char *name, int *n) {
+    int *list = NULL;
+    char *end = NULL;
+    long int v = 0;
+
+    *n = 0;
+    while(1) {
+        v = strtol(s, &end, 10);
+        if(end == s || v < 1 || (*end != ',' && *end != '\0')) {
+            fprintf(stderr, "\nERROR: Invalid value for %s [string]! Should be a comma separated list of positive integers.\n\n", name);
+            exit(EXIT_FAILURE);
+        }
+        if((list = realloc(list, (*n + 1) * sizeof(int))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        list[(*n)++] = (int)v;
+        if(*end == '\0')
+            break;
+        s = end + 1;
+    }
+
+    return list;
+}
+
+void readPloidy(const char *s, Sim_s *sim) {
+    int k, tot = 0;
+    char *end = NULL;
+    long int p = 0, w = 0;
+
+    memset(sim->weight, 0, sizeof(sim->weight));
+    while(1) {
+        p = strtol(s, &end, 10);
+        w = 1;
+        if(*end == ':') {
+            s = end + 1;
+            w = strtol(s, &end, 10);
+            if(end == s)
+                w = -1;
+        }
+        if((p != 2 && p != 4 && p != 6 && p != 8) || w < 0 || (*end != ',' && *end != '\0')) {
+            fprintf(stderr, "\nERROR: Invalid value for -ploidy [string]! Should be a comma separated list of ploidies (2, 4, 6, or 8), each optionally followed by :weight.\n\n");
+            exit(EXIT_FAILURE);
+        }
+        k = p / 2 - 1;
+        sim->weight[k] += w;
+        tot += w;
+        if(*end == '\0')
+            break;
+        s = end + 1;
+    }
+    if(tot == 0) {
+        fprintf(stderr, "\nERROR: Invalid value for -ploidy [string]! At least one weight should be above 0.\n\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Writes sim.vcf, sim.pops, sim.sites (every other site) and sim.genes into the directory. A new LD block starts every
+   -block sites and at each chromosome, where each haplotype picks its founder for the block */
+void writeData(Sim_s *sim, const char *dir) {
+    int i, j, k, h, c = -1, pos = 0, hap_n = 0, len = 0, *ploidy = NULL, *pops = NULL, *src = NULL, *ends = NULL;
+    char name[400], *line = NULL, *p = NULL;
+    double m = 0, w[4], *weights = NULL, founders[BENCH_FOUNDER];
+    FILE *vcf_file = NULL, *pop_file = NULL, *site_file = NULL, *gene_file = NULL;
+
+    if((ploidy = malloc(sim->ind_n * sizeof(int))) == NULL || (pops = malloc(sim->ind_n * sizeof(int))) == NULL || (ends = calloc(sim->chr_n, sizeof(int))) == NULL || (weights = malloc((size_t)sim->pop_n * BENCH_FOUNDER * sizeof(double))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < 4; i++)
+        w[i] = sim->weight[i];
+    for(i = 0; i < sim->ind_n; i++) {
+        ploidy[i] = sim->ploidy[drawIndex(w, 4, &sim->state)];
+        pops[i] = i % sim->pop_n;
+        hap_n += ploidy[i];
+    }
+    if((src = malloc(hap_n * sizeof(int))) == NULL || (line = malloc((size_t)hap_n * 2 + sim->ind_n + 200)) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    snprintf(name, sizeof(name), "%s/sim.vcf", dir);
+    if((vcf_file = fopen(name, "w")) == NULL) {
+        fprintf(stderr, "\nERROR: Cannot create file '%s'\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+    snprintf(name, sizeof(name), "%s/sim.pops", dir);
+    if((pop_file = fopen(name, "w")) == NULL) {
+        fprintf(stderr, "\nERROR: Cannot create file '%s'\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+    snprintf(name, sizeof(name), "%s/sim.sites", dir);
+    if((site_file = fopen(name, "w")) == NULL) {
+        fprintf(stderr, "\nERROR: Cannot create file '%s'\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(vcf_file, "##fileformat=VCFv4.2\n");
+    for(i = 0; i < sim->chr_n; i++)
+        fprintf(vcf_file, "##contig=<ID=chr%i,length=%li>\n", i + 1, ((long int)sim->site_n / sim->chr_n + 1) * BENCH_GAP);
+    fprintf(vcf_file, "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n");
+    fprintf(vcf_file, "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT");
+    for(i = 0; i < sim->ind_n; i++) {
+        fprintf(vcf_file, "\tind%i", i);
+        fprintf(pop_file, "ind%i\tpop%i\n", i, pops[i]);
+    }
+    fprintf(vcf_file, "\n");
+
+    for(i = 0; i < sim->site_n; i++) {
+        k = (int)((long int)i * sim->chr_n / sim->site_n);
+        if(k != c || i % sim->block == 0) {
+            /* founder weights are squared uniforms, so each population is dominated by a few founders */
+            for(j = 0; j < sim->pop_n * BENCH_FOUNDER; j++) {
+                m = randUniform(&sim->state);
+                weights[j] = m * m;
+            }
+            for(j = 0, h = 0; j < sim->ind_n; j++)
+                for(k = 0; k < ploidy[j]; k++, h++)
+                    src[h] = drawIndex(weights + pops[j] * BENCH_FOUNDER, BENCH_FOUNDER, &sim->state);
+        }
+        k = (int)((long int)i * sim->chr_n / sim->site_n);
+        if(k != c) {
+            c = k;
+            pos = 0;
+        }
+        pos += 1 + (int)(randUniform(&sim->state) * (BENCH_GAP - 1));
+        ends[c] = pos;
+        m = drawFreq(sim);
+        for(j = 0; j < BENCH_FOUNDER; j++)
+            founders[j] = randUniform(&sim->state) < m;
+        m = randUniform(&sim->state) * 2 * sim->mis;
+        len = sprintf(line, "chr%i\t%i\t.\tA\tT\t.\tPASS\t.\tGT", c + 1, pos);
+        p = line + len;
+        for(j = 0, h = 0; j < sim->ind_n; j++) {
+            *p++ = '\t';
+            if(randUniform(&sim->state) < m) {
+                for(k = 0; k < ploidy[j]; k++) {
+                    *p++ = '.';
+                    *p++ = '/';
+                }
+                h += ploidy[j];
+            } else {
+                for(k = 0; k < ploidy[j]; k++, h++) {
+                    *p++ = '0' + ((int)founders[src[h]] ^ (randUniform(&sim->state) < BENCH_NOISE));
+                    *p++ = '/';
+                }
+            }
+            p--;
+        }
+        *p++ = '\n';
+        fwrite(line, 1, p - line, vcf_file);
+        if(i % 2 == 0)
+            fprintf(site_file, "chr%i\t%i\n", c + 1, pos);
+    }
+
+    snprintf(name, sizeof(name), "%s/sim.genes", dir);
+    if((gene_file = fopen(name, "w")) == NULL) {
+        fprintf(stderr, "\nERROR: Cannot create file '%s'\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < sim->chr_n; i++)
+        for(j = 1, k = 0; j <= ends[i]; j += sim->gene * 2, k++)
+            fprintf(gene_file, "chr%i\t%i\t%i\tchr%i_g%i\n", i + 1, j, j + sim->gene - 1, i + 1, k);
+
+    if(fclose(vcf_file) != 0 || fclose(pop_file) != 0 || fclose(site_file) != 0 || fclose(gene_file) != 0) {
+        fprintf(stderr, "\nERROR: Cannot write the files into '%s'\n\n", dir);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "Wrote %i sites and %i individuals (%i haplotypes) to %s/sim.vcf\n\n", sim->site_n, sim->ind_n, hap_n, dir);
+
+    free(ploidy);
+    free(pops);
+    free(src);
+    free(ends);
+    free(weights);
+    free(line);
+}
+
+/* splitmix64 stream on the 64-bit seed, so the simulated data are the same on any platform */
+double randUniform(unsigned long int *state) {
+    unsigned long int z = (*state += 0x9E3779B97F4A7C15UL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+    z ^= z >> 31;
+    return (double)(z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+int drawIndex(const double *weights, int n, unsigned long int *state) {
+    int i;
+    double tot = 0, u = 0;
+    for(i = 0; i < n; i++)
+        tot += weights[i];
+    u = randUniform(state) * tot;
+    for(i = 0; i < n - 1; i++) {
+        if(u < weights[i])
+            return i;
+        u -= weights[i];
+    }
+    while(i > 0 && weights[i] == 0)
+        i--;
+    return i;
+}
+
+/* With 'neutral', log(p) is uniform between log(0.001) and log(0.5), and the alternative allele is the minor one half of the time */
+double drawFreq(Sim_s *sim) {
+    double p = 0;
+    if(sim->neutral == 0)
+        return randUniform(&sim->state);
+    p = 0.001 * exp(randUniform(&sim->state) * log(500));
+    return randUniform(&sim->state) < 0.5 ? p : 1 - p;
+}
+
+/* Each line of the output is one run: program, arguments, threads, repeat, sites, individuals, genotypes, wall-clock
+   seconds, sites/s, genotypes/s, peak resident memory in kB and exit status */
+void runAll(Bench_s *bench, const int *r2, int r2_n, const int *win, int win_n, const int *threads, int thread_n) {
+    int i, j;
+    char args[2000], vcf[300], pops[300], sites[300], genes[300];
+
+    snprintf(vcf, sizeof(vcf), "%s/sim.vcf", bench->dir);
+    snprintf(pops, sizeof(pops), "%s/sim.pops", bench->dir);
+    snprintf(sites, sizeof(sites), "%s/sim.sites", bench->dir);
+    snprintf(genes, sizeof(genes), "%s/sim.genes", bench->dir);
+    if(access(vcf, R_OK) != 0) {
+        fprintf(stderr, "\nERROR: Cannot open file %s\n\n", vcf);
+        exit(EXIT_FAILURE);
+    }
+    printf("#program\targs\tthreads\trep\tsites\tinds\tgenotypes\tseconds\tsites_per_s\tgenotypes_per_s\tmax_rss_kb\tstatus\n");
+    fflush(stdout);
+    for(i = 0; i < thread_n; i++) {
+        for(j = 0; j < r2_n; j++) {
+            snprintf(args, sizeof(args), "-vcf %s -r2 %i %i 0.5", vcf, r2[j], r2[j] / 2 > 0 ? r2[j] / 2 : 1);
+            runTool(bench, "prune_ld", args, threads[i]);
+        }
+        snprintf(args, sizeof(args), "-vcf %s -pops %s -mis 0.8 -maf 0.05", vcf, pops);
+        runTool(bench, "poly_freq", args, threads[i]);
+        snprintf(args, sizeof(args), "-vcf %s -pops %s -sites %s -mis 0.8 -maf 0.05", vcf, pops, sites);
+        runTool(bench, "poly_freq", args, threads[i]);
+        for(j = 0; j < r2_n; j++) {
+            snprintf(args, sizeof(args), "-vcf %s -pops %s -mis 0.8 -maf 0.05 -r2 %i %i 0.5", vcf, pops, r2[j], r2[j] / 2 > 0 ? r2[j] / 2 : 1);
+            runTool(bench, "poly_freq", args, threads[i]);
+        }
+        snprintf(args, sizeof(args), "-vcf %s -pops %s -mis 0.8 -seed 1", vcf, pops);
+        runTool(bench, "poly_sfs", args, threads[i]);
+        snprintf(args, sizeof(args), "-vcf %s -pops %s -mis 0.8 -out 1", vcf, pops);
+        runTool(bench, "poly_fst", args, threads[i]);
+        snprintf(args, sizeof(args), "-vcf %s -pops %s -mis 0.8 -genes %s", vcf, pops, genes);
+        runTool(bench, "poly_fst", args, threads[i]);
+        for(j = 0; j < win_n; j++) {
+            snprintf(args, sizeof(args), "-vcf %s -pops %s -mis 0.8 -window %i %i", vcf, pops, win[j], win[j] / 5 > 0 ? win[j] / 5 : 1);
+            runTool(bench, "poly_fst", args, threads[i]);
+        }
+        snprintf(args, sizeof(args), "-vcf %s -mis 0.8 -maf 0.05", vcf);
+        runTool(bench, "poly_pca", args, threads[i]);
+        snprintf(args, sizeof(args), "-vcf %s -pops %s -seed 1 -freq %s/poly_sv.freq 0.8 0.05 -sfs %s/poly_sv.sfs 0.8 -fst %s/poly_sv.fst 0.8 0", vcf, pops, bench->dir, bench->dir, bench->dir);
+        runTool(bench, "poly_sv", args, threads[i]);
+    }
+}
+
+/* The program is run with its output in dir/program.out and its messages in dir/program.err. wait4 returns the
+   resource use of the child, whose ru_maxrss is its peak resident memory in kB */
+void runTool(Bench_s *bench, const char *tool, const char *args, int thread_n) {
+    int i, status = 0, arg_n = 0;
+    char path[400], out[400], err[400], line[2100], thread[20], *argl[BENCH_ARG + 3], *tok = NULL;
+    double sec = 0, geno_n = (double)bench->site_n * bench->ind_n;
+    struct timespec start, end;
+    struct rusage usage;
+    pid_t pid;
+
+    snprintf(path, sizeof(path), "%s/%s", bench->bin, tool);
+    if(access(path, X_OK) != 0) {
+        fprintf(stderr, "Warning: %s was not found, skipping it\n\n", path);
+        return;
+    }
+    snprintf(out, sizeof(out), "%s/%s.out", bench->dir, tool);
+    snprintf(err, sizeof(err), "%s/%s.err", bench->dir, tool);
+    snprintf(line, sizeof(line), "%s -threads %i", args, thread_n);
+    snprintf(thread, sizeof(thread), "%i", thread_n);
+    argl[arg_n++] = path;
+    for(tok = strtok(line, " "); tok != NULL && arg_n < BENCH_ARG; tok = strtok(NULL, " "))
+        argl[arg_n++] = tok;
+    argl[arg_n] = NULL;
+    for(i = 0; i < bench->reps; i++) {
+        fprintf(stderr, "Running %s %s -threads %i\n", tool, args, thread_n);
+        fflush(stdout);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if((pid = fork()) < 0) {
+            fprintf(stderr, "\nERROR: Cannot run %s\n\n", path);
+            exit(EXIT_FAILURE);
+        }
+        if(pid == 0) {
+            if(freopen(out, "w", stdout) == NULL || freopen(err, "w", stderr) == NULL)
+                _exit(127);
+            execv(path, argl);
+            _exit(127);
+        }
+        if(wait4(pid, &status, 0, &usage) < 0) {
+            fprintf(stderr, "\nERROR: Cannot run %s\n\n", path);
+            exit(EXIT_FAILURE);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        sec = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        if(status != 0)
+            fprintf(stderr, "Warning: %s exited with status %i, see %s\n", tool, status, err);
+        printf("%s\t%s\t%s\t%i\t%i\t%i\t%.0f\t%.3f\t%.0f\t%.0f\t%li\t%i\n", tool, args, thread, i + 1, bench->site_n, bench->ind_n, geno_n, sec, bench->site_n / sec, geno_n / sec, usage.ru_maxrss, status);
+        fflush(stdout);
+    }
+    fprintf(stderr, "\n");
+}
+
+int isNumeric(const char *s) {
+    char *p;
+    if(s == NULL || *s == '\0' || isspace(*s))
+        return 0;
+    strtod(s, &p);
+    return *p == '\0';
+}
+
+void printHelp(void) {
+    fprintf(stderr, "\nProgram for benchmarking the C programs on synthetic mixed ploidy VCF files.\n\n");
+    fprintf(stderr, "Usage:\n");
+    fprintf(stderr, "-dir [string] Directory for the generated files and the outputs of the programs. Created if it does not exist. Default 'poly_bench' in $TMPDIR, or in /tmp if TMPDIR is not set.\n");
+    fprintf(stderr, "-bin [string] Directory containing the compiled programs. Programs that are not found are skipped. Default '.'.\n");
+    fprintf(stderr, "-inds [int] Number of individuals. Default 100.\n");
+    fprintf(stderr, "-sites [int] Number of sites. Default 100000.\n");
+    fprintf(stderr, "-chr [int] Number of chromosomes the sites are divided over. Default 4.\n");
+    fprintf(stderr, "-pops [int] Number of populations the individuals are divided over. Default 4.\n");
+    fprintf(stderr, "-ploidy [string] Comma separated list of ploidies and their weights (for example 2:3,4:1). Allowed ploidies are 2, 4, 6, and 8. Default 2:1,4:1,6:1,8:1.\n");
+    fprintf(stderr, "-mis [double] Average proportion of missing genotypes. The proportion of each site is drawn between 0 and twice this value. Default 0.05.\n");
+    fprintf(stderr, "-maf [string] Distribution of alternative allele frequencies: 'uniform' or 'neutral' (density proportional to 1/p, as in a neutral SFS). Default 'neutral'.\n");
+    fprintf(stderr, "-block [int] Length of the LD blocks in number of sites. Default 50.\n");
+    fprintf(stderr, "-gene [int] Length of the genes in bp. A gene starts at every other gene length. Default 3000.\n");
+    fprintf(stderr, "-r2 [string] Comma separated list of -r2 window sizes for prune_ld and poly_freq. The step is half of the window. Default 100,1000,5000.\n");
+    fprintf(stderr, "-window [string] Comma separated list of -window sizes in bp for poly_fst. The step is a fifth of the window. Default 10000,100000.\n");
+    fprintf(stderr, "-threads [string] Comma separated list of -threads values. Default 1.\n");
+    fprintf(stderr, "-reps [int] Number of times each run is repeated. Default 1.\n");
+    fprintf(stderr, "-seed [int] Seed number used for generating the data. Default 1.\n");
+    fprintf(stderr, "-gen [int] Whether to generate the data and run the programs (0), only generate the data (1), or only run the programs on data generated earlier into -dir with the same settings (2). Default 0.\n\n");
+    fprintf(stderr, "Example:\n");
+    fprintf(stderr, "./poly_bench -inds 200 -sites 500000 -ploidy 2:1,4:1 -r2 100,500,1000,5000 -threads 1,4 > bench.tsv\n\n");
+}
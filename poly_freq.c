@@ -18,17 +18,23 @@
  Program for estimating allele frequencies from mixed ploidy VCF files.
  Output will be either population-specific allele frequencies or allele counts in the format required by BayPass.
 
- Compiling: gcc poly_freq.c -o poly_freq -lm
+ Compiling: gcc poly_freq.c poly_ld.c vcf_freq.c vcf_parse.c vcf_thread.c vcf_cache.c vcf_bcf.c vcf_write.c vcf_stats.c bgzf.c -o poly_freq -lm -lpthread -lz
 
  Usage:
- -vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8.
+ -vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8. Can be bgzip-compressed or a BCF file.
+ -cache [file] Binary genotype cache. With -vcf, the VCF file is first converted into this file; without it, an existing cache is read instead of a VCF file. Optional.
  -pops [file] Tab delimited file listing individuals to use and their populations (format: individual id, population id).
  -sites [file] Tab delimited file listing sites to use (format: chr, pos). Optional.
  -mis [double] Excludes sites based of the proportion of missing data (0 = all missing allowed, 1 = no missing data allowed). Default > 0.
  -maf [double] Minimum minor allele frequency allowed. Default 0.
  -r2 [int] [int] [double] Excludes sites based on squared genotypic correlation. Requires a window size in number of SNPs, a step size in number of SNPs, and a maximum r2 value. Optional.
- -out [int] Whether to output allele frequencies (0) or allele counts in the BayPass format (1). Default 0.
- -info [string] If -out is 1, records populations and locations of used SNPs into this file. Default 'info.txt'.
+ -r2bp [int] Maximum distance in bp between the sites of a pair compared with -r2. Pairs further apart are not compared. Optional.
+ -out [int] Whether to output allele frequencies (0), allele counts in the BayPass format (1), or allele frequencies as binary 32-bit floats in native byte order, one row of populations per site (2). Default 0.
+ -O [string] Format of the output table: 'v' for uncompressed or 'z' for bgzip-compressed (BGZF). The -info file is not compressed. With -threads, the BGZF blocks of a single part are compressed on the threads. Default 'v'.
+ -info [string] If -out is 1 or 2, records populations and locations of used SNPs into this file. Default 'info.txt'.
+ -region [chr:start-end] Only uses sites within the region (for example chr1:1000-2000 or chr1). Uses the .tbi or .csi index of a bgzip-compressed VCF file to read only that part of the file. Optional.
+ -threads [int] Number of threads used for processing chromosomes (or parts of chromosomes without -r2) in parallel. A pipe, a gzip file or a single chromosome is read as one part, with its lines parsed on the threads. Default 1.
+ -stats [string] Writes a JSON report of the time spent in each stage, the numbers of sites read and dropped by each filter, the numbers of r2 estimates, and peak memory use into this file, or to stderr with 'stderr'. Optional.
 
  Example:
  ./poly_freq -vcf in.vcf -pops pops.txt -sites 4fold.sites -mis 0.8 -maf 0.05 -r2 100 50 0.1 -out 1 -info 4fold_ld_pruned.info > 4fold_ld_pruned.baypass
@@ -41,6 +47,11 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include "poly_ld.h"
+#include "vcf_freq.h"
+#include "vcf_parse.h"
+#include "vcf_thread.h"
+#include "vcf_write.h"
 #define merror "\nERROR: System out of memory\n\n"
 
 typedef struct {
@@ -49,23 +60,17 @@ typedef struct {
 } Pop_s;
 
 typedef struct {
-    int pos;
-    char chr[100];
-} Site_s;
-
-typedef struct {
-    int pos, ok;
-    double *geno, **counts;
-    char chr[100];
-} SNP_s;
+    int win, step, maxdist, out, ind_n, pop_n, sample_n, bgzf, pool_n, *pop_l, *snp_n;
+    double mis, maf, r2;
+    char *use;
+    Pop_s *pops;
+    Sites_s *sites;
+} Job_s;
 
 void openFiles(int argc, char *argv[]);
-Pop_s *readPops(FILE *pop_file, FILE *out_file, int out, int *n, int *m);
-Site_s *readSites(FILE *site_file, int *n);
-void readVcf(FILE *vcf_file, FILE *out_file, Pop_s *pops, Site_s *sites, int win, int step, int out, int ind_n, int pop_n, int site_n, double mis, double maf, double r2);
-void estLD(SNP_s *snps, int win, int ind_n, double r2);
-double estR2(double geno1[], double geno2[], int n);
-void printOut(FILE *out_file, double **counts, char chr[], int pos, int out, int n);
+Pop_s *readPops(FILE *pop_file, FILE *out_file, int out, int bgzf, int *n, int *m);
+void readVcf(Bgzf_s *vcf_file, Cache_s *cache, FILE *out_file, const char *vcf_name, const Region_s *region, Pop_s *pops, Sites_s *sites, int win, int step, int maxdist, int out, int bgzf, int ind_n, int pop_n, int thread_n, double mis, double maf, double r2, const char *stats_name);
+void readChunk(Chunk_s *chunk, void *arg);
 int isNumeric(const char *s);
 void stringTerminator(char *string);
 void printHelp(void);
@@ -94,12 +99,15 @@ int main(int argc, char *argv[]) {
 }
 
 void openFiles(int argc, char *argv[]) {
-    int i, win = 0, step = 0, out = 0, ind_n = 0, pop_n = 0, site_n = 0;
+    int i, win = 0, step = 0, maxdist = 0, out = 0, bgzf = 0, ind_n = 0, pop_n = 0, thread_n = 1;
     double mis = 0, maf = 0, r2 = 1;
-    char info[200] = "info.txt";
+    char temp[10], info[200] = "info.txt", *vcf_name = NULL, *cache_name = NULL, *stats_name = NULL;
     Pop_s *pops = NULL;
-    Site_s *sites = NULL;
-    FILE *vcf_file = NULL, *pop_file = NULL, *site_file = NULL, *out_file = NULL;
+    Sites_s *sites = NULL;
+    Region_s region, *reg = NULL;
+    Bgzf_s *vcf_file = NULL;
+    Cache_s *cache = NULL;
+    FILE *pop_file = NULL, *site_file = NULL, *out_file = NULL;
 
     if(argc == 1) {
         printHelp();
@@ -110,11 +118,15 @@ void openFiles(int argc, char *argv[]) {
 
     for(i = 1; i < argc; i++) {
         if(strcmp(argv[i], "-vcf") == 0) {
-            if((vcf_file = fopen(argv[++i], "r")) == NULL) {
+            if((vcf_file = openBgzf(argv[++i])) == NULL) {
                 fprintf(stderr, "\nERROR: Cannot open file %s\n\n", argv[i]);
                 exit(EXIT_FAILURE);
             }
+            vcf_name = argv[i];
             fprintf(stderr, "\t-vcf %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-cache") == 0) {
+            cache_name = argv[++i];
+            fprintf(stderr, "\t-cache %s\n", argv[i]);
         } else if(strcmp(argv[i], "-pops") == 0) {
             if((pop_file = fopen(argv[++i], "r")) == NULL) {
                 fprintf(stderr, "\nERROR: Cannot open file %s\n\n", argv[i]);
@@ -177,17 +189,55 @@ void openFiles(int argc, char *argv[]) {
                 exit(EXIT_FAILURE);
             }
             fprintf(stderr, "\t-r2 %i %i %s\n", win, step, argv[i]);
+        } else if(strcmp(argv[i], "-r2bp") == 0) {
+            if(isNumeric(argv[++i]))
+                maxdist = atoi(argv[i]);
+            if(maxdist < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -r2bp [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-r2bp %s\n", argv[i]);
         } else if(strcmp(argv[i], "-out") == 0) {
             if(isNumeric(argv[++i]))
                 out = atoi(argv[i]);
-            if(out != 0 && out != 1) {
-                fprintf(stderr, "\nERROR: Invalid value for -out [int]! Allowed are 0 (allele frequencies) and 1 (allele counts).\n\n");
+            if(out < 0 || out > 2) {
+                fprintf(stderr, "\nERROR: Invalid value for -out [int]! Allowed are 0 (allele frequencies), 1 (allele counts) and 2 (binary allele frequencies).\n\n");
                 exit(EXIT_FAILURE);
             }
             fprintf(stderr, "\t-out %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-O") == 0) {
+            strncpy(temp, argv[++i], 9);
+            temp[9] = '\0';
+            if(strcmp(temp, "v") == 0)
+                bgzf = 0;
+            else if(strcmp(temp, "z") == 0)
+                bgzf = 1;
+            else {
+                fprintf(stderr, "\nERROR: Invalid input for -O [string]! Allowed are 'v' and 'z'\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-O %s\n", argv[i]);
         } else if(strcmp(argv[i], "-info") == 0) {
             strncpy(info, argv[++i], 199);
             fprintf(stderr, "\t-info %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-region") == 0) {
+            if(parseRegion(argv[++i], &region) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -region [chr:start-end]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            reg = &region;
+            fprintf(stderr, "\t-region %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-threads") == 0) {
+            if(isNumeric(argv[++i]))
+                thread_n = atoi(argv[i]);
+            if(thread_n < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -threads [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-threads %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-stats") == 0) {
+            stats_name = argv[++i];
+            fprintf(stderr, "\t-stats %s\n", argv[i]);
         } else if(strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             fprintf(stderr, "\t%s\n", argv[i]);
             printHelp();
@@ -199,34 +249,52 @@ void openFiles(int argc, char *argv[]) {
     }
     fprintf(stderr, "\n");
 
-    if(vcf_file == NULL || pop_file == NULL) {
-        fprintf(stderr, "\nERROR: -vcf [file] and -pops [file] are required!\n\n");
+    if((vcf_file == NULL && cache_name == NULL) || pop_file == NULL) {
+        fprintf(stderr, "\nERROR: -vcf [file] (or -cache [file]) and -pops [file] are required!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(cache_name != NULL) {
+        if(vcf_file != NULL) {
+            writeCache(vcf_file, cache_name);
+            closeBgzf(vcf_file);
+            vcf_file = NULL;
+            vcf_name = NULL;
+        }
+        if((cache = openCache(cache_name)) == NULL) {
+            fprintf(stderr, "\nERROR: Cannot open file %s\n\n", cache_name);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if(maxdist > 0 && r2 == 1) {
+        fprintf(stderr, "\nERROR: -r2bp [int] requires -r2 [int] [int] [double]!\n\n");
         exit(EXIT_FAILURE);
     }
     if(r2 < 1 && maf == 0) {
         fprintf(stderr, "Warning: Doing LD-pruning, setting -maf to 0.05\n\n");
         maf = 0.05;
     }
-    if(out == 1) {
+    if(out > 0) {
         if((out_file = fopen(info, "w")) == NULL) {
             fprintf(stderr, "\n\nERROR: Cannot create file '%s'\n\n", info);
             exit(EXIT_FAILURE);
         }
     }
     if(site_file != NULL)
-        sites = readSites(site_file, &site_n);
-    pops = readPops(pop_file, out_file, out, &ind_n, &pop_n);
-    readVcf(vcf_file, out_file, pops, sites, win, step, out, ind_n, pop_n, site_n, mis, maf, r2);
+        sites = readSites(site_file);
+    pops = readPops(pop_file, out_file, out, bgzf, &ind_n, &pop_n);
+    readVcf(vcf_file, cache, out_file, vcf_name, reg, pops, sites, win, step, maxdist, out, bgzf, ind_n, pop_n, thread_n, mis, maf, r2, stats_name);
 
-    if(out == 1)
+    if(out > 0)
         fclose(out_file);
 }
 
-Pop_s *readPops(FILE *pop_file, FILE *out_file, int out, int *n, int *m) {
-    int i;
+Pop_s *readPops(FILE *pop_file, FILE *out_file, int out, int bgzf, int *n, int *m) {
+    int i, *v = NULL;
     double list_i = 200, pops_i = 50;
     char *line = NULL, **pops = NULL;
     Pop_s *list = NULL;
+    Hash_s hash;
+    Writer_s w;
     size_t len = 0;
     ssize_t read;
 
@@ -234,6 +302,7 @@ Pop_s *readPops(FILE *pop_file, FILE *out_file, int out, int *n, int *m) {
         fprintf(stderr, merror);
         exit(EXIT_FAILURE);
     }
+    initHash(&hash, 50);
     while((read = getline(&line, &len, pop_file)) != -1) {
         if(line[0] == '\n' || line[0] == '#')
             continue;
@@ -251,18 +320,13 @@ Pop_s *readPops(FILE *pop_file, FILE *out_file, int out, int *n, int *m) {
                     exit(EXIT_FAILURE);
                 }
             }
-            strcpy(pops[*m], list[*n].pop);
-            *m = *m + 1;
         }
-        for(i = 0; i <= *m; i++) {
-            if(strcmp(pops[i], list[*n].pop) == 0) {
-                list[*n].idx = i;
-                break;
-            }
-        }
-        if(i > *m) {
+        if((v = findHash(&hash, list[*n].pop)) != NULL)
+            list[*n].idx = *v;
+        else {
             list[*n].idx = *m;
             strcpy(pops[*m], list[*n].pop);
+            *addHash(&hash, pops[*m]) = *m;
             *m = *m + 1;
             if(*m >= pops_i) {
                 pops_i += 20;
@@ -288,13 +352,13 @@ Pop_s *readPops(FILE *pop_file, FILE *out_file, int out, int *n, int *m) {
         }
     }
     if(out == 0) {
-        printf("\t");
+        initWriter(&w, stdout, bgzf);
+        writeChar(&w, '\t');
         for(i = 0; i < *m; i++) {
-            if(i < *m - 1)
-                printf("%s\t", pops[i]);
-            else
-                printf("%s\n", pops[i]);
+            writeString(&w, pops[i]);
+            writeChar(&w, i < *m - 1 ? '\t' : '\n');
         }
+        freeWriter(&w);
     } else {
         fprintf(out_file, "#");
         for(i = 0; i < *m; i++) {
@@ -305,6 +369,7 @@ Pop_s *readPops(FILE *pop_file, FILE *out_file, int out, int *n, int *m) {
         }
     }
     free(line);
+    freeHash(&hash);
     for(i = 0; i < pops_i; i++)
         free(pops[i]);
     free(pops);
@@ -313,115 +378,113 @@ Pop_s *readPops(FILE *pop_file, FILE *out_file, int out, int *n, int *m) {
     return list;
 }
 
-Site_s *readSites(FILE *site_file, int *n) {
-    double list_i = 1e6;
-    char *line = NULL;
-    Site_s *list = NULL;
-    size_t len = 0;
-    ssize_t read;
+void readVcf(Bgzf_s *vcf_file, Cache_s *cache, FILE *out_file, const char *vcf_name, const Region_s *region, Pop_s *pops, Sites_s *sites, int win, int step, int maxdist, int out, int bgzf, int ind_n, int pop_n, int thread_n, double mis, double maf, double r2, const char *stats_name) {
+    int i, chunk_n = 0, snp_i = 0;
+    double start = clockStats(CLOCK_MONOTONIC);
+    FILE *outs[2] = {stdout, out_file};
+    Stats_s *stats = NULL;
+    Chunk_s *chunks = NULL;
+    Job_s job = {win, step, maxdist, out, ind_n, pop_n, 0, bgzf, 0, NULL, NULL, mis, maf, r2, NULL, pops, sites};
 
-    if((list = malloc(list_i * sizeof(Site_s))) == NULL) {
+    if(cache != NULL)
+        chunks = splitCache(cache, region, thread_n, r2 < 1, &chunk_n);
+    else
+        chunks = splitVcf(vcf_file, vcf_name, region, thread_n, r2 < 1, &chunk_n);
+    if(chunk_n <= 2)
+        job.pool_n = thread_n;
+    if((job.snp_n = calloc(chunk_n, sizeof(int))) == NULL || (stats_name != NULL && (stats = calloc(chunk_n, sizeof(Stats_s))) == NULL)) {
         fprintf(stderr, merror);
         exit(EXIT_FAILURE);
     }
-    while((read = getline(&line, &len, site_file)) != -1) {
-        if(line[0] == '\n' || line[0] == '#')
-            continue;
-        strncpy(list[*n].chr, strtok(line, "\t"), 99);
-        list[*n].pos = atoi(strtok(NULL, "\t"));
-        if(*n > 0) {
-            if(strcmp(list[*n].chr, list[*n - 1].chr) < 0) {
-                fprintf(stderr, "ERROR: Site file is not sorted. Use: sort -k1,1 -k2,2n list.sites > sorted.sites\n\n");
-                exit(EXIT_FAILURE);
-            } else if(strcmp(list[*n].chr, list[*n - 1].chr) == 0) {
-                if(list[*n].pos < list[*n - 1].pos) {
-                    fprintf(stderr, "ERROR: Site file is not sorted. Use: sort -k1,1 -k2,2n list.sites > sorted.sites\n\n");
-                    exit(EXIT_FAILURE);
-                }
-            }
-        }
-        *n = *n + 1;
-        if(*n >= list_i) {
-            list_i += 1e5;
-            if((list = realloc(list, list_i * sizeof(Site_s))) == NULL) {
-                fprintf(stderr, merror);
-                exit(EXIT_FAILURE);
-            }
-        }
-    }
+    for(i = 0; stats != NULL && i < chunk_n; i++)
+        chunks[i].stats = &stats[i];
+    runChunks(chunks, 1, 1, vcf_name, vcf_file, outs, readChunk, &job);
+    runChunks(chunks + 1, chunk_n - 1, thread_n, vcf_name, vcf_file, outs, readChunk, &job);
+    if(bgzf)
+        writeEof(stdout);
+    for(i = 0; i < chunk_n; i++)
+        snp_i += job.snp_n[i];
 
-    free(line);
-    fclose(site_file);
-
-    return list;
+    if(isatty(1))
+        fprintf(stderr, "\n");
+    fprintf(stderr, "Kept %i variants\n\n", snp_i);
+    if(stats != NULL)
+        printStats(stats_name, "poly_freq", stats, chunk_n, start);
+
+    free(job.snp_n);
+    free(stats);
+    free(job.pop_l);
+    free(job.use);
+    freeChunks(chunks);
+    free(pops);
+    if(sites != NULL)
+        freeSites(sites);
+    if(cache != NULL)
+        closeCache(cache);
+    else
+        closeBgzf(vcf_file);
 }
 
-void readVcf(FILE *vcf_file, FILE *out_file, Pop_s *pops, Site_s *sites, int win, int step, int out, int ind_n, int pop_n, int site_n, double mis, double maf, double r2) {
-    int i, j = 0, k = 0, pos = 0, ok = 0, stop = 0, geno_n = 0, ind_i = 0, site_i = 0, win_n = 0, win_i = 0, step_i = 0, snp_i = 0, *pop_l = NULL;
-    double ploidy = 0, mis_i = 0, alt_i = 0, hap_i = 0, **counts = NULL;
-    char chr[100], hap[50], *line = NULL, *temp = NULL, *end = NULL;
+void readChunk(Chunk_s *chunk, void *arg) {
+    int i, j = 0, ind_i = 0, win_n = 0, win_i = 0, step_i = 0, snp_i = 0, sample_n = 0, *pop_l = NULL, *v = NULL;
+    double mis_i = 0, alt_i = 0, hap_i = 0, *counts = NULL, *cur = NULL;
+    char *line = NULL, *use = NULL, **samples = NULL;
+    Record_s rec = {0};
+    SiteCursor_s site_c = {0};
+    Geno_s *g = NULL;
+    Hash_s hash;
+    Dosage_s dose = {0};
     SNP_s *snps = NULL;
+    Writer_s w[2];
+    Job_s *job = arg;
+    Pop_s *pops = job->pops;
+    Sites_s *sites = job->sites;
+    Stats_s *st = chunk->stats;
+    int win = job->win, step = job->step, out = job->out, ind_n = job->ind_n, pop_n = job->pop_n;
+    double mis = job->mis, maf = job->maf, r2 = job->r2;
     size_t len = 0;
     ssize_t read;
 
-    while((read = getline(&line, &len, vcf_file)) != -1) {
-        if(line[0] == '\n' || (line[0] == '#' && line[1] == '#'))
-            continue;
-        temp = strtok_r(line, "\t", &end);
-        k = 1;
-        if(strcmp(temp, "#CHROM") == 0) {
-            if(r2 < 1) {
-                if((snps = malloc(win * sizeof(SNP_s))) == NULL) {
-                    fprintf(stderr, merror);
-                    exit(EXIT_FAILURE);
-                }
-                geno_n = (int)read;
-                for(i = 0; i < win; i++) {
-                    if((snps[i].geno = malloc(geno_n * sizeof(double))) == NULL) {
-                        fprintf(stderr, merror);
-                        exit(EXIT_FAILURE);
-                    }
-                    if((snps[i].counts = malloc(pop_n * sizeof(double *))) == NULL) {
-                        fprintf(stderr, merror);
-                        exit(EXIT_FAILURE);
-                    }
-                    for(j = 0; j < pop_n; j++) {
-                        if((snps[i].counts[j] = malloc(2 * sizeof(double))) == NULL) {
-                            fprintf(stderr, merror);
-                            exit(EXIT_FAILURE);
-                        }
-                    }
-                }
-            } else {
-                if((counts = malloc(pop_n * sizeof(double *))) == NULL) {
-                    fprintf(stderr, merror);
-                    exit(EXIT_FAILURE);
-                }
-                for(i = 0; i < pop_n; i++) {
-                    if((counts[i] = malloc(2 * sizeof(double))) == NULL) {
-                        fprintf(stderr, merror);
-                        exit(EXIT_FAILURE);
-                    }
-                }
-            }
-            if((pop_l = malloc(read * sizeof(int))) == NULL) {
+    sample_n = job->sample_n;
+    pop_l = job->pop_l;
+    use = job->use;
+    initWriter(&w[0], chunk->out[0], job->bgzf);
+    threadWriter(&w[0], job->pool_n);
+    if(out > 0)
+        initWriter(&w[1], chunk->out[1], 0);
+    if(r2 < 1) {
+        if((snps = calloc(win, sizeof(SNP_s))) == NULL || (counts = calloc(win * pop_n * 2, sizeof(double))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        for(i = 0; i < win; i++)
+            snps[i].counts = counts + i * pop_n * 2;
+    } else {
+        if((counts = calloc(pop_n * 2, sizeof(double))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+    }
+    while((read = readSite(chunk, &line, &len, &rec)) != -1) {
+        if(read == 0 && strncmp(line, "#CHROM\t", 7) == 0) {
+            samples = parseSamples(line, &sample_n);
+            if((pop_l = malloc((sample_n + 1) * sizeof(int))) == NULL || (use = calloc(sample_n + 1, sizeof(char))) == NULL) {
                 fprintf(stderr, merror);
                 exit(EXIT_FAILURE);
             }
-            memset(pop_l, -1, read * sizeof(int));
-            while(temp != NULL) {
-                if(k > 9) {
-                    stringTerminator(temp);
-                    for(i = 0; i < ind_n; i++) {
-                        if(strcmp(temp, pops[i].ind) == 0) {
-                            pop_l[k] = pops[i].idx;
-                            ind_i++;
-                        }
-                    }
+            memset(pop_l, -1, (sample_n + 1) * sizeof(int));
+            initHash(&hash, ind_n);
+            for(i = 0; i < ind_n; i++)
+                *addHash(&hash, pops[i].ind) = i;
+            for(j = 0; j < sample_n; j++) {
+                if((v = findHash(&hash, samples[j])) != NULL) {
+                    pop_l[j] = pops[*v].idx;
+                    use[j] = 1;
+                    ind_i++;
                 }
-                temp = strtok_r(NULL, "\t", &end);
-                k++;
             }
+            freeHash(&hash);
+            free(samples);
             if(ind_i == 0) {
                 fprintf(stderr, "\nERROR: Individuals in pops file were not found in the VCF file!\n\n");
                 exit(EXIT_FAILURE);
@@ -430,169 +493,128 @@ void readVcf(FILE *vcf_file, FILE *out_file, Pop_s *pops, Site_s *sites, int win
                 fprintf(stderr, "Warning: pops file contains individuals that are not in the VCF file\n\n");
                 ind_n = ind_i;
             }
+            job->ind_n = ind_n;
+            job->sample_n = sample_n;
+            job->pop_l = pop_l;
+            job->use = use;
             continue;
         }
-        ind_i = 0;
-        mis_i = 0;
-        alt_i = 0;
-        hap_i = 0;
+        if(read == 0)
+            continue;
         if(r2 < 1) {
-            memset(snps[win_i].geno, 0, geno_n * sizeof(double));
-            for(i = 0; i < pop_n; i++)
-                memset(snps[win_i].counts[i], 0, 2 * sizeof(double));
-        } else {
-            for(i = 0; i < pop_n; i++)
-                memset(counts[i], 0, 2 * sizeof(double));
+            if(dose.dose == NULL)
+                initDosages(&dose, win, ind_n);
+            clearDosages(&dose, win_i);
+        }
+        if(sites != NULL && findSite(sites, &site_c, rec.chr, rec.pos) == 0) {
+            if(st != NULL)
+                st->drop_sites++;
+            lapStats(st, STAT_SITES);
+            continue;
         }
-        while(temp != NULL) {
-            if(k == 1)
-                strncpy(chr, temp, 99);
-            else if(k == 2) {
-                pos = atoi(temp);
-                if(site_n > 0) {
-                    ok = 0;
-                    while(site_i < site_n) {
-                        if(strcmp(chr, sites[site_i].chr) == 0) {
-                            if(pos == sites[site_i].pos) {
-                                ok = 1;
-                                break;
-                            } else if(pos < sites[site_i].pos)
-                                break;
-                        } else if(strcmp(chr, sites[site_i].chr) < 0)
-                            break;
-                        site_i++;
+        if(sites != NULL)
+            lapStats(st, STAT_SITES);
+        if(r2 < 1) {
+            if(win_n > 0 && strcmp(snps[0].chr, rec.chr) != 0) {
+                estLD(snps, &dose, win_n + 1, job->maxdist, r2, st);
+                lapStats(st, STAT_LD);
+                for(i = 0; i < win; i++) {
+                    if(snps[win_i].ok == 1) {
+                        printFreq(w, snps[win_i].counts, snps[win_i].chr, snps[win_i].pos, out, pop_n);
+                        snps[win_i].ok = 0;
+                        snp_i++;
                     }
-                    if(ok == 0)
-                        break;
-                }
-                if(r2 < 1) {
-                    if(win_n > 0 && strcmp(snps[0].chr, chr) != 0) {
-                        estLD(snps, win_n + 1, ind_n, r2);
-                        for(i = 0; i < win; i++) {
-                            if(snps[win_i].ok == 1) {
-                                printOut(out_file, snps[win_i].counts, snps[win_i].chr, snps[win_i].pos, out, pop_n);
-                                snps[win_i].ok = 0;
-                                snp_i++;
-                            }
-                            win_i++;
-                            if(win_i == win)
-                                win_i = 0;
-                        }
-                        win_n = 0;
+                    win_i++;
+                    if(win_i == win)
                         win_i = 0;
-                        step_i = 0;
-                        memset(snps[win_i].geno, 0, geno_n * sizeof(double));
-                        for(i = 0; i < pop_n; i++)
-                            memset(snps[win_i].counts[i], 0, 2 * sizeof(double));
-                    }
-                    strcpy(snps[win_i].chr, chr);
-                    snps[win_i].pos = pos;
-                    snps[win_i].ok = -1;
-                }
-            } else if(k > 9) {
-                if(pop_l[k] == -1) {
-                    temp = strtok_r(NULL, "\t", &end);
-                    k++;
-                    continue;
-                }
-                if(strchr(temp, ':') != NULL)
-                    strncpy(hap, strtok(temp, ":"), 49);
-                else {
-                    stringTerminator(temp);
-                    strncpy(hap, temp, 49);
-                }
-                if(hap[0] == '.') {
-                    if(r2 < 1)
-                        snps[win_i].geno[ind_i++] = -1;
-                    mis_i++;
-                    temp = strtok_r(NULL, "\t", &end);
-                    k++;
-                    continue;
-                }
-                switch(strlen(hap)) {
-                    case 3:
-                        ploidy = 2;
-                        stop = 2;
-                        break;
-                    case 7:
-                        ploidy = 4;
-                        stop = 6;
-                        break;
-                    case 11:
-                        ploidy = 6;
-                        stop = 10;
-                        break;
-                    case 15:
-                        ploidy = 8;
-                        stop = 14;
-                        break;
-                    default:
-                        fprintf(stderr, "\nERROR: Allowed ploidy-levels are 2, 4, 6, and 8!\n\n");
-                        exit(EXIT_FAILURE);
                 }
-                for(i = 0; i <= stop; i += 2) {
-                    if(hap[i] == '0' || hap[i] == '1') {
-                        if(r2 < 1) {
-                            snps[win_i].geno[ind_i] += hap[i] - '0';
-                            snps[win_i].counts[pop_l[k]][1] += hap[i] - '0';
-                        } else
-                            counts[pop_l[k]][1] += hap[i] - '0';
-                        alt_i += hap[i] - '0';
-                    } else {
-                        fprintf(stderr, "\nERROR: Unknown alleles found at site %s:%i! Only 0 and 1 are allowed.\n\n", chr, pos);
-                        exit(EXIT_FAILURE);
-                    }
-                }
-                if(r2 < 1)
-                    snps[win_i].counts[pop_l[k]][0] += ploidy;
-                else
-                    counts[pop_l[k]][0] += ploidy;
-                hap_i += ploidy;
-                ind_i++;
+                lapStats(st, STAT_OUT);
+                win_n = 0;
+                win_i = 0;
+                step_i = 0;
             }
-            temp = strtok_r(NULL, "\t", &end);
-            k++;
-        }
-        if(temp == NULL) {
-            if(mis_i / ind_n > 1 - mis || mis_i == ind_n) {
-                if(r2 < 1)
-                    snps[win_i].chr[0] = '\0';
+            strncpy(snps[win_i].chr, rec.chr, 99);
+            snps[win_i].pos = rec.pos;
+            snps[win_i].ok = -1;
+            snps[win_i].fresh = 1;
+            cur = snps[win_i].counts;
+        } else
+            cur = counts;
+        memset(cur, 0, pop_n * 2 * sizeof(double));
+        parseGenos(&rec, use, sample_n);
+        if(r2 < 1)
+            packDosages(&dose, win_i, rec.geno, use, rec.ind_n < sample_n ? rec.ind_n : sample_n);
+        lapStats(st, STAT_PARSE);
+        mis_i = 0;
+        alt_i = 0;
+        hap_i = 0;
+        for(i = 0; i < rec.ind_n && i < sample_n; i++) {
+            if(pop_l[i] == -1)
                 continue;
-            }
-            if(alt_i / hap_i < maf || alt_i / hap_i > 1 - maf) {
-                if(r2 < 1)
-                    snps[win_i].chr[0] = '\0';
+            g = &rec.geno[i];
+            if(g->mis) {
+                mis_i++;
                 continue;
             }
-            if(r2 < 1) {
-                if((win_n == win - 1 && step_i >= step) || (win == step && win_i == win - 1)) {
-                    estLD(snps, win_n + 1, ind_n, r2);
-                    step_i = 0;
-                }
-                if(win_n < win - 1)
-                    win_n++;
-                step_i++;
-                win_i++;
-                if(win_i == win)
-                    win_i = 0;
-                if(win_n == win - 1) {
-                    if(snps[win_i].ok == 1) {
-                        printOut(out_file, snps[win_i].counts, snps[win_i].chr, snps[win_i].pos, out, pop_n);
-                        snps[win_i].ok = 0;
-                        snp_i++;
-                    }
+            cur[pop_l[i] * 2] += g->ploidy;
+            cur[pop_l[i] * 2 + 1] += g->alt;
+            alt_i += g->alt;
+            hap_i += g->ploidy;
+        }
+        if(mis_i / ind_n > 1 - mis || mis_i == ind_n) {
+            if(r2 < 1)
+                snps[win_i].chr[0] = '\0';
+            if(st != NULL)
+                st->drop_mis++;
+            lapStats(st, STAT_FILTER);
+            continue;
+        }
+        if(alt_i / hap_i < maf || alt_i / hap_i > 1 - maf) {
+            if(r2 < 1)
+                snps[win_i].chr[0] = '\0';
+            if(st != NULL)
+                st->drop_maf++;
+            lapStats(st, STAT_FILTER);
+            continue;
+        }
+        if(st != NULL)
+            st->pass_n++;
+        lapStats(st, STAT_FILTER);
+        if(r2 < 1) {
+            if((win_n == win - 1 && step_i >= step) || (win == step && win_i == win - 1)) {
+                estLD(snps, &dose, win_n + 1, job->maxdist, r2, st);
+                lapStats(st, STAT_LD);
+                step_i = 0;
+            }
+            if(win_n < win - 1)
+                win_n++;
+            step_i++;
+            win_i++;
+            if(win_i == win)
+                win_i = 0;
+            if(win_n == win - 1) {
+                if(snps[win_i].ok == 1) {
+                    printFreq(w, snps[win_i].counts, snps[win_i].chr, snps[win_i].pos, out, pop_n);
+                    snps[win_i].ok = 0;
+                    snp_i++;
+                    lapStats(st, STAT_OUT);
                 }
-            } else {
-                printOut(out_file, counts, chr, pos, out, pop_n);
-                snp_i++;
             }
+        } else {
+            printFreq(w, counts, rec.chr, rec.pos, out, pop_n);
+            snp_i++;
+            lapStats(st, STAT_OUT);
         }
     }
     if(r2 < 1) {
-        estLD(snps, win_n + 1, ind_n, r2);
+        /* In a single pass, the first line of the next chromosome clears the pending slot before this window is flushed */
+        if(dose.dose != NULL && chunk->last == 0)
+            clearDosages(&dose, win_i);
+        estLD(snps, &dose, win_n + 1, job->maxdist, r2, st);
+        lapStats(st, STAT_LD);
         for(i = 0; i < win; i++) {
             if(snps[win_i].ok == 1) {
-                printOut(out_file, snps[win_i].counts, snps[win_i].chr, snps[win_i].pos, out, pop_n);
+                printFreq(w, snps[win_i].counts, snps[win_i].chr, snps[win_i].pos, out, pop_n);
                 snps[win_i].ok = 0;
                 snp_i++;
             }
@@ -601,101 +623,19 @@ void readVcf(FILE *vcf_file, FILE *out_file, Pop_s *pops, Site_s *sites, int win
                 win_i = 0;
         }
     }
-
-    if(isatty(1))
-        fprintf(stderr, "\n");
-    fprintf(stderr, "Kept %i variants\n\n", snp_i);
-
-    if(r2 < 1) {
-        for(i = 0; i < win; i++) {
-            free(snps[i].geno);
-            for(j = 0; j < pop_n; j++)
-                free(snps[i].counts[j]);
-            free(snps[i].counts);
-        }
-        free(snps);
-    } else {
-        for(i = 0; i < pop_n; i++)
-            free(counts[i]);
-        free(counts);
-    }
-    free(pop_l);
-    free(pops);
-    if(site_n > 0)
-        free(sites);
+    job->snp_n[chunk->idx] = snp_i;
+
+    freeWriter(&w[0]);
+    if(out > 0)
+        freeWriter(&w[1]);
+    lapStats(st, STAT_OUT);
+    if(st != NULL)
+        st->kept_n = snp_i;
+    free(snps);
+    free(counts);
+    freeDosages(&dose);
+    freeRecord(&rec);
     free(line);
-    fclose(vcf_file);
-}
-
-void estLD(SNP_s *snps, int win, int ind_n, double r2) {
-    int i, j;
-    for(i = 0; i < win; i++) {
-        if(snps[i].chr[0] == '\0')
-            continue;
-        for(j = i + 1; j < win; j++) {
-            if(snps[j].chr[0] == '\0')
-                continue;
-            if(strcmp(snps[i].chr, snps[j].chr) != 0)
-                continue;
-            /*
-            fprintf(stderr, "%s %i: ", snps[i].chr, snps[i].pos);
-            for(k = 0; k < ind_n; k++)
-                fprintf(stderr, "%.0f ", snps[i].geno[k]);
-            fprintf(stderr, "\n");
-            fprintf(stderr, "%s %i: ", snps[j].chr, snps[j].pos);
-            for(k = 0; k < ind_n; k++)
-                fprintf(stderr, "%.0f ", snps[j].geno[k]);
-            fprintf(stderr, "\n");
-            fprintf(stderr, "%f\n\n", estR2(snps[i].geno, snps[j].geno, ind_n));
-            */
-            if(estR2(snps[i].geno, snps[j].geno, ind_n) > r2)
-                break;
-        }
-        if(j == win && (snps[i].ok == -1 || snps[i].ok == 1))
-            snps[i].ok = 1;
-        else
-            snps[i].ok = 0;
-    }
-}
-
-double estR2(double geno1[], double geno2[], int n) {
-    int i, m = 0;
-    double sum1 = 0, sum2 = 0, sum12 = 0, sqsum1 = 0, sqsum2 = 0, r = 0;
-    m = n;
-    for(i = 0; i < m; i++) {
-        if(geno1[i] == -1 || geno2[i] == -1) {
-            n--;
-            continue;
-        }
-        sum1 += geno1[i];
-        sum2 += geno2[i];
-        sum12 += geno1[i] * geno2[i];
-        sqsum1 += geno1[i] * geno1[i];
-        sqsum2 += geno2[i] * geno2[i];
-    }
-    r = (n * sum12 - sum1 * sum2) / sqrt((n * sqsum1 - sum1 * sum1) * (n * sqsum2 - sum2 * sum2));
-    return r * r;
-}
-
-void printOut(FILE *out_file, double **counts, char chr[], int pos, int out, int n) {
-    int i;
-    if(out == 0)
-        printf("%s:%i\t", chr, pos);
-    else
-        fprintf(out_file, "%s\t%i\n", chr, pos);
-    for(i = 0; i < n; i++) {
-        if(out == 0) {
-            if(i < n - 1)
-                printf("%f\t", counts[i][1] / (counts[i][0]));
-            else
-                printf("%f\n", counts[i][1] / (counts[i][0]));
-        } else {
-            if(i < n - 1)
-                printf("%.0f %.0f ", counts[i][0] - counts[i][1], counts[i][1]);
-            else
-                printf("%.0f %.0f\n", counts[i][0] - counts[i][1], counts[i][1]);
-        }
-    }
 }
 
 int isNumeric(const char *s) {
@@ -713,14 +653,20 @@ void stringTerminator(char *string) {
 void printHelp(void) {
     fprintf(stderr, "\nProgram for estimating allele frequencies from mixed ploidy VCF files.\nOutput will be either population-specific allele frequencies or allele counts in the format required by BayPass.\n\n");
     fprintf(stderr, "Usage:\n");
-    fprintf(stderr, "-vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8.\n");
+    fprintf(stderr, "-vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8. Can be bgzip-compressed or a BCF file.\n");
+    fprintf(stderr, "-cache [file] Binary genotype cache. With -vcf, the VCF file is first converted into this file; without it, an existing cache is read instead of a VCF file. Optional.\n");
     fprintf(stderr, "-pops [file] Tab delimited file listing individuals to use and their populations (format: individual id, population id).\n");
     fprintf(stderr, "-sites [file] Tab delimited file listing sites to use (format: chr, pos). Optional.\n");
     fprintf(stderr, "-mis [double] Excludes sites based of the proportion of missing data (0 = all missing allowed, 1 = no missing data allowed). Default > 0.\n");
     fprintf(stderr, "-maf [double] Minimum minor allele frequency allowed. Default 0.\n");
     fprintf(stderr, "-r2 [int] [int] [double] Excludes sites based on squared genotypic correlation. Requires a window size in number of SNPs, a step size in number of SNPs, and a maximum r2 value. Optional.\n");
-    fprintf(stderr, "-out [int] Whether to output allele frequencies (0) or allele counts in the BayPass format (1). Default 0.\n");
-    fprintf(stderr, "-info [string] If -out is 1, records populations and locations of used SNPs into this file. Default 'info.txt'.\n\n");
+    fprintf(stderr, "-r2bp [int] Maximum distance in bp between the sites of a pair compared with -r2. Pairs further apart are not compared. Optional.\n");
+    fprintf(stderr, "-out [int] Whether to output allele frequencies (0), allele counts in the BayPass format (1), or allele frequencies as binary 32-bit floats in native byte order, one row of populations per site (2). Default 0.\n");
+    fprintf(stderr, "-O [string] Format of the output table: 'v' for uncompressed or 'z' for bgzip-compressed (BGZF). The -info file is not compressed. With -threads, the BGZF blocks of a single part are compressed on the threads. Default 'v'.\n");
+    fprintf(stderr, "-info [string] If -out is 1 or 2, records populations and locations of used SNPs into this file. Default 'info.txt'.\n");
+    fprintf(stderr, "-region [chr:start-end] Only uses sites within the region (for example chr1:1000-2000 or chr1). Uses the .tbi or .csi index of a bgzip-compressed VCF file to read only that part of the file. Optional.\n");
+    fprintf(stderr, "-threads [int] Number of threads used for processing chromosomes (or parts of chromosomes without -r2) in parallel. A pipe, a gzip file or a single chromosome is read as one part, with its lines parsed on the threads. Default 1.\n");
+    fprintf(stderr, "-stats [string] Writes a JSON report of the time spent in each stage, the numbers of sites read and dropped by each filter, the numbers of r2 estimates, and peak memory use into this file, or to stderr with 'stderr'. Optional.\n\n");
     fprintf(stderr, "Example:\n");
     fprintf(stderr, "./poly_freq -vcf in.vcf -pops pops.txt -sites 4fold.sites -mis 0.8 -maf 0.05 -r2 100 50 0.1 -out 1 -info 4fold_ld_pruned.info > 4fold_ld_pruned.baypass\n\n");
 }
\ No newline at end of file
@@ -17,21 +17,35 @@
 
  Program for estimating pairwise Fst and Dxy from mixed ploidy VCF files.
 
- Compiling: gcc poly_fst.c -o poly_fst -lm
+ Compiling: gcc poly_fst.c vcf_parse.c vcf_thread.c vcf_cache.c vcf_bcf.c vcf_write.c vcf_block.c vcf_state.c vcf_pop.c bgzf.c -o poly_fst -lm -lpthread -lz
 
  Usage:
- -vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8.
+ -vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8. Can be bgzip-compressed or a BCF file.
+ -cache [file] Binary genotype cache. With -vcf, the VCF file is first converted into this file; without it, an existing cache is read instead of a VCF file. Optional.
  -pop1 [file] File listing individuals from population 1.
  -pop2 [file] File listing individuals from population 2.
+ -pops [file] Tab delimited file listing individuals and their populations (format: individual id, population id). Used instead of -pop1 and -pop2 to estimate Fst/Dxy between all population pairs in one pass. Output will be a matrix, or one matrix for each gene with -genes.
  -sites [file] Tab delimited file listing sites to use (format: chr, pos). Optional.
  -genes [file] Tab delimited file listing genes to use (format: chr, start, end, id). Output will be Fst/Dxy calculated for each gene. Optional.
  -mis [double] Excludes sites based of the proportion of missing data (0 = all missing allowed, 1 = no missing data allowed). Default > 0.
  -maf [double] Minimum minor allele frequency allowed. Default 0.
  -stat [string] Whether to calculate 'fst' or 'dxy'. Default 'fst'. Note that dxy requires invariant sites to be included in the VCF file.
  -out [int] Whether to print full output (0) or genome-wide estimate only (1). Default 0.
+ -window [int] [int] Output will be Fst, Dxy, pi, Watterson's theta and Tajima's D calculated in sliding windows of the given size and step, for each population pair and population. Used instead of -genes and -stat. Optional.
+ -wtype [string] Whether -window is given in base pairs ('bp') or in number of sites ('snp'). Default 'bp'.
+ -jackknife [int] Also estimates the block-jackknife standard error of the genome-wide Fst/Dxy, using blocks of the given number of base pairs. Optional.
+ -bootstrap [int] Also estimates a 95% confidence interval of the genome-wide Fst/Dxy from the given number of bootstrap replicates of the -jackknife blocks. Optional.
+ -seed [int] Seed number used for -bootstrap. Default is a random seed.
+ -region [chr:start-end] Only uses sites within the region (for example chr1:1000-2000 or chr1). Uses the .tbi or .csi index of a bgzip-compressed VCF file to read only that part of the file. Optional.
+ -threads [int] Number of threads used for processing parts of chromosomes in parallel. A pipe or a gzip file is read as one part, with its lines parsed on the threads. Default 1.
+ -state [file] Writes the sums of the run into a binary state file instead of printing the output, for example for one chromosome of a cluster run given with -region. Cannot be used with -window, -jackknife or the per-site output of -pop1 and -pop2. Optional.
+ -merge [file] File listing state files written with -state (one per line). Sums the states and prints the output of the whole run. Used instead of all other options, which are taken from the state files. Optional.
 
  Example:
  ./poly_fst -vcf in.vcf -pop1 pop1.txt -pop2 pop2.txt -sites 4fold.sites -genes genes.txt -mis 0.8 -stat dxy > out_gene.dxy
+ ./poly_fst -vcf in.vcf -pops pops.txt -mis 0.8 -window 50000 10000 > out_windows.txt
+ ./poly_fst -vcf in.vcf.gz -pops pops.txt -mis 0.8 -region chr1 -state chr1.state
+ ./poly_fst -merge states.txt > out.fst
 */
 
 #include <ctype.h>
@@ -41,24 +55,67 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include "vcf_block.h"
+#include "vcf_parse.h"
+#include "vcf_pop.h"
+#include "vcf_state.h"
+#include "vcf_thread.h"
 #define merror "ERROR: System out of memory\n\n"
 
 typedef struct {
-    int pos;
+    int idx;
+    char ind[200];
+} Pop_s;
+
+typedef struct {
+    int ok;
+    double ind, mis, p, n;
+} Freq_s;
+
+typedef struct {
+    long int bin, first, last;
+    int site_n;
+    double *sums;
+} Bin_s;
+
+typedef struct {
+    int size, step, unit, pair_n, pop_n, bin_n, gap, site_n, field_n, harm_n;
+    long int next, snp_i;
+    double *tot, *vals, *harm;
     char chr[100];
-} Site_s;
+    Bin_s *bins;
+    FILE *out;
+} Window_s;
 
 typedef struct {
-    int start, end;
-    double hw, hb, n;
-    char chr[100], id[200];
-} Gene_s;
+    int stat, out, win, step, unit, ind_n, pop_n, pair_n, gene_n, sample_n, *pop_l;
+    double mis, maf;
+    char *use, **names;
+    Pop_s *pops;
+    Sites_s *sites;
+    Features_s *genes;
+    Sum_s *tot, **sums;
+    Blocks_s *blocks;
+} Job_s;
 
 void openFiles(int argc, char *argv[]);
 char **readInds(FILE *ind_file, int *n);
-Site_s *readSites(FILE *site_file, int *n);
-Gene_s *readGenes(FILE *gene_file, int *n);
-void readVcf(FILE *vcf_file, char **pop1, char **pop2, Site_s *sites, Gene_s *genes, int stat, int out, int pop1_n, int pop2_n, int site_n, int gene_n, double mis, double maf);
+Pop_s *readPops(FILE *pop_file, char ***names, int *n, int *m);
+Pop_s *mergeInds(char **pop1, char **pop2, int pop1_n, int pop2_n);
+void readVcf(Bgzf_s *vcf_file, Cache_s *cache, const char *vcf_name, const Region_s *region, Pop_s *pops, char **names, Sites_s *sites, Features_s *genes, int stat, int out, int win, int step, int unit, int ind_n, int pop_n, int gene_n, int thread_n, int boot_n, long int block, long int seed, double mis, double maf, const char *state_name);
+void readChunk(Chunk_s *chunk, void *arg);
+void addSums(Sum_s *sum, const Sum_s *site, int pair_n);
+void initWindow(Window_s *w, FILE *out, int size, int step, int unit, int pop_n, int pair_n);
+void addWindow(Window_s *w, const char *chr, int pos, const Sum_s *site, const Freq_s *freq);
+void dropBin(Window_s *w, long int bin);
+void flushWindows(Window_s *w);
+void printWindow(Window_s *w);
+void printHeader(char **names, int pop_n);
+void freeWindow(Window_s *w);
+void estBlocks(Job_s *job, int chunk_n, int boot_n, long int seed, double *se, double *low, double *high);
+void printResults(char **names, char **ids, const Sum_s *tot, const Sum_s *sum, int stat, int out, int win, int pop_n, int gene_n, int boot_n, const double *se);
+void saveState(const char *name, char **names, char **ids, const Sum_s *tot, const Sum_s *sum, int stat, int out, int pop_n, int gene_n, double mis, double maf);
+void mergeStates(FILE *merge_file);
 int isNumeric(const char *s);
 void stringTerminator(char *string);
 void printHelp(void);
@@ -87,12 +144,17 @@ int main(int argc, char *argv[]) {
 }
 
 void openFiles(int argc, char *argv[]) {
-    int i, stat = 0, pop1_n = 0, pop2_n = 0, site_n = 0, gene_n = 0, out = 0;
+    int i, stat = 0, pop1_n = 0, pop2_n = 0, ind_n = 0, pop_n = 2, gene_n = 0, out = 0, win = 0, step = 0, unit = 0, thread_n = 1, boot_n = 0;
+    long int block = 0, seed = 0;
     double mis = 0, maf = 0;
-    char temp[10], **pop1 = NULL, **pop2 = NULL;
-    Site_s *sites = NULL;
-    Gene_s *genes = NULL;
-    FILE *vcf_file = NULL, *pop1_file = NULL, *pop2_file = NULL, *site_file = NULL, *gene_file = NULL;
+    char temp[10], *vcf_name = NULL, *cache_name = NULL, *state_name = NULL, **pop1 = NULL, **pop2 = NULL, **names = NULL;
+    Pop_s *pops = NULL;
+    Sites_s *sites = NULL;
+    Features_s *genes = NULL;
+    Region_s region, *reg = NULL;
+    Bgzf_s *vcf_file = NULL;
+    Cache_s *cache = NULL;
+    FILE *pop1_file = NULL, *pop2_file = NULL, *pop_file = NULL, *site_file = NULL, *gene_file = NULL, *merge_file = NULL;
 
     if(argc == 1) {
         printHelp();
@@ -103,11 +165,15 @@ void openFiles(int argc, char *argv[]) {
 
     for(i = 1; i < argc; i++) {
         if(strcmp(argv[i], "-vcf") == 0) {
-            if((vcf_file = fopen(argv[++i], "r")) == NULL) {
+            if((vcf_file = openBgzf(argv[++i])) == NULL) {
                 fprintf(stderr, "ERROR: Cannot open file %s\n\n", argv[i]);
                 exit(EXIT_FAILURE);
             }
+            vcf_name = argv[i];
             fprintf(stderr, "\t-vcf %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-cache") == 0) {
+            cache_name = argv[++i];
+            fprintf(stderr, "\t-cache %s\n", argv[i]);
         } else if(strcmp(argv[i], "-pop1") == 0) {
             if((pop1_file = fopen(argv[++i], "r")) == NULL) {
                 fprintf(stderr, "ERROR: Cannot open file %s\n\n", argv[i]);
@@ -120,6 +186,12 @@ void openFiles(int argc, char *argv[]) {
                 exit(EXIT_FAILURE);
             }
             fprintf(stderr, "\t-pop2 %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-pops") == 0) {
+            if((pop_file = fopen(argv[++i], "r")) == NULL) {
+                fprintf(stderr, "ERROR: Cannot open file %s\n\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-pops %s\n", argv[i]);
         } else if(strcmp(argv[i], "-sites") == 0) {
             if((site_file = fopen(argv[++i], "r")) == NULL) {
                 fprintf(stderr, "ERROR: Cannot open file %s\n\n", argv[i]);
@@ -179,6 +251,77 @@ void openFiles(int argc, char *argv[]) {
                 exit(EXIT_FAILURE);
             }
             fprintf(stderr, "\t-out %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-window") == 0) {
+            if(i + 2 >= argc || isNumeric(argv[i + 1]) == 0 || isNumeric(argv[i + 2]) == 0) {
+                fprintf(stderr, "ERROR: Invalid values for -window [int] [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            win = atoi(argv[++i]);
+            step = atoi(argv[++i]);
+            if(win < 1 || step < 1) {
+                fprintf(stderr, "ERROR: Invalid values for -window [int] [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-window %s %s\n", argv[i - 1], argv[i]);
+        } else if(strcmp(argv[i], "-wtype") == 0) {
+            strncpy(temp, argv[++i], 9);
+            if(strcmp(temp, "bp") == 0)
+                unit = 0;
+            else if(strcmp(temp, "snp") == 0)
+                unit = 1;
+            else {
+                fprintf(stderr, "ERROR: Invalid input for -wtype [string]! Allowed are 'bp' and 'snp'\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-wtype %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-jackknife") == 0) {
+            if(isNumeric(argv[++i]))
+                block = atol(argv[i]);
+            if(block < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "ERROR: Invalid value for -jackknife [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-jackknife %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-bootstrap") == 0) {
+            if(isNumeric(argv[++i]))
+                boot_n = atoi(argv[i]);
+            if(boot_n < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "ERROR: Invalid value for -bootstrap [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-bootstrap %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-seed") == 0) {
+            if(isNumeric(argv[++i]))
+                seed = atol(argv[i]);
+            else {
+                fprintf(stderr, "ERROR: Invalid value for -seed [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-seed %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-region") == 0) {
+            if(parseRegion(argv[++i], &region) == 0) {
+                fprintf(stderr, "ERROR: Invalid value for -region [chr:start-end]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            reg = &region;
+            fprintf(stderr, "\t-region %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-threads") == 0) {
+            if(isNumeric(argv[++i]))
+                thread_n = atoi(argv[i]);
+            if(thread_n < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "ERROR: Invalid value for -threads [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-threads %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-state") == 0) {
+            state_name = argv[++i];
+            fprintf(stderr, "\t-state %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-merge") == 0) {
+            if((merge_file = fopen(argv[++i], "r")) == NULL) {
+                fprintf(stderr, "ERROR: Cannot open file %s\n\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-merge %s\n", argv[i]);
         } else if(strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             fprintf(stderr, "\t%s\n", argv[i]);
             printHelp();
@@ -190,17 +333,66 @@ void openFiles(int argc, char *argv[]) {
     }
     fprintf(stderr, "\n");
 
-    if(vcf_file == NULL || pop1_file == NULL || pop2_file == NULL) {
-        fprintf(stderr, "ERROR: -vcf [file] -pop1 [file] -pop2 [file] are required!\n\n");
+    if(merge_file != NULL) {
+        if(argc > 3) {
+            fprintf(stderr, "ERROR: -merge [file] cannot be used with other options, which are taken from the state files!\n\n");
+            exit(EXIT_FAILURE);
+        }
+        mergeStates(merge_file);
+        return;
+    }
+    if((vcf_file == NULL && cache_name == NULL) || (pop_file == NULL && (pop1_file == NULL || pop2_file == NULL))) {
+        fprintf(stderr, "ERROR: -vcf [file] (or -cache [file]) -pop1 [file] -pop2 [file] (or -pops [file]) are required!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(pop_file != NULL && (pop1_file != NULL || pop2_file != NULL)) {
+        fprintf(stderr, "ERROR: -pops [file] cannot be used together with -pop1 [file] and -pop2 [file]!\n\n");
         exit(EXIT_FAILURE);
     }
-    pop1 = readInds(pop1_file, &pop1_n);
-    pop2 = readInds(pop2_file, &pop2_n);
+    if(win > 0 && (gene_file != NULL || out == 1)) {
+        fprintf(stderr, "ERROR: -window [int] [int] cannot be used together with -genes [file] or -out 1!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(boot_n > 0 && block == 0) {
+        fprintf(stderr, "ERROR: -bootstrap [int] requires the block size given with -jackknife [int]!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(state_name != NULL && (win > 0 || block > 0 || (pop_file == NULL && gene_file == NULL && out == 0))) {
+        fprintf(stderr, "ERROR: -state [file] cannot be used with -window [int] [int], -jackknife [int] or the per-site output of -pop1 [file] and -pop2 [file]!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(cache_name != NULL) {
+        if(vcf_file != NULL) {
+            writeCache(vcf_file, cache_name);
+            closeBgzf(vcf_file);
+            vcf_file = NULL;
+            vcf_name = NULL;
+        }
+        if((cache = openCache(cache_name)) == NULL) {
+            fprintf(stderr, "ERROR: Cannot open file %s\n\n", cache_name);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if(pop_file != NULL) {
+        pop_n = 0;
+        pops = readPops(pop_file, &names, &ind_n, &pop_n);
+        if(pop_n < 2) {
+            fprintf(stderr, "ERROR: -pops file should list at least two populations!\n\n");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        pop1 = readInds(pop1_file, &pop1_n);
+        pop2 = readInds(pop2_file, &pop2_n);
+        pops = mergeInds(pop1, pop2, pop1_n, pop2_n);
+        ind_n = pop1_n + pop2_n;
+    }
     if(site_file != NULL)
-        sites = readSites(site_file, &site_n);
-    if(gene_file != NULL)
-        genes = readGenes(gene_file, &gene_n);
-    readVcf(vcf_file, pop1, pop2, sites, genes, stat, out, pop1_n, pop2_n, site_n, gene_n, mis, maf);
+        sites = readSites(site_file);
+    if(gene_file != NULL) {
+        genes = readFeatures(gene_file);
+        gene_n = genes->feature_n;
+    }
+    readVcf(vcf_file, cache, vcf_name, reg, pops, names, sites, genes, stat, out, win, step, unit, ind_n, pop_n, gene_n, thread_n, boot_n, block, seed, mis, maf, state_name);
 }
 
 char **readInds(FILE *ind_file, int *n) {
@@ -238,37 +430,54 @@ char **readInds(FILE *ind_file, int *n) {
     return list;
 }
 
-Site_s *readSites(FILE *site_file, int *n) {
-    double list_i = 1e6;
-    char *line = NULL;
-    Site_s *list = NULL;
+Pop_s *readPops(FILE *pop_file, char ***names, int *n, int *m) {
+    int i;
+    int *v = NULL;
+    double list_i = 200, names_i = 50;
+    char *line = NULL, *ind = NULL, *pop = NULL;
+    Pop_s *list = NULL;
+    Hash_s hash;
     size_t len = 0;
     ssize_t read;
 
-    if((list = malloc(list_i * sizeof(Site_s))) == NULL) {
+    if((list = malloc(list_i * sizeof(Pop_s))) == NULL || (*names = malloc(names_i * sizeof(char *))) == NULL) {
         fprintf(stderr, merror);
         exit(EXIT_FAILURE);
     }
-    while((read = getline(&line, &len, site_file)) != -1) {
+    initHash(&hash, 50);
+    while((read = getline(&line, &len, pop_file)) != -1) {
         if(line[0] == '\n' || line[0] == '#')
             continue;
-        strncpy(list[*n].chr, strtok(line, "\t"), 99);
-        list[*n].pos = atoi(strtok(NULL, "\t"));
-        if(*n > 0) {
-            if(strcmp(list[*n].chr, list[*n - 1].chr) < 0) {
-                fprintf(stderr, "ERROR: Site file is not sorted. Use: sort -k1,1 -k2,2n list.sites > sorted.sites\n\n");
+        stringTerminator(line);
+        if((ind = strtok(line, "\t")) == NULL || (pop = strtok(NULL, "\t")) == NULL) {
+            fprintf(stderr, "ERROR: -pops file should have two tab delimited columns (individual id, population id)!\n\n");
+            exit(EXIT_FAILURE);
+        }
+        if((v = findHash(&hash, pop)) != NULL)
+            i = *v;
+        else {
+            i = *m;
+            if(((*names)[i] = strdup(pop)) == NULL) {
+                fprintf(stderr, merror);
                 exit(EXIT_FAILURE);
-            } else if(strcmp(list[*n].chr, list[*n - 1].chr) == 0) {
-                if(list[*n].pos < list[*n - 1].pos) {
-                    fprintf(stderr, "ERROR: Site file is not sorted. Use: sort -k1,1 -k2,2n list.sites > sorted.sites\n\n");
+            }
+            *addHash(&hash, (*names)[i]) = i;
+            *m = *m + 1;
+            if(*m >= names_i) {
+                names_i += 50;
+                if((*names = realloc(*names, names_i * sizeof(char *))) == NULL) {
+                    fprintf(stderr, merror);
                     exit(EXIT_FAILURE);
                 }
             }
         }
+        strncpy(list[*n].ind, ind, 199);
+        list[*n].ind[199] = '\0';
+        list[*n].idx = i + 1;
         *n = *n + 1;
         if(*n >= list_i) {
-            list_i += 1e5;
-            if((list = realloc(list, list_i * sizeof(Site_s))) == NULL) {
+            list_i += 100;
+            if((list = realloc(list, list_i * sizeof(Pop_s))) == NULL) {
                 fprintf(stderr, merror);
                 exit(EXIT_FAILURE);
             }
@@ -276,313 +485,649 @@ Site_s *readSites(FILE *site_file, int *n) {
     }
 
     free(line);
-    fclose(site_file);
+    freeHash(&hash);
+    fclose(pop_file);
 
     return list;
 }
 
-Gene_s *readGenes(FILE *gene_file, int *n) {
-    double list_i = 1e4;
-    char *line = NULL;
-    Gene_s *list = NULL;
-    size_t len = 0;
-    ssize_t read;
+/* Population 1 is listed first, so that individuals in both files end up in population 2 */
+Pop_s *mergeInds(char **pop1, char **pop2, int pop1_n, int pop2_n) {
+    int i;
+    Pop_s *list = NULL;
 
-    if((list = malloc(list_i * sizeof(Gene_s))) == NULL) {
+    if((list = malloc((pop1_n + pop2_n + 1) * sizeof(Pop_s))) == NULL) {
         fprintf(stderr, merror);
         exit(EXIT_FAILURE);
     }
-    while((read = getline(&line, &len, gene_file)) != -1) {
-        if(line[0] == '\n')
-            continue;
-        stringTerminator(line);
-        strncpy(list[*n].chr, strtok(line, "\t"), 99);
-        list[*n].start = atoi(strtok(NULL, "\t"));
-        list[*n].end = atoi(strtok(NULL, "\t"));
-        strncpy(list[*n].id, strtok(NULL, "\t"), 199);
-        list[*n].hw = 0;
-        list[*n].hb = 0;
-        list[*n].n = 0;
-        *n = *n + 1;
-        if(*n >= list_i) {
-            list_i += 1000;
-            if((list = realloc(list, list_i * sizeof(Gene_s))) == NULL) {
-                fprintf(stderr, merror);
-                exit(EXIT_FAILURE);
-            }
-        }
+    for(i = 0; i < pop1_n + pop2_n; i++) {
+        strncpy(list[i].ind, i < pop1_n ? pop1[i] : pop2[i - pop1_n], 199);
+        list[i].ind[199] = '\0';
+        list[i].idx = i < pop1_n ? 1 : 2;
     }
-
-    free(line);
-    fclose(gene_file);
+    for(i = 0; i < pop1_n; i++)
+        free(pop1[i]);
+    free(pop1);
+    for(i = 0; i < pop2_n; i++)
+        free(pop2[i]);
+    free(pop2);
 
     return list;
 }
 
-void readVcf(FILE *vcf_file, char **pop1, char **pop2, Site_s *sites, Gene_s *genes, int stat, int out, int pop1_n, int pop2_n, int site_n, int gene_n, double mis, double maf) {
-    int i, j = 0, k = 0, pos = 0, ok = 0, stop = 0, pop_i = 0, site_i = 0, gene_i = 0, *pop_l = NULL;
-    double ploidy = 0, mis1_i = 0, mis2_i = 0, pop1_i = 0, pop2_i = 0, p1 = 0, p2 = 0, n1 = 0, n2 = 0, hw = 0, hb = 0, tot_hw = 0, tot_hb = 0, tot_n = 0;
-    char chr[100], hap[50], *line = NULL, *temp = NULL, *end = NULL;
+void readVcf(Bgzf_s *vcf_file, Cache_s *cache, const char *vcf_name, const Region_s *region, Pop_s *pops, char **names, Sites_s *sites, Features_s *genes, int stat, int out, int win, int step, int unit, int ind_n, int pop_n, int gene_n, int thread_n, int boot_n, long int block, long int seed, double mis, double maf, const char *state_name) {
+    int i, j, chunk_n = 0, pair_n = pop_n * (pop_n - 1) / 2;
+    double *se = NULL, *low = NULL, *high = NULL;
+    FILE *outs[2] = {stdout, NULL};
+    Sum_s *tot = NULL, *sum = NULL;
+    Chunk_s *chunks = NULL;
+    Job_s job = {stat, out, win, step, unit, ind_n, pop_n, pair_n, gene_n, 0, NULL, mis, maf, NULL, names, pops, sites, genes, NULL, NULL, NULL};
+
+    if(cache != NULL)
+        chunks = splitCache(cache, region, thread_n, win > 0, &chunk_n);
+    else
+        chunks = splitVcf(vcf_file, vcf_name, region, thread_n, win > 0, &chunk_n);
+    if((job.tot = calloc((size_t)chunk_n * (pair_n + 1), sizeof(Sum_s))) == NULL || (job.sums = calloc(thread_n, sizeof(Sum_s *))) == NULL || (tot = calloc(pair_n + 1, sizeof(Sum_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    if(block > 0) {
+        if((job.blocks = malloc(chunk_n * sizeof(Blocks_s))) == NULL || (se = malloc(pair_n * 3 * sizeof(double))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        for(i = 0; i < chunk_n; i++)
+            initBlocks(&job.blocks[i], block, pair_n * 3);
+        low = se + pair_n;
+        high = se + pair_n * 2;
+    }
+    for(i = 0; i < thread_n && gene_n > 0; i++) {
+        if((job.sums[i] = calloc((size_t)gene_n * pair_n, sizeof(Sum_s))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if(win > 0)
+        printHeader(names, pop_n);
+    runChunks(chunks, 1, 1, vcf_name, vcf_file, outs, readChunk, &job);
+    runChunks(chunks + 1, chunk_n - 1, thread_n, vcf_name, vcf_file, outs, readChunk, &job);
+    for(i = 0; i < chunk_n; i++) {
+        for(j = 0; j <= pair_n; j++) {
+            tot[j].hw += job.tot[i * (pair_n + 1) + j].hw;
+            tot[j].hb += job.tot[i * (pair_n + 1) + j].hb;
+            tot[j].n += job.tot[i * (pair_n + 1) + j].n;
+        }
+    }
+    sum = job.sums[0];
+    for(i = 1; i < thread_n && gene_n > 0; i++) {
+        for(j = 0; j < gene_n * pair_n; j++) {
+            sum[j].hw += job.sums[i][j].hw;
+            sum[j].hb += job.sums[i][j].hb;
+            sum[j].n += job.sums[i][j].n;
+        }
+    }
+    if(block > 0)
+        estBlocks(&job, chunk_n, boot_n, seed, se, low, high);
+    if(state_name != NULL) {
+        saveState(state_name, names, gene_n > 0 ? genes->ids : NULL, tot, sum, stat, out, pop_n, gene_n, mis, maf);
+        fprintf(stderr, "Total sites = %.0f\n\n", names != NULL ? tot[pair_n].n : tot[0].n);
+    } else
+        printResults(names, gene_n > 0 ? genes->ids : NULL, tot, sum, stat, out, win, pop_n, gene_n, boot_n, se);
+
+    for(i = 0; names != NULL && i < pop_n; i++)
+        free(names[i]);
+    free(names);
+    free(pops);
+    for(i = 0; i < thread_n; i++)
+        free(job.sums[i]);
+    free(job.sums);
+    free(job.tot);
+    free(job.blocks);
+    free(se);
+    free(tot);
+    free(job.pop_l);
+    free(job.use);
+    freeChunks(chunks);
+    if(sites != NULL)
+        freeSites(sites);
+    if(genes != NULL)
+        freeFeatures(genes);
+    if(cache != NULL)
+        closeCache(cache);
+    else
+        closeBgzf(vcf_file);
+}
+
+/* Population pairs are kept in the order (0,1), (0,2), ..., (1,2), ..., so the pair loop of each site runs over contiguous memory */
+void readChunk(Chunk_s *chunk, void *arg) {
+    int i, j, pos = 0, ok = 0, pop_i = 0, pair_i = 0, sample_n = 0, *pop_l = NULL, *v = NULL;
+    double p1 = 0, p2 = 0, n1 = 0, n2 = 0, *b = NULL;
+    char *chr = NULL, *line = NULL, *use = NULL, **samples = NULL;
+    Record_s rec = {0};
+    SiteCursor_s site_c = {0};
+    FeatureCursor_s gene_c = {0};
+    Geno_s *g = NULL;
+    Hash_s hash;
+    Freq_s *freq = NULL, *f = NULL;
+    Sum_s *site = NULL, *tot = NULL;
+    Window_s w;
+    Job_s *job = arg;
+    Pop_s *pops = job->pops;
+    Sites_s *sites = job->sites;
+    Features_s *genes = job->genes;
+    Sum_s *sum = job->sums[chunk->thread];
+    char **names = job->names;
+    int stat = job->stat, out = job->out, win = job->win, ind_n = job->ind_n, pop_n = job->pop_n, pair_n = job->pair_n, gene_n = job->gene_n;
+    double mis = job->mis, maf = job->maf;
     size_t len = 0;
     ssize_t read;
 
-    while((read = getline(&line, &len, vcf_file)) != -1) {
-        if(line[0] == '\n' || (line[0] == '#' && line[1] == '#'))
-            continue;
-        temp = strtok_r(line, "\t", &end);
-        j = 1;
-        if(strcmp(temp, "#CHROM") == 0) {
-            if((pop_l = calloc(read, sizeof(int))) == NULL) {
+    if((freq = malloc(pop_n * sizeof(Freq_s))) == NULL || (site = malloc(pair_n * sizeof(Sum_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    tot = job->tot + (size_t)chunk->idx * (pair_n + 1);
+    if(win > 0)
+        initWindow(&w, chunk->out[0], win, job->step, job->unit, pop_n, pair_n);
+    sample_n = job->sample_n;
+    pop_l = job->pop_l;
+    use = job->use;
+    while((read = readSite(chunk, &line, &len, &rec)) != -1) {
+        if(read == 0 && strncmp(line, "#CHROM\t", 7) == 0) {
+            samples = parseSamples(line, &sample_n);
+            if((pop_l = calloc(sample_n + 1, sizeof(int))) == NULL || (use = calloc(sample_n + 1, sizeof(char))) == NULL) {
                 fprintf(stderr, merror);
                 exit(EXIT_FAILURE);
             }
-            while(temp != NULL) {
-                if(j > 9) {
-                    stringTerminator(temp);
-                    for(i = 0; i < pop1_n; i++) {
-                        if(strcmp(temp, pop1[i]) == 0) {
-                            pop_l[j] = 1;
-                            pop_i++;
-                        }
-                    }
-                    for(i = 0; i < pop2_n; i++) {
-                        if(strcmp(temp, pop2[i]) == 0) {
-                            pop_l[j] = 2;
-                            pop_i++;
-                        }
-                    }
+            initHash(&hash, ind_n);
+            for(i = 0; i < ind_n; i++)
+                *addHash(&hash, pops[i].ind) = i;
+            for(j = 0; j < sample_n; j++) {
+                if((v = findHash(&hash, samples[j])) != NULL) {
+                    pop_l[j] = pops[*v].idx;
+                    pop_i++;
                 }
-                temp = strtok_r(NULL, "\t", &end);
-                j++;
+                use[j] = pop_l[j] != 0;
             }
+            freeHash(&hash);
+            free(samples);
             if(pop_i == 0) {
-                fprintf(stderr, "ERROR: Individuals in -pop1 and -pop2 files were not found in the VCF file!\n\n");
+                if(names != NULL)
+                    fprintf(stderr, "ERROR: Individuals in -pops file were not found in the VCF file!\n\n");
+                else
+                    fprintf(stderr, "ERROR: Individuals in -pop1 and -pop2 files were not found in the VCF file!\n\n");
                 exit(EXIT_FAILURE);
             }
-            if(pop_i < pop1_n + pop2_n)
+            if(pop_i < ind_n && names != NULL)
+                fprintf(stderr, "Warning: -pops file contains individuals that are not in the VCF file\n\n");
+            else if(pop_i < ind_n)
                 fprintf(stderr, "Warning: -pop1 and -pop2 files contain individuals that are not in the VCF file\n\n");
+            job->sample_n = sample_n;
+            job->pop_l = pop_l;
+            job->use = use;
             continue;
         }
-        mis1_i = 0;
-        mis2_i = 0;
-        pop1_i = 0;
-        pop2_i = 0;
-        p1 = 0;
-        p2 = 0;
-        n1 = 0;
-        n2 = 0;
-        while(temp != NULL) {
-            if(j == 1)
-                strncpy(chr, temp, 99);
-            else if(j == 2) {
-                pos = atoi(temp);
-                if(site_n > 0) {
-                    ok = 0;
-                    while(site_i < site_n) {
-                        if(strcmp(chr, sites[site_i].chr) == 0) {
-                            if(pos == sites[site_i].pos) {
-                                ok = 1;
-                                break;
-                            } else if(pos < sites[site_i].pos)
-                                break;
-                        } else if(strcmp(chr, sites[site_i].chr) < 0)
-                            break;
-                        site_i++;
-                    }
-                    if(ok == 0)
-                        break;
-                }
-                if(gene_n > 0) {
-                    ok = 0;
-                    while(gene_i < gene_n) {
-                        if(strcmp(chr, genes[gene_i].chr) == 0) {
-                            if(pos <= genes[gene_i].end && pos >= genes[gene_i].start) {
-                                ok = 1;
-                                break;
-                            } else if(pos < genes[gene_i].start)
-                                break;
-                        } else if(strcmp(chr, genes[gene_i].chr) < 0)
-                            break;
-                        gene_i++;
-                    }
-                    if(ok == 0)
-                        break;
-                }
-            } else if(j > 9) {
-                if(pop_l[j] == 0) {
-                    temp = strtok_r(NULL, "\t", &end);
-                    j++;
-                    continue;
-                }
-                if(strchr(temp, ':') != NULL)
-                    strncpy(hap, strtok(temp, ":"), 49);
-                else {
-                    stringTerminator(temp);
-                    strncpy(hap, temp, 49);
-                }
-                if(hap[0] == '.') {
-                    if(pop_l[j] == 1)
-                        mis1_i++;
-                    else if(pop_l[j] == 2)
-                        mis2_i++;
-                    else {
-                        fprintf(stderr, "ERROR: Unknown population labels!\n\n");
-                        exit(EXIT_FAILURE);
-                    }
-                    temp = strtok_r(NULL, "\t", &end);
-                    j++;
-                    continue;
-                }
-                switch(strlen(hap)) {
-                    case 3:
-                        ploidy = 2;
-                        stop = 2;
-                        break;
-                    case 7:
-                        ploidy = 4;
-                        stop = 6;
-                        break;
-                    case 11:
-                        ploidy = 6;
-                        stop = 10;
-                        break;
-                    case 15:
-                        ploidy = 8;
-                        stop = 14;
-                        break;
-                    default:
-                        fprintf(stderr, "ERROR: Allowed ploidy-levels are 2, 4, 6, and 8!\n\n");
-                        exit(EXIT_FAILURE);
-                }
-                if(pop_l[j] == 1) {
-                    n1 += ploidy;
-                    pop1_i++;
-                } else if(pop_l[j] == 2) {
-                    n2 += ploidy;
-                    pop2_i++;
-                } else {
-                    fprintf(stderr, "ERROR: Unknown population labels!\n\n");
-                    exit(EXIT_FAILURE);
-                }
-                for(i = 0; i <= stop; i += 2) {
-                    if(hap[i] == '0' || hap[i] == '1') {
-                        if(pop_l[j] == 1)
-                            p1 += hap[i] - '0';
-                        else if(pop_l[j] == 2)
-                            p2 += hap[i] - '0';
-                        else {
-                            fprintf(stderr, "ERROR: Unknown population labels!\n\n");
-                            exit(EXIT_FAILURE);
-                        }
-                    } else {
-                        fprintf(stderr, "ERROR: Unknown alleles found at site %s:%i! Only 0 and 1 are allowed.\n\n", chr, pos);
-                        exit(EXIT_FAILURE);
-                    }
-                }
+        if(read == 0)
+            continue;
+        chr = rec.chr;
+        pos = rec.pos;
+        if(sites != NULL && findSite(sites, &site_c, chr, pos) == 0)
+            continue;
+        if(gene_n > 0 && findFeatures(genes, &gene_c, chr, pos) == 0)
+            continue;
+        parseGenos(&rec, use, sample_n);
+        memset(freq, 0, pop_n * sizeof(Freq_s));
+        for(i = 0; i < rec.ind_n && i < sample_n; i++) {
+            if(pop_l[i] == 0)
+                continue;
+            g = &rec.geno[i];
+            f = &freq[pop_l[i] - 1];
+            if(g->mis)
+                f->mis++;
+            else {
+                f->n += g->ploidy;
+                f->p += g->alt;
+                f->ind++;
             }
-            temp = strtok_r(NULL, "\t", &end);
-            j++;
         }
-        if(temp == NULL) {
-            if(pop1_i == 0 || pop2_i == 0)
-                continue;
-            if(pop1_i / (pop1_i + mis1_i) < mis || pop2_i / (pop2_i + mis2_i) < mis)
-                continue;
-            p1 /= n1;
-            p2 /= n2;
-            if(p1 < maf || p1 > 1 - maf || p2 < maf || p2 > 1 - maf)
+        for(i = 0; i < pop_n; i++) {
+            f = &freq[i];
+            if(f->ind == 0 || f->ind / (f->ind + f->mis) < mis)
                 continue;
-            if(stat == 0 && p1 == 0 && p2 == 0)
-                continue;
-            hw = (p1 - p2) * (p1 - p2) - p1 * (1 - p1) / (n1 - 1) - p2 * (1 - p2) / (n2 - 1);
-            hb = p1 * (1 - p2) + p2 * (1 - p1);
-            tot_hw += hw;
-            tot_hb += hb;
-            tot_n++;
-            if(gene_n == 0 && out == 0) {
-                if(stat == 1)
-                    printf("%s\t%i\t%f\n", chr, pos, hb);
-                else if(isnan(hw / hb) == 0)
-                    printf("%s\t%i\t%f\n", chr, pos, hw / hb);
-            } else if(out == 0) {
-                for(i = k; i < gene_n; i++) {
-                    if(strcmp(chr, genes[i].chr) == 0) {
-                        if(pos <= genes[i].end && pos >= genes[i].start) {
-                            genes[i].hw += hw;
-                            genes[i].hb += hb;
-                            genes[i].n++;
-                        } else if(pos < genes[i].start) {
-                            k = i;
-                            for(j = 1; j <= i; j++) {
-                                if(pos <= genes[i - j].end && pos >= genes[i - j].start)
-                                    k = i - j;
-                                else if(pos > genes[i - j].end) {
-                                    if(i - j - 1 >= 0) {
-                                        if(pos > genes[i - j - 1].end)
-                                            break;
-                                    } else
-                                        break;
-                                }
-                            }
-                            break;
-                        }
-                    } else if(strcmp(chr, genes[i].chr) < 0) {
-                        k = i;
-                        for(j = 1; j <= i; j++) {
-                            if(strcmp(chr, genes[i - j].chr) == 0) {
-                                if(pos <= genes[i - j].end && pos >= genes[i - j].start)
-                                    k = i - j;
-                                else if(pos > genes[i - j].end) {
-                                    if(i - j - 1 >= 0) {
-                                        if(pos > genes[i - j - 1].end)
-                                            break;
-                                    } else
-                                        break;
-                                }
-                            } else if(strcmp(chr, genes[i - j].chr) > 0)
-                                break;
-                        }
-                        break;
-                    }
+            f->p /= f->n;
+            f->ok = f->p >= maf && f->p <= 1 - maf;
+        }
+        ok = 0;
+        for(i = 0, pair_i = 0; i < pop_n; i++) {
+            p1 = freq[i].p;
+            n1 = freq[i].n;
+            for(j = i + 1; j < pop_n; j++, pair_i++) {
+                p2 = freq[j].p;
+                n2 = freq[j].n;
+                site[pair_i].n = freq[i].ok && freq[j].ok && (stat == 1 || win > 0 || p1 != 0 || p2 != 0);
+                site[pair_i].hw = (p1 - p2) * (p1 - p2) - p1 * (1 - p1) / (n1 - 1) - p2 * (1 - p2) / (n2 - 1);
+                site[pair_i].hb = p1 * (1 - p2) + p2 * (1 - p1);
+                ok += site[pair_i].n > 0;
+            }
+        }
+        if(win > 0)
+            addWindow(&w, chr, pos, site, freq);
+        if(ok == 0)
+            continue;
+        addSums(tot, site, pair_n);
+        tot[pair_n].n++;
+        if(job->blocks != NULL) {
+            b = addBlock(&job->blocks[chunk->idx], chr, pos);
+            for(i = 0; i < pair_n; i++) {
+                if(site[i].n > 0) {
+                    b[i * 3] += site[i].hw;
+                    b[i * 3 + 1] += site[i].hb;
+                    b[i * 3 + 2]++;
                 }
             }
         }
+        if(names == NULL && gene_n == 0 && win == 0 && out == 0) {
+            if(stat == 1)
+                fprintf(chunk->out[0], "%s\t%i\t%f\n", chr, pos, site[0].hb);
+            else if(isnan(site[0].hw / site[0].hb) == 0)
+                fprintf(chunk->out[0], "%s\t%i\t%f\n", chr, pos, site[0].hw / site[0].hb);
+        } else if(out == 0) {
+            for(i = 0; i < gene_c.n; i++)
+                addSums(sum + (size_t)gene_c.hits[i] * pair_n, site, pair_n);
+        }
     }
-    if(gene_n > 0 && out == 0) {
+
+    freeRecord(&rec);
+    free(line);
+    free(freq);
+    free(site);
+    free(gene_c.hits);
+    if(win > 0) {
+        flushWindows(&w);
+        freeWindow(&w);
+    }
+}
+
+void addSums(Sum_s *sum, const Sum_s *site, int pair_n) {
+    int i;
+    for(i = 0; i < pair_n; i++) {
+        if(site[i].n > 0) {
+            sum[i].hw += site[i].hw;
+            sum[i].hb += site[i].hb;
+            sum[i].n++;
+        }
+    }
+}
+
+/* The blocks of all chunks are merged into the first one. Fst is jackknifed as sum(hw) / sum(hb) and Dxy as
+   sum(hb) / sites, with the blocks weighted by their number of sites. The bootstrap gives the 2.5% and 97.5% quantiles
+   of the same ratio over boot_n resamplings of the blocks */
+void estBlocks(Job_s *job, int chunk_n, int boot_n, long int seed, double *se, double *low, double *high) {
+    int i, j, pair_n = job->pair_n, stat = job->stat;
+    double *tot = NULL, *reps = NULL;
+    Blocks_s *blocks = &job->blocks[0];
+
+    for(i = 1; i < chunk_n; i++) {
+        mergeBlocks(blocks, &job->blocks[i]);
+        freeBlocks(&job->blocks[i]);
+    }
+    if((tot = malloc(pair_n * 3 * sizeof(double))) == NULL || (reps = malloc(((size_t)boot_n + 1) * pair_n * sizeof(double))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    sumBlocks(blocks, tot);
+    for(i = 0; i < pair_n; i++)
+        se[i] = stat == 1 ? jackRatio(blocks, tot, i * 3 + 1, i * 3 + 2, i * 3 + 2) : jackRatio(blocks, tot, i * 3, i * 3 + 1, i * 3 + 2);
+    if(boot_n > 0) {
+        if(seed == 0) {
+            seed = (long int)time(NULL);
+            fprintf(stderr, "Seed number used for bootstrap: %ld\n\n", seed);
+        }
+        for(i = 0; i < boot_n; i++) {
+            bootBlocks(blocks, seed, i, tot);
+            for(j = 0; j < pair_n; j++)
+                reps[(size_t)j * boot_n + i] = stat == 1 ? tot[j * 3 + 1] / tot[j * 3 + 2] : tot[j * 3] / tot[j * 3 + 1];
+        }
+        for(j = 0; j < pair_n; j++) {
+            low[j] = getQuantile(reps + (size_t)j * boot_n, boot_n, 0.025);
+            high[j] = getQuantile(reps + (size_t)j * boot_n, boot_n, 0.975);
+        }
+    }
+    freeBlocks(blocks);
+    free(tot);
+    free(reps);
+}
+
+void printResults(char **names, char **ids, const Sum_s *tot, const Sum_s *sum, int stat, int out, int win, int pop_n, int gene_n, int boot_n, const double *se) {
+    int i, pair_n = pop_n * (pop_n - 1) / 2;
+    const double *low = se != NULL ? se + pair_n : NULL, *high = se != NULL ? se + pair_n * 2 : NULL;
+
+    if(names != NULL && win == 0) {
+        if(gene_n > 0 && out == 0) {
+            for(i = 0; i < gene_n; i++)
+                printMatrix(stdout, ids[i], names, sum + (size_t)i * pair_n, pop_n, stat);
+        } else {
+            printMatrix(stdout, "pop", names, tot, pop_n, stat);
+            if(se != NULL)
+                printValues(stdout, "se", names, se, pop_n);
+            if(boot_n > 0) {
+                printValues(stdout, "ci_low", names, low, pop_n);
+                printValues(stdout, "ci_high", names, high, pop_n);
+            }
+        }
+    } else if(gene_n > 0 && out == 0) {
         for(i = 0; i < gene_n; i++) {
-            printf("%s\t", genes[i].id);
+            printf("%s\t", ids[i]);
             if(stat == 1)
-                printf("%f\t%0.f\n", genes[i].hb / genes[i].n, genes[i].n);
+                printf("%f\t%0.f\n", sum[i].hb / sum[i].n, sum[i].n);
             else
-                printf("%f\t%.0f\n", genes[i].hw / genes[i].hb, genes[i].n);
+                printf("%f\t%.0f\n", sum[i].hw / sum[i].hb, sum[i].n);
         }
     } else if(out == 1) {
         if(stat == 1)
-            printf("%f\n", tot_hb / tot_n);
+            printf("%f", tot[0].hb / tot[0].n);
         else
-            printf("%f\n", tot_hw / tot_hb);
+            printf("%f", tot[0].hw / tot[0].hb);
+        if(se != NULL)
+            printf("\t%f", se[0]);
+        if(boot_n > 0)
+            printf("\t%f\t%f", low[0], high[0]);
+        printf("\n");
     }
 
     if(isatty(1))
         fprintf(stderr, "\n");
-    if(stat == 1)
-        fprintf(stderr, "Average Dxy = %f\nTotal sites = %.0f\n", tot_hb / tot_n, tot_n);
-    else
-        fprintf(stderr, "Average weighted Fst = %f\nTotal sites = %.0f\n\n", tot_hw / tot_hb, tot_n);
+    if(names != NULL)
+        fprintf(stderr, "Population pairs = %i\nTotal sites = %.0f\n\n", pair_n, tot[pair_n].n);
+    else {
+        if(stat == 1)
+            fprintf(stderr, "Average Dxy = %f\n", tot[0].hb / tot[0].n);
+        else
+            fprintf(stderr, "Average weighted Fst = %f\n", tot[0].hw / tot[0].hb);
+        if(se != NULL)
+            fprintf(stderr, "Block-jackknife SE = %f\n", se[0]);
+        if(boot_n > 0)
+            fprintf(stderr, "Bootstrap 95%% CI = %f - %f\n", low[0], high[0]);
+        fprintf(stderr, stat == 1 ? "Total sites = %.0f\n" : "Total sites = %.0f\n\n", tot[0].n);
+    }
+}
 
-    for(i = 0; i < pop1_n; i++)
-        free(pop1[i]);
-    free(pop1);
-    for(i = 0; i < pop2_n; i++)
-        free(pop2[i]);
-    free(pop2);
-    free(pop_l);
-    if(site_n > 0)
-        free(sites);
-    if(gene_n > 0)
-        free(genes);
-    free(line);
-    fclose(vcf_file);
+/* The state holds the settings, the population names and gene ids, the genome-wide sums and the sums of each gene. The
+   window and jackknife sums depend on the order of the sites across chunks, so they are not kept */
+void saveState(const char *name, char **names, char **ids, const Sum_s *tot, const Sum_s *sum, int stat, int out, int pop_n, int gene_n, double mis, double maf) {
+    long int i, k = 0, pair_n = pop_n * (pop_n - 1) / 2, ints[7] = {stat, out, pop_n, gene_n, names != NULL, lround(mis * 1e6), lround(maf * 1e6)};
+    State_s state = {7, (names != NULL ? pop_n : 0) + gene_n, (pair_n + 1 + (long int)gene_n * pair_n) * 3, ints, NULL, NULL};
+    const Sum_s *v = NULL;
+
+    if((state.strs = malloc((state.str_n + 1) * sizeof(char *))) == NULL || (state.vals = malloc(state.val_n * sizeof(double))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; names != NULL && i < pop_n; i++)
+        state.strs[k++] = names[i];
+    for(i = 0; i < gene_n; i++)
+        state.strs[k++] = ids[i];
+    for(i = 0; i < pair_n + 1 + (long int)gene_n * pair_n; i++) {
+        v = i <= pair_n ? &tot[i] : &sum[i - pair_n - 1];
+        state.vals[i * 3] = v->hw;
+        state.vals[i * 3 + 1] = v->hb;
+        state.vals[i * 3 + 2] = v->n;
+    }
+    writeState(name, "POLYFST1", &state);
+    free(state.strs);
+    free(state.vals);
+}
+
+void mergeStates(FILE *merge_file) {
+    int pop_n = 0, gene_n = 0, pair_n = 0;
+    long int i;
+    char **names = NULL;
+    Sum_s *tot = NULL;
+    State_s state;
+
+    if(readStates(merge_file, "POLYFST1", &state) == 0) {
+        fprintf(stderr, "ERROR: -merge file does not list any state files!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(state.int_n == 7) {
+        pop_n = state.ints[2];
+        gene_n = state.ints[3];
+        pair_n = pop_n * (pop_n - 1) / 2;
+        names = state.ints[4] ? state.strs : NULL;
+    }
+    if(state.int_n != 7 || pop_n < 2 || state.str_n != (names != NULL ? pop_n : 0) + gene_n || state.val_n != (pair_n + 1 + (long int)gene_n * pair_n) * 3) {
+        fprintf(stderr, "ERROR: -merge file lists state files that were not written by this version of poly_fst!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if((tot = malloc(state.val_n / 3 * sizeof(Sum_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < state.val_n / 3; i++) {
+        tot[i].hw = state.vals[i * 3];
+        tot[i].hb = state.vals[i * 3 + 1];
+        tot[i].n = state.vals[i * 3 + 2];
+    }
+    printResults(names, state.strs + (names != NULL ? pop_n : 0), tot, tot + pair_n + 1, state.ints[0], state.ints[1], 0, pop_n, gene_n, 0, NULL);
+
+    free(tot);
+    freeState(&state);
+}
+
+void initWindow(Window_s *w, FILE *out, int size, int step, int unit, int pop_n, int pair_n) {
+    int i, a = size, b = step, c = 0;
+
+    while(b > 0) {
+        c = a % b;
+        a = b;
+        b = c;
+    }
+    memset(w, 0, sizeof(Window_s));
+    w->size = size;
+    w->step = step;
+    w->unit = unit;
+    w->pop_n = pop_n;
+    w->pair_n = pair_n;
+    w->bin_n = size / a;
+    w->gap = step / a;
+    w->field_n = pair_n * 3 + pop_n * 5;
+    w->out = out;
+    if((w->bins = calloc(w->bin_n, sizeof(Bin_s))) == NULL || (w->tot = calloc((size_t)w->field_n * (w->bin_n + 2), sizeof(double))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    w->vals = w->tot + w->field_n;
+    for(i = 0; i < w->bin_n; i++) {
+        w->bins[i].bin = -1;
+        w->bins[i].sums = w->tot + (size_t)(i + 2) * w->field_n;
+    }
+}
+
+/* Sites are added to bins of gcd(size, step) bp or sites, kept in a ring that holds one window. The running totals of the
+   window are updated as bins enter and leave it, so each site is added once and removed once however much windows overlap.
+   The fields of a bin are hw, hb and sites for each pair, followed by sites, pi, segregating sites, theta and haplotypes for
+   each population */
+void addWindow(Window_s *w, const char *chr, int pos, const Sum_s *site, const Freq_s *freq) {
+    int i, n, ok = 0;
+    long int b, k;
+    double *vals = w->vals, p;
+    Bin_s *bin = NULL;
+
+    for(i = 0; i < w->pop_n; i++)
+        ok += freq[i].ok;
+    if(ok == 0)
+        return;
+    if(strcmp(w->chr, chr) != 0) {
+        flushWindows(w);
+        strncpy(w->chr, chr, 99);
+        w->next = 0;
+        w->snp_i = 0;
+    }
+    b = w->unit == 0 ? (pos - 1) / (w->size / w->bin_n) : w->snp_i++ / (w->size / w->bin_n);
+    while(w->site_n > 0 && w->next * w->gap + w->bin_n - 1 < b) {
+        printWindow(w);
+        for(k = 0; k < w->gap && k < w->bin_n; k++)
+            dropBin(w, w->next * w->gap + k);
+        w->next++;
+    }
+    if(w->site_n == 0) {
+        k = b - w->bin_n + 1 > 0 ? (b - w->bin_n + w->gap) / w->gap : 0;
+        if(k > w->next)
+            w->next = k;
+    }
+    if(b < w->next * w->gap)
+        return;
+    for(i = 0; i < w->pair_n; i++) {
+        vals[i * 3] = site[i].n > 0 ? site[i].hw : 0;
+        vals[i * 3 + 1] = site[i].n > 0 ? site[i].hb : 0;
+        vals[i * 3 + 2] = site[i].n > 0;
+    }
+    for(i = 0; i < w->pop_n; i++) {
+        memset(vals + w->pair_n * 3 + i * 5, 0, 5 * sizeof(double));
+        if(freq[i].ok == 0)
+            continue;
+        p = freq[i].p;
+        n = freq[i].n;
+        if(n > w->harm_n) {
+            if((w->harm = realloc(w->harm, (n + 1) * sizeof(double))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+            for(k = w->harm_n > 0 ? w->harm_n + 1 : 1; k <= n; k++)
+                w->harm[k] = (k > 1 ? w->harm[k - 1] : 0) + (k > 1 ? 1.0 / (k - 1) : 0);
+            w->harm_n = n;
+        }
+        vals[w->pair_n * 3 + i * 5] = 1;
+        vals[w->pair_n * 3 + i * 5 + 1] = 2 * p * (1 - p) * n / (n - 1);
+        vals[w->pair_n * 3 + i * 5 + 2] = p > 0 && p < 1;
+        vals[w->pair_n * 3 + i * 5 + 3] = p > 0 && p < 1 ? 1 / w->harm[n] : 0;
+        vals[w->pair_n * 3 + i * 5 + 4] = n;
+    }
+    bin = &w->bins[b % w->bin_n];
+    if(bin->bin != b) {
+        bin->bin = b;
+        bin->first = pos;
+    }
+    bin->last = pos;
+    bin->site_n++;
+    w->site_n++;
+    for(i = 0; i < w->field_n; i++) {
+        bin->sums[i] += vals[i];
+        w->tot[i] += vals[i];
+    }
+}
+
+void dropBin(Window_s *w, long int bin) {
+    int i;
+    Bin_s *b = &w->bins[bin % w->bin_n];
+
+    if(b->bin != bin)
+        return;
+    for(i = 0; i < w->field_n; i++)
+        w->tot[i] -= b->sums[i];
+    w->site_n -= b->site_n;
+    if(w->site_n == 0)
+        memset(w->tot, 0, w->field_n * sizeof(double));
+    memset(b->sums, 0, w->field_n * sizeof(double));
+    b->bin = -1;
+    b->site_n = 0;
+}
+
+void flushWindows(Window_s *w) {
+    long int k;
+    while(w->site_n > 0) {
+        printWindow(w);
+        for(k = 0; k < w->gap && k < w->bin_n; k++)
+            dropBin(w, w->next * w->gap + k);
+        w->next++;
+    }
+}
+
+/* Tajima's D uses the mean number of haplotypes of the sites in the window as the sample size */
+void printWindow(Window_s *w) {
+    int i, j, n;
+    long int start = 0, end = 0, k;
+    double a1, a2, b1, b2, c1, c2, e1, e2, pi, seg, sites, d;
+    const double *t = w->tot;
+    const Bin_s *b = NULL;
+
+    if(w->unit == 0) {
+        start = w->next * w->step + 1;
+        end = w->next * w->step + w->size;
+    } else {
+        for(k = 0; k < w->bin_n; k++) {
+            b = &w->bins[(w->next * w->gap + k) % w->bin_n];
+            if(b->bin != w->next * w->gap + k)
+                continue;
+            if(start == 0)
+                start = b->first;
+            end = b->last;
+        }
+    }
+    fprintf(w->out, "%s\t%li\t%li\t%i", w->chr, start, end, w->site_n);
+    for(i = 0; i < w->pair_n; i++, t += 3) {
+        if(t[1] > 0)
+            fprintf(w->out, "\t%f", t[0] / t[1]);
+        else
+            fprintf(w->out, "\tNA");
+        if(t[2] > 0)
+            fprintf(w->out, "\t%f", t[1] / t[2]);
+        else
+            fprintf(w->out, "\tNA");
+    }
+    for(i = 0; i < w->pop_n; i++, t += 5) {
+        sites = t[0];
+        pi = t[1];
+        seg = t[2];
+        if(sites == 0) {
+            fprintf(w->out, "\tNA\tNA\tNA");
+            continue;
+        }
+        fprintf(w->out, "\t%f\t%f", pi / sites, t[3] / sites);
+        n = (int)(t[4] / sites + 0.5);
+        if(seg == 0 || n < 2) {
+            fprintf(w->out, "\tNA");
+            continue;
+        }
+        for(j = 1, a1 = 0, a2 = 0; j < n; j++) {
+            a1 += 1.0 / j;
+            a2 += 1.0 / ((double)j * j);
+        }
+        b1 = (n + 1.0) / (3.0 * (n - 1));
+        b2 = 2.0 * ((double)n * n + n + 3) / (9.0 * n * (n - 1));
+        c1 = b1 - 1 / a1;
+        c2 = b2 - (n + 2.0) / (a1 * n) + a2 / (a1 * a1);
+        e1 = c1 / a1;
+        e2 = c2 / (a1 * a1 + a2);
+        d = (pi - seg / a1) / sqrt(e1 * seg + e2 * seg * (seg - 1));
+        fprintf(w->out, "\t%f", d);
+    }
+    fprintf(w->out, "\n");
+}
+
+void printHeader(char **names, int pop_n) {
+    int i, j;
+    char name1[20], name2[20];
+
+    printf("chr\tstart\tend\tsites");
+    for(i = 0; i < pop_n; i++) {
+        for(j = i + 1; j < pop_n; j++) {
+            snprintf(name1, sizeof(name1), "pop%i", i + 1);
+            snprintf(name2, sizeof(name2), "pop%i", j + 1);
+            printf("\tfst_%s_%s\tdxy_%s_%s", names != NULL ? names[i] : name1, names != NULL ? names[j] : name2, names != NULL ? names[i] : name1, names != NULL ? names[j] : name2);
+        }
+    }
+    for(i = 0; i < pop_n; i++) {
+        snprintf(name1, sizeof(name1), "pop%i", i + 1);
+        printf("\tpi_%s\ttheta_%s\ttajima_%s", names != NULL ? names[i] : name1, names != NULL ? names[i] : name1, names != NULL ? names[i] : name1);
+    }
+    printf("\n");
+}
+
+void freeWindow(Window_s *w) {
+    free(w->bins);
+    free(w->tot);
+    free(w->harm);
 }
 
 int isNumeric(const char *s) {
@@ -600,15 +1145,29 @@ void stringTerminator(char *string) {
 void printHelp(void) {
     fprintf(stderr, "\nProgram for estimating pairwise Fst and Dxy from mixed ploidy VCF files.\n\n");
     fprintf(stderr, "Usage:\n");
-    fprintf(stderr, "-vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8.\n");
+    fprintf(stderr, "-vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8. Can be bgzip-compressed or a BCF file.\n");
+    fprintf(stderr, "-cache [file] Binary genotype cache. With -vcf, the VCF file is first converted into this file; without it, an existing cache is read instead of a VCF file. Optional.\n");
     fprintf(stderr, "-pop1 [file] File listing individuals from population 1.\n");
     fprintf(stderr, "-pop2 [file] File listing individuals from population 2.\n");
+    fprintf(stderr, "-pops [file] Tab delimited file listing individuals and their populations (format: individual id, population id). Used instead of -pop1 and -pop2 to estimate Fst/Dxy between all population pairs in one pass. Output will be a matrix, or one matrix for each gene with -genes.\n");
     fprintf(stderr, "-sites [file] Tab delimited file listing sites to use (format: chr, pos). Optional.\n");
     fprintf(stderr, "-genes [file] Tab delimited file listing genes to use (format: chr, start, end, id). Output will be Fst/Dxy calculated for each gene. Optional.\n");
     fprintf(stderr, "-mis [double] Excludes sites based of the proportion of missing data (0 = all missing allowed, 1 = no missing data allowed). Default > 0.\n");
     fprintf(stderr, "-maf [double] Minimum minor allele frequency allowed. Default 0.\n");
     fprintf(stderr, "-stat [string] Whether to calculate 'fst' or 'dxy'. Default 'fst'. Note that dxy requires invariant sites to be included in the VCF file.\n");
-    fprintf(stderr, "-out [int] Whether to print full output (0) or genome-wide estimate only (1). Default 0.\n\n");
+    fprintf(stderr, "-out [int] Whether to print full output (0) or genome-wide estimate only (1). Default 0.\n");
+    fprintf(stderr, "-window [int] [int] Output will be Fst, Dxy, pi, Watterson's theta and Tajima's D calculated in sliding windows of the given size and step, for each population pair and population. Used instead of -genes and -stat. Optional.\n");
+    fprintf(stderr, "-wtype [string] Whether -window is given in base pairs ('bp') or in number of sites ('snp'). Default 'bp'.\n");
+    fprintf(stderr, "-jackknife [int] Also estimates the block-jackknife standard error of the genome-wide Fst/Dxy, using blocks of the given number of base pairs. Optional.\n");
+    fprintf(stderr, "-bootstrap [int] Also estimates a 95%% confidence interval of the genome-wide Fst/Dxy from the given number of bootstrap replicates of the -jackknife blocks. Optional.\n");
+    fprintf(stderr, "-seed [int] Seed number used for -bootstrap. Default is a random seed.\n");
+    fprintf(stderr, "-region [chr:start-end] Only uses sites within the region (for example chr1:1000-2000 or chr1). Uses the .tbi or .csi index of a bgzip-compressed VCF file to read only that part of the file. Optional.\n");
+    fprintf(stderr, "-threads [int] Number of threads used for processing parts of chromosomes in parallel. A pipe or a gzip file is read as one part, with its lines parsed on the threads. Default 1.\n");
+    fprintf(stderr, "-state [file] Writes the sums of the run into a binary state file instead of printing the output, for example for one chromosome of a cluster run given with -region. Cannot be used with -window, -jackknife or the per-site output of -pop1 and -pop2. Optional.\n");
+    fprintf(stderr, "-merge [file] File listing state files written with -state (one per line). Sums the states and prints the output of the whole run. Used instead of all other options, which are taken from the state files. Optional.\n\n");
     fprintf(stderr, "Example:\n");
-    fprintf(stderr, "./poly_fst -vcf in.vcf -pop1 pop1.txt -pop2 pop2.txt -sites 4fold.sites -genes genes.txt -mis 0.8 -stat dxy > out_gene.dxy\n\n");
+    fprintf(stderr, "./poly_fst -vcf in.vcf -pop1 pop1.txt -pop2 pop2.txt -sites 4fold.sites -genes genes.txt -mis 0.8 -stat dxy > out_gene.dxy\n");
+    fprintf(stderr, "./poly_fst -vcf in.vcf -pops pops.txt -mis 0.8 -window 50000 10000 > out_windows.txt\n");
+    fprintf(stderr, "./poly_fst -vcf in.vcf.gz -pops pops.txt -mis 0.8 -region chr1 -state chr1.state\n");
+    fprintf(stderr, "./poly_fst -merge states.txt > out.fst\n\n");
 }
\ No newline at end of file
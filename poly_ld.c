@@ -0,0 +1,470 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Genotype storage and r2 estimation for LD-pruning. See poly_ld.h.
+
+ The kernels sum g1, g2, g1*g2, g1^2 and g2^2 over individuals genotyped at both SNPs. Dosages are
+ zeroed wherever either SNP holds the missing value, so the sums need no branches, and the number of
+ individuals used comes from the popcount of the two bitmasks. The kernel is chosen once at start-up,
+ before any worker threads are created.
+
+ maxR2 bounds the sum of g1*g2 from the number of individuals with a dosage of at least t at each SNP (c1(t)
+ and c2(t)). As g1*g2 is the sum of [g1 >= t][g2 >= u] over t and u, the sum is at most the sum of min(c1(t), c2(u))
+ and at least the sum of max(0, c1(t) + c2(u) - n), both reached by sorting the individuals. For haploid 0/1 data
+ this is the usual bound of r2 from the two allele frequencies. Rows with missing genotypes are not bounded (1 is
+ returned), as the sums of a pair then depend on which individuals are called at both SNPs.
+
+ estR2Tile takes the sums of a pair from the sums of each row, corrected for the individuals missing at the other
+ row: the sum of g1 over the individuals called at both SNPs is the sum of row 1 minus its dosages at the missing
+ genotypes of row 2, and so on. Only the sum of g1*g2 needs both rows, and the kernel gives it for blocks of 2 x 4
+ pairs, so that every load of a row is used for several pairs. The corrections read the interleaved copy of the
+ tiles (cols), where the g, g^2 and called flag of one individual at the LD_TILE rows of a tile are adjacent, so a
+ missing genotype of a row corrects its pairs with the whole other tile at once. Rows with more than mis_max missing
+ genotypes (1/8 of the individuals) keep no list, and their pairs are left to estR2. Rows of records shorter than the
+ header are filled with missing values, so that both functions leave the individuals without a genotype out of the sums.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "poly_ld.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+#define merror "\nERROR: System out of memory\n\n"
+
+static void (*sumKernel)(const unsigned char *p1, const unsigned char *p2, int bytes, long int *sums) = NULL;
+
+static void (*tileKernel)(const unsigned char **a, const unsigned char **b, int na, int nb, int bytes, int32_t *prod) = NULL;
+
+static void sumScalar(const unsigned char *p1, const unsigned char *p2, int bytes, long int *sums) {
+    int i, k;
+    unsigned int g1, g2, v;
+    for(i = 0; i < bytes; i++) {
+        for(k = 0; k < 8; k += 4) {
+            g1 = (p1[i] >> k) & 15;
+            g2 = (p2[i] >> k) & 15;
+            v = (g1 != DOSE_MIS) & (g2 != DOSE_MIS);
+            g1 *= v;
+            g2 *= v;
+            sums[0] += g1;
+            sums[1] += g2;
+            sums[2] += g1 * g2;
+            sums[3] += g1 * g1;
+            sums[4] += g2 * g2;
+        }
+    }
+}
+
+static void tileScalar(const unsigned char **a, const unsigned char **b, int na, int nb, int bytes, int32_t *prod) {
+    int i, j, k;
+    int32_t v;
+    for(i = 0; i < na; i++) {
+        for(j = 0; j < nb; j++) {
+            v = 0;
+            for(k = 0; k < bytes; k++)
+                v += a[i][k] * b[j][k];
+            prod[i * LD_TILE + j] += v;
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* na is rounded up to 2 and nb to 4 by repeating the last row, and the extra products are ignored by estR2Tile */
+__attribute__((target("avx2"))) static void tileAvx2(const unsigned char **a, const unsigned char **b, int na, int nb, int bytes, int32_t *prod) {
+    int i, j, k, l;
+    const unsigned char *pa[2], *pb[4];
+    __m256i x0, x1, y, s[8], one = _mm256_set1_epi16(1);
+    __m128i v;
+    for(i = 0; i < na; i += 2) {
+        pa[0] = a[i];
+        pa[1] = a[i + 1 < na ? i + 1 : i];
+        for(j = 0; j < nb; j += 4) {
+            for(l = 0; l < 4; l++)
+                pb[l] = b[j + l < nb ? j + l : nb - 1];
+            for(l = 0; l < 8; l++)
+                s[l] = _mm256_setzero_si256();
+            for(k = 0; k < bytes; k += 32) {
+                x0 = _mm256_loadu_si256((const __m256i *)(pa[0] + k));
+                x1 = _mm256_loadu_si256((const __m256i *)(pa[1] + k));
+                for(l = 0; l < 4; l++) {
+                    y = _mm256_loadu_si256((const __m256i *)(pb[l] + k));
+                    s[l] = _mm256_add_epi32(s[l], _mm256_madd_epi16(_mm256_maddubs_epi16(x0, y), one));
+                    s[l + 4] = _mm256_add_epi32(s[l + 4], _mm256_madd_epi16(_mm256_maddubs_epi16(x1, y), one));
+                }
+            }
+            for(l = 0; l < 2; l++) {
+                x0 = _mm256_hadd_epi32(_mm256_hadd_epi32(s[l * 4], s[l * 4 + 1]), _mm256_hadd_epi32(s[l * 4 + 2], s[l * 4 + 3]));
+                v = _mm_add_epi32(_mm256_castsi256_si128(x0), _mm256_extracti128_si256(x0, 1));
+                v = _mm_add_epi32(v, _mm_loadu_si128((const __m128i *)(prod + (i + l) * LD_TILE + j)));
+                _mm_storeu_si128((__m128i *)(prod + (i + l) * LD_TILE + j), v);
+            }
+        }
+    }
+}
+
+__attribute__((target("avx2"))) static void sumAvx2(const unsigned char *p1, const unsigned char *p2, int bytes, long int *sums) {
+    int i, k;
+    long long int t[4];
+    int u[8];
+    __m256i x1, x2, g1, g2, v, lo = _mm256_set1_epi8(15), zero = _mm256_setzero_si256(), one = _mm256_set1_epi16(1);
+    __m256i s1 = zero, s2 = zero, s12 = zero, q1 = zero, q2 = zero;
+    for(i = 0; i < bytes; i += 32) {
+        x1 = _mm256_loadu_si256((const __m256i *)(p1 + i));
+        x2 = _mm256_loadu_si256((const __m256i *)(p2 + i));
+        for(k = 0; k < 2; k++) {
+            g1 = _mm256_and_si256(x1, lo);
+            g2 = _mm256_and_si256(x2, lo);
+            v = _mm256_or_si256(_mm256_cmpeq_epi8(g1, lo), _mm256_cmpeq_epi8(g2, lo));
+            g1 = _mm256_andnot_si256(v, g1);
+            g2 = _mm256_andnot_si256(v, g2);
+            s1 = _mm256_add_epi64(s1, _mm256_sad_epu8(g1, zero));
+            s2 = _mm256_add_epi64(s2, _mm256_sad_epu8(g2, zero));
+            s12 = _mm256_add_epi32(s12, _mm256_madd_epi16(_mm256_maddubs_epi16(g1, g2), one));
+            q1 = _mm256_add_epi32(q1, _mm256_madd_epi16(_mm256_maddubs_epi16(g1, g1), one));
+            q2 = _mm256_add_epi32(q2, _mm256_madd_epi16(_mm256_maddubs_epi16(g2, g2), one));
+            x1 = _mm256_srli_epi16(x1, 4);
+            x2 = _mm256_srli_epi16(x2, 4);
+        }
+    }
+    _mm256_storeu_si256((__m256i *)t, s1);
+    sums[0] += t[0] + t[1] + t[2] + t[3];
+    _mm256_storeu_si256((__m256i *)t, s2);
+    sums[1] += t[0] + t[1] + t[2] + t[3];
+    _mm256_storeu_si256((__m256i *)u, s12);
+    for(k = 0; k < 8; k++)
+        sums[2] += u[k];
+    _mm256_storeu_si256((__m256i *)u, q1);
+    for(k = 0; k < 8; k++)
+        sums[3] += u[k];
+    _mm256_storeu_si256((__m256i *)u, q2);
+    for(k = 0; k < 8; k++)
+        sums[4] += u[k];
+}
+
+__attribute__((target("avx512f,avx512bw"))) static void sumAvx512(const unsigned char *p1, const unsigned char *p2, int bytes, long int *sums) {
+    int i, k;
+    __mmask64 v;
+    __m512i x1, x2, g1, g2, lo = _mm512_set1_epi8(15), zero = _mm512_setzero_si512(), one = _mm512_set1_epi16(1);
+    __m512i s1 = zero, s2 = zero, s12 = zero, q1 = zero, q2 = zero;
+    for(i = 0; i < bytes; i += 64) {
+        x1 = _mm512_loadu_si512((const void *)(p1 + i));
+        x2 = _mm512_loadu_si512((const void *)(p2 + i));
+        for(k = 0; k < 2; k++) {
+            g1 = _mm512_and_si512(x1, lo);
+            g2 = _mm512_and_si512(x2, lo);
+            v = _mm512_cmpneq_epi8_mask(g1, lo) & _mm512_cmpneq_epi8_mask(g2, lo);
+            g1 = _mm512_maskz_mov_epi8(v, g1);
+            g2 = _mm512_maskz_mov_epi8(v, g2);
+            s1 = _mm512_add_epi64(s1, _mm512_sad_epu8(g1, zero));
+            s2 = _mm512_add_epi64(s2, _mm512_sad_epu8(g2, zero));
+            s12 = _mm512_add_epi32(s12, _mm512_madd_epi16(_mm512_maddubs_epi16(g1, g2), one));
+            q1 = _mm512_add_epi32(q1, _mm512_madd_epi16(_mm512_maddubs_epi16(g1, g1), one));
+            q2 = _mm512_add_epi32(q2, _mm512_madd_epi16(_mm512_maddubs_epi16(g2, g2), one));
+            x1 = _mm512_srli_epi16(x1, 4);
+            x2 = _mm512_srli_epi16(x2, 4);
+        }
+    }
+    sums[0] += _mm512_reduce_add_epi64(s1);
+    sums[1] += _mm512_reduce_add_epi64(s2);
+    sums[2] += _mm512_reduce_add_epi32(s12);
+    sums[3] += _mm512_reduce_add_epi32(q1);
+    sums[4] += _mm512_reduce_add_epi32(q2);
+}
+#elif defined(__aarch64__)
+static void sumNeon(const unsigned char *p1, const unsigned char *p2, int bytes, long int *sums) {
+    int i, k;
+    uint8x16_t x1, x2, g1, g2, v, lo = vdupq_n_u8(15);
+    uint32x4_t s1 = vdupq_n_u32(0), s2 = s1, s12 = s1, q1 = s1, q2 = s1;
+    for(i = 0; i < bytes; i += 16) {
+        x1 = vld1q_u8(p1 + i);
+        x2 = vld1q_u8(p2 + i);
+        for(k = 0; k < 2; k++) {
+            g1 = k == 0 ? vandq_u8(x1, lo) : vshrq_n_u8(x1, 4);
+            g2 = k == 0 ? vandq_u8(x2, lo) : vshrq_n_u8(x2, 4);
+            v = vorrq_u8(vceqq_u8(g1, lo), vceqq_u8(g2, lo));
+            g1 = vbicq_u8(g1, v);
+            g2 = vbicq_u8(g2, v);
+            s1 = vpadalq_u16(s1, vpaddlq_u8(g1));
+            s2 = vpadalq_u16(s2, vpaddlq_u8(g2));
+            s12 = vpadalq_u16(s12, vmull_u8(vget_low_u8(g1), vget_low_u8(g2)));
+            s12 = vpadalq_u16(s12, vmull_high_u8(g1, g2));
+            q1 = vpadalq_u16(q1, vmull_u8(vget_low_u8(g1), vget_low_u8(g1)));
+            q1 = vpadalq_u16(q1, vmull_high_u8(g1, g1));
+            q2 = vpadalq_u16(q2, vmull_u8(vget_low_u8(g2), vget_low_u8(g2)));
+            q2 = vpadalq_u16(q2, vmull_high_u8(g2, g2));
+        }
+    }
+    sums[0] += vaddvq_u32(s1);
+    sums[1] += vaddvq_u32(s2);
+    sums[2] += vaddvq_u32(s12);
+    sums[3] += vaddvq_u32(q1);
+    sums[4] += vaddvq_u32(q2);
+}
+#endif
+
+__attribute__((constructor)) static void pickKernel(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512bw"))
+        sumKernel = sumAvx512;
+    else if(__builtin_cpu_supports("avx2"))
+        sumKernel = sumAvx2;
+    else
+        sumKernel = sumScalar;
+    tileKernel = __builtin_cpu_supports("avx2") ? tileAvx2 : tileScalar;
+#elif defined(__aarch64__)
+    sumKernel = sumNeon;
+    tileKernel = tileScalar;
+#else
+    sumKernel = sumScalar;
+    tileKernel = tileScalar;
+#endif
+}
+
+void initDosages(Dosage_s *m, int row_n, int ind_n) {
+    m->row_n = row_n;
+    m->ind_n = ind_n;
+    m->stride = ((ind_n + 1) / 2 + 63) & ~63;
+    m->mask_n = m->stride / 32;
+    m->tile_len = 0;
+    m->mis_max = 0;
+    m->mis = NULL;
+    m->tile = NULL;
+    m->cols = NULL;
+    m->prod = NULL;
+    if((m->dose = calloc((size_t)row_n * m->stride, sizeof(unsigned char))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    if((m->mask = calloc((size_t)row_n * m->mask_n, sizeof(uint64_t))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    if((m->hist = calloc(row_n, sizeof(DoseHist_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Must be called before the rows are packed. The number of rows must be a multiple of LD_TILE */
+void initTiles(Dosage_s *m) {
+    m->tile_len = (m->ind_n + 31) & ~31;
+    m->mis_max = m->tile_len / 8;
+    if((m->tile = calloc((size_t)m->row_n * m->tile_len, sizeof(unsigned char))) == NULL || (m->cols = calloc((size_t)m->row_n * m->tile_len * 3, sizeof(unsigned char))) == NULL || (m->mis = malloc((size_t)m->row_n * m->mis_max * sizeof(int))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    if((m->prod = malloc(LD_TILE * LD_TILE * sizeof(int32_t))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+}
+
+void clearDosages(Dosage_s *m, int row) {
+    memset(m->dose + (size_t)row * m->stride, 0, m->stride);
+    memset(m->mask + (size_t)row * m->mask_n, 0, m->mask_n * sizeof(uint64_t));
+    memset(&m->hist[row], 0, sizeof(DoseHist_s));
+}
+
+int packDosages(Dosage_s *m, int row, const Geno_s *geno, const char *use, int n) {
+    int i, k = 0, d, mis_n = 0;
+    unsigned char *p = m->dose + (size_t)row * m->stride, *t = m->tile != NULL ? m->tile + (size_t)row * m->tile_len : NULL, *c = NULL;
+    int *mis = m->mis != NULL ? m->mis + (size_t)row * m->mis_max : NULL;
+    uint64_t *b = m->mask + (size_t)row * m->mask_n;
+    int bin[DOSE_MIS + 1] = {0};
+    long int sq = 0;
+    DoseHist_s *h = &m->hist[row];
+
+    clearDosages(m, row);
+    for(i = 0; i < n && k < m->ind_n; i++) {
+        if(use != NULL && use[i] == 0)
+            continue;
+        if(geno[i].mis)
+            d = DOSE_MIS;
+        else {
+            d = geno[i].alt;
+            b[k >> 6] |= (uint64_t)1 << (k & 63);
+        }
+        p[k >> 1] |= d << ((k & 1) << 2);
+        bin[d]++;
+        if(t != NULL)
+            t[k] = d == DOSE_MIS ? 0 : d;
+        if(t != NULL && d == DOSE_MIS && mis_n < m->mis_max)
+            mis[mis_n++] = k;
+        k++;
+    }
+    for(i = k; i < m->ind_n; i++) {
+        p[i >> 1] |= DOSE_MIS << ((i & 1) << 2);
+        if(t != NULL)
+            t[i] = 0;
+        if(t != NULL && mis_n < m->mis_max)
+            mis[mis_n++] = i;
+    }
+    if(t != NULL) {
+        c = m->cols + (size_t)(row / LD_TILE) * m->tile_len * 3 * LD_TILE + row % LD_TILE;
+        for(i = 0; i < m->ind_n; i++, c += 3 * LD_TILE) {
+            c[0] = t[i];
+            c[LD_TILE] = t[i] * t[i];
+            c[2 * LD_TILE] = (b[i >> 6] >> (i & 63)) & 1;
+        }
+    }
+    for(d = DOSE_MIS - 1; d >= 0; d--) {
+        if(bin[d] > 0 && h->top == 0)
+            h->top = d;
+        h->n += bin[d];
+        h->sum += (long int)d * bin[d];
+        sq += (long int)d * d * bin[d];
+        if(d > 0)
+            h->cum[d - 1] = h->n;
+    }
+    h->sq = sq;
+    h->var = (double)h->n * sq - (double)h->sum * h->sum;
+
+    return k;
+}
+
+double estR2(const Dosage_s *m, int row1, int row2) {
+    int i;
+    long int n = 0, sums[5] = {0};
+    double r = 0;
+    const uint64_t *b1 = m->mask + (size_t)row1 * m->mask_n, *b2 = m->mask + (size_t)row2 * m->mask_n;
+
+    for(i = 0; i < m->mask_n; i++)
+        n += __builtin_popcountll(b1[i] & b2[i]);
+    sumKernel(m->dose + (size_t)row1 * m->stride, m->dose + (size_t)row2 * m->stride, m->stride, sums);
+    r = ((double)n * sums[2] - (double)sums[0] * sums[1]) / sqrt(((double)n * sums[3] - (double)sums[0] * sums[0]) * ((double)n * sums[4] - (double)sums[1] * sums[1]));
+
+    return r * r;
+}
+
+/* The bound is raised by 1e-9 of its value, so that rounding cannot put the result of estR2 above it */
+double maxR2(const Dosage_s *m, int row1, int row2) {
+    int t, u, c;
+    long int n = m->ind_n, hi = 0, lo = 0;
+    double e = 0, r1 = 0, r2 = 0;
+    const DoseHist_s *h1 = &m->hist[row1], *h2 = &m->hist[row2];
+
+    if(h1->n != n || h2->n != n || h1->var <= 0 || h2->var <= 0)
+        return 1;
+    for(t = 0; t < h1->top; t++) {
+        for(u = 0; u < h2->top; u++) {
+            c = h1->cum[t] + h2->cum[u];
+            hi += h1->cum[t] < h2->cum[u] ? h1->cum[t] : h2->cum[u];
+            lo += c > n ? c - n : 0;
+        }
+    }
+    e = (double)h1->sum * h2->sum;
+    r1 = (double)n * hi - e;
+    r2 = (double)n * lo - e;
+
+    return (r1 * r1 > r2 * r2 ? r1 * r1 : r2 * r2) / (h1->var * h2->var) * (1 + 1e-9);
+}
+
+/* Writes the r2 of rows row1 + i and row2 + j into r2[i * n2 + j], with n1 and n2 at most LD_TILE */
+void estR2Tile(Dosage_s *m, int row1, int n1, int row2, int n2, double *r2) {
+    int i, j, k, l, first, bytes, mis1, mis2;
+    long int n = 0, sums[5] = {0};
+    int32_t g[LD_TILE], q[LD_TILE], c[LD_TILE], g1[LD_TILE][LD_TILE], q1[LD_TILE][LD_TILE], c1[LD_TILE][LD_TILE], g2[LD_TILE][LD_TILE], q2[LD_TILE][LD_TILE];
+    double r = 0;
+    const unsigned char *a[LD_TILE], *b[LD_TILE], *col = NULL;
+    const unsigned char *cols1 = m->cols + (size_t)(row1 / LD_TILE) * m->tile_len * 3 * LD_TILE, *cols2 = m->cols + (size_t)(row2 / LD_TILE) * m->tile_len * 3 * LD_TILE;
+    const int *list = NULL;
+    const DoseHist_s *h1 = NULL, *h2 = NULL;
+
+    memset(m->prod, 0, LD_TILE * LD_TILE * sizeof(int32_t));
+    for(first = 0; first < m->tile_len; first += LD_BYTES) {
+        bytes = m->tile_len - first < LD_BYTES ? m->tile_len - first : LD_BYTES;
+        for(i = 0; i < n1; i++)
+            a[i] = m->tile + (size_t)(row1 + i) * m->tile_len + first;
+        for(j = 0; j < n2; j++)
+            b[j] = m->tile + (size_t)(row2 + j) * m->tile_len + first;
+        tileKernel(a, b, n1, n2, bytes, m->prod);
+    }
+    /* g1[j][i] and q1[j][i] are the sums of g and g^2 of row1 + i, and c1[j][i] its number of calls, at the missing genotypes of row2 + j */
+    for(j = 0; j < n2; j++) {
+        mis2 = m->ind_n - m->hist[row2 + j].n;
+        list = m->mis + (size_t)(row2 + j) * m->mis_max;
+        memset(g, 0, sizeof(g));
+        memset(q, 0, sizeof(q));
+        memset(c, 0, sizeof(c));
+        for(k = 0; k < mis2 && mis2 <= m->mis_max; k++) {
+            col = cols1 + (size_t)list[k] * 3 * LD_TILE;
+            for(l = 0; l < LD_TILE; l++) {
+                g[l] += col[l];
+                q[l] += col[LD_TILE + l];
+                c[l] += col[2 * LD_TILE + l];
+            }
+        }
+        memcpy(g1[j], g, sizeof(g));
+        memcpy(q1[j], q, sizeof(q));
+        memcpy(c1[j], c, sizeof(c));
+    }
+    for(i = 0; i < n1; i++) {
+        mis1 = m->ind_n - m->hist[row1 + i].n;
+        list = m->mis + (size_t)(row1 + i) * m->mis_max;
+        memset(g, 0, sizeof(g));
+        memset(q, 0, sizeof(q));
+        for(k = 0; k < mis1 && mis1 <= m->mis_max; k++) {
+            col = cols2 + (size_t)list[k] * 3 * LD_TILE;
+            for(l = 0; l < LD_TILE; l++) {
+                g[l] += col[l];
+                q[l] += col[LD_TILE + l];
+            }
+        }
+        memcpy(g2[i], g, sizeof(g));
+        memcpy(q2[i], q, sizeof(q));
+    }
+    for(i = 0; i < n1; i++) {
+        h1 = &m->hist[row1 + i];
+        for(j = 0; j < n2; j++) {
+            h2 = &m->hist[row2 + j];
+            if(m->ind_n - h1->n > m->mis_max || m->ind_n - h2->n > m->mis_max) {
+                r2[i * n2 + j] = estR2(m, row1 + i, row2 + j);
+                continue;
+            }
+            n = h1->n - c1[j][i];
+            sums[0] = h1->sum - g1[j][i];
+            sums[1] = h2->sum - g2[i][j];
+            sums[2] = m->prod[i * LD_TILE + j];
+            sums[3] = h1->sq - q1[j][i];
+            sums[4] = h2->sq - q2[i][j];
+            r = ((double)n * sums[2] - (double)sums[0] * sums[1]) / sqrt(((double)n * sums[3] - (double)sums[0] * sums[0]) * ((double)n * sums[4] - (double)sums[1] * sums[1]));
+            r2[i * n2 + j] = r * r;
+        }
+    }
+}
+
+void freeDosages(Dosage_s *m) {
+    free(m->dose);
+    free(m->mask);
+    free(m->hist);
+    free(m->tile);
+    free(m->cols);
+    free(m->mis);
+    free(m->prod);
+    m->dose = NULL;
+    m->mask = NULL;
+    m->hist = NULL;
+    m->tile = NULL;
+    m->cols = NULL;
+    m->mis = NULL;
+    m->prod = NULL;
+}
@@ -0,0 +1,67 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Genotype storage and r2 estimation for the LD-pruning windows of prune_ld and poly_freq. poly_pca reads its blocks of sites
+ into the same packed rows.
+
+ The window is a single block of rows, one row per SNP. Each row holds the alternative allele dosages
+ of all individuals packed into 4 bits (0-8), with 15 marking missing genotypes, and a bitmask of the
+ individuals with a called genotype. estR2 uses an AVX-512, AVX2 or NEON kernel when the CPU supports one.
+ Each row also keeps the counts of its dosages, from which maxR2 gives an upper bound of r2 without reading the rows.
+
+ estR2Tile gives the r2 of every pair between two tiles of up to LD_TILE rows, for the -ldmatrix and -lddecay modes of
+ prune_ld. A tile starts at a multiple of LD_TILE. After initTiles, packDosages also keeps each row as one byte per
+ individual, both by row and interleaved with the other rows of its tile, together with the list of its missing
+ genotypes. The sum of g1*g2 of all pairs is a small matrix multiply of the two tiles (with an AVX2 kernel when the CPU
+ supports one), and the other sums are corrected for missing data a whole column of the tile at a time. The results
+ equal those of estR2.
+*/
+
+#ifndef POLY_LD_H
+#define POLY_LD_H
+
+#include <stdint.h>
+#include "vcf_parse.h"
+
+#define DOSE_MIS 15
+#define LD_TILE 32
+#define LD_BYTES 1024
+
+typedef struct {
+    int n, top, cum[DOSE_MIS];
+    long int sum, sq;
+    double var;
+} DoseHist_s;
+
+typedef struct {
+    int row_n, ind_n, stride, mask_n, tile_len, mis_max, *mis;
+    DoseHist_s *hist;
+    unsigned char *dose, *tile, *cols;
+    uint64_t *mask;
+    int32_t *prod;
+} Dosage_s;
+
+void initDosages(Dosage_s *m, int row_n, int ind_n);
+void initTiles(Dosage_s *m);
+void clearDosages(Dosage_s *m, int row);
+int packDosages(Dosage_s *m, int row, const Geno_s *geno, const char *use, int n);
+double estR2(const Dosage_s *m, int row1, int row2);
+double maxR2(const Dosage_s *m, int row1, int row2);
+void estR2Tile(Dosage_s *m, int row1, int n1, int row2, int n2, double *r2);
+void freeDosages(Dosage_s *m);
+
+#endif
@@ -0,0 +1,818 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Program for conducting PCA on mixed ploidy VCF files.
+ The genotypes of each individual are scaled by its ploidy, and the matrix is either the covariance of est_cov_pca.r
+ (the mean over sites of (g_i/x_i - p)(g_j/x_j - p)/(p(1 - p))), or a genomic relationship matrix (the sum over sites
+ of (g_i/x_i - p)(g_j/x_j - p) divided by the sum of p(1 - p)). Both only use the sites where the two individuals are
+ genotyped. The sites are read once, in blocks of PCA_BLOCK, and the matrix is updated from each block in tiles.
+ The output lists the top principal components (eigenvectors of the matrix) of each individual, and the proportion of
+ the variance they explain is printed with the run information. The LD-pruned VCF file of prune_ld can be used as such.
+
+ Compiling: gcc poly_pca.c poly_ld.c vcf_parse.c vcf_thread.c vcf_cache.c vcf_bcf.c vcf_write.c bgzf.c -o poly_pca -lm -lpthread -lz
+
+ Usage:
+ -vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8. Can be bgzip-compressed or a BCF file.
+ -cache [file] Binary genotype cache. With -vcf, the VCF file is first converted into this file; without it, an existing cache is read instead of a VCF file. Optional.
+ -inds [file] File listing individuals to use. Optional.
+ -sites [file] Tab delimited file listing sites to use (format: chr, pos). Optional.
+ -mis [double] Excludes sites based of the proportion of missing data (0 = all missing allowed, 1 = no missing data allowed). Default 0.6.
+ -maf [double] Minimum minor allele frequency allowed. Default 0.05.
+ -matrix [string] Whether to use the covariance matrix ('cov') or the genomic relationship matrix ('grm'). Default 'cov'.
+ -pcs [int] Number of principal components to print. Default 10.
+ -out [int] Whether to print the principal components (0) or the matrix itself (1). Default 0.
+ -region [chr:start-end] Only uses sites within the region (for example chr1:1000-2000 or chr1). Uses the .tbi or .csi index of a bgzip-compressed VCF file to read only that part of the file. Optional.
+ -threads [int] Number of threads used for processing parts of the VCF file in parallel. A pipe or a gzip file is read as one part, with its lines parsed on the threads. Default 1.
+
+ Example:
+ ./poly_pca -vcf 4fold_ld_pruned.vcf -mis 0.8 -maf 0.05 -pcs 5 > out.pca
+*/
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "poly_ld.h"
+#include "vcf_parse.h"
+#include "vcf_thread.h"
+#define merror "\nERROR: System out of memory\n\n"
+#define PCA_BLOCK 256
+#define PCA_TILE 32
+#define PCA_OVER 20
+#define PCA_POWER 12
+#define PCA_EXACT 300
+
+typedef struct {
+    char ind[200];
+} Ind_s;
+
+typedef struct {
+    int ind_n, sample_n, n, matrix, *ploidy, **ploidies;
+    long int *site_n;
+    double mis, maf, **sums;
+    char *use, **names;
+    Ind_s *inds;
+    Sites_s *sites;
+} Job_s;
+
+void openFiles(int argc, char *argv[]);
+Ind_s *readInds(FILE *ind_file, int *n);
+void readVcf(Bgzf_s *vcf_file, Cache_s *cache, const char *vcf_name, const Region_s *region, Ind_s *inds, Sites_s *sites, int ind_n, int matrix, int pc_n, int out, int thread_n, double mis, double maf);
+void readChunk(Chunk_s *chunk, void *arg);
+void setSamples(Job_s *job, char *line);
+void addRows(Job_s *job, double *sums, const int *ploidy, const Dosage_s *dose, const double *freqs, int row_n, double *z, double *w);
+void estPcs(const double *a, int n, int k, double *vals, double *vecs);
+void multMatrix(const double *a, const double *q, int n, int l, double *y);
+void orthColumns(double *q, int n, int l);
+void estEigen(double *a, int n, double *vals, double *vecs);
+void printPcs(const Job_s *job, const double *vals, const double *vecs, double trace, int pc_n);
+void printMatrix(const Job_s *job, const double *a);
+int isNumeric(const char *s);
+void stringTerminator(char *string);
+void printHelp(void);
+
+int main(int argc, char *argv[]) {
+    int second = 0, minute = 0, hour = 0;
+    time_t timer = 0;
+
+    timer = time(NULL);
+    openFiles(argc, argv);
+    second = time(NULL) - timer;
+    minute = second / 60;
+    hour = second / 3600;
+
+    fprintf(stderr, "Done!");
+    if(hour > 0)
+        fprintf(stderr, "\nElapsed time: %i h, %i min & %i sec\n\n", hour, minute - hour * 60, second - minute * 60);
+    else if(minute > 0)
+        fprintf(stderr, "\nElapset time: %i min & %i sec\n\n", minute, second - minute * 60);
+    else if(second > 5)
+        fprintf(stderr, "\nElapsed time: %i sec\n\n", second);
+    else
+        fprintf(stderr, "\n\n");
+
+    return 0;
+}
+
+void openFiles(int argc, char *argv[]) {
+    int i, ind_n = 0, matrix = 0, pc_n = 10, out = 0, thread_n = 1;
+    double mis = 0.6, maf = 0.05;
+    char temp[10], *vcf_name = NULL, *cache_name = NULL;
+    Ind_s *inds = NULL;
+    Sites_s *sites = NULL;
+    Region_s region, *reg = NULL;
+    Bgzf_s *vcf_file = NULL;
+    Cache_s *cache = NULL;
+    FILE *ind_file = NULL, *site_file = NULL;
+
+    if(argc == 1) {
+        printHelp();
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "\nParameters:\n");
+
+    for(i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-vcf") == 0) {
+            if((vcf_file = openBgzf(argv[++i])) == NULL) {
+                fprintf(stderr, "\nERROR: Cannot open file %s\n\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            vcf_name = argv[i];
+            fprintf(stderr, "\t-vcf %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-cache") == 0) {
+            cache_name = argv[++i];
+            fprintf(stderr, "\t-cache %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-inds") == 0) {
+            if((ind_file = fopen(argv[++i], "r")) == NULL) {
+                fprintf(stderr, "\nERROR: Cannot open file %s\n\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-inds %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-sites") == 0) {
+            if((site_file = fopen(argv[++i], "r")) == NULL) {
+                fprintf(stderr, "\nERROR: Cannot open file %s\n\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-sites %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-mis") == 0) {
+            if(isNumeric(argv[++i])) {
+                mis = atof(argv[i]);
+                if(mis < 0 || mis > 1) {
+                    fprintf(stderr, "\nERROR: Invalid value for -mis [double]!\n\n");
+                    exit(EXIT_FAILURE);
+                }
+            } else {
+                fprintf(stderr, "\nERROR: Invalid value for -mis [double]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-mis %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-maf") == 0) {
+            if(isNumeric(argv[++i])) {
+                maf = atof(argv[i]);
+                if(maf < 0 || maf > 0.5) {
+                    fprintf(stderr, "\nERROR: Invalid value for -maf [double]!\n\n");
+                    exit(EXIT_FAILURE);
+                }
+            } else {
+                fprintf(stderr, "\nERROR: Invalid value for -maf [double]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-maf %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-matrix") == 0) {
+            strncpy(temp, argv[++i], 9);
+            temp[9] = '\0';
+            if(strcmp(temp, "cov") == 0)
+                matrix = 0;
+            else if(strcmp(temp, "grm") == 0)
+                matrix = 1;
+            else {
+                fprintf(stderr, "\nERROR: Invalid input for -matrix [string]! Allowed are 'cov' and 'grm'\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-matrix %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-pcs") == 0) {
+            if(isNumeric(argv[++i]))
+                pc_n = atoi(argv[i]);
+            if(pc_n < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -pcs [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-pcs %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-out") == 0) {
+            if(isNumeric(argv[++i]))
+                out = atoi(argv[i]);
+            if((out != 0 && out != 1) || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -out [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-out %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-region") == 0) {
+            if(parseRegion(argv[++i], &region) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -region [chr:start-end]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            reg = &region;
+            fprintf(stderr, "\t-region %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-threads") == 0) {
+            if(isNumeric(argv[++i]))
+                thread_n = atoi(argv[i]);
+            if(thread_n < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -threads [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-threads %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            fprintf(stderr, "\t%s\n", argv[i]);
+            printHelp();
+            exit(EXIT_FAILURE);
+        } else {
+            fprintf(stderr, "\nERROR: Unknown argument '%s'\n\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    fprintf(stderr, "\n");
+
+    if(vcf_file == NULL && cache_name == NULL) {
+        fprintf(stderr, "\nERROR: -vcf [file] (or -cache [file]) is required!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(cache_name != NULL) {
+        if(vcf_file != NULL) {
+            writeCache(vcf_file, cache_name);
+            closeBgzf(vcf_file);
+            vcf_file = NULL;
+            vcf_name = NULL;
+        }
+        if((cache = openCache(cache_name)) == NULL) {
+            fprintf(stderr, "\nERROR: Cannot open file %s\n\n", cache_name);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if(ind_file != NULL)
+        inds = readInds(ind_file, &ind_n);
+    if(site_file != NULL)
+        sites = readSites(site_file);
+    readVcf(vcf_file, cache, vcf_name, reg, inds, sites, ind_n, matrix, pc_n, out, thread_n, mis, maf);
+}
+
+Ind_s *readInds(FILE *ind_file, int *n) {
+    int list_i = 100;
+    char *line = NULL;
+    Ind_s *list = NULL;
+    size_t len = 0;
+    ssize_t read;
+
+    if((list = malloc(list_i * sizeof(Ind_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    while((read = getline(&line, &len, ind_file)) != -1) {
+        if(line[0] == '\n' || line[0] == '#')
+            continue;
+        stringTerminator(line);
+        strncpy(list[*n].ind, line, 199);
+        list[*n].ind[199] = '\0';
+        *n = *n + 1;
+        if(*n >= list_i) {
+            list_i += 50;
+            if((list = realloc(list, list_i * sizeof(Ind_s))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    free(line);
+    fclose(ind_file);
+
+    return list;
+}
+
+void readVcf(Bgzf_s *vcf_file, Cache_s *cache, const char *vcf_name, const Region_s *region, Ind_s *inds, Sites_s *sites, int ind_n, int matrix, int pc_n, int out, int thread_n, double mis, double maf) {
+    int i, j, t, chunk_n = 0, n = 0, zero = 0;
+    long int site_n = 0;
+    double trace = 0, *a = NULL, *s = NULL, *vals = NULL, *vecs = NULL;
+    FILE *outs[2] = {stdout, NULL};
+    Chunk_s *chunks = NULL;
+    Job_s job = {ind_n, 0, 0, matrix, NULL, NULL, NULL, mis, maf, NULL, NULL, NULL, inds, sites};
+
+    if(cache != NULL)
+        chunks = splitCache(cache, region, thread_n, 0, &chunk_n);
+    else
+        chunks = splitVcf(vcf_file, vcf_name, region, thread_n, 0, &chunk_n);
+    if((job.site_n = calloc(chunk_n, sizeof(long int))) == NULL || (job.sums = calloc(thread_n, sizeof(double *))) == NULL || (job.ploidies = calloc(thread_n, sizeof(int *))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    runChunks(chunks, 1, 1, vcf_name, vcf_file, outs, readChunk, &job);
+    runChunks(chunks + 1, chunk_n - 1, thread_n, vcf_name, vcf_file, outs, readChunk, &job);
+    for(i = 0; i < chunk_n; i++)
+        site_n += job.site_n[i];
+    n = job.n;
+    if(site_n == 0 || n < 2) {
+        fprintf(stderr, "\nERROR: No sites or individuals left for PCA. Please check your input files!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    for(t = 0; t < thread_n; t++) {
+        if(job.sums[t] == NULL)
+            continue;
+        for(i = 0; i < n; i++) {
+            if(job.ploidy[i] < job.ploidies[t][i])
+                job.ploidy[i] = job.ploidies[t][i];
+        }
+        free(job.ploidies[t]);
+        if(s == NULL)
+            s = job.sums[t];
+        else {
+            for(i = 0; i < n * n * 2; i++)
+                s[i] += job.sums[t][i];
+            free(job.sums[t]);
+        }
+    }
+    if((a = malloc((size_t)n * n * sizeof(double))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < n; i++) {
+        for(j = 0; j <= i; j++) {
+            if(s[(size_t)n * n + (size_t)i * n + j] > 0)
+                a[(size_t)i * n + j] = s[(size_t)i * n + j] / s[(size_t)n * n + (size_t)i * n + j];
+            else {
+                a[(size_t)i * n + j] = 0;
+                zero++;
+            }
+            a[(size_t)j * n + i] = a[(size_t)i * n + j];
+        }
+        trace += a[(size_t)i * n + i];
+    }
+    if(zero > 0)
+        fprintf(stderr, "Warning: %i pairs of individuals share no genotyped sites and were set to 0\n\n", zero);
+    fprintf(stderr, "Total sites = %li\nTotal individuals = %i\n\n", site_n, n);
+
+    if(out == 1)
+        printMatrix(&job, a);
+    else {
+        if(pc_n > n)
+            pc_n = n;
+        if((vals = malloc(pc_n * sizeof(double))) == NULL || (vecs = malloc((size_t)n * pc_n * sizeof(double))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        estPcs(a, n, pc_n, vals, vecs);
+        printPcs(&job, vals, vecs, trace, pc_n);
+    }
+    if(isatty(1))
+        fprintf(stderr, "\n");
+
+    for(i = 0; i < n; i++)
+        free(job.names[i]);
+    free(job.names);
+    free(job.use);
+    free(job.ploidy);
+    free(job.ploidies);
+    free(job.sums);
+    free(job.site_n);
+    free(s);
+    free(a);
+    free(vals);
+    free(vecs);
+    free(inds);
+    freeChunks(chunks);
+    if(sites != NULL)
+        freeSites(sites);
+    if(cache != NULL)
+        closeCache(cache);
+    else
+        closeBgzf(vcf_file);
+}
+
+void readChunk(Chunk_s *chunk, void *arg) {
+    int i, k, row_n = 0, n = 0, *ploidy = NULL;
+    long int site_n = 0;
+    double mis_i = 0, alt_i = 0, hap_i = 0, *sums = NULL, *freqs = NULL, *z = NULL, *w = NULL;
+    char *line = NULL;
+    Record_s rec = {0};
+    SiteCursor_s site_c = {0};
+    Geno_s *g = NULL;
+    Dosage_s dose = {0};
+    Job_s *job = arg;
+    Sites_s *sites = job->sites;
+    double mis = job->mis, maf = job->maf;
+    size_t len = 0;
+    ssize_t read;
+
+    while((read = readSite(chunk, &line, &len, &rec)) != -1) {
+        if(read == 0) {
+            if(strncmp(line, "#CHROM\t", 7) == 0)
+                setSamples(job, line);
+            continue;
+        }
+        if(sites != NULL && findSite(sites, &site_c, rec.chr, rec.pos) == 0)
+            continue;
+        if(dose.dose == NULL) {
+            n = job->n;
+            initDosages(&dose, PCA_BLOCK, n);
+            if((freqs = malloc(PCA_BLOCK * sizeof(double))) == NULL || (z = malloc((size_t)n * PCA_BLOCK * 2 * sizeof(double))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+            w = z + (size_t)n * PCA_BLOCK;
+            if((sums = job->sums[chunk->thread]) == NULL && ((sums = job->sums[chunk->thread] = calloc((size_t)n * n * 2, sizeof(double))) == NULL || (job->ploidies[chunk->thread] = calloc(n, sizeof(int))) == NULL)) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+            ploidy = job->ploidies[chunk->thread];
+        }
+        parseGenos(&rec, job->use, job->sample_n);
+        mis_i = 0;
+        alt_i = 0;
+        hap_i = 0;
+        for(i = 0, k = 0; i < rec.ind_n && k < n; i++) {
+            if(job->use != NULL && (i >= job->sample_n || job->use[i] == 0))
+                continue;
+            g = &rec.geno[i];
+            k++;
+            if(g->mis) {
+                mis_i++;
+                continue;
+            }
+            if(g->ploidy == 0) {
+                fprintf(stderr, "\nERROR: Allowed ploidy-levels are 2, 4, 6, and 8!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            if(ploidy[k - 1] < g->ploidy)
+                ploidy[k - 1] = g->ploidy;
+            alt_i += g->alt;
+            hap_i += g->ploidy;
+        }
+        mis_i += n - k;
+        if(mis_i / n > 1 - mis || mis_i == n)
+            continue;
+        if(alt_i / hap_i < maf || alt_i / hap_i > 1 - maf || alt_i == 0 || alt_i == hap_i)
+            continue;
+        packDosages(&dose, row_n, rec.geno, job->use, rec.ind_n < job->sample_n || job->use == NULL ? rec.ind_n : job->sample_n);
+        freqs[row_n++] = alt_i / hap_i;
+        site_n++;
+        if(row_n == PCA_BLOCK) {
+            addRows(job, sums, ploidy, &dose, freqs, row_n, z, w);
+            row_n = 0;
+        }
+    }
+    if(row_n > 0)
+        addRows(job, sums, ploidy, &dose, freqs, row_n, z, w);
+    job->site_n[chunk->idx] = site_n;
+
+    freeDosages(&dose);
+    freeRecord(&rec);
+    free(line);
+    free(freqs);
+    free(z);
+}
+
+void setSamples(Job_s *job, char *line) {
+    int i, j = 0, *v = NULL;
+    char **samples = NULL;
+    Hash_s hash;
+
+    samples = parseSamples(line, &job->sample_n);
+    if(job->ind_n > 0) {
+        if((job->use = calloc(job->sample_n + 1, sizeof(char))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        initHash(&hash, job->ind_n);
+        for(i = 0; i < job->ind_n; i++)
+            *addHash(&hash, job->inds[i].ind) = i;
+        for(i = 0; i < job->sample_n; i++) {
+            if((v = findHash(&hash, samples[i])) != NULL) {
+                job->use[i] = 1;
+                job->n++;
+            }
+        }
+        freeHash(&hash);
+        if(job->n == 0) {
+            fprintf(stderr, "\nERROR: Individuals in -inds file were not found in the VCF file!\n\n");
+            exit(EXIT_FAILURE);
+        }
+        if(job->n < job->ind_n)
+            fprintf(stderr, "Warning: -inds file contain individuals that are not in the VCF file\n\n");
+    } else
+        job->n = job->sample_n;
+    if((job->names = malloc(job->n * sizeof(char *))) == NULL || (job->ploidy = calloc(job->n, sizeof(int))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < job->sample_n; i++) {
+        if(job->use != NULL && job->use[i] == 0)
+            continue;
+        if((job->names[j++] = strdup(samples[i])) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+    }
+    free(samples);
+}
+
+/*
+ The block of sites is first unpacked into one row of standardized genotypes (z) and one row of weights (w) per
+ individual, with both set to 0 where the genotype is missing. The lower triangle of z z' then gets the numerators
+ of the matrix, and w w' the number of shared sites (cov) or their sum of p(1 - p) (grm). The products are taken
+ over PCA_TILE x PCA_TILE tiles of individuals so that both sets of rows stay in cache while they are used.
+*/
+void addRows(Job_s *job, double *sums, const int *ploidy, const Dosage_s *dose, const double *freqs, int row_n, double *z, double *w) {
+    int i, j, r, ib, jb, i_end, j_end, n = job->n, d;
+    double p = 0, sd = 0, a = 0, b = 0, *zi = NULL, *wi = NULL, *zj = NULL, *wj = NULL, *nums = sums, *dens = sums + (size_t)n * n;
+    const unsigned char *row = NULL;
+    const uint64_t *mask = NULL;
+
+    for(r = 0; r < row_n; r++) {
+        p = freqs[r];
+        sd = sqrt(p * (1 - p));
+        row = dose->dose + (size_t)r * dose->stride;
+        mask = dose->mask + (size_t)r * dose->mask_n;
+        for(i = 0; i < n; i++) {
+            d = (row[i >> 1] >> ((i & 1) << 2)) & 15;
+            if(((mask[i >> 6] >> (i & 63)) & 1) == 0) {
+                z[(size_t)i * PCA_BLOCK + r] = 0;
+                w[(size_t)i * PCA_BLOCK + r] = 0;
+            } else if(job->matrix == 0) {
+                z[(size_t)i * PCA_BLOCK + r] = ((double)d / ploidy[i] - p) / sd;
+                w[(size_t)i * PCA_BLOCK + r] = 1;
+            } else {
+                z[(size_t)i * PCA_BLOCK + r] = (double)d / ploidy[i] - p;
+                w[(size_t)i * PCA_BLOCK + r] = sd;
+            }
+        }
+    }
+    for(ib = 0; ib < n; ib += PCA_TILE) {
+        i_end = ib + PCA_TILE < n ? ib + PCA_TILE : n;
+        for(jb = 0; jb <= ib; jb += PCA_TILE) {
+            j_end = jb + PCA_TILE < n ? jb + PCA_TILE : n;
+            for(i = ib; i < i_end; i++) {
+                zi = z + (size_t)i * PCA_BLOCK;
+                wi = w + (size_t)i * PCA_BLOCK;
+                for(j = jb; j < j_end && j <= i; j++) {
+                    zj = z + (size_t)j * PCA_BLOCK;
+                    wj = w + (size_t)j * PCA_BLOCK;
+                    a = 0;
+                    b = 0;
+                    for(r = 0; r < row_n; r++) {
+                        a += zi[r] * zj[r];
+                        b += wi[r] * wj[r];
+                    }
+                    nums[(size_t)i * n + j] += a;
+                    dens[(size_t)i * n + j] += b;
+                }
+            }
+        }
+    }
+}
+
+/*
+ Top k eigenpairs of the symmetric n x n matrix a by randomized subspace iteration (Halko et al. 2011): a random basis
+ of k + PCA_OVER columns is multiplied by a and re-orthonormalized PCA_POWER times, and the small projected matrix
+ q'aq is diagonalized with Jacobi rotations. Up to PCA_EXACT individuals, or when the basis would not be much smaller than
+ the matrix, a is diagonalized directly, which is fast at that size and exact even when the leading eigenvalues are close.
+*/
+void estPcs(const double *a, int n, int k, double *vals, double *vecs) {
+    int i, j, c, l = k + PCA_OVER;
+    unsigned long int z = 0x9E3779B97F4A7C15UL;
+    double *q = NULL, *y = NULL, *b = NULL, *bv = NULL, *bw = NULL, t = 0;
+
+    if(n <= PCA_EXACT || 2 * l >= n) {
+        if((b = malloc((size_t)n * n * sizeof(double))) == NULL || (bv = malloc((size_t)n * n * sizeof(double))) == NULL || (bw = malloc(n * sizeof(double))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        memcpy(b, a, (size_t)n * n * sizeof(double));
+        estEigen(b, n, bw, bv);
+        for(c = 0; c < k; c++) {
+            vals[c] = bw[c];
+            for(i = 0; i < n; i++)
+                vecs[(size_t)i * k + c] = bv[(size_t)i * n + c];
+        }
+    } else {
+        if((q = malloc((size_t)n * l * sizeof(double))) == NULL || (y = malloc((size_t)n * l * sizeof(double))) == NULL || (b = malloc((size_t)l * l * sizeof(double))) == NULL || (bv = malloc((size_t)l * l * sizeof(double))) == NULL || (bw = malloc(l * sizeof(double))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        for(i = 0; i < n * l; i++) {
+            z += 0x9E3779B97F4A7C15UL;
+            q[i] = (double)(((z ^ (z >> 31)) * 0xBF58476D1CE4E5B9UL) >> 11) / 9007199254740992.0 - 0.5;
+        }
+        orthColumns(q, n, l);
+        for(i = 0; i < PCA_POWER; i++) {
+            multMatrix(a, q, n, l, y);
+            memcpy(q, y, (size_t)n * l * sizeof(double));
+            orthColumns(q, n, l);
+        }
+        multMatrix(a, q, n, l, y);
+        for(i = 0; i < l; i++) {
+            for(j = 0; j <= i; j++) {
+                t = 0;
+                for(c = 0; c < n; c++)
+                    t += q[(size_t)c * l + i] * y[(size_t)c * l + j];
+                b[i * l + j] = b[j * l + i] = t;
+            }
+        }
+        estEigen(b, l, bw, bv);
+        for(c = 0; c < k; c++) {
+            vals[c] = bw[c];
+            for(i = 0; i < n; i++) {
+                t = 0;
+                for(j = 0; j < l; j++)
+                    t += q[(size_t)i * l + j] * bv[j * l + c];
+                vecs[(size_t)i * k + c] = t;
+            }
+        }
+    }
+    /* Eigenvectors are only defined up to their sign, which is fixed by making the largest loading positive */
+    for(c = 0; c < k; c++) {
+        t = 0;
+        for(i = 0; i < n; i++) {
+            if(fabs(vecs[(size_t)i * k + c]) > fabs(t))
+                t = vecs[(size_t)i * k + c];
+        }
+        for(i = 0; t < 0 && i < n; i++)
+            vecs[(size_t)i * k + c] = -vecs[(size_t)i * k + c];
+    }
+
+    free(q);
+    free(y);
+    free(b);
+    free(bv);
+    free(bw);
+}
+
+void multMatrix(const double *a, const double *q, int n, int l, double *y) {
+    int i, j, c, jb, j_end;
+    double v = 0;
+    const double *ai = NULL;
+
+    memset(y, 0, (size_t)n * l * sizeof(double));
+    for(jb = 0; jb < n; jb += PCA_TILE) {
+        j_end = jb + PCA_TILE < n ? jb + PCA_TILE : n;
+        for(i = 0; i < n; i++) {
+            ai = a + (size_t)i * n;
+            for(j = jb; j < j_end; j++) {
+                v = ai[j];
+                for(c = 0; c < l; c++)
+                    y[(size_t)i * l + c] += v * q[(size_t)j * l + c];
+            }
+        }
+    }
+}
+
+/* Modified Gram-Schmidt on the columns of the row-major n x l matrix q; a column that vanishes is left as zeros */
+void orthColumns(double *q, int n, int l) {
+    int i, j, c;
+    double t = 0;
+
+    for(c = 0; c < l; c++) {
+        for(j = 0; j < c; j++) {
+            t = 0;
+            for(i = 0; i < n; i++)
+                t += q[(size_t)i * l + j] * q[(size_t)i * l + c];
+            for(i = 0; i < n; i++)
+                q[(size_t)i * l + c] -= t * q[(size_t)i * l + j];
+        }
+        t = 0;
+        for(i = 0; i < n; i++)
+            t += q[(size_t)i * l + c] * q[(size_t)i * l + c];
+        t = t > 0 ? 1 / sqrt(t) : 0;
+        for(i = 0; i < n; i++)
+            q[(size_t)i * l + c] *= t;
+    }
+}
+
+/* Cyclic Jacobi eigendecomposition of the symmetric n x n matrix a (overwritten). The eigenvalues are returned in
+   decreasing order with the eigenvectors in the matching columns of vecs */
+void estEigen(double *a, int n, double *vals, double *vecs) {
+    int i, j, k, it, best;
+    double off = 0, norm = 0, theta = 0, t = 0, c = 0, s = 0, x = 0, y = 0;
+
+    for(i = 0; i < n; i++) {
+        for(j = 0; j < n; j++) {
+            vecs[(size_t)i * n + j] = i == j;
+            norm += a[(size_t)i * n + j] * a[(size_t)i * n + j];
+        }
+    }
+    for(it = 0; it < 100; it++) {
+        off = 0;
+        for(i = 0; i < n; i++) {
+            for(j = i + 1; j < n; j++)
+                off += a[(size_t)i * n + j] * a[(size_t)i * n + j];
+        }
+        if(off <= 1e-22 * norm)
+            break;
+        for(i = 0; i < n; i++) {
+            for(j = i + 1; j < n; j++) {
+                if(a[(size_t)i * n + j] == 0)
+                    continue;
+                theta = (a[(size_t)j * n + j] - a[(size_t)i * n + i]) / (2 * a[(size_t)i * n + j]);
+                t = (theta >= 0 ? 1 : -1) / (fabs(theta) + sqrt(theta * theta + 1));
+                c = 1 / sqrt(t * t + 1);
+                s = t * c;
+                for(k = 0; k < n; k++) {
+                    x = a[(size_t)k * n + i];
+                    y = a[(size_t)k * n + j];
+                    a[(size_t)k * n + i] = c * x - s * y;
+                    a[(size_t)k * n + j] = s * x + c * y;
+                }
+                for(k = 0; k < n; k++) {
+                    x = a[(size_t)i * n + k];
+                    y = a[(size_t)j * n + k];
+                    a[(size_t)i * n + k] = c * x - s * y;
+                    a[(size_t)j * n + k] = s * x + c * y;
+                }
+                for(k = 0; k < n; k++) {
+                    x = vecs[(size_t)k * n + i];
+                    y = vecs[(size_t)k * n + j];
+                    vecs[(size_t)k * n + i] = c * x - s * y;
+                    vecs[(size_t)k * n + j] = s * x + c * y;
+                }
+            }
+        }
+    }
+    for(i = 0; i < n; i++)
+        vals[i] = a[(size_t)i * n + i];
+    for(i = 0; i < n; i++) {
+        best = i;
+        for(j = i + 1; j < n; j++) {
+            if(vals[j] > vals[best])
+                best = j;
+        }
+        if(best == i)
+            continue;
+        t = vals[i];
+        vals[i] = vals[best];
+        vals[best] = t;
+        for(k = 0; k < n; k++) {
+            t = vecs[(size_t)k * n + i];
+            vecs[(size_t)k * n + i] = vecs[(size_t)k * n + best];
+            vecs[(size_t)k * n + best] = t;
+        }
+    }
+}
+
+void printPcs(const Job_s *job, const double *vals, const double *vecs, double trace, int pc_n) {
+    int i, c;
+
+    printf("id\tploidy");
+    for(c = 0; c < pc_n; c++)
+        printf("\tPC%i", c + 1);
+    printf("\n");
+    for(i = 0; i < job->n; i++) {
+        printf("%s\t%i", job->names[i], job->ploidy[i]);
+        for(c = 0; c < pc_n; c++)
+            printf("\t%f", vecs[(size_t)i * pc_n + c]);
+        printf("\n");
+    }
+    fprintf(stderr, "Variance explained:\n");
+    for(c = 0; c < pc_n; c++)
+        fprintf(stderr, "PC%i = %.2f%%\n", c + 1, trace != 0 ? vals[c] / trace * 100 : 0);
+    fprintf(stderr, "\n");
+}
+
+void printMatrix(const Job_s *job, const double *a) {
+    int i, j;
+
+    printf("id");
+    for(i = 0; i < job->n; i++)
+        printf("\t%s", job->names[i]);
+    printf("\n");
+    for(i = 0; i < job->n; i++) {
+        printf("%s", job->names[i]);
+        for(j = 0; j < job->n; j++)
+            printf("\t%f", a[(size_t)i * job->n + j]);
+        printf("\n");
+    }
+}
+
+int isNumeric(const char *s) {
+    char *p;
+    if(s == NULL || *s == '\0' || isspace(*s))
+        return 0;
+    strtod(s, &p);
+    return *p == '\0';
+}
+
+void stringTerminator(char *string) {
+    string[strcspn(string, "\n")] = 0;
+}
+
+void printHelp(void) {
+    fprintf(stderr, "\nProgram for conducting PCA on mixed ploidy VCF files.\n\n");
+    fprintf(stderr, "Usage:\n");
+    fprintf(stderr, "-vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8. Can be bgzip-compressed or a BCF file.\n");
+    fprintf(stderr, "-cache [file] Binary genotype cache. With -vcf, the VCF file is first converted into this file; without it, an existing cache is read instead of a VCF file. Optional.\n");
+    fprintf(stderr, "-inds [file] File listing individuals to use. Optional.\n");
+    fprintf(stderr, "-sites [file] Tab delimited file listing sites to use (format: chr, pos). Optional.\n");
+    fprintf(stderr, "-mis [double] Excludes sites based of the proportion of missing data (0 = all missing allowed, 1 = no missing data allowed). Default 0.6.\n");
+    fprintf(stderr, "-maf [double] Minimum minor allele frequency allowed. Default 0.05.\n");
+    fprintf(stderr, "-matrix [string] Whether to use the covariance matrix ('cov') or the genomic relationship matrix ('grm'). Default 'cov'.\n");
+    fprintf(stderr, "-pcs [int] Number of principal components to print. Default 10.\n");
+    fprintf(stderr, "-out [int] Whether to print the principal components (0) or the matrix itself (1). Default 0.\n");
+    fprintf(stderr, "-region [chr:start-end] Only uses sites within the region (for example chr1:1000-2000 or chr1). Uses the .tbi or .csi index of a bgzip-compressed VCF file to read only that part of the file. Optional.\n");
+    fprintf(stderr, "-threads [int] Number of threads used for processing parts of the VCF file in parallel. A pipe or a gzip file is read as one part, with its lines parsed on the threads. Default 1.\n\n");
+    fprintf(stderr, "Example:\n");
+    fprintf(stderr, "./poly_pca -vcf 4fold_ld_pruned.vcf -mis 0.8 -maf 0.05 -pcs 5 > out.pca\n\n");
+}
@@ -0,0 +1,1190 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Program for answering repeated Fst/Dxy, allele frequency and SFS queries on mixed ploidy VCF files without re-reading them.
+ The VCF file (or a genotype cache) is read once, and the counts of alternative alleles, called haplotypes, called
+ individuals and missing individuals of each population are kept in memory as one column per population. Queries are then
+ read one per line from stdin, or from the connections to a local socket with -socket, and answered from the columns.
+
+ A query is a command followed by groups of populations and options, separated by spaces. A group is a comma separated
+ list of population ids of the -pops file (for example dip1,dip2,dip3), whose individuals are pooled. The answer is
+ written in the format of the program whose math it uses, and ends with an empty line. A query that cannot be answered
+ gets a single line starting with 'ERROR:', and the program keeps running.
+
+ fst [group] [group] ... Fst between the groups, as poly_fst: with two groups the genome-wide estimate (-out 1) or one
+                         line per gene, and with more groups a matrix of all pairs (-pops), or one matrix per gene.
+ dxy [group] [group] ... Dxy between the groups, as fst.
+ freq [group] ...        Allele frequencies of the groups, as poly_freq.
+ sfs [group] ...         SFS of each group, as poly_sfs with -pops.
+ pops                    Lists the populations and their numbers of individuals in the VCF file.
+ quit                    Stops the program.
+
+ Options: mis=[double] and maf=[double] are -mis and -maf of the program (sfs has no maf), sites=[file] and genes=[file]
+ are its -sites and -genes files (genes only for fst and dxy), and seed=[int] is -seed of sfs. The sites and genes files
+ are matched against the sites once, and reused by later queries until the file changes.
+
+ Compiling: gcc poly_query.c vcf_parse.c vcf_thread.c vcf_cache.c vcf_bcf.c vcf_write.c vcf_pop.c vcf_rand.c bgzf.c -o poly_query -lm -lpthread -lz
+
+ Usage:
+ -vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8. Can be bgzip-compressed or a BCF file.
+ -cache [file] Binary genotype cache. With -vcf, the VCF file is first converted into this file; without it, an existing cache is read instead of a VCF file. Optional.
+ -pops [file] Tab delimited file listing individuals to use and their populations (format: individual id, population id).
+ -region [chr:start-end] Only loads sites within the region (for example chr1:1000-2000 or chr1). Uses the .tbi or .csi index of a bgzip-compressed VCF file to read only that part of the file. Optional.
+ -threads [int] Number of threads used for loading parts of the VCF file in parallel. A pipe or a gzip file is read as one part, with its lines parsed on the threads. Default 1.
+ -socket [file] Answers queries sent to a Unix domain socket created at this path, one connection at a time, instead of queries read from stdin. Optional.
+
+ Example:
+ ./poly_query -cache in.cache -pops pops.txt -socket /tmp/poly.sock
+ echo "fst dip1,dip2 tet1,tet2,tet3 genes=genes.txt mis=0.8" | nc -U /tmp/poly.sock
+*/
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "vcf_parse.h"
+#include "vcf_pop.h"
+#include "vcf_rand.h"
+#include "vcf_thread.h"
+#define merror "\nERROR: System out of memory\n\n"
+#define QUERY_FST 0
+#define QUERY_DXY 1
+#define QUERY_FREQ 2
+#define QUERY_SFS 3
+
+typedef struct {
+    int idx;
+    char ind[200];
+} Pop_s;
+
+typedef struct {
+    int chr_n, chr_max, *chr, *pos, *first;
+    long int n, max;
+    char **chrs;
+    uint16_t *rows;
+} Part_s;
+
+typedef struct {
+    int ind_n, pop_n, sample_n, *pop_l, *size;
+    char *use;
+    Pop_s *pops;
+    Part_s *parts;
+} Job_s;
+
+typedef struct {
+    char *name;
+    int genes, *gene;
+    long int hit_n, *off, *site;
+    char *mask;
+    time_t mtime;
+    off_t size;
+    Features_s *features;
+} List_s;
+
+typedef struct {
+    int pop_n, chr_n, list_n, list_max, *chr, *pos, *size, *ploidy, *nul;
+    long int site_n;
+    char **names, **chrs;
+    uint16_t *alt, *hap, *ind, *mis;
+    Hash_s hash;
+    List_s **lists;
+} Data_s;
+
+typedef struct {
+    int alt, hap, ind, mis;
+} Count_s;
+
+typedef struct {
+    int cmd, group_n, *off, *members;
+    long int seed;
+    double mis, maf;
+    char **labels;
+    List_s *sites, *genes;
+} Query_s;
+
+typedef struct {
+    int ok;
+    double ind, mis, p, n, hs;
+} Freq_s;
+
+void openFiles(int argc, char *argv[]);
+Pop_s *readPops(FILE *pop_file, char ***names, int *n, int *m);
+void loadVcf(Bgzf_s *vcf_file, Cache_s *cache, const char *vcf_name, const Region_s *region, Pop_s *pops, Data_s *data, int ind_n, int thread_n);
+void readChunk(Chunk_s *chunk, void *arg);
+void addPart(Part_s *part, const char *chr, int pos, const int *counts, int pop_n);
+void mergeParts(Data_s *data, Part_s *parts, int chunk_n);
+void serveSocket(Data_s *data, const char *name);
+int serveQueries(Data_s *data, FILE *in, FILE *out);
+int answerQuery(Data_s *data, char *line, FILE *out);
+int readQuery(Data_s *data, char **tokens, int token_n, Query_s *query, char *err);
+List_s *getList(Data_s *data, const char *name, int genes, char *err);
+void matchList(const Data_s *data, List_s *list, FILE *file);
+void freeList(List_s *list);
+void sumGroups(const Data_s *data, const Query_s *query, long int s, Count_s *counts);
+void answerFst(const Data_s *data, const Query_s *query, FILE *out);
+void addSums(Sum_s *sum, const Sum_s *site, int pair_n);
+void answerFreq(const Data_s *data, const Query_s *query, FILE *out);
+void answerSfs(const Data_s *data, const Query_s *query, FILE *out);
+void freeData(Data_s *data);
+int isNumeric(const char *s);
+void stringTerminator(char *string);
+void printHelp(void);
+
+int main(int argc, char *argv[]) {
+    int second = 0, minute = 0, hour = 0;
+    time_t timer = 0;
+
+    timer = time(NULL);
+    openFiles(argc, argv);
+    second = time(NULL) - timer;
+    minute = second / 60;
+    hour = second / 3600;
+
+    fprintf(stderr, "Done!");
+    if(hour > 0)
+        fprintf(stderr, "\nElapsed time: %i h, %i min & %i sec\n\n", hour, minute - hour * 60, second - minute * 60);
+    else if(minute > 0)
+        fprintf(stderr, "\nElapset time: %i min & %i sec\n\n", minute, second - minute * 60);
+    else if(second > 5)
+        fprintf(stderr, "\nElapsed time: %i sec\n\n", second);
+    else
+        fprintf(stderr, "\n\n");
+
+    return 0;
+}
+
+void openFiles(int argc, char *argv[]) {
+    int i, ind_n = 0, pop_n = 0, thread_n = 1;
+    char *vcf_name = NULL, *cache_name = NULL, *socket_name = NULL, **names = NULL;
+    Pop_s *pops = NULL;
+    Data_s data = {0};
+    Region_s region, *reg = NULL;
+    Bgzf_s *vcf_file = NULL;
+    Cache_s *cache = NULL;
+    FILE *pop_file = NULL;
+
+    if(argc == 1) {
+        printHelp();
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "\nParameters:\n");
+
+    for(i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-vcf") == 0) {
+            if((vcf_file = openBgzf(argv[++i])) == NULL) {
+                fprintf(stderr, "\nERROR: Cannot open file %s\n\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            vcf_name = argv[i];
+            fprintf(stderr, "\t-vcf %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-cache") == 0) {
+            cache_name = argv[++i];
+            fprintf(stderr, "\t-cache %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-pops") == 0) {
+            if((pop_file = fopen(argv[++i], "r")) == NULL) {
+                fprintf(stderr, "\nERROR: Cannot open file %s\n\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-pops %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-region") == 0) {
+            if(parseRegion(argv[++i], &region) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -region [chr:start-end]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            reg = &region;
+            fprintf(stderr, "\t-region %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-threads") == 0) {
+            if(isNumeric(argv[++i]))
+                thread_n = atoi(argv[i]);
+            if(thread_n < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -threads [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-threads %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-socket") == 0) {
+            socket_name = argv[++i];
+            if(socket_name == NULL) {
+                fprintf(stderr, "\nERROR: Invalid value for -socket [file]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-socket %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            fprintf(stderr, "\t%s\n", argv[i]);
+            printHelp();
+            exit(EXIT_FAILURE);
+        } else {
+            fprintf(stderr, "\nERROR: Unknown argument '%s'\n\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    fprintf(stderr, "\n");
+
+    if((vcf_file == NULL && cache_name == NULL) || pop_file == NULL) {
+        fprintf(stderr, "\nERROR: -vcf [file] (or -cache [file]) and -pops [file] are required!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(cache_name != NULL) {
+        if(vcf_file != NULL) {
+            writeCache(vcf_file, cache_name);
+            closeBgzf(vcf_file);
+            vcf_file = NULL;
+            vcf_name = NULL;
+        }
+        if((cache = openCache(cache_name)) == NULL) {
+            fprintf(stderr, "\nERROR: Cannot open file %s\n\n", cache_name);
+            exit(EXIT_FAILURE);
+        }
+    }
+    pops = readPops(pop_file, &names, &ind_n, &pop_n);
+    data.pop_n = pop_n;
+    data.names = names;
+    initHash(&data.hash, pop_n);
+    for(i = 0; i < pop_n; i++)
+        *addHash(&data.hash, names[i]) = i;
+    loadVcf(vcf_file, cache, vcf_name, reg, pops, &data, ind_n, thread_n);
+    free(pops);
+    if(cache != NULL)
+        closeCache(cache);
+    else
+        closeBgzf(vcf_file);
+
+    if(socket_name != NULL)
+        serveSocket(&data, socket_name);
+    else
+        serveQueries(&data, stdin, stdout);
+    freeData(&data);
+}
+
+Pop_s *readPops(FILE *pop_file, char ***names, int *n, int *m) {
+    int i;
+    int *v = NULL;
+    double list_i = 200, names_i = 50;
+    char *line = NULL, *ind = NULL, *pop = NULL;
+    Pop_s *list = NULL;
+    Hash_s hash;
+    size_t len = 0;
+    ssize_t read;
+
+    if((list = malloc(list_i * sizeof(Pop_s))) == NULL || (*names = malloc(names_i * sizeof(char *))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    initHash(&hash, 50);
+    while((read = getline(&line, &len, pop_file)) != -1) {
+        if(line[0] == '\n' || line[0] == '#')
+            continue;
+        stringTerminator(line);
+        if((ind = strtok(line, "\t")) == NULL || (pop = strtok(NULL, "\t")) == NULL) {
+            fprintf(stderr, "\nERROR: -pops file should have two tab delimited columns (individual id, population id)!\n\n");
+            exit(EXIT_FAILURE);
+        }
+        if(strchr(pop, ',') != NULL || strchr(pop, ' ') != NULL) {
+            fprintf(stderr, "\nERROR: Population ids of the -pops file cannot contain commas or spaces!\n\n");
+            exit(EXIT_FAILURE);
+        }
+        if((v = findHash(&hash, pop)) != NULL)
+            i = *v;
+        else {
+            i = *m;
+            if(((*names)[i] = strdup(pop)) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+            *addHash(&hash, (*names)[i]) = i;
+            *m = *m + 1;
+            if(*m >= names_i) {
+                names_i += 50;
+                if((*names = realloc(*names, names_i * sizeof(char *))) == NULL) {
+                    fprintf(stderr, merror);
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+        strncpy(list[*n].ind, ind, 199);
+        list[*n].ind[199] = '\0';
+        list[*n].idx = i;
+        *n = *n + 1;
+        if(*n >= list_i) {
+            list_i += 100;
+            if((list = realloc(list, list_i * sizeof(Pop_s))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    free(line);
+    freeHash(&hash);
+    fclose(pop_file);
+
+    return list;
+}
+
+/* Each data chunk collects its sites into its own part, and the parts are joined into the columns in input order */
+void loadVcf(Bgzf_s *vcf_file, Cache_s *cache, const char *vcf_name, const Region_s *region, Pop_s *pops, Data_s *data, int ind_n, int thread_n) {
+    int chunk_n = 0;
+    FILE *outs[2] = {NULL, NULL};
+    Chunk_s *chunks = NULL;
+    Job_s job = {0};
+
+    if(cache != NULL)
+        chunks = splitCache(cache, region, thread_n, 0, &chunk_n);
+    else
+        chunks = splitVcf(vcf_file, vcf_name, region, thread_n, 0, &chunk_n);
+    job.ind_n = ind_n;
+    job.pop_n = data->pop_n;
+    job.pops = pops;
+    if((job.parts = calloc(chunk_n, sizeof(Part_s))) == NULL || (job.size = calloc(data->pop_n, sizeof(int))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    runChunks(chunks, 1, 1, vcf_name, vcf_file, outs, readChunk, &job);
+    runChunks(chunks + 1, chunk_n - 1, thread_n, vcf_name, vcf_file, outs, readChunk, &job);
+    mergeParts(data, job.parts, chunk_n);
+    if(data->site_n == 0) {
+        fprintf(stderr, "\nERROR: No sites were found in the VCF file!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    data->size = job.size;
+    fprintf(stderr, "Loaded %li sites of %i populations (%i individuals)\n\n", data->site_n, data->pop_n, job.ind_n);
+
+    free(job.parts);
+    free(job.pop_l);
+    free(job.use);
+    freeChunks(chunks);
+}
+
+/* The counts of each site are stored as alt, hap, ind and mis of each population. The ploidy of each population at the
+   first site of the part gives the number of haplotypes used by sfs, as in poly_sfs */
+void readChunk(Chunk_s *chunk, void *arg) {
+    int i, j, ind_i = 0, sample_n = 0, first = 1, *pop_l = NULL, *counts = NULL, *c = NULL, *v = NULL;
+    char *line = NULL, *use = NULL, **samples = NULL;
+    Record_s rec = {0};
+    Geno_s *g = NULL;
+    Hash_s hash;
+    Job_s *job = arg;
+    Pop_s *pops = job->pops;
+    Part_s *part = &job->parts[chunk->idx];
+    int ind_n = job->ind_n, pop_n = job->pop_n;
+    size_t len = 0;
+    ssize_t read;
+
+    if((counts = malloc(pop_n * 4 * sizeof(int))) == NULL || (part->first = calloc(pop_n * 2, sizeof(int))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    sample_n = job->sample_n;
+    pop_l = job->pop_l;
+    use = job->use;
+    while((read = readSite(chunk, &line, &len, &rec)) != -1) {
+        if(read == 0 && strncmp(line, "#CHROM\t", 7) == 0) {
+            samples = parseSamples(line, &sample_n);
+            if((pop_l = malloc((sample_n + 1) * sizeof(int))) == NULL || (use = calloc(sample_n + 1, sizeof(char))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+            memset(pop_l, -1, (sample_n + 1) * sizeof(int));
+            initHash(&hash, ind_n);
+            for(i = 0; i < ind_n; i++)
+                *addHash(&hash, pops[i].ind) = i;
+            for(j = 0; j < sample_n; j++) {
+                if((v = findHash(&hash, samples[j])) != NULL) {
+                    pop_l[j] = pops[*v].idx;
+                    use[j] = 1;
+                    job->size[pop_l[j]]++;
+                    ind_i++;
+                }
+            }
+            freeHash(&hash);
+            free(samples);
+            if(ind_i == 0) {
+                fprintf(stderr, "\nERROR: Individuals in pops file were not found in the VCF file!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            if(ind_i < ind_n) {
+                fprintf(stderr, "Warning: pops file contains individuals that are not in the VCF file\n\n");
+                ind_n = ind_i;
+            }
+            job->ind_n = ind_n;
+            job->sample_n = sample_n;
+            job->pop_l = pop_l;
+            job->use = use;
+            continue;
+        }
+        if(read == 0)
+            continue;
+        parseGenos(&rec, use, sample_n);
+        memset(counts, 0, pop_n * 4 * sizeof(int));
+        for(i = 0; i < rec.ind_n && i < sample_n; i++) {
+            if(pop_l[i] == -1)
+                continue;
+            g = &rec.geno[i];
+            c = &counts[pop_l[i] * 4];
+            if(first) {
+                part->first[pop_l[i] * 2] += g->ploidy;
+                part->first[pop_l[i] * 2 + 1] += g->ploidy == 0;
+            }
+            if(g->mis) {
+                c[3]++;
+                continue;
+            }
+            c[0] += g->alt;
+            c[1] += g->ploidy;
+            c[2]++;
+        }
+        first = 0;
+        addPart(part, rec.chr, rec.pos, counts, pop_n);
+    }
+
+    freeRecord(&rec);
+    free(line);
+    free(counts);
+}
+
+void addPart(Part_s *part, const char *chr, int pos, const int *counts, int pop_n) {
+    int i;
+
+    for(i = 0; i < pop_n; i++) {
+        if(counts[i * 4 + 1] > UINT16_MAX || counts[i * 4 + 3] > UINT16_MAX) {
+            fprintf(stderr, "\nERROR: Populations with more than %i haplotypes are not supported!\n\n", UINT16_MAX);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if(part->chr_n == 0 || strcmp(part->chrs[part->chr_n - 1], chr) != 0) {
+        if(part->chr_n == part->chr_max) {
+            part->chr_max = part->chr_max > 0 ? part->chr_max * 2 : 16;
+            if((part->chrs = realloc(part->chrs, part->chr_max * sizeof(char *))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+        }
+        if((part->chrs[part->chr_n++] = strdup(chr)) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if(part->n == part->max) {
+        part->max = part->max > 0 ? part->max * 2 : 4096;
+        if((part->chr = realloc(part->chr, part->max * sizeof(int))) == NULL || (part->pos = realloc(part->pos, part->max * sizeof(int))) == NULL || (part->rows = realloc(part->rows, (size_t)part->max * pop_n * 4 * sizeof(uint16_t))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+    }
+    part->chr[part->n] = part->chr_n - 1;
+    part->pos[part->n] = pos;
+    for(i = 0; i < pop_n * 4; i++)
+        part->rows[(size_t)part->n * pop_n * 4 + i] = counts[i];
+    part->n++;
+}
+
+/* A chromosome that was split between chunks gets a single index. Each part is freed once it is copied, so the rows and
+   the columns of all sites are not held at the same time */
+void mergeParts(Data_s *data, Part_s *parts, int chunk_n) {
+    int i, j, k, *map = NULL, *v = NULL;
+    long int s, site_i = 0, site_n = 0, chr_max = 64;
+    const uint16_t *row = NULL;
+    Part_s *part = NULL;
+    Hash_s hash;
+    int pop_n = data->pop_n;
+
+    for(i = 0; i < chunk_n; i++)
+        site_n += parts[i].n;
+    data->site_n = site_n;
+    if((data->chr = malloc((site_n + 1) * sizeof(int))) == NULL || (data->pos = malloc((site_n + 1) * sizeof(int))) == NULL || (data->chrs = malloc(chr_max * sizeof(char *))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    if((data->alt = malloc(((size_t)site_n * pop_n + 1) * sizeof(uint16_t))) == NULL || (data->hap = malloc(((size_t)site_n * pop_n + 1) * sizeof(uint16_t))) == NULL || (data->ind = malloc(((size_t)site_n * pop_n + 1) * sizeof(uint16_t))) == NULL || (data->mis = malloc(((size_t)site_n * pop_n + 1) * sizeof(uint16_t))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    if((data->ploidy = calloc(pop_n, sizeof(int))) == NULL || (data->nul = calloc(pop_n, sizeof(int))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    initHash(&hash, 64);
+    for(i = 0; i < chunk_n; i++) {
+        part = &parts[i];
+        if(part->n > 0 && site_i == 0) {
+            for(k = 0; k < pop_n; k++) {
+                data->ploidy[k] = part->first[k * 2];
+                data->nul[k] = part->first[k * 2 + 1];
+            }
+        }
+        if((map = realloc(map, (part->chr_n + 1) * sizeof(int))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        for(j = 0; j < part->chr_n; j++) {
+            if((v = findHash(&hash, part->chrs[j])) != NULL) {
+                map[j] = *v;
+                free(part->chrs[j]);
+                continue;
+            }
+            if(data->chr_n == chr_max) {
+                chr_max *= 2;
+                if((data->chrs = realloc(data->chrs, chr_max * sizeof(char *))) == NULL) {
+                    fprintf(stderr, merror);
+                    exit(EXIT_FAILURE);
+                }
+            }
+            data->chrs[data->chr_n] = part->chrs[j];
+            *addHash(&hash, part->chrs[j]) = data->chr_n;
+            map[j] = data->chr_n++;
+        }
+        for(s = 0; s < part->n; s++, site_i++) {
+            data->chr[site_i] = map[part->chr[s]];
+            data->pos[site_i] = part->pos[s];
+            row = part->rows + (size_t)s * pop_n * 4;
+            for(k = 0; k < pop_n; k++) {
+                data->alt[(size_t)k * site_n + site_i] = row[k * 4];
+                data->hap[(size_t)k * site_n + site_i] = row[k * 4 + 1];
+                data->ind[(size_t)k * site_n + site_i] = row[k * 4 + 2];
+                data->mis[(size_t)k * site_n + site_i] = row[k * 4 + 3];
+            }
+        }
+        free(part->chrs);
+        free(part->chr);
+        free(part->pos);
+        free(part->rows);
+        free(part->first);
+    }
+
+    free(map);
+    freeHash(&hash);
+}
+
+/* Connections are served one at a time, each until the client closes it. A client that disconnects before reading its
+   answer does not stop the program */
+void serveSocket(Data_s *data, const char *name) {
+    int fd = -1, con = -1, stop = 0;
+    struct sockaddr_un addr;
+    struct stat st;
+    FILE *in = NULL, *out = NULL;
+
+    memset(&addr, 0, sizeof(addr));
+    if(strlen(name) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "\nERROR: The path of -socket [file] is too long\n\n");
+        exit(EXIT_FAILURE);
+    }
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, name);
+    if(stat(name, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(name);
+    if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, 16) == -1) {
+        fprintf(stderr, "\nERROR: Cannot create socket '%s'\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "Listening on %s\n\n", name);
+    while(stop == 0) {
+        if((con = accept(fd, NULL, NULL)) == -1) {
+            if(errno == EINTR || errno == ECONNABORTED)
+                continue;
+            fprintf(stderr, "\nERROR: Cannot accept connections on socket '%s'\n\n", name);
+            exit(EXIT_FAILURE);
+        }
+        if((in = fdopen(con, "r")) == NULL || (out = fdopen(dup(con), "w")) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        stop = serveQueries(data, in, out);
+        fclose(in);
+        fclose(out);
+    }
+
+    close(fd);
+    unlink(name);
+}
+
+/* Returns 1 if the queries ended with quit, and 0 at the end of the input */
+int serveQueries(Data_s *data, FILE *in, FILE *out) {
+    int stop = 0;
+    char *line = NULL;
+    size_t len = 0;
+
+    while(stop == 0 && ferror(out) == 0 && getline(&line, &len, in) != -1) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if(line[strspn(line, " \t")] == '\0' || line[strspn(line, " \t")] == '#')
+            continue;
+        stop = answerQuery(data, line, out);
+        if(stop == 0)
+            fprintf(out, "\n");
+        fflush(out);
+    }
+    free(line);
+
+    return stop;
+}
+
+int answerQuery(Data_s *data, char *line, FILE *out) {
+    int i, token_n = 0, token_max = 16;
+    char err[512] = "", *tok = NULL, **tokens = NULL;
+    Query_s query = {0};
+
+    if((tokens = malloc(token_max * sizeof(char *))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(tok = strtok(line, " \t"); tok != NULL; tok = strtok(NULL, " \t")) {
+        if(token_n == token_max) {
+            token_max *= 2;
+            if((tokens = realloc(tokens, token_max * sizeof(char *))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+        }
+        tokens[token_n++] = tok;
+    }
+    if(strcmp(tokens[0], "quit") == 0) {
+        free(tokens);
+        return 1;
+    }
+    if(strcmp(tokens[0], "pops") == 0) {
+        for(i = 0; i < data->pop_n; i++)
+            fprintf(out, "%s\t%i\n", data->names[i], data->size[i]);
+    } else if(readQuery(data, tokens, token_n, &query, err) == 0)
+        fprintf(out, "ERROR: %s\n", err);
+    else if(query.cmd == QUERY_FST || query.cmd == QUERY_DXY)
+        answerFst(data, &query, out);
+    else if(query.cmd == QUERY_FREQ)
+        answerFreq(data, &query, out);
+    else
+        answerSfs(data, &query, out);
+
+    free(query.off);
+    free(query.members);
+    free(query.labels);
+    free(tokens);
+
+    return 0;
+}
+
+/* Parses the groups and options of a query. Returns 0 with the reason in err if the query cannot be answered */
+int readQuery(Data_s *data, char **tokens, int token_n, Query_s *query, char *err) {
+    int i, k, g, member_n = 0, *v = NULL, *seen = NULL;
+    char *val = NULL, *name = NULL, *copy = NULL, *save = NULL;
+    const char *cmds[4] = {"fst", "dxy", "freq", "sfs"}, *keys[5] = {"mis", "maf", "seed", "sites", "genes"};
+    const int allowed[4] = {27, 27, 11, 13};
+
+    for(i = 0; i < 4; i++) {
+        if(strcmp(tokens[0], cmds[i]) == 0)
+            break;
+    }
+    if(i == 4) {
+        snprintf(err, 512, "Unknown query '%s'. Allowed are fst, dxy, freq, sfs, pops and quit", tokens[0]);
+        return 0;
+    }
+    query->cmd = i;
+    query->mis = query->cmd == QUERY_SFS ? 0.6 : 0;
+    if((query->off = calloc(token_n + 1, sizeof(int))) == NULL || (query->labels = malloc(token_n * sizeof(char *))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(i = 1; i < token_n; i++) {
+        if((val = strchr(tokens[i], '=')) == NULL) {
+            query->labels[query->group_n++] = tokens[i];
+            member_n += 1;
+            for(name = tokens[i]; *name != '\0'; name++)
+                member_n += *name == ',';
+            continue;
+        }
+        *val++ = '\0';
+        for(k = 0; k < 5; k++) {
+            if(strcmp(tokens[i], keys[k]) == 0)
+                break;
+        }
+        if(k == 5) {
+            snprintf(err, 512, "Unknown option '%s='", tokens[i]);
+            return 0;
+        }
+        if((allowed[query->cmd] & (1 << k)) == 0) {
+            snprintf(err, 512, "Option '%s=' cannot be used with %s", keys[k], cmds[query->cmd]);
+            return 0;
+        }
+        if(k < 2 && (isNumeric(val) == 0 || atof(val) < 0 || atof(val) > 1)) {
+            snprintf(err, 512, "Invalid value for %s=[double]", keys[k]);
+            return 0;
+        } else if(k == 2 && isNumeric(val) == 0) {
+            snprintf(err, 512, "Invalid value for seed=[int]");
+            return 0;
+        }
+        if(k == 0)
+            query->mis = atof(val);
+        else if(k == 1)
+            query->maf = atof(val);
+        else if(k == 2)
+            query->seed = atol(val);
+        else if(k == 3 && (query->sites = getList(data, val, 0, err)) == NULL)
+            return 0;
+        else if(k == 4 && (query->genes = getList(data, val, 1, err)) == NULL)
+            return 0;
+    }
+    if(query->group_n < (query->cmd <= QUERY_DXY ? 2 : 1)) {
+        snprintf(err, 512, "%s requires at least %s of populations", cmds[query->cmd], query->cmd <= QUERY_DXY ? "two groups" : "one group");
+        return 0;
+    }
+    if((query->members = malloc(member_n * sizeof(int))) == NULL || (seen = calloc(data->pop_n, sizeof(int))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    member_n = 0;
+    for(g = 0; g < query->group_n; g++) {
+        if((copy = strdup(query->labels[g])) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        for(name = strtok_r(copy, ",", &save); name != NULL; name = strtok_r(NULL, ",", &save)) {
+            if((v = findHash(&data->hash, name)) == NULL)
+                snprintf(err, 512, "Population '%s' is not in the -pops file", name);
+            else if(seen[*v] == g + 1)
+                snprintf(err, 512, "Population '%s' is listed twice in group '%s'", name, query->labels[g]);
+            else {
+                seen[*v] = g + 1;
+                query->members[member_n++] = *v;
+                continue;
+            }
+            break;
+        }
+        free(copy);
+        if(err[0] == '\0' && member_n == query->off[g])
+            snprintf(err, 512, "Group '%s' has no populations", query->labels[g]);
+        if(err[0] != '\0') {
+            free(seen);
+            return 0;
+        }
+        query->off[g + 1] = member_n;
+    }
+    free(seen);
+    if(query->cmd == QUERY_SFS && query->seed == 0) {
+        query->seed = (long int)time(NULL);
+        fprintf(stderr, "Seed number used for imputation: %ld\n\n", query->seed);
+    }
+
+    return 1;
+}
+
+/* A file is matched again only if its modification time or size has changed since the previous query that used it */
+List_s *getList(Data_s *data, const char *name, int genes, char *err) {
+    int i;
+    struct stat st;
+    List_s *list = NULL;
+    FILE *file = NULL;
+
+    if(stat(name, &st) != 0 || (file = fopen(name, "r")) == NULL) {
+        snprintf(err, 512, "Cannot open file %s", name);
+        return NULL;
+    }
+    for(i = 0; i < data->list_n; i++) {
+        list = data->lists[i];
+        if(list->genes == genes && strcmp(list->name, name) == 0)
+            break;
+    }
+    if(i < data->list_n && list->mtime == st.st_mtime && list->size == st.st_size) {
+        fclose(file);
+        return list;
+    }
+    if(i == data->list_n) {
+        if(data->list_n == data->list_max) {
+            data->list_max = data->list_max > 0 ? data->list_max * 2 : 16;
+            if((data->lists = realloc(data->lists, data->list_max * sizeof(List_s *))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+        }
+        if((list = calloc(1, sizeof(List_s))) == NULL || (list->name = strdup(name)) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        list->genes = genes;
+        data->lists[data->list_n++] = list;
+    }
+    list->mtime = st.st_mtime;
+    list->size = st.st_size;
+    matchList(data, list, file);
+    fprintf(stderr, "%s: %li of the sites are listed\n\n", name, list->hit_n);
+
+    return list;
+}
+
+/* A sites file becomes a mask of the sites. A genes file becomes the list of sites within genes, each with the genes
+   that it overlaps */
+void matchList(const Data_s *data, List_s *list, FILE *file) {
+    int i;
+    long int s, hit_max = 0, gene_n = 0, gene_max = 0;
+    SiteCursor_s site_c = {0};
+    FeatureCursor_s gene_c = {0};
+    Sites_s *sites = NULL;
+
+    free(list->mask);
+    free(list->off);
+    free(list->site);
+    free(list->gene);
+    if(list->features != NULL)
+        freeFeatures(list->features);
+    list->mask = NULL;
+    list->off = NULL;
+    list->site = NULL;
+    list->gene = NULL;
+    list->features = NULL;
+    list->hit_n = 0;
+    if(list->genes == 0) {
+        sites = readSites(file);
+        if((list->mask = malloc(data->site_n)) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        for(s = 0; s < data->site_n; s++) {
+            list->mask[s] = findSite(sites, &site_c, data->chrs[data->chr[s]], data->pos[s]);
+            list->hit_n += list->mask[s];
+        }
+        freeSites(sites);
+        return;
+    }
+    list->features = readFeatures(file);
+    if((list->off = calloc(1, sizeof(long int))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(s = 0; s < data->site_n; s++) {
+        if(findFeatures(list->features, &gene_c, data->chrs[data->chr[s]], data->pos[s]) == 0)
+            continue;
+        if(list->hit_n == hit_max) {
+            hit_max = hit_max > 0 ? hit_max * 2 : 1024;
+            if((list->site = realloc(list->site, hit_max * sizeof(long int))) == NULL || (list->off = realloc(list->off, (hit_max + 1) * sizeof(long int))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+        }
+        if(gene_n + gene_c.n > gene_max) {
+            gene_max = gene_max > 0 ? gene_max * 2 : 1024;
+            if(gene_max < gene_n + gene_c.n)
+                gene_max = gene_n + gene_c.n;
+            if((list->gene = realloc(list->gene, gene_max * sizeof(int))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+        }
+        for(i = 0; i < gene_c.n; i++)
+            list->gene[gene_n++] = gene_c.hits[i];
+        list->site[list->hit_n++] = s;
+        list->off[list->hit_n] = gene_n;
+    }
+    free(gene_c.hits);
+}
+
+void freeList(List_s *list) {
+    free(list->name);
+    free(list->mask);
+    free(list->off);
+    free(list->site);
+    free(list->gene);
+    if(list->features != NULL)
+        freeFeatures(list->features);
+    free(list);
+}
+
+/* Pools the counts of the populations of each group at site s */
+void sumGroups(const Data_s *data, const Query_s *query, long int s, Count_s *counts) {
+    int g, m;
+    size_t k;
+
+    for(g = 0; g < query->group_n; g++) {
+        memset(&counts[g], 0, sizeof(Count_s));
+        for(m = query->off[g]; m < query->off[g + 1]; m++) {
+            k = (size_t)query->members[m] * data->site_n + s;
+            counts[g].alt += data->alt[k];
+            counts[g].hap += data->hap[k];
+            counts[g].ind += data->ind[k];
+            counts[g].mis += data->mis[k];
+        }
+    }
+}
+
+/* Group pairs are kept in the order (0,1), (0,2), ..., (1,2), ..., as in poly_fst. The within-group term of hw (hs) is
+   computed once per group and site, and only the pairs that use the site are evaluated. With genes, only the sites
+   within genes are used, and each of them is added to every gene that it overlaps */
+void answerFst(const Data_s *data, const Query_s *query, FILE *out) {
+    int i, j, ok = 0, pair_i = 0, gene_n = 0;
+    long int h, k, s, hit_n = data->site_n;
+    double p1 = 0, p2 = 0;
+    Count_s *counts = NULL;
+    Freq_s *freq = NULL, *f = NULL;
+    Sum_s *site = NULL, *tot = NULL, *sum = NULL;
+    const List_s *genes = query->genes;
+    const char *mask = query->sites != NULL ? query->sites->mask : NULL;
+    int stat = query->cmd == QUERY_DXY, group_n = query->group_n, pair_n = group_n * (group_n - 1) / 2;
+    double mis = query->mis, maf = query->maf;
+
+    if(genes != NULL) {
+        gene_n = genes->features->feature_n;
+        hit_n = genes->hit_n;
+    }
+    if((counts = malloc(group_n * sizeof(Count_s))) == NULL || (freq = malloc(group_n * sizeof(Freq_s))) == NULL || (site = malloc(pair_n * sizeof(Sum_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    if((tot = calloc(pair_n + 1, sizeof(Sum_s))) == NULL || (sum = calloc((size_t)gene_n * pair_n + 1, sizeof(Sum_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(h = 0; h < hit_n; h++) {
+        s = genes != NULL ? genes->site[h] : h;
+        if(mask != NULL && mask[s] == 0)
+            continue;
+        sumGroups(data, query, s, counts);
+        for(i = 0; i < group_n; i++) {
+            f = &freq[i];
+            f->ok = 0;
+            f->ind = counts[i].ind;
+            f->mis = counts[i].mis;
+            f->n = counts[i].hap;
+            f->p = counts[i].alt;
+            if(f->ind == 0 || f->ind / (f->ind + f->mis) < mis)
+                continue;
+            f->p /= f->n;
+            f->ok = f->p >= maf && f->p <= 1 - maf;
+            f->hs = f->p * (1 - f->p) / (f->n - 1);
+        }
+        ok = 0;
+        for(i = 0, pair_i = 0; i < group_n; i++) {
+            p1 = freq[i].p;
+            for(j = i + 1; j < group_n; j++, pair_i++) {
+                p2 = freq[j].p;
+                site[pair_i].n = freq[i].ok && freq[j].ok && (stat == 1 || p1 != 0 || p2 != 0);
+                if(site[pair_i].n == 0)
+                    continue;
+                site[pair_i].hw = (p1 - p2) * (p1 - p2) - freq[i].hs - freq[j].hs;
+                site[pair_i].hb = p1 * (1 - p2) + p2 * (1 - p1);
+                ok++;
+            }
+        }
+        if(ok == 0)
+            continue;
+        addSums(tot, site, pair_n);
+        tot[pair_n].n++;
+        for(k = genes != NULL ? genes->off[h] : 0; genes != NULL && k < genes->off[h + 1]; k++)
+            addSums(sum + (size_t)genes->gene[k] * pair_n, site, pair_n);
+    }
+
+    if(group_n > 2 && gene_n > 0) {
+        for(i = 0; i < gene_n; i++)
+            printMatrix(out, genes->features->ids[i], query->labels, sum + (size_t)i * pair_n, group_n, stat);
+    } else if(group_n > 2)
+        printMatrix(out, "pop", query->labels, tot, group_n, stat);
+    else if(gene_n > 0) {
+        for(i = 0; i < gene_n; i++)
+            fprintf(out, "%s\t%f\t%.0f\n", genes->features->ids[i], stat == 1 ? sum[i].hb / sum[i].n : sum[i].hw / sum[i].hb, sum[i].n);
+    } else
+        fprintf(out, "%f\n", stat == 1 ? tot[0].hb / tot[0].n : tot[0].hw / tot[0].hb);
+
+    free(counts);
+    free(freq);
+    free(site);
+    free(tot);
+    free(sum);
+}
+
+void addSums(Sum_s *sum, const Sum_s *site, int pair_n) {
+    int i;
+    for(i = 0; i < pair_n; i++) {
+        if(site[i].n > 0) {
+            sum[i].hw += site[i].hw;
+            sum[i].hb += site[i].hb;
+            sum[i].n++;
+        }
+    }
+}
+
+/* As in poly_freq, the missing data and minor allele frequency thresholds apply to the individuals of all groups pooled */
+void answerFreq(const Data_s *data, const Query_s *query, FILE *out) {
+    int g, m;
+    long int s;
+    double ind_n = 0, mis_i = 0, alt_i = 0, hap_i = 0;
+    Count_s *counts = NULL;
+    const char *mask = query->sites != NULL ? query->sites->mask : NULL;
+    int group_n = query->group_n;
+    double mis = query->mis, maf = query->maf;
+
+    if((counts = malloc(group_n * sizeof(Count_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(g = 0; g < group_n; g++) {
+        for(m = query->off[g]; m < query->off[g + 1]; m++)
+            ind_n += data->size[query->members[m]];
+        fprintf(out, "\t%s", query->labels[g]);
+    }
+    fprintf(out, "\n");
+    for(s = 0; s < data->site_n && ferror(out) == 0; s++) {
+        if(mask != NULL && mask[s] == 0)
+            continue;
+        sumGroups(data, query, s, counts);
+        mis_i = alt_i = hap_i = 0;
+        for(g = 0; g < group_n; g++) {
+            mis_i += counts[g].mis;
+            alt_i += counts[g].alt;
+            hap_i += counts[g].hap;
+        }
+        if(mis_i / ind_n > 1 - mis || mis_i == ind_n || alt_i / hap_i < maf || alt_i / hap_i > 1 - maf)
+            continue;
+        fprintf(out, "%s:%i", data->chrs[data->chr[s]], data->pos[s]);
+        for(g = 0; g < group_n; g++)
+            fprintf(out, "\t%f", (double)counts[g].alt / counts[g].hap);
+        fprintf(out, "\n");
+    }
+
+    free(counts);
+}
+
+/* The number of haplotypes of a group is the sum of the ploidies of its populations at the first site. Missing alleles
+   are drawn as in poly_sfs, with the place of the group in the query as the population index, so a single population
+   in the place it has in the -pops file gets the same SFS as with poly_sfs -pops and the same -seed */
+void answerSfs(const Data_s *data, const Query_s *query, FILE *out) {
+    int g, m, first = 1;
+    long int s, *off = NULL;
+    unsigned long int key = 0;
+    double p = 0, alt = 0, mis_i = 0, *hap_n = NULL, *sfs = NULL;
+    Count_s *counts = NULL, *c = NULL;
+    const char *mask = query->sites != NULL ? query->sites->mask : NULL;
+    int group_n = query->group_n;
+
+    if((counts = malloc(group_n * sizeof(Count_s))) == NULL || (hap_n = calloc(group_n, sizeof(double))) == NULL || (off = calloc(group_n + 1, sizeof(long int))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(g = 0; g < group_n; g++) {
+        for(m = query->off[g]; m < query->off[g + 1]; m++) {
+            if(data->nul[query->members[m]] > 0) {
+                fprintf(out, "ERROR: Allowed ploidy-levels are 2, 4, 6, and 8!\n");
+                free(counts);
+                free(hap_n);
+                free(off);
+                return;
+            }
+            hap_n[g] += data->ploidy[query->members[m]];
+        }
+    }
+    setOffsets(off, hap_n, NULL, group_n, 0, 0);
+    if((sfs = calloc(off[group_n], sizeof(double))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(s = 0; s < data->site_n; s++) {
+        if(mask != NULL && mask[s] == 0)
+            continue;
+        sumGroups(data, query, s, counts);
+        first = 1;
+        for(g = 0; g < group_n; g++) {
+            c = &counts[g];
+            if(c->hap / hap_n[g] < query->mis || c->hap > hap_n[g])
+                continue;
+            alt = c->alt;
+            if(c->hap < hap_n[g]) {
+                p = (double)c->alt / c->hap;
+                mis_i = hap_n[g] - c->hap;
+                if(p == 1)
+                    alt += mis_i;
+                else if(p > 0) {
+                    if(first) {
+                        key = siteKey(query->seed, data->chrs[data->chr[s]], data->pos[s]);
+                        first = 0;
+                    }
+                    alt += drawBinom(mis_i, p, drawUniform(key, g));
+                }
+            }
+            sfs[off[g] + (int)alt]++;
+        }
+    }
+    for(g = 0; g < group_n; g++) {
+        fprintf(out, "%s\t", query->labels[g]);
+        printSfs(out, sfs + off[g], off[g + 1] - off[g], 0);
+    }
+
+    free(counts);
+    free(hap_n);
+    free(off);
+    free(sfs);
+}
+
+void freeData(Data_s *data) {
+    int i;
+
+    for(i = 0; i < data->pop_n; i++)
+        free(data->names[i]);
+    for(i = 0; i < data->chr_n; i++)
+        free(data->chrs[i]);
+    for(i = 0; i < data->list_n; i++)
+        freeList(data->lists[i]);
+    free(data->names);
+    free(data->chrs);
+    free(data->lists);
+    free(data->chr);
+    free(data->pos);
+    free(data->size);
+    free(data->ploidy);
+    free(data->nul);
+    free(data->alt);
+    free(data->hap);
+    free(data->ind);
+    free(data->mis);
+    freeHash(&data->hash);
+}
+
+int isNumeric(const char *s) {
+    char *p;
+    if(s == NULL || *s == '\0' || isspace(*s))
+        return 0;
+    strtod(s, &p);
+    return *p == '\0';
+}
+
+void stringTerminator(char *string) {
+    string[strcspn(string, "\n")] = 0;
+}
+
+void printHelp(void) {
+    fprintf(stderr, "\nProgram for answering repeated Fst/Dxy, allele frequency and SFS queries on mixed ploidy VCF files without re-reading them.\n");
+    fprintf(stderr, "Queries are read one per line from stdin (or from -socket) and answered in the format of poly_fst, poly_freq or poly_sfs.\n\n");
+    fprintf(stderr, "Usage:\n");
+    fprintf(stderr, "-vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8. Can be bgzip-compressed or a BCF file.\n");
+    fprintf(stderr, "-cache [file] Binary genotype cache. With -vcf, the VCF file is first converted into this file; without it, an existing cache is read instead of a VCF file. Optional.\n");
+    fprintf(stderr, "-pops [file] Tab delimited file listing individuals to use and their populations (format: individual id, population id).\n");
+    fprintf(stderr, "-region [chr:start-end] Only loads sites within the region (for example chr1:1000-2000 or chr1). Uses the .tbi or .csi index of a bgzip-compressed VCF file to read only that part of the file. Optional.\n");
+    fprintf(stderr, "-threads [int] Number of threads used for loading parts of the VCF file in parallel. A pipe or a gzip file is read as one part, with its lines parsed on the threads. Default 1.\n");
+    fprintf(stderr, "-socket [file] Answers queries sent to a Unix domain socket created at this path, one connection at a time, instead of queries read from stdin. Optional.\n\n");
+    fprintf(stderr, "Queries (groups are comma separated lists of populations):\n");
+    fprintf(stderr, "fst [group] [group] ... Fst between the groups, as poly_fst -out 1 (two groups) or -pops (more groups). Options mis=, maf=, sites= and genes=.\n");
+    fprintf(stderr, "dxy [group] [group] ... Dxy between the groups, as fst.\n");
+    fprintf(stderr, "freq [group] ... Allele frequencies of the groups, as poly_freq. Options mis=, maf= and sites=.\n");
+    fprintf(stderr, "sfs [group] ... SFS of each group, as poly_sfs -pops. Options mis=, seed= and sites=.\n");
+    fprintf(stderr, "pops Lists the populations and their numbers of individuals.\n");
+    fprintf(stderr, "quit Stops the program.\n\n");
+    fprintf(stderr, "Example:\n");
+    fprintf(stderr, "./poly_query -cache in.cache -pops pops.txt -socket /tmp/poly.sock\n");
+    fprintf(stderr, "echo \"fst dip1,dip2 tet1,tet2,tet3 genes=genes.txt mis=0.8\" | nc -U /tmp/poly.sock\n\n");
+}
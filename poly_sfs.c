@@ -16,18 +16,41 @@
  ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
 
  Program for estimating SFS from mixed ploidy VCF files. Missing alleles are imputed by drawing them from a Bernoulli distribution.
+ With -pops, each output line holds a population id and its SFS. The joint SFS of a population pair is written on one line
+ row by row, with a row for each allele count in the first population. The -jackknife standard errors and -bootstrap replicates
+ follow the spectra on lines of the same layout, labelled with se and bootN (after the population id with -pops).
+ With -gl, genotypes are not imputed: the SFS is fitted by EM to the genotype likelihoods of the sites and written as the
+ expected number of sites in each bin. -mis then refers to the proportion of haplotypes with likelihoods.
+ With -project, missing alleles are not imputed: the allele count of each site is projected down to a fixed number of
+ haplotypes with hypergeometric weights, and each bin holds the expected number of sites, so no random numbers are drawn.
 
- Compiling: gcc poly_sfs.c -o poly_sfs -lm
+ Compiling: gcc poly_sfs.c vcf_parse.c vcf_thread.c vcf_cache.c vcf_bcf.c vcf_write.c vcf_block.c vcf_state.c vcf_pop.c vcf_rand.c bgzf.c -o poly_sfs -lm -lpthread -lz
 
  Usage:
- -vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8.
+ -vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8. Can be bgzip-compressed or a BCF file.
+ -cache [file] Binary genotype cache. With -vcf, the VCF file is first converted into this file; without it, an existing cache is read instead of a VCF file. Optional.
  -inds [file] File listing individuals to use. Optional.
+ -pops [file] Tab delimited file listing individuals and their populations (format: individual id, population id). Used instead of -inds to estimate the SFS of each population in one pass. Optional.
+ -pairs [string] Population pairs for which to also estimate the joint (2D) SFS with -pops, either 'all' or a comma separated list (for example pop1:pop2,pop1:pop3). Optional.
  -sites [file] Tab delimited file listing sites to use (format: chr, pos). Optional.
  -mis [double] Excludes sites based of the proportion of missing data (0 = all missing allowed, 1 = no missing data allowed). Default 0.6.
- -seed [int] Seed number used for imputation. Default is a random seed.
+ -seed [int] Seed number used for imputation and -bootstrap. Default is a random seed.
+ -gl [string] Estimates the SFS by EM from genotype likelihoods instead of imputing genotype calls, using the FORMAT field 'PL' (phred-scaled likelihoods), 'GL' (log10 likelihoods) or 'GP' (genotype probabilities). The ploidy is still read from GT. Cannot be used with -cache, -pairs, -jackknife or a BCF file. Optional.
+ -glstore [string] Whether the site likelihoods of -gl are kept in memory ('mem') or in memory-mapped temporary files ('mmap'). Default 'mem'.
+ -project [int] Projects the observed allele counts of each site down to the given number of haplotypes with hypergeometric weights instead of imputing missing alleles, giving a deterministic SFS of fractional site counts. Sites with fewer observed haplotypes in a population are left out of its SFS. Cannot be used with -gl. Optional.
+ -jackknife [int] Also prints the block-jackknife standard error of each SFS bin, using blocks of the given number of base pairs. Optional.
+ -bootstrap [int] Also prints the given number of bootstrap replicates of each SFS, resampling the -jackknife blocks. Optional.
+ -region [chr:start-end] Only uses sites within the region (for example chr1:1000-2000 or chr1). Uses the .tbi or .csi index of a bgzip-compressed VCF file to read only that part of the file. Optional.
+ -threads [int] Number of threads used for processing parts of the VCF file in parallel. A pipe or a gzip file is read as one part, with its lines parsed on the threads. Imputation draws its random numbers from the seed and the position of each site, so results do not depend on the number of threads. Default 1.
+ -state [file] Writes the SFS of the run into a binary state file instead of printing it, for example for one chromosome of a cluster run given with -region. With the same -seed in every part, the merged SFS equals that of a single run. Cannot be used with -gl or -jackknife. Optional.
+ -merge [file] File listing state files written with -state (one per line). Sums the states and prints the SFS of the whole run. Used instead of all other options, which are taken from the state files. Optional.
 
  Example:
  ./poly_sfs -vcf in.vcf -inds inds.txt -sites 4fold.sites -mis 0.8 -seed 1524796 > out.sfs
+ ./poly_sfs -vcf in.vcf -pops pops.txt -gl PL -mis 0.8 > out.sfs
+ ./poly_sfs -vcf in.vcf -pops pops.txt -project 20 -mis 0.8 > out.sfs
+ ./poly_sfs -vcf in.vcf.gz -pops pops.txt -mis 0.8 -seed 1524796 -region chr1 -state chr1.state
+ ./poly_sfs -merge states.txt > out.sfs
 */
 
 #include <ctype.h>
@@ -35,19 +58,76 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <time.h>
 #include <unistd.h>
+#include "vcf_block.h"
+#include "vcf_parse.h"
+#include "vcf_pop.h"
+#include "vcf_rand.h"
+#include "vcf_state.h"
+#include "vcf_thread.h"
 #define merror "ERROR: System out of memory\n\n"
 
 typedef struct {
-    int pos;
-    char chr[100];
-} Site_s;
+    int idx;
+    char ind[200];
+} Pop_s;
+
+typedef struct {
+    int lo, len;
+    double *w;
+} Proj_s;
+
+typedef struct {
+    long int size;
+    Proj_s *tab;
+} Projs_s;
+
+typedef struct {
+    int ok;
+    double alt, hap;
+    Proj_s proj;
+} Count_s;
+
+typedef struct {
+    long int site_n, max;
+    float *lik;
+    FILE *tmp;
+} Lik_s;
+
+typedef struct {
+    int ind_n, pop_n, pair_n, sample_n, split, gl, store, project, *pop_l, *pairs;
+    long int seed, block;
+    double mis, *hap_n, *lchoose;
+    long int *off;
+    unsigned int **sfs;
+    double **proj;
+    char *use, **names;
+    Pop_s *pops;
+    Sites_s *sites;
+    Blocks_s *blocks;
+    Lik_s *liks;
+    Projs_s *projs;
+} Job_s;
 
 void openFiles(int argc, char *argv[]);
-char **readInds(FILE *ind_file, int *n);
-Site_s *readSites(FILE *site_file, int *n);
-void readVcf(FILE *vcf_file, char **inds, Site_s *sites, int ind_n, int site_n, long int seed, double mis);
+Pop_s *readInds(FILE *ind_file, int *n);
+Pop_s *readPops(FILE *pop_file, char ***names, int *n, int *m);
+int *readPairs(char *str, char **names, int pop_n, int *n);
+void readVcf(Bgzf_s *vcf_file, Cache_s *cache, const char *vcf_name, const Region_s *region, Pop_s *pops, char **names, Sites_s *sites, int *pairs, int ind_n, int pop_n, int pair_n, int thread_n, int boot_n, int gl, int project, int store, long int block, long int seed, double mis, const char *state_name);
+void readChunk(Chunk_s *chunk, void *arg);
+void initSpectra(Job_s *job);
+void addLiks(Job_s *job, Lik_s *lik, const Record_s *rec, const Count_s *counts, const int *pop_l, double *a, int *cur, double **miss);
+int readLiks(const char *p, int type, int m, double *v);
+void fitSfs(Job_s *job, int chunk_n);
+void projectSite(Job_s *job, Projs_s *projs, Count_s *counts, double *sfs, double *b, long int tot_i);
+const Proj_s *findProj(Projs_s *projs, int n, int m, int a);
+void printSpectra(const double *sfs, const long int *off, char **names, const int *pairs, int pop_n, int pair_n, int frac);
+void saveState(const char *name, const Job_s *job, const double *sfs);
+void mergeStates(FILE *merge_file);
+void printBlocks(Job_s *job, int chunk_n, int boot_n, int frac);
+void printLabel(char **names, const int *pairs, int pop_n, int i, const char *name, int rep);
 int isNumeric(const char *s);
 void stringTerminator(char *string);
 void printHelp(void);
@@ -76,12 +156,16 @@ int main(int argc, char *argv[]) {
 }
 
 void openFiles(int argc, char *argv[]) {
-    int i, ind_n = 0, site_n = 0;
-    long int seed = 0;
+    int i, ind_n = 0, pop_n = 1, pair_n = 0, thread_n = 1, boot_n = 0, gl = 0, store = 0, project = 0, *pairs = NULL;
+    long int seed = 0, block = 0;
     double mis = 0.6;
-    char **inds = NULL;
-    Site_s *sites = NULL;
-    FILE *vcf_file = NULL, *ind_file = NULL, *site_file = NULL;
+    char temp[10], *vcf_name = NULL, *cache_name = NULL, *pair_str = NULL, *state_name = NULL, **names = NULL;
+    Pop_s *pops = NULL;
+    Sites_s *sites = NULL;
+    Region_s region, *reg = NULL;
+    Bgzf_s *vcf_file = NULL;
+    Cache_s *cache = NULL;
+    FILE *ind_file = NULL, *pop_file = NULL, *site_file = NULL, *merge_file = NULL;
 
     if(argc == 1) {
         printHelp();
@@ -92,17 +176,30 @@ void openFiles(int argc, char *argv[]) {
 
     for(i = 1; i < argc; i++) {
         if(strcmp(argv[i], "-vcf") == 0) {
-            if((vcf_file = fopen(argv[++i], "r")) == NULL) {
+            if((vcf_file = openBgzf(argv[++i])) == NULL) {
                 fprintf(stderr, "ERROR: Cannot open file %s\n\n", argv[i]);
                 exit(EXIT_FAILURE);
             }
+            vcf_name = argv[i];
             fprintf(stderr, "\t-vcf %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-cache") == 0) {
+            cache_name = argv[++i];
+            fprintf(stderr, "\t-cache %s\n", argv[i]);
         } else if(strcmp(argv[i], "-inds") == 0) {
             if((ind_file = fopen(argv[++i], "r")) == NULL) {
                 fprintf(stderr, "ERROR: Cannot open file %s\n\n", argv[i]);
                 exit(EXIT_FAILURE);
             }
             fprintf(stderr, "\t-inds %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-pops") == 0) {
+            if((pop_file = fopen(argv[++i], "r")) == NULL) {
+                fprintf(stderr, "ERROR: Cannot open file %s\n\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-pops %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-pairs") == 0) {
+            pair_str = argv[++i];
+            fprintf(stderr, "\t-pairs %s\n", argv[i]);
         } else if(strcmp(argv[i], "-sites") == 0) {
             if((site_file = fopen(argv[++i], "r")) == NULL) {
                 fprintf(stderr, "ERROR: Cannot open file %s\n\n", argv[i]);
@@ -129,6 +226,80 @@ void openFiles(int argc, char *argv[]) {
                 exit(EXIT_FAILURE);
             }
             fprintf(stderr, "\t-seed %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-gl") == 0) {
+            strncpy(temp, argv[++i], 9);
+            temp[9] = '\0';
+            if(strcmp(temp, "PL") == 0)
+                gl = 1;
+            else if(strcmp(temp, "GL") == 0)
+                gl = 2;
+            else if(strcmp(temp, "GP") == 0)
+                gl = 3;
+            else {
+                fprintf(stderr, "ERROR: Invalid input for -gl [string]! Allowed are 'PL', 'GL' and 'GP'\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-gl %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-glstore") == 0) {
+            strncpy(temp, argv[++i], 9);
+            temp[9] = '\0';
+            if(strcmp(temp, "mem") == 0)
+                store = 0;
+            else if(strcmp(temp, "mmap") == 0)
+                store = 1;
+            else {
+                fprintf(stderr, "ERROR: Invalid input for -glstore [string]! Allowed are 'mem' and 'mmap'\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-glstore %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-project") == 0) {
+            if(isNumeric(argv[++i]))
+                project = atoi(argv[i]);
+            if(project < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "ERROR: Invalid value for -project [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-project %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-jackknife") == 0) {
+            if(isNumeric(argv[++i]))
+                block = atol(argv[i]);
+            if(block < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "ERROR: Invalid value for -jackknife [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-jackknife %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-bootstrap") == 0) {
+            if(isNumeric(argv[++i]))
+                boot_n = atoi(argv[i]);
+            if(boot_n < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "ERROR: Invalid value for -bootstrap [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-bootstrap %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-region") == 0) {
+            if(parseRegion(argv[++i], &region) == 0) {
+                fprintf(stderr, "ERROR: Invalid value for -region [chr:start-end]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            reg = &region;
+            fprintf(stderr, "\t-region %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-threads") == 0) {
+            if(isNumeric(argv[++i]))
+                thread_n = atoi(argv[i]);
+            if(thread_n < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "ERROR: Invalid value for -threads [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-threads %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-state") == 0) {
+            state_name = argv[++i];
+            fprintf(stderr, "\t-state %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-merge") == 0) {
+            if((merge_file = fopen(argv[++i], "r")) == NULL) {
+                fprintf(stderr, "ERROR: Cannot open file %s\n\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-merge %s\n", argv[i]);
         } else if(strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             fprintf(stderr, "\t%s\n", argv[i]);
             printHelp();
@@ -140,42 +311,91 @@ void openFiles(int argc, char *argv[]) {
     }
     fprintf(stderr, "\n");
 
-    if(vcf_file == NULL) {
-        fprintf(stderr, "ERROR: -vcf [file] is required!\n\n");
+    if(merge_file != NULL) {
+        if(argc > 3) {
+            fprintf(stderr, "ERROR: -merge [file] cannot be used with other options, which are taken from the state files!\n\n");
+            exit(EXIT_FAILURE);
+        }
+        mergeStates(merge_file);
+        return;
+    }
+    if((vcf_file == NULL && cache_name == NULL)) {
+        fprintf(stderr, "ERROR: -vcf [file] (or -cache [file]) is required!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(pop_file != NULL && ind_file != NULL) {
+        fprintf(stderr, "ERROR: -pops [file] cannot be used together with -inds [file]!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(pair_str != NULL && pop_file == NULL) {
+        fprintf(stderr, "ERROR: -pairs [string] requires -pops [file]!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(boot_n > 0 && block == 0) {
+        fprintf(stderr, "ERROR: -bootstrap [int] requires the block size given with -jackknife [int]!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(gl > 0 && (cache_name != NULL || pair_str != NULL || block > 0)) {
+        fprintf(stderr, "ERROR: -gl [string] cannot be used with -cache [file], -pairs [string] or -jackknife [int]!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(gl > 0 && project > 0) {
+        fprintf(stderr, "ERROR: -project [int] cannot be used with -gl [string]!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(state_name != NULL && (gl > 0 || block > 0)) {
+        fprintf(stderr, "ERROR: -state [file] cannot be used with -gl [string] or -jackknife [int]!\n\n");
         exit(EXIT_FAILURE);
     }
-    if(mis < 0.6)
+    if(cache_name != NULL) {
+        if(vcf_file != NULL) {
+            writeCache(vcf_file, cache_name);
+            closeBgzf(vcf_file);
+            vcf_file = NULL;
+            vcf_name = NULL;
+        }
+        if((cache = openCache(cache_name)) == NULL) {
+            fprintf(stderr, "ERROR: Cannot open file %s\n\n", cache_name);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if(mis < 0.6 && gl == 0 && project == 0)
         fprintf(stderr, "Warning: When over 40%% missing data is allowed, imputation is unreliable\n\n");
     if(ind_file != NULL)
-        inds = readInds(ind_file, &ind_n);
+        pops = readInds(ind_file, &ind_n);
+    if(pop_file != NULL) {
+        pop_n = 0;
+        pops = readPops(pop_file, &names, &ind_n, &pop_n);
+        if(pair_str != NULL)
+            pairs = readPairs(pair_str, names, pop_n, &pair_n);
+    }
     if(site_file != NULL)
-        sites = readSites(site_file, &site_n);
-    readVcf(vcf_file, inds, sites, ind_n, site_n, seed, mis);
+        sites = readSites(site_file);
+    readVcf(vcf_file, cache, vcf_name, reg, pops, names, sites, pairs, ind_n, pop_n, pair_n, thread_n, boot_n, gl, project, store, block, seed, mis, state_name);
 }
 
-char **readInds(FILE *ind_file, int *n) {
+Pop_s *readInds(FILE *ind_file, int *n) {
     double list_i = 100;
-    char *line = NULL, **list = NULL;
+    char *line = NULL;
+    Pop_s *list = NULL;
     size_t len = 0;
     ssize_t read;
 
-    if((list = malloc(list_i * sizeof(char *))) == NULL) {
+    if((list = malloc(list_i * sizeof(Pop_s))) == NULL) {
         fprintf(stderr, merror);
         exit(EXIT_FAILURE);
     }
     while((read = getline(&line, &len, ind_file)) != -1) {
         if(line[0] == '\n' || line[0] == '#')
             continue;
-        if((list[*n] = malloc(read * sizeof(char))) == NULL) {
-            fprintf(stderr, merror);
-            exit(EXIT_FAILURE);
-        }
         stringTerminator(line);
-        strcpy(list[*n], line);
+        strncpy(list[*n].ind, line, 199);
+        list[*n].ind[199] = '\0';
+        list[*n].idx = 1;
         *n = *n + 1;
         if(*n >= list_i) {
             list_i += 50;
-            if((list = realloc(list, list_i * sizeof(char *))) == NULL) {
+            if((list = realloc(list, list_i * sizeof(Pop_s))) == NULL) {
                 fprintf(stderr, merror);
                 exit(EXIT_FAILURE);
             }
@@ -188,37 +408,54 @@ char **readInds(FILE *ind_file, int *n) {
     return list;
 }
 
-Site_s *readSites(FILE *site_file, int *n) {
-    double list_i = 1e6;
-    char *line = NULL;
-    Site_s *list = NULL;
+Pop_s *readPops(FILE *pop_file, char ***names, int *n, int *m) {
+    int i;
+    int *v = NULL;
+    double list_i = 200, names_i = 50;
+    char *line = NULL, *ind = NULL, *pop = NULL;
+    Pop_s *list = NULL;
+    Hash_s hash;
     size_t len = 0;
     ssize_t read;
 
-    if((list = malloc(list_i * sizeof(Site_s))) == NULL) {
+    if((list = malloc(list_i * sizeof(Pop_s))) == NULL || (*names = malloc(names_i * sizeof(char *))) == NULL) {
         fprintf(stderr, merror);
         exit(EXIT_FAILURE);
     }
-    while((read = getline(&line, &len, site_file)) != -1) {
+    initHash(&hash, 50);
+    while((read = getline(&line, &len, pop_file)) != -1) {
         if(line[0] == '\n' || line[0] == '#')
             continue;
-        strncpy(list[*n].chr, strtok(line, "\t"), 99);
-        list[*n].pos = atoi(strtok(NULL, "\t"));
-        if(*n > 0) {
-            if(strcmp(list[*n].chr, list[*n - 1].chr) < 0) {
-                fprintf(stderr, "ERROR: Site file is not sorted. Use: sort -k1,1 -k2,2n list.sites > sorted.sites\n\n");
+        stringTerminator(line);
+        if((ind = strtok(line, "\t")) == NULL || (pop = strtok(NULL, "\t")) == NULL) {
+            fprintf(stderr, "ERROR: -pops file should have two tab delimited columns (individual id, population id)!\n\n");
+            exit(EXIT_FAILURE);
+        }
+        if((v = findHash(&hash, pop)) != NULL)
+            i = *v;
+        else {
+            i = *m;
+            if(((*names)[i] = strdup(pop)) == NULL) {
+                fprintf(stderr, merror);
                 exit(EXIT_FAILURE);
-            } else if(strcmp(list[*n].chr, list[*n - 1].chr) == 0) {
-                if(list[*n].pos < list[*n - 1].pos) {
-                    fprintf(stderr, "ERROR: Site file is not sorted. Use: sort -k1,1 -k2,2n list.sites > sorted.sites\n\n");
+            }
+            *addHash(&hash, (*names)[i]) = i;
+            *m = *m + 1;
+            if(*m >= names_i) {
+                names_i += 50;
+                if((*names = realloc(*names, names_i * sizeof(char *))) == NULL) {
+                    fprintf(stderr, merror);
                     exit(EXIT_FAILURE);
                 }
             }
         }
+        strncpy(list[*n].ind, ind, 199);
+        list[*n].ind[199] = '\0';
+        list[*n].idx = i + 1;
         *n = *n + 1;
         if(*n >= list_i) {
-            list_i += 1e5;
-            if((list = realloc(list, list_i * sizeof(Site_s))) == NULL) {
+            list_i += 100;
+            if((list = realloc(list, list_i * sizeof(Pop_s))) == NULL) {
                 fprintf(stderr, merror);
                 exit(EXIT_FAILURE);
             }
@@ -226,196 +463,814 @@ Site_s *readSites(FILE *site_file, int *n) {
     }
 
     free(line);
-    fclose(site_file);
+    freeHash(&hash);
+    fclose(pop_file);
 
     return list;
 }
 
-void readVcf(FILE *vcf_file, char **inds, Site_s *sites, int ind_n, int site_n, long int seed, double mis) {
-    int i, j = 0, pos = 0, ok = 0, stop = 0, ind_i = 0, site_i = 0, mis_i = 0, *ind_l = NULL;
-    double alt_i = 0, hap_i = 0, hap_n = 0, p = 0, *sfs = NULL;
-    char chr[100], hap[50], *line = NULL, *temp = NULL, *end = NULL;
-    size_t len = 0;
-    ssize_t read;
+int *readPairs(char *str, char **names, int pop_n, int *n) {
+    int i, j, *list = NULL;
+    char *tok = NULL, *sep = NULL;
 
-    if(seed == 0) {
+    if((list = malloc(pop_n * pop_n * sizeof(int))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    if(strcmp(str, "all") == 0) {
+        for(i = 0; i < pop_n; i++) {
+            for(j = i + 1; j < pop_n; j++) {
+                list[*n * 2] = i;
+                list[*n * 2 + 1] = j;
+                *n = *n + 1;
+            }
+        }
+        return list;
+    }
+    for(tok = strtok(str, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        if((sep = strchr(tok, ':')) == NULL) {
+            fprintf(stderr, "ERROR: Invalid value for -pairs [string]! Use 'all' or a list like pop1:pop2,pop1:pop3\n\n");
+            exit(EXIT_FAILURE);
+        }
+        *sep = '\0';
+        for(i = 0; i < pop_n && strcmp(names[i], tok) != 0; i++)
+            ;
+        for(j = 0; j < pop_n && strcmp(names[j], sep + 1) != 0; j++)
+            ;
+        if(i == pop_n || j == pop_n || i == j) {
+            fprintf(stderr, "ERROR: Invalid population pair '%s:%s' in -pairs!\n\n", tok, sep + 1);
+            exit(EXIT_FAILURE);
+        }
+        if(*n >= pop_n * pop_n / 2) {
+            fprintf(stderr, "ERROR: Too many pairs in -pairs [string]!\n\n");
+            exit(EXIT_FAILURE);
+        }
+        list[*n * 2] = i;
+        list[*n * 2 + 1] = j;
+        *n = *n + 1;
+    }
+
+    return list;
+}
+
+void readVcf(Bgzf_s *vcf_file, Cache_s *cache, const char *vcf_name, const Region_s *region, Pop_s *pops, char **names, Sites_s *sites, int *pairs, int ind_n, int pop_n, int pair_n, int thread_n, int boot_n, int gl, int project, int store, long int block, long int seed, double mis, const char *state_name) {
+    int i, j, chunk_n = 0;
+    long int k;
+    double *sfs = NULL;
+    FILE *outs[2] = {stdout, NULL};
+    Chunk_s *chunks = NULL;
+    Job_s job = {ind_n, pop_n, pair_n, 0, 0, gl, store, project, NULL, pairs, 0, block, mis, NULL, NULL, NULL, NULL, NULL, NULL, names, pops, sites, NULL, NULL, NULL};
+
+    if(seed == 0 && gl == 0 && (project == 0 || boot_n > 0)) {
         seed = (long int)time(NULL);
-        fprintf(stderr, "Seed number used for imputation: %ld\n\n", seed);
+        fprintf(stderr, "Seed number used for %s: %ld\n\n", project == 0 ? "imputation" : "-bootstrap", seed);
     }
-    srand(seed);
+    job.seed = seed;
 
-    while((read = getline(&line, &len, vcf_file)) != -1) {
-        if(line[0] == '\n' || (line[0] == '#' && line[1] == '#'))
+    if(cache != NULL)
+        chunks = splitCache(cache, region, thread_n, 0, &chunk_n);
+    else
+        chunks = splitVcf(vcf_file, vcf_name, region, thread_n, 0, &chunk_n);
+    if(gl > 0 && chunks[0].bcf != NULL) {
+        fprintf(stderr, "ERROR: -gl [string] cannot be used with a BCF file, as only GT is decoded from BCF records!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    job.split = chunk_n > 2;
+    if(block > 0 && (job.blocks = calloc(chunk_n, sizeof(Blocks_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    if(gl > 0 && (job.liks = calloc(chunk_n, sizeof(Lik_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    if(project > 0 && ((job.proj = calloc(thread_n, sizeof(double *))) == NULL || (job.projs = calloc(thread_n, sizeof(Projs_s))) == NULL)) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    if((job.sfs = calloc(thread_n, sizeof(unsigned int *))) == NULL || (job.hap_n = calloc(pop_n, sizeof(double))) == NULL || (job.off = calloc(pop_n + pair_n + 1, sizeof(long int))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    runChunks(chunks, 1, 1, vcf_name, vcf_file, outs, readChunk, &job);
+    if(job.split == 0)
+        runChunks(chunks + 1, chunk_n - 1, thread_n, vcf_name, vcf_file, outs, readChunk, &job);
+    else if(countHaps(vcf_file, chunks + 1, chunk_n - 1, job.sites, job.use, job.pop_l, job.sample_n, job.hap_n) > 0) {
+        initSpectra(&job);
+        runChunks(chunks + 1, chunk_n - 1, thread_n, vcf_name, vcf_file, outs, readChunk, &job);
+    }
+    for(i = 0; i < thread_n; i++) {
+        if(job.sfs[i] == NULL && (project == 0 || job.proj[i] == NULL))
             continue;
-        temp = strtok_r(line, "\t", &end);
-        j = 1;
-        if(strcmp(temp, "#CHROM") == 0) {
+        if(sfs == NULL && (sfs = calloc(job.off[pop_n + pair_n], sizeof(double))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        for(j = 0; j < job.off[pop_n + pair_n]; j++)
+            sfs[j] += project > 0 ? job.proj[i][j] : job.sfs[i][j];
+        free(job.sfs[i]);
+        if(project == 0)
+            continue;
+        free(job.proj[i]);
+        for(k = 0; k < job.projs[i].size; k++)
+            free(job.projs[i].tab[k].w);
+        free(job.projs[i].tab);
+    }
+    if(state_name != NULL)
+        saveState(state_name, &job, sfs);
+    if(gl > 0) {
+        fitSfs(&job, chunk_n);
+        free(sfs);
+    } else if(sfs == NULL)
+        fprintf(stderr, "Warning: SFS is empty. Please check your input files!\n\n");
+    else if(state_name != NULL)
+        free(sfs);
+    else {
+        printSpectra(sfs, job.off, names, pairs, pop_n, pair_n, project > 0);
+        if(block > 0)
+            printBlocks(&job, chunk_n, boot_n, project > 0);
+        if(isatty(1))
+            fprintf(stderr, "\n");
+        free(sfs);
+    }
+    if(ind_n > 0) {
+        free(pops);
+        free(job.use);
+        free(job.pop_l);
+    }
+    for(i = 0; names != NULL && i < pop_n; i++)
+        free(names[i]);
+    free(names);
+    free(pairs);
+    free(job.sfs);
+    free(job.proj);
+    free(job.projs);
+    free(job.hap_n);
+    free(job.off);
+    free(job.lchoose);
+    free(job.blocks);
+    free(job.liks);
+    freeChunks(chunks);
+    if(sites != NULL)
+        freeSites(sites);
+    if(cache != NULL)
+        closeCache(cache);
+    else
+        closeBgzf(vcf_file);
+}
+
+void readChunk(Chunk_s *chunk, void *arg) {
+    int i, j = 0, k = 0, ind_i = 0, mis_i = 0, sample_n = 0, hap_max = 0, *pop_l = NULL, *v = NULL, *cur = NULL;
+    const char *gl_keys[4] = {NULL, "PL", "GL", "GP"};
+    unsigned int *sfs = NULL;
+    unsigned long int key = 0;
+    long int tot_i = 0;
+    double p = 0, *hap_n = NULL, *b = NULL, *conv = NULL, *proj = NULL, **miss = NULL;
+    char *line = NULL, *use = NULL, **samples = NULL;
+    Record_s rec = {0};
+    SiteCursor_s site_c = {0};
+    Geno_s *g = NULL;
+    Hash_s hash;
+    Count_s *counts = NULL, *c = NULL;
+    Job_s *job = arg;
+    Pop_s *pops = job->pops;
+    Sites_s *sites = job->sites;
+    Blocks_s *blocks = job->blocks != NULL ? &job->blocks[chunk->idx] : NULL;
+    char **names = job->names;
+    int ind_n = job->ind_n, pop_n = job->pop_n, pair_n = job->pair_n, split = job->split, *pairs = job->pairs, first = 1;
+    double mis = job->mis;
+    size_t len = 0;
+    ssize_t read;
+
+    if((counts = malloc(pop_n * sizeof(Count_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    sample_n = job->sample_n;
+    use = job->use;
+    pop_l = job->pop_l;
+    hap_n = job->hap_n;
+    sfs = job->sfs[chunk->thread];
+    if(job->project > 0)
+        proj = job->proj[chunk->thread];
+    while((read = readSite(chunk, &line, &len, &rec)) != -1) {
+        if(read == 0 && strncmp(line, "#CHROM\t", 7) == 0) {
             if(ind_n == 0)
                 continue;
-            if((ind_l = calloc(read, sizeof(int))) == NULL) {
+            samples = parseSamples(line, &sample_n);
+            if((use = calloc(sample_n + 1, sizeof(char))) == NULL || (pop_l = calloc(sample_n + 1, sizeof(int))) == NULL) {
                 fprintf(stderr, merror);
                 exit(EXIT_FAILURE);
             }
-            while(temp != NULL) {
-                if(j > 9) {
-                    stringTerminator(temp);
-                    for(i = 0; i < ind_n; i++) {
-                        if(strcmp(temp, inds[i]) == 0) {
-                            ind_l[j] = 1;
-                            ind_i++;
-                        }
-                    }
+            initHash(&hash, ind_n);
+            for(i = 0; i < ind_n; i++)
+                *addHash(&hash, pops[i].ind) = i;
+            for(j = 0; j < sample_n; j++) {
+                if((v = findHash(&hash, samples[j])) != NULL) {
+                    use[j] = 1;
+                    pop_l[j] = pops[*v].idx;
+                    ind_i++;
                 }
-                temp = strtok_r(NULL, "\t", &end);
-                j++;
             }
+            freeHash(&hash);
+            free(samples);
             if(ind_i == 0) {
-                fprintf(stderr, "ERROR: Individuals in -ind file were not found in the VCF file!\n\n");
+                fprintf(stderr, "ERROR: Individuals in %s file were not found in the VCF file!\n\n", names != NULL ? "-pops" : "-ind");
                 exit(EXIT_FAILURE);
             }
             if(ind_i < ind_n)
-                fprintf(stderr, "Warning: -ind file contain individuals that are not in the VCF file\n\n");
+                fprintf(stderr, "Warning: %s file contain individuals that are not in the VCF file\n\n", names != NULL ? "-pops" : "-ind");
+            job->sample_n = sample_n;
+            job->use = use;
+            job->pop_l = pop_l;
             continue;
         }
-        alt_i = 0;
-        hap_i = 0;
-        while(temp != NULL) {
-            if(j == 1)
-                strncpy(chr, temp, 99);
-            else if(j == 2) {
-                pos = atoi(temp);
-                if(site_n > 0) {
-                    ok = 0;
-                    while(site_i < site_n) {
-                        if(strcmp(chr, sites[site_i].chr) == 0) {
-                            if(pos == sites[site_i].pos) {
-                                ok = 1;
-                                break;
-                            } else if(pos < sites[site_i].pos)
-                                break;
-                        } else if(strcmp(chr, sites[site_i].chr) < 0)
-                            break;
-                        site_i++;
-                    }
-                    if(ok == 0)
-                        break;
-                }
-            } else if(j > 9) {
-                if(ind_n > 0 && ind_l[j] == 0) {
-                    temp = strtok_r(NULL, "\t", &end);
-                    j++;
-                    continue;
-                }
-                if(strchr(temp, ':') != NULL)
-                    strncpy(hap, strtok(temp, ":"), 49);
-                else {
-                    stringTerminator(temp);
-                    strncpy(hap, temp, 49);
-                }
-                if(sfs == NULL) {
-                    switch(strlen(hap)) {
-                        case 3:
-                            hap_n += 2;
-                            break;
-                        case 7:
-                            hap_n += 4;
-                            break;
-                        case 11:
-                            hap_n += 6;
-                            break;
-                        case 15:
-                            hap_n += 8;
-                            break;
-                        default:
-                            fprintf(stderr, "ERROR: Allowed ploidy-levels are 2, 4, 6, and 8!\n\n");
-                            exit(EXIT_FAILURE);
-                    }
-                }
-                if(hap[0] == '.') {
-                    temp = strtok_r(NULL, "\t", &end);
-                    j++;
-                    continue;
+        if(read == 0)
+            continue;
+        if(sites != NULL && findSite(sites, &site_c, rec.chr, rec.pos) == 0)
+            continue;
+        if(job->gl > 0 && (rec.field = findFormat(&rec, gl_keys[job->gl])) < 0)
+            rec.field = 0;
+        parseGenos(&rec, use, sample_n);
+        memset(counts, 0, pop_n * sizeof(Count_s));
+        first = 1;
+        for(i = 0; i < rec.ind_n; i++) {
+            if(use != NULL && (i >= sample_n || use[i] == 0))
+                continue;
+            g = &rec.geno[i];
+            k = pop_l != NULL ? pop_l[i] - 1 : 0;
+            if(sfs == NULL && proj == NULL && split == 0) {
+                if(g->ploidy == 0) {
+                    fprintf(stderr, "ERROR: Allowed ploidy-levels are 2, 4, 6, and 8!\n\n");
+                    exit(EXIT_FAILURE);
                 }
-                switch(strlen(hap)) {
-                    case 3:
-                        stop = 2;
-                        hap_i += 2;
-                        break;
-                    case 7:
-                        stop = 6;
-                        hap_i += 4;
-                        break;
-                    case 11:
-                        stop = 10;
-                        hap_i += 6;
-                        break;
-                    case 15:
-                        stop = 14;
-                        hap_i += 8;
-                        break;
-                    default:
-                        fprintf(stderr, "ERROR: Allowed ploidy-levels are 2, 4, 6, and 8!\n\n");
-                        exit(EXIT_FAILURE);
+                hap_n[k] += g->ploidy;
+            }
+            if(job->gl > 0 ? g->field == NULL || g->field[0] == '.' : g->mis)
+                continue;
+            counts[k].alt += g->alt;
+            counts[k].hap += g->ploidy;
+        }
+        if(sfs == NULL && proj == NULL) {
+            if(split == 0)
+                initSpectra(job);
+            if(job->project > 0) {
+                if((proj = calloc(job->off[pop_n + pair_n], sizeof(double))) == NULL) {
+                    fprintf(stderr, merror);
+                    exit(EXIT_FAILURE);
                 }
-                for(i = 0; i <= stop; i += 2) {
-                    if(hap[i] == '0' || hap[i] == '1')
-                        alt_i += hap[i] - '0';
-                    else {
-                        fprintf(stderr, "ERROR: Unknown alleles found at site %s:%i! Only 0 and 1 are allowed.\n\n", chr, pos);
-                        exit(EXIT_FAILURE);
-                    }
+                job->proj[chunk->thread] = proj;
+            } else {
+                if((sfs = calloc(job->off[pop_n + pair_n], sizeof(unsigned int))) == NULL) {
+                    fprintf(stderr, merror);
+                    exit(EXIT_FAILURE);
                 }
+                job->sfs[chunk->thread] = sfs;
             }
-            temp = strtok_r(NULL, "\t", &end);
-            j++;
         }
-        if(temp == NULL) {
-            if(sfs == NULL) {
-                if((sfs = calloc(hap_n + 1, sizeof(double))) == NULL) {
+        if(blocks != NULL) {
+            tot_i = job->off[pop_n + pair_n];
+            if(blocks->field_n == 0)
+                initBlocks(blocks, job->block, tot_i + pop_n + pair_n);
+            b = addBlock(blocks, rec.chr, rec.pos);
+        }
+        if(job->gl > 0) {
+            if(conv == NULL) {
+                for(k = 0; k < pop_n; k++) {
+                    if(hap_n[k] > hap_max)
+                        hap_max = (int)hap_n[k];
+                }
+                if((conv = malloc(job->off[pop_n] * sizeof(double))) == NULL || (cur = malloc(pop_n * sizeof(int))) == NULL || (miss = calloc(hap_max + 1, sizeof(double *))) == NULL) {
                     fprintf(stderr, merror);
                     exit(EXIT_FAILURE);
                 }
             }
-            if(hap_i / hap_n < mis)
+            addLiks(job, &job->liks[chunk->idx], &rec, counts, pop_l, conv, cur, miss);
+            continue;
+        }
+        if(job->project > 0) {
+            projectSite(job, &job->projs[chunk->thread], counts, proj, b, tot_i);
+            continue;
+        }
+        for(k = 0; k < pop_n; k++) {
+            c = &counts[k];
+            if(c->hap / hap_n[k] < mis)
                 continue;
-            if(hap_i < hap_n) {
-                p = alt_i / hap_i;
-                mis_i = hap_n - hap_i;
+            c->ok = 1;
+            if(c->hap < hap_n[k]) {
+                p = c->alt / c->hap;
+                mis_i = hap_n[k] - c->hap;
                 if(p == 1)
-                    alt_i += mis_i;
+                    c->alt += mis_i;
                 else if(p > 0) {
-                    for(i = 0; i < mis_i; i++) {
-                        if((double)rand() / RAND_MAX < p)
-                            alt_i++;
+                    if(first) {
+                        key = siteKey(job->seed, rec.chr, rec.pos);
+                        first = 0;
                     }
+                    c->alt += drawBinom(mis_i, p, drawUniform(key, k));
+                }
+            }
+            sfs[job->off[k] + (int)c->alt]++;
+            if(b != NULL) {
+                b[job->off[k] + (int)c->alt]++;
+                b[tot_i + k]++;
+            }
+        }
+        for(k = 0; k < pair_n; k++) {
+            i = pairs[k * 2];
+            j = pairs[k * 2 + 1];
+            if(counts[i].ok && counts[j].ok) {
+                sfs[job->off[pop_n + k] + (int)counts[i].alt * ((int)hap_n[j] + 1) + (int)counts[j].alt]++;
+                if(b != NULL) {
+                    b[job->off[pop_n + k] + (int)counts[i].alt * ((int)hap_n[j] + 1) + (int)counts[j].alt]++;
+                    b[tot_i + pop_n + k]++;
+                }
+            }
+        }
+    }
+
+    freeRecord(&rec);
+    free(line);
+    free(counts);
+    free(conv);
+    free(cur);
+    if(miss != NULL) {
+        for(i = 0; i <= hap_max; i++)
+            free(miss[i]);
+        free(miss);
+    }
+}
+
+/* With -project, every spectrum has the projected number of haplotypes instead of that of its populations. -gl also needs
+   log C(H, j) of every count j of each population */
+void initSpectra(Job_s *job) {
+    int i, j;
+    for(i = 0; i < job->pop_n; i++) {
+        if(job->project > job->hap_n[i]) {
+            fprintf(stderr, "ERROR: -project [int] is larger than the %.0f haplotypes of %s!\n\n", job->hap_n[i], job->names != NULL ? job->names[i] : "the individuals");
+            exit(EXIT_FAILURE);
+        }
+    }
+    setOffsets(job->off, job->hap_n, job->pairs, job->pop_n, job->pair_n, job->project);
+    if(job->gl == 0)
+        return;
+    if((job->lchoose = malloc(job->off[job->pop_n] * sizeof(double))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < job->pop_n; i++) {
+        for(j = 0; j <= (int)job->hap_n[i]; j++)
+            job->lchoose[job->off[i] + j] = lgamma(job->hap_n[i] + 1) - lgamma(j + 1) - lgamma(job->hap_n[i] - j + 1);
+    }
+}
+
+/* The likelihood of a site given each alternative allele count of a population is the convolution of the genotype
+   likelihoods of its individuals, each weighted by the number of ways its alleles can be drawn, so that
+   P(data | j) = sum over genotypes g summing to j of prod C(m_i, g_i) L_i(g_i) / C(H, j). Individuals without likelihoods
+   are left out and the remaining haplotypes are added at the end with weights C(r, g) only, which marginalizes them.
+   The convolution is done in place from the top count down, and the partial sums are rescaled to avoid underflow.
+   A site is stored as one float row with a segment per population, the first value set to -1 when it failed -mis.
+   The weights of r missing haplotypes are computed on the first site with r of them and kept in miss[r] for the chunk */
+void addLiks(Job_s *job, Lik_s *lik, const Record_s *rec, const Count_s *counts, const int *pop_l, double *a, int *cur, double **miss) {
+    int i, j, g, k, m, r, pop_n = job->pop_n;
+    long int row_n = job->off[job->pop_n];
+    double s = 0, max = 0, v[9], *w = NULL, *h = NULL;
+    float *row = NULL;
+    const Geno_s *geno = NULL;
+
+    if(job->store == 0) {
+        if(lik->site_n >= lik->max) {
+            lik->max = lik->max > 0 ? lik->max * 2 : 1024;
+            if((lik->lik = realloc(lik->lik, lik->max * row_n * sizeof(float))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+        }
+        row = lik->lik + lik->site_n * row_n;
+    } else {
+        if(lik->lik == NULL && ((lik->lik = malloc(row_n * sizeof(float))) == NULL || (lik->tmp = tmpfile()) == NULL)) {
+            fprintf(stderr, "ERROR: Cannot create a temporary file for -glstore mmap\n\n");
+            exit(EXIT_FAILURE);
+        }
+        row = lik->lik;
+    }
+    for(k = 0; k < pop_n; k++) {
+        cur[k] = 0;
+        a[job->off[k]] = 1;
+        if(counts[k].hap == 0 || counts[k].hap / job->hap_n[k] < job->mis)
+            cur[k] = -1;
+    }
+    for(i = 0; i < rec->ind_n; i++) {
+        geno = &rec->geno[i];
+        if(geno->field == NULL)
+            continue;
+        k = pop_l != NULL ? pop_l[i] - 1 : 0;
+        if(cur[k] < 0)
+            continue;
+        m = geno->ploidy;
+        if(m == 0 || readLiks(geno->field, job->gl, m, v) == 0)
+            continue;
+        if(cur[k] + m > job->hap_n[k]) {
+            fprintf(stderr, "ERROR: Ploidy of the individuals changes at site %s:%i!\n\n", rec->chr, rec->pos);
+            exit(EXIT_FAILURE);
+        }
+        for(g = 0, s = 1; g <= m; s = s * (m - g) / (g + 1), g++)
+            v[g] *= s;
+        h = a + job->off[k];
+        max = 0;
+        for(j = cur[k] + m; j >= 0; j--) {
+            s = 0;
+            for(g = j > cur[k] ? j - cur[k] : 0; g <= m && g <= j; g++)
+                s += h[j - g] * v[g];
+            h[j] = s;
+            if(s > max)
+                max = s;
+        }
+        cur[k] += m;
+        for(j = 0; j <= cur[k]; j++)
+            h[j] /= max;
+    }
+    for(k = 0; k < pop_n; k++) {
+        h = a + job->off[k];
+        if(cur[k] < 0) {
+            row[job->off[k]] = -1;
+            continue;
+        }
+        if((r = job->hap_n[k] - cur[k]) > 0) {
+            if((w = miss[r]) == NULL) {
+                if((w = miss[r] = malloc((r + 1) * sizeof(double))) == NULL) {
+                    fprintf(stderr, merror);
+                    exit(EXIT_FAILURE);
+                }
+                for(g = 0; g <= r; g++)
+                    w[g] = exp(lgamma(r + 1) - lgamma(g + 1) - lgamma(r - g + 1) - (lgamma(r + 1) - lgamma(r / 2 + 1) - lgamma(r - r / 2 + 1)));
+            }
+            for(j = cur[k] + r; j >= 0; j--) {
+                s = 0;
+                for(g = j > cur[k] ? j - cur[k] : 0; g <= r && g <= j; g++)
+                    s += h[j - g] * w[g];
+                h[j] = s;
+            }
+        }
+        max = -INFINITY;
+        for(j = 0; j <= job->hap_n[k]; j++) {
+            h[j] = log(h[j]) - job->lchoose[job->off[k] + j];
+            if(h[j] > max)
+                max = h[j];
+        }
+        for(j = 0; j <= job->hap_n[k]; j++)
+            row[job->off[k] + j] = exp(h[j] - max);
+    }
+    if(job->store == 1)
+        fwrite(row, sizeof(float), row_n, lik->tmp);
+    lik->site_n++;
+}
+
+/* Returns the genotype likelihoods of an individual of ploidy m scaled to a maximum of 1, or 0 when they are missing */
+int readLiks(const char *p, int type, int m, double *v) {
+    int g = 0;
+    double max = 0;
+    char *end = NULL;
+
+    if(*p == '.')
+        return 0;
+    while(g <= m) {
+        v[g] = strtod(p, &end);
+        if(end == p)
+            break;
+        if(type == 1)
+            v[g] = pow(10, -v[g] / 10);
+        else if(type == 2)
+            v[g] = pow(10, v[g]);
+        if(v[g] > max)
+            max = v[g];
+        g++;
+        if(*end != ',')
+            break;
+        p = end + 1;
+    }
+    if(g != m + 1 || *end == ',') {
+        fprintf(stderr, "ERROR: Number of genotype likelihoods does not match the ploidy of %i!\n\n", m);
+        exit(EXIT_FAILURE);
+    }
+    if(max <= 0)
+        return 0;
+    for(g = 0; g <= m; g++)
+        v[g] /= max;
+
+    return 1;
+}
+
+/* EM for the SFS of each population over the stored site likelihoods: the expected share of each allele count is
+   summed over the sites given the current SFS, until the log-likelihood changes by less than 1e-8 per site */
+void fitSfs(Job_s *job, int chunk_n) {
+    int i, j, k, it, hap_n, empty = 1;
+    long int s, site_n = 0, row_n = job->off[job->pop_n];
+    double sum = 0, ll = 0, prev = 0, *phi = NULL, *next = NULL;
+    const float *h = NULL;
+    Lik_s *lik = NULL;
+
+    for(i = 0; i < chunk_n; i++) {
+        lik = &job->liks[i];
+        if(job->store == 0 || lik->site_n == 0)
+            continue;
+        free(lik->lik);
+        fflush(lik->tmp);
+        if((lik->lik = mmap(NULL, lik->site_n * row_n * sizeof(float), PROT_READ, MAP_PRIVATE, fileno(lik->tmp), 0)) == MAP_FAILED) {
+            fprintf(stderr, "ERROR: Cannot map the temporary file of -glstore mmap\n\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if(row_n > 0 && ((phi = malloc(row_n * sizeof(double))) == NULL || (next = malloc(row_n * sizeof(double))) == NULL)) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(k = 0; k < job->pop_n && row_n > 0; k++) {
+        hap_n = job->hap_n[k];
+        site_n = 0;
+        for(i = 0; i < chunk_n; i++) {
+            for(s = 0; s < job->liks[i].site_n; s++)
+                site_n += job->liks[i].lik[s * row_n + job->off[k]] >= 0;
+        }
+        if(site_n == 0)
+            continue;
+        empty = 0;
+        for(j = 0; j <= hap_n; j++)
+            phi[j] = 1.0 / (hap_n + 1);
+        for(it = 1; it <= 1000; it++) {
+            ll = 0;
+            memset(next, 0, (hap_n + 1) * sizeof(double));
+            for(i = 0; i < chunk_n; i++) {
+                for(s = 0; s < job->liks[i].site_n; s++) {
+                    h = job->liks[i].lik + s * row_n + job->off[k];
+                    if(h[0] < 0)
+                        continue;
+                    sum = 0;
+                    for(j = 0; j <= hap_n; j++)
+                        sum += phi[j] * h[j];
+                    ll += log(sum);
+                    for(j = 0; j <= hap_n; j++)
+                        next[j] += phi[j] * h[j] / sum;
                 }
             }
-            sfs[(int)alt_i]++;
+            for(j = 0; j <= hap_n; j++)
+                phi[j] = next[j] / site_n;
+            if(it > 1 && fabs(ll - prev) < 1e-8 * site_n)
+                break;
+            prev = ll;
         }
+        if(it > 1000)
+            fprintf(stderr, "Warning: EM for the SFS%s%s did not converge in 1000 iterations\n\n", job->names != NULL ? " of " : "", job->names != NULL ? job->names[k] : "");
+        if(job->names != NULL)
+            printf("%s\t", job->names[k]);
+        for(j = 0; j <= hap_n; j++)
+            printf(j < hap_n ? "%f," : "%f\n", phi[j] * site_n);
     }
-    if(sfs == NULL)
+    if(empty)
         fprintf(stderr, "Warning: SFS is empty. Please check your input files!\n\n");
-    else {
-        for(i = 0; i <= hap_n; i++) {
-            if(i < hap_n)
-                printf("%.0f,", sfs[i]);
-            else
-                printf("%.0f\n", sfs[i]);
+    else if(isatty(1))
+        fprintf(stderr, "\n");
+    for(i = 0; i < chunk_n; i++) {
+        lik = &job->liks[i];
+        if(job->store == 1 && lik->site_n > 0)
+            munmap(lik->lik, lik->site_n * row_n * sizeof(float));
+        else
+            free(lik->lik);
+        if(lik->tmp != NULL)
+            fclose(lik->tmp);
+    }
+    free(phi);
+    free(next);
+}
+
+/* Adds the projection of a site to the spectra: a population with a of its m observed haplotypes carrying the alternative
+   allele adds to each bin j the hypergeometric probability C(a, j) C(m - a, n - j) / C(m, n) of drawing j of them in a
+   sample of n haplotypes. Populations with fewer than n observed haplotypes, or failing -mis, are left out of the site */
+void projectSite(Job_s *job, Projs_s *projs, Count_s *counts, double *sfs, double *b, long int tot_i) {
+    int i, j, k, x, y, n = job->project, pop_n = job->pop_n;
+    long int o = 0;
+    double w = 0;
+    const Proj_s *p = NULL, *q = NULL;
+    Count_s *c = NULL;
+
+    for(k = 0; k < pop_n; k++) {
+        c = &counts[k];
+        if(c->hap / job->hap_n[k] < job->mis || c->hap < n)
+            continue;
+        c->ok = 1;
+        c->proj = *findProj(projs, n, (int)c->hap, (int)c->alt);
+        p = &c->proj;
+        o = job->off[k] + p->lo;
+        for(x = 0; x < p->len; x++)
+            sfs[o + x] += p->w[x];
+        if(b != NULL) {
+            for(x = 0; x < p->len; x++)
+                b[o + x] += p->w[x];
+            b[tot_i + k]++;
         }
-        if(isatty(1))
-            fprintf(stderr, "\n");
-        free(sfs);
     }
-    if(ind_n > 0) {
-        for(i = 0; i < ind_n; i++)
-            free(inds[i]);
-        free(inds);
-        free(ind_l);
+    for(k = 0; k < job->pair_n; k++) {
+        i = job->pairs[k * 2];
+        j = job->pairs[k * 2 + 1];
+        if(counts[i].ok == 0 || counts[j].ok == 0)
+            continue;
+        p = &counts[i].proj;
+        q = &counts[j].proj;
+        for(x = 0; x < p->len; x++) {
+            o = job->off[pop_n + k] + (long int)(p->lo + x) * (n + 1) + q->lo;
+            for(y = 0; y < q->len; y++) {
+                w = p->w[x] * q->w[y];
+                sfs[o + y] += w;
+                if(b != NULL)
+                    b[o + y] += w;
+            }
+        }
+        if(b != NULL)
+            b[tot_i + pop_n + k]++;
     }
-    if(site_n > 0)
-        free(sites);
-    free(line);
-    fclose(vcf_file);
+}
+
+/* The weights of each observed count pair (m, a) are computed on first use and kept in a triangular table of the thread,
+   at index m(m + 1) / 2 + a, which grows with m, so the entries are copied by the callers. Only the bins from max(0, n - m + a) to min(a, n) can be non-zero.
+   The weight of the mode comes from lgamma and the others from the ratios of consecutive weights, outwards from the mode */
+const Proj_s *findProj(Projs_s *projs, int n, int m, int a) {
+    int j, k;
+    long int i = (long int)m * (m + 1) / 2 + a, size = (long int)(m + 1) * (m + 2) / 2;
+    double *w = NULL;
+    Proj_s *p = NULL;
+
+    if(i >= projs->size) {
+        if((projs->tab = realloc(projs->tab, size * sizeof(Proj_s))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        memset(projs->tab + projs->size, 0, (size - projs->size) * sizeof(Proj_s));
+        projs->size = size;
+    }
+    p = &projs->tab[i];
+    if(p->w != NULL)
+        return p;
+    p->lo = n - m + a > 0 ? n - m + a : 0;
+    p->len = (a < n ? a : n) - p->lo + 1;
+    if((p->w = malloc(p->len * sizeof(double))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    j = (int)((double)(n + 1) * (a + 1) / (m + 2));
+    if(j < p->lo)
+        j = p->lo;
+    if(j >= p->lo + p->len)
+        j = p->lo + p->len - 1;
+    w = p->w - p->lo;
+    w[j] = exp(lgamma(a + 1) - lgamma(j + 1) - lgamma(a - j + 1) + lgamma(m - a + 1) - lgamma(n - j + 1) - lgamma(m - a - n + j + 1) - lgamma(m + 1) + lgamma(n + 1) + lgamma(m - n + 1));
+    for(k = j; k < p->lo + p->len - 1; k++)
+        w[k + 1] = w[k] * (a - k) * (n - k) / ((double)(k + 1) * (m - a - n + k + 1));
+    for(k = j; k > p->lo; k--)
+        w[k - 1] = w[k] * k * (m - a - n + k) / ((double)(a - k + 1) * (n - k + 1));
+
+    return p;
+}
+
+void printSpectra(const double *sfs, const long int *off, char **names, const int *pairs, int pop_n, int pair_n, int frac) {
+    int i;
+    for(i = 0; i < pop_n; i++) {
+        if(names != NULL)
+            printf("%s\t", names[i]);
+        printSfs(stdout, sfs + off[i], off[i + 1] - off[i], frac);
+    }
+    for(i = 0; i < pair_n; i++) {
+        printf("%s:%s\t", names[pairs[i * 2]], names[pairs[i * 2 + 1]]);
+        printSfs(stdout, sfs + off[pop_n + i], off[pop_n + i + 1] - off[pop_n + i], frac);
+    }
+}
+
+/* The state holds the settings (including the -project size), the haplotype number of each population, the pairs and the population names, and the
+   bins of all spectra. A part without sites is written without bins, so that -merge skips it */
+void saveState(const char *name, const Job_s *job, const double *sfs) {
+    int i, pop_n = job->pop_n, pair_n = job->pair_n;
+    State_s state = {5 + pop_n + pair_n * 2, job->names != NULL ? pop_n : 0, sfs != NULL ? job->off[pop_n + pair_n] : 0, NULL, job->names, NULL};
+
+    if((state.ints = malloc(state.int_n * sizeof(long int))) == NULL || (state.vals = malloc((state.val_n + 1) * sizeof(double))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    state.ints[0] = pop_n;
+    state.ints[1] = pair_n;
+    state.ints[2] = job->names != NULL;
+    state.ints[3] = lround(job->mis * 1e6);
+    state.ints[4] = job->project;
+    for(i = 0; i < pop_n; i++)
+        state.ints[5 + i] = (long int)job->hap_n[i];
+    for(i = 0; i < pair_n * 2; i++)
+        state.ints[5 + pop_n + i] = job->pairs[i];
+    for(i = 0; i < state.val_n; i++)
+        state.vals[i] = sfs[i];
+    writeState(name, "POLYSFS1", &state);
+    free(state.ints);
+    free(state.vals);
+}
+
+void mergeStates(FILE *merge_file) {
+    int i, pop_n = 0, pair_n = 0, *pairs = NULL;
+    State_s state;
+    Job_s job = {0};
+
+    if(readStates(merge_file, "POLYSFS1", &state) == 0) {
+        fprintf(stderr, "ERROR: -merge file does not list any state files with sites!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(state.int_n >= 5) {
+        pop_n = state.ints[0];
+        pair_n = state.ints[1];
+        job.project = state.ints[4];
+    }
+    if(state.int_n < 5 || pop_n < 1 || pair_n < 0 || job.project < 0 || state.int_n != 5 + pop_n + pair_n * 2 || state.str_n != (state.ints[2] ? pop_n : 0) || (pair_n > 0 && state.str_n == 0)) {
+        fprintf(stderr, "ERROR: -merge file lists state files that were not written by this version of poly_sfs!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if((job.hap_n = malloc(pop_n * sizeof(double))) == NULL || (job.off = calloc(pop_n + pair_n + 1, sizeof(long int))) == NULL || (pairs = malloc((pair_n * 2 + 1) * sizeof(int))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < pop_n; i++)
+        job.hap_n[i] = state.ints[5 + i];
+    for(i = 0; i < pair_n * 2; i++) {
+        pairs[i] = state.ints[5 + pop_n + i];
+        if(pairs[i] < 0 || pairs[i] >= pop_n) {
+            fprintf(stderr, "ERROR: -merge file lists state files that were not written by this version of poly_sfs!\n\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    job.pop_n = pop_n;
+    job.pair_n = pair_n;
+    job.pairs = pairs;
+    initSpectra(&job);
+    if(job.off[pop_n + pair_n] != state.val_n) {
+        fprintf(stderr, "ERROR: -merge file lists state files that were not written by this version of poly_sfs!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    printSpectra(state.vals, job.off, state.str_n > 0 ? state.strs : NULL, pairs, pop_n, pair_n, job.project > 0);
+    if(isatty(1))
+        fprintf(stderr, "\n");
+
+    free(pairs);
+    free(job.hap_n);
+    free(job.off);
+    freeState(&state);
+}
+
+/* Each bin is jackknifed as its proportion of the sites in the spectrum, with the blocks weighted by their number of sites,
+   and the standard error is given in counts. The bootstrap replicates are whole spectra summed over resampled blocks */
+void printBlocks(Job_s *job, int chunk_n, int boot_n, int frac) {
+    int i, r, pop_n = job->pop_n, spec_n = job->pop_n + job->pair_n;
+    long int k, tot_i = job->off[spec_n];
+    double *tot = NULL, *rep = NULL;
+    Blocks_s *blocks = NULL;
+
+    for(i = 0; i < chunk_n && blocks == NULL; i++) {
+        if(job->blocks[i].field_n > 0)
+            blocks = &job->blocks[i];
+    }
+    for(; i < chunk_n; i++) {
+        if(job->blocks[i].field_n > 0)
+            mergeBlocks(blocks, &job->blocks[i]);
+    }
+    if(blocks == NULL)
+        return;
+    if((tot = malloc(blocks->field_n * 2 * sizeof(double))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    rep = tot + blocks->field_n;
+    sumBlocks(blocks, tot);
+    for(i = 0; i < spec_n; i++) {
+        printLabel(job->names, job->pairs, pop_n, i, "se", 0);
+        for(k = job->off[i]; k < job->off[i + 1]; k++)
+            printf(k < job->off[i + 1] - 1 ? "%f," : "%f\n", jackRatio(blocks, tot, k, tot_i + i, tot_i + i) * tot[tot_i + i]);
+    }
+    for(r = 1; r <= boot_n; r++) {
+        bootBlocks(blocks, job->seed, r, rep);
+        for(i = 0; i < spec_n; i++) {
+            printLabel(job->names, job->pairs, pop_n, i, "boot", r);
+            for(k = job->off[i]; k < job->off[i + 1]; k++)
+                printf(k < job->off[i + 1] - 1 ? (frac ? "%f," : "%.0f,") : (frac ? "%f\n" : "%.0f\n"), rep[k]);
+        }
+    }
+    for(i = 0; i < chunk_n; i++)
+        freeBlocks(&job->blocks[i]);
+    free(tot);
+}
+
+void printLabel(char **names, const int *pairs, int pop_n, int i, const char *name, int rep) {
+    if(names == NULL)
+        printf("%s", name);
+    else if(i < pop_n)
+        printf("%s_%s", names[i], name);
+    else
+        printf("%s:%s_%s", names[pairs[(i - pop_n) * 2]], names[pairs[(i - pop_n) * 2 + 1]], name);
+    if(rep > 0)
+        printf("%i", rep);
+    printf("\t");
 }
 
 int isNumeric(const char *s) {
@@ -433,11 +1288,27 @@ void stringTerminator(char *string) {
 void printHelp(void) {
     fprintf(stderr, "\nProgram for estimating SFS from mixed ploidy VCF files.\nMissing alleles are imputed by drawing them from a Bernoulli distribution.\n\n");
     fprintf(stderr, "Usage:\n");
-    fprintf(stderr, "-vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8.\n");
+    fprintf(stderr, "-vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8. Can be bgzip-compressed or a BCF file.\n");
+    fprintf(stderr, "-cache [file] Binary genotype cache. With -vcf, the VCF file is first converted into this file; without it, an existing cache is read instead of a VCF file. Optional.\n");
     fprintf(stderr, "-inds [file] File listing individuals to use. Optional.\n");
+    fprintf(stderr, "-pops [file] Tab delimited file listing individuals and their populations (format: individual id, population id). Used instead of -inds to estimate the SFS of each population in one pass. Optional.\n");
+    fprintf(stderr, "-pairs [string] Population pairs for which to also estimate the joint (2D) SFS with -pops, either 'all' or a comma separated list (for example pop1:pop2,pop1:pop3). Optional.\n");
     fprintf(stderr, "-sites [file] Tab delimited file listing sites to use (format: chr, pos). Optional.\n");
     fprintf(stderr, "-mis [double] Excludes sites based of the proportion of missing data (0 = all missing allowed, 1 = no missing data allowed). Default 0.6.\n");
-    fprintf(stderr, "-seed [int] Seed number used for imputation. Default is a random seed.\n\n");
+    fprintf(stderr, "-seed [int] Seed number used for imputation and -bootstrap. Default is a random seed.\n");
+    fprintf(stderr, "-gl [string] Estimates the SFS by EM from genotype likelihoods instead of imputing genotype calls, using the FORMAT field 'PL' (phred-scaled likelihoods), 'GL' (log10 likelihoods) or 'GP' (genotype probabilities). The ploidy is still read from GT. Cannot be used with -cache, -pairs, -jackknife or a BCF file. Optional.\n");
+    fprintf(stderr, "-glstore [string] Whether the site likelihoods of -gl are kept in memory ('mem') or in memory-mapped temporary files ('mmap'). Default 'mem'.\n");
+    fprintf(stderr, "-project [int] Projects the observed allele counts of each site down to the given number of haplotypes with hypergeometric weights instead of imputing missing alleles, giving a deterministic SFS of fractional site counts. Sites with fewer observed haplotypes in a population are left out of its SFS. Cannot be used with -gl. Optional.\n");
+    fprintf(stderr, "-jackknife [int] Also prints the block-jackknife standard error of each SFS bin, using blocks of the given number of base pairs. Optional.\n");
+    fprintf(stderr, "-bootstrap [int] Also prints the given number of bootstrap replicates of each SFS, resampling the -jackknife blocks. Optional.\n");
+    fprintf(stderr, "-region [chr:start-end] Only uses sites within the region (for example chr1:1000-2000 or chr1). Uses the .tbi or .csi index of a bgzip-compressed VCF file to read only that part of the file. Optional.\n");
+    fprintf(stderr, "-threads [int] Number of threads used for processing parts of the VCF file in parallel. A pipe or a gzip file is read as one part, with its lines parsed on the threads. Imputation draws its random numbers from the seed and the position of each site, so results do not depend on the number of threads. Default 1.\n");
+    fprintf(stderr, "-state [file] Writes the SFS of the run into a binary state file instead of printing it, for example for one chromosome of a cluster run given with -region. With the same -seed in every part, the merged SFS equals that of a single run. Cannot be used with -gl or -jackknife. Optional.\n");
+    fprintf(stderr, "-merge [file] File listing state files written with -state (one per line). Sums the states and prints the SFS of the whole run. Used instead of all other options, which are taken from the state files. Optional.\n\n");
     fprintf(stderr, "Example:\n");
-    fprintf(stderr, "./poly_sfs -vcf in.vcf -inds inds.txt -sites 4fold.sites -mis 0.8 -seed 1524796 > out.sfs\n\n");
+    fprintf(stderr, "./poly_sfs -vcf in.vcf -inds inds.txt -sites 4fold.sites -mis 0.8 -seed 1524796 > out.sfs\n");
+    fprintf(stderr, "./poly_sfs -vcf in.vcf -pops pops.txt -gl PL -mis 0.8 > out.sfs\n");
+    fprintf(stderr, "./poly_sfs -vcf in.vcf -pops pops.txt -project 20 -mis 0.8 > out.sfs\n");
+    fprintf(stderr, "./poly_sfs -vcf in.vcf.gz -pops pops.txt -mis 0.8 -seed 1524796 -region chr1 -state chr1.state\n");
+    fprintf(stderr, "./poly_sfs -merge states.txt > out.sfs\n\n");
 }
\ No newline at end of file
@@ -0,0 +1,999 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Program for estimating allele frequencies, SFS and Fst/Dxy from mixed ploidy VCF files in a single pass.
+ Each record is parsed once, and the genotype counts of each population are passed on to the stages that are turned on:
+ allele frequencies (-freq, as poly_freq, optionally LD-pruned with -r2), the SFS of each population (-sfs, as poly_sfs
+ with -pops) and the genome-wide Fst or Dxy matrix (-fst, as poly_fst with -pops). Each stage has its own missing data
+ and allele frequency thresholds, and writes the same output as the program it replaces into its own file.
+
+ Compiling: gcc poly_sv.c poly_ld.c vcf_freq.c vcf_parse.c vcf_thread.c vcf_cache.c vcf_bcf.c vcf_write.c vcf_pop.c vcf_rand.c bgzf.c -o poly_sv -lm -lpthread -lz
+
+ Usage:
+ -vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8. Can be bgzip-compressed or a BCF file.
+ -cache [file] Binary genotype cache. With -vcf, the VCF file is first converted into this file; without it, an existing cache is read instead of a VCF file. Optional.
+ -pops [file] Tab delimited file listing individuals to use and their populations (format: individual id, population id).
+ -sites [file] Tab delimited file listing sites to use (format: chr, pos). Optional.
+ -freq [file] [double] [double] Writes the allele frequencies of each population into the file. Requires the proportion of missing data and the minimum minor allele frequency allowed (-mis and -maf of poly_freq). Optional.
+ -r2 [int] [int] [double] Excludes sites of -freq based on squared genotypic correlation. Requires a window size in number of SNPs, a step size in number of SNPs, and a maximum r2 value. Optional.
+ -r2bp [int] Maximum distance in bp between the sites of a pair compared with -r2. Pairs further apart are not compared. Optional.
+ -out [int] Whether -freq outputs allele frequencies (0), allele counts in the BayPass format (1), or allele frequencies as binary 32-bit floats in native byte order, one row of populations per site (2). Default 0.
+ -info [string] If -out is 1 or 2, records populations and locations of the SNPs of -freq into this file. Default 'info.txt'.
+ -sfs [file] [double] Writes the SFS of each population into the file. Requires the proportion of missing data allowed (-mis of poly_sfs). Missing alleles are imputed by drawing them from a Bernoulli distribution. Optional.
+ -seed [int] Seed number used for the imputation of -sfs. Default is a random seed.
+ -fst [file] [double] [double] Writes the genome-wide matrix of Fst (or Dxy) between all population pairs into the file. Requires the proportion of missing data and the minimum minor allele frequency allowed (-mis and -maf of poly_fst). Optional.
+ -stat [string] Whether -fst calculates 'fst' or 'dxy'. Default 'fst'. Note that dxy requires invariant sites to be included in the VCF file.
+ -region [chr:start-end] Only uses sites within the region (for example chr1:1000-2000 or chr1). Uses the .tbi or .csi index of a bgzip-compressed VCF file to read only that part of the file. Optional.
+ -threads [int] Number of threads used for processing parts of the VCF file (chromosomes with -r2) in parallel. A pipe, a gzip file or a single chromosome is read as one part, with its lines parsed on the threads. Default 1.
+
+ Example:
+ ./poly_sv -vcf in.vcf -pops pops.txt -sites 4fold.sites -freq 4fold_ld_pruned.freq 0.8 0.05 -r2 100 50 0.1 -sfs 4fold.sfs 0.8 -fst 4fold.fst 0.8 0
+*/
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "poly_ld.h"
+#include "vcf_freq.h"
+#include "vcf_parse.h"
+#include "vcf_pop.h"
+#include "vcf_rand.h"
+#include "vcf_thread.h"
+#include "vcf_write.h"
+#define merror "\nERROR: System out of memory\n\n"
+
+typedef struct {
+    int idx;
+    char ind[200];
+} Pop_s;
+
+typedef struct {
+    int ind, mis, nul;
+    double hap, alt, ploidy;
+} Count_s;
+
+typedef struct {
+    int skip, ind_n, sample_n;
+    const char *use;
+    const Record_s *rec;
+    const Count_s *counts;
+} Site_s;
+
+typedef struct {
+    void *arg;
+    void *(*open)(void *arg, Chunk_s *chunk);
+    void (*add)(void *state, const Site_s *site);
+    void (*close)(void *state, Chunk_s *chunk);
+} Stage_s;
+
+typedef struct {
+    int ind_n, pop_n, sample_n, stage_n, *pop_l;
+    char *use;
+    Pop_s *pops;
+    Sites_s *sites;
+    Stage_s stages[3];
+} Job_s;
+
+typedef struct {
+    int win, step, maxdist, out, pop_n, *snp_n;
+    double mis, maf, r2;
+    FILE *file, *info;
+} FreqJob_s;
+
+typedef struct {
+    int win_n, win_i, step_i, snp_i;
+    double *counts;
+    SNP_s *snps;
+    Dosage_s dose;
+    Writer_s w[2];
+    FreqJob_s *job;
+} FreqStage_s;
+
+typedef struct {
+    int pop_n, split;
+    long int seed, *off;
+    double mis, *hap_n;
+    unsigned int **sfs;
+    FILE *file;
+} SfsJob_s;
+
+typedef struct {
+    int thread;
+    SfsJob_s *job;
+} SfsStage_s;
+
+typedef struct {
+    int ok;
+    double ind, mis, p, n;
+} PopFreq_s;
+
+typedef struct {
+    int stat, pop_n, pair_n;
+    double mis, maf;
+    Sum_s *tot;
+    FILE *file;
+} FstJob_s;
+
+typedef struct {
+    PopFreq_s *freq;
+    Sum_s *site, *tot;
+    FstJob_s *job;
+} FstStage_s;
+
+void openFiles(int argc, char *argv[]);
+FILE *openStage(const char *name, const char *stage);
+double readThreshold(const char *s, const char *stage, const char *name);
+Pop_s *readPops(FILE *pop_file, char ***names, int *n, int *m);
+void readVcf(Bgzf_s *vcf_file, Cache_s *cache, const char *vcf_name, const Region_s *region, Job_s *job, FreqJob_s *freq, SfsJob_s *sfs, FstJob_s *fst, char **names, int thread_n);
+void addStage(Job_s *job, void *arg, void *(*open)(void *, Chunk_s *), void (*add)(void *, const Site_s *), void (*close)(void *, Chunk_s *));
+void readChunk(Chunk_s *chunk, void *arg);
+void *openFreq(void *arg, Chunk_s *chunk);
+void addFreq(void *state, const Site_s *site);
+void flushFreq(FreqStage_s *s);
+void closeFreq(void *state, Chunk_s *chunk);
+void *openSfs(void *arg, Chunk_s *chunk);
+void addSfs(void *state, const Site_s *site);
+void closeSfs(void *state, Chunk_s *chunk);
+void *openFst(void *arg, Chunk_s *chunk);
+void addFst(void *state, const Site_s *site);
+void closeFst(void *state, Chunk_s *chunk);
+int isNumeric(const char *s);
+void stringTerminator(char *string);
+void printHelp(void);
+
+int main(int argc, char *argv[]) {
+    int second = 0, minute = 0, hour = 0;
+    time_t timer = 0;
+
+    timer = time(NULL);
+    openFiles(argc, argv);
+    second = time(NULL) - timer;
+    minute = second / 60;
+    hour = second / 3600;
+
+    fprintf(stderr, "Done!");
+    if(hour > 0)
+        fprintf(stderr, "\nElapsed time: %i h, %i min & %i sec\n\n", hour, minute - hour * 60, second - minute * 60);
+    else if(minute > 0)
+        fprintf(stderr, "\nElapset time: %i min & %i sec\n\n", minute, second - minute * 60);
+    else if(second > 5)
+        fprintf(stderr, "\nElapsed time: %i sec\n\n", second);
+    else
+        fprintf(stderr, "\n\n");
+
+    return 0;
+}
+
+void openFiles(int argc, char *argv[]) {
+    int i, ind_n = 0, pop_n = 0, thread_n = 1;
+    char temp[10], info[200] = "info.txt", *vcf_name = NULL, *cache_name = NULL, **names = NULL;
+    Job_s job = {0};
+    FreqJob_s freq = {0, 0, 0, 0, 0, NULL, 0, 0, 1, NULL, NULL};
+    SfsJob_s sfs = {0};
+    FstJob_s fst = {0};
+    Region_s region, *reg = NULL;
+    Bgzf_s *vcf_file = NULL;
+    Cache_s *cache = NULL;
+    FILE *pop_file = NULL, *site_file = NULL;
+
+    if(argc == 1) {
+        printHelp();
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "\nParameters:\n");
+
+    for(i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-vcf") == 0) {
+            if((vcf_file = openBgzf(argv[++i])) == NULL) {
+                fprintf(stderr, "\nERROR: Cannot open file %s\n\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            vcf_name = argv[i];
+            fprintf(stderr, "\t-vcf %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-cache") == 0) {
+            cache_name = argv[++i];
+            fprintf(stderr, "\t-cache %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-pops") == 0) {
+            if((pop_file = fopen(argv[++i], "r")) == NULL) {
+                fprintf(stderr, "\nERROR: Cannot open file %s\n\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-pops %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-sites") == 0) {
+            if((site_file = fopen(argv[++i], "r")) == NULL) {
+                fprintf(stderr, "\nERROR: Cannot open file %s\n\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-sites %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-freq") == 0) {
+            if(i + 3 >= argc) {
+                fprintf(stderr, "\nERROR: Invalid value for -freq [file] [double] [double]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            freq.file = openStage(argv[++i], "-freq");
+            freq.mis = readThreshold(argv[++i], "-freq", "missing data");
+            freq.maf = readThreshold(argv[++i], "-freq", "minor allele frequency");
+            fprintf(stderr, "\t-freq %s %s %s\n", argv[i - 2], argv[i - 1], argv[i]);
+        } else if(strcmp(argv[i], "-r2") == 0) {
+            if(isNumeric(argv[++i])) {
+                freq.win = atoi(argv[i]);
+                if(freq.win < 1) {
+                    fprintf(stderr, "\nERROR: Invalid value for the -r2 window size [int]!\n\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            if(isNumeric(argv[++i])) {
+                freq.step = atoi(argv[i]);
+                if(freq.step > freq.win || freq.step < 1) {
+                    fprintf(stderr, "\nERROR: Invalid value for the -r2 step size [int]!\n\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            if(isNumeric(argv[++i])) {
+                freq.r2 = atof(argv[i]);
+                if(freq.r2 < 0 || freq.r2 > 1) {
+                    fprintf(stderr, "\nERROR: Invalid value for -r2 [double]!\n\n");
+                    exit(EXIT_FAILURE);
+                }
+            } else {
+                fprintf(stderr, "\nERROR: Invalid value for -r2 [int] [int] [double]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-r2 %i %i %s\n", freq.win, freq.step, argv[i]);
+        } else if(strcmp(argv[i], "-r2bp") == 0) {
+            if(isNumeric(argv[++i]))
+                freq.maxdist = atoi(argv[i]);
+            if(freq.maxdist < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -r2bp [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-r2bp %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-out") == 0) {
+            if(isNumeric(argv[++i]))
+                freq.out = atoi(argv[i]);
+            if(freq.out < 0 || freq.out > 2) {
+                fprintf(stderr, "\nERROR: Invalid value for -out [int]! Allowed are 0 (allele frequencies), 1 (allele counts) and 2 (binary allele frequencies).\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-out %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-info") == 0) {
+            strncpy(info, argv[++i], 199);
+            fprintf(stderr, "\t-info %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-sfs") == 0) {
+            if(i + 2 >= argc) {
+                fprintf(stderr, "\nERROR: Invalid value for -sfs [file] [double]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            sfs.file = openStage(argv[++i], "-sfs");
+            sfs.mis = readThreshold(argv[++i], "-sfs", "missing data");
+            fprintf(stderr, "\t-sfs %s %s\n", argv[i - 1], argv[i]);
+        } else if(strcmp(argv[i], "-seed") == 0) {
+            if(isNumeric(argv[++i]))
+                sfs.seed = atol(argv[i]);
+            else {
+                fprintf(stderr, "\nERROR: Invalid value for -seed [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-seed %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-fst") == 0) {
+            if(i + 3 >= argc) {
+                fprintf(stderr, "\nERROR: Invalid value for -fst [file] [double] [double]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fst.file = openStage(argv[++i], "-fst");
+            fst.mis = readThreshold(argv[++i], "-fst", "missing data");
+            fst.maf = readThreshold(argv[++i], "-fst", "minor allele frequency");
+            fprintf(stderr, "\t-fst %s %s %s\n", argv[i - 2], argv[i - 1], argv[i]);
+        } else if(strcmp(argv[i], "-stat") == 0) {
+            strncpy(temp, argv[++i], 9);
+            temp[9] = '\0';
+            if(strcmp(temp, "fst") == 0)
+                fst.stat = 0;
+            else if(strcmp(temp, "dxy") == 0)
+                fst.stat = 1;
+            else {
+                fprintf(stderr, "\nERROR: Invalid input for -stat [string]! Allowed are 'fst' and 'dxy'\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-stat %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-region") == 0) {
+            if(parseRegion(argv[++i], &region) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -region [chr:start-end]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            reg = &region;
+            fprintf(stderr, "\t-region %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-threads") == 0) {
+            if(isNumeric(argv[++i]))
+                thread_n = atoi(argv[i]);
+            if(thread_n < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -threads [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-threads %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            fprintf(stderr, "\t%s\n", argv[i]);
+            printHelp();
+            exit(EXIT_FAILURE);
+        } else {
+            fprintf(stderr, "\nERROR: Unknown argument '%s'\n\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    fprintf(stderr, "\n");
+
+    if((vcf_file == NULL && cache_name == NULL) || pop_file == NULL) {
+        fprintf(stderr, "\nERROR: -vcf [file] (or -cache [file]) and -pops [file] are required!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(freq.file == NULL && sfs.file == NULL && fst.file == NULL) {
+        fprintf(stderr, "\nERROR: At least one of -freq [file] [double] [double], -sfs [file] [double] and -fst [file] [double] [double] is required!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if((freq.r2 < 1 || freq.out > 0) && freq.file == NULL) {
+        fprintf(stderr, "\nERROR: -r2 [int] [int] [double] and -out [int] require -freq [file] [double] [double]!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(freq.maxdist > 0 && freq.r2 == 1) {
+        fprintf(stderr, "\nERROR: -r2bp [int] requires -r2 [int] [int] [double]!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(cache_name != NULL) {
+        if(vcf_file != NULL) {
+            writeCache(vcf_file, cache_name);
+            closeBgzf(vcf_file);
+            vcf_file = NULL;
+            vcf_name = NULL;
+        }
+        if((cache = openCache(cache_name)) == NULL) {
+            fprintf(stderr, "\nERROR: Cannot open file %s\n\n", cache_name);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if(freq.r2 < 1 && freq.maf == 0) {
+        fprintf(stderr, "Warning: Doing LD-pruning, setting the -freq minor allele frequency to 0.05\n\n");
+        freq.maf = 0.05;
+    }
+    if(sfs.file != NULL && sfs.mis < 0.6)
+        fprintf(stderr, "Warning: When over 40%% missing data is allowed, imputation is unreliable\n\n");
+    if(freq.out > 0 && (freq.info = fopen(info, "w")) == NULL) {
+        fprintf(stderr, "\nERROR: Cannot create file '%s'\n\n", info);
+        exit(EXIT_FAILURE);
+    }
+    job.pops = readPops(pop_file, &names, &ind_n, &pop_n);
+    if(fst.file != NULL && pop_n < 2) {
+        fprintf(stderr, "\nERROR: -pops file should list at least two populations for -fst [file] [double] [double]!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    job.ind_n = ind_n;
+    job.pop_n = pop_n;
+    if(site_file != NULL)
+        job.sites = readSites(site_file);
+    readVcf(vcf_file, cache, vcf_name, reg, &job, &freq, &sfs, &fst, names, thread_n);
+}
+
+FILE *openStage(const char *name, const char *stage) {
+    FILE *file = NULL;
+    if((file = fopen(name, "w")) == NULL) {
+        fprintf(stderr, "\nERROR: Cannot create file '%s' of %s\n\n", name, stage);
+        exit(EXIT_FAILURE);
+    }
+    return file;
+}
+
+double readThreshold(const char *s, const char *stage, const char *name) {
+    double v = 0;
+    if(isNumeric(s) == 0 || (v = atof(s)) < 0 || v > 1) {
+        fprintf(stderr, "\nERROR: Invalid value for the %s %s threshold [double]!\n\n", stage, name);
+        exit(EXIT_FAILURE);
+    }
+    return v;
+}
+
+Pop_s *readPops(FILE *pop_file, char ***names, int *n, int *m) {
+    int i;
+    int *v = NULL;
+    double list_i = 200, names_i = 50;
+    char *line = NULL, *ind = NULL, *pop = NULL;
+    Pop_s *list = NULL;
+    Hash_s hash;
+    size_t len = 0;
+    ssize_t read;
+
+    if((list = malloc(list_i * sizeof(Pop_s))) == NULL || (*names = malloc(names_i * sizeof(char *))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    initHash(&hash, 50);
+    while((read = getline(&line, &len, pop_file)) != -1) {
+        if(line[0] == '\n' || line[0] == '#')
+            continue;
+        stringTerminator(line);
+        if((ind = strtok(line, "\t")) == NULL || (pop = strtok(NULL, "\t")) == NULL) {
+            fprintf(stderr, "\nERROR: -pops file should have two tab delimited columns (individual id, population id)!\n\n");
+            exit(EXIT_FAILURE);
+        }
+        if((v = findHash(&hash, pop)) != NULL)
+            i = *v;
+        else {
+            i = *m;
+            if(((*names)[i] = strdup(pop)) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+            *addHash(&hash, (*names)[i]) = i;
+            *m = *m + 1;
+            if(*m >= names_i) {
+                names_i += 50;
+                if((*names = realloc(*names, names_i * sizeof(char *))) == NULL) {
+                    fprintf(stderr, merror);
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+        strncpy(list[*n].ind, ind, 199);
+        list[*n].ind[199] = '\0';
+        list[*n].idx = i + 1;
+        *n = *n + 1;
+        if(*n >= list_i) {
+            list_i += 100;
+            if((list = realloc(list, list_i * sizeof(Pop_s))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    free(line);
+    freeHash(&hash);
+    fclose(pop_file);
+
+    return list;
+}
+
+/* The stages run in the order they were added, on every record of every chunk. -r2 needs whole chromosomes in each chunk */
+void readVcf(Bgzf_s *vcf_file, Cache_s *cache, const char *vcf_name, const Region_s *region, Job_s *job, FreqJob_s *freq, SfsJob_s *sfs, FstJob_s *fst, char **names, int thread_n) {
+    int i, j, chunk_n = 0, snp_i = 0, pop_n = job->pop_n, contig = freq->file != NULL && freq->r2 < 1;
+    double *sum = NULL;
+    FILE *outs[2] = {freq->file, freq->info};
+    Sum_s *tot = NULL;
+    Chunk_s *chunks = NULL;
+
+    if(cache != NULL)
+        chunks = splitCache(cache, region, thread_n, contig, &chunk_n);
+    else
+        chunks = splitVcf(vcf_file, vcf_name, region, thread_n, contig, &chunk_n);
+    if(freq->file != NULL) {
+        freq->pop_n = pop_n;
+        if((freq->snp_n = calloc(chunk_n, sizeof(int))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        for(i = 0; i < pop_n; i++)
+            fprintf(freq->out == 0 ? freq->file : freq->info, "%s%s", i == 0 ? (freq->out == 0 ? "\t" : "#") : "\t", names[i]);
+        fprintf(freq->out == 0 ? freq->file : freq->info, "\n");
+        addStage(job, freq, openFreq, addFreq, closeFreq);
+    }
+    if(sfs->file != NULL) {
+        if(sfs->seed == 0) {
+            sfs->seed = (long int)time(NULL);
+            fprintf(stderr, "Seed number used for imputation: %ld\n\n", sfs->seed);
+        }
+        sfs->pop_n = pop_n;
+        sfs->split = chunk_n > 2;
+        if((sfs->sfs = calloc(thread_n, sizeof(unsigned int *))) == NULL || (sfs->hap_n = calloc(pop_n, sizeof(double))) == NULL || (sfs->off = calloc(pop_n + 1, sizeof(long int))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        addStage(job, sfs, openSfs, addSfs, closeSfs);
+    }
+    if(fst->file != NULL) {
+        fst->pop_n = pop_n;
+        fst->pair_n = pop_n * (pop_n - 1) / 2;
+        if((fst->tot = calloc((size_t)chunk_n * (fst->pair_n + 1), sizeof(Sum_s))) == NULL || (tot = calloc(fst->pair_n + 1, sizeof(Sum_s))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        addStage(job, fst, openFst, addFst, closeFst);
+    }
+    runChunks(chunks, 1, 1, vcf_name, vcf_file, outs, readChunk, job);
+    if(sfs->split && countHaps(vcf_file, chunks + 1, chunk_n - 1, job->sites, job->use, job->pop_l, job->sample_n, sfs->hap_n) > 0)
+        setOffsets(sfs->off, sfs->hap_n, NULL, sfs->pop_n, 0, 0);
+    runChunks(chunks + 1, chunk_n - 1, thread_n, vcf_name, vcf_file, outs, readChunk, job);
+
+    if(freq->file != NULL) {
+        for(i = 0; i < chunk_n; i++)
+            snp_i += freq->snp_n[i];
+        fprintf(stderr, "-freq: kept %i variants\n\n", snp_i);
+    }
+    if(sfs->file != NULL) {
+        for(i = 0; i < thread_n; i++) {
+            if(sfs->sfs[i] == NULL)
+                continue;
+            if(sum == NULL && (sum = calloc(sfs->off[pop_n], sizeof(double))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+            for(j = 0; j < sfs->off[pop_n]; j++)
+                sum[j] += sfs->sfs[i][j];
+            free(sfs->sfs[i]);
+        }
+        if(sum == NULL)
+            fprintf(stderr, "Warning: -sfs: SFS is empty. Please check your input files!\n\n");
+        for(i = 0; sum != NULL && i < pop_n; i++) {
+            fprintf(sfs->file, "%s\t", names[i]);
+            printSfs(sfs->file, sum + sfs->off[i], sfs->off[i + 1] - sfs->off[i], 0);
+        }
+    }
+    if(fst->file != NULL) {
+        for(i = 0; i < chunk_n; i++) {
+            for(j = 0; j <= fst->pair_n; j++) {
+                tot[j].hw += fst->tot[i * (fst->pair_n + 1) + j].hw;
+                tot[j].hb += fst->tot[i * (fst->pair_n + 1) + j].hb;
+                tot[j].n += fst->tot[i * (fst->pair_n + 1) + j].n;
+            }
+        }
+        printMatrix(fst->file, "pop", names, tot, pop_n, fst->stat);
+        fprintf(stderr, "-fst: population pairs = %i\nTotal sites = %.0f\n\n", fst->pair_n, tot[fst->pair_n].n);
+    }
+
+    for(i = 0; i < 2; i++) {
+        if(outs[i] != NULL && fclose(outs[i]) != 0) {
+            fprintf(stderr, "\nERROR: Cannot write the output files\n\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if((sfs->file != NULL && fclose(sfs->file) != 0) || (fst->file != NULL && fclose(fst->file) != 0)) {
+        fprintf(stderr, "\nERROR: Cannot write the output files\n\n");
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < pop_n; i++)
+        free(names[i]);
+    free(names);
+    free(freq->snp_n);
+    free(sfs->sfs);
+    free(sfs->hap_n);
+    free(sfs->off);
+    free(sum);
+    free(fst->tot);
+    free(tot);
+    free(job->pops);
+    free(job->pop_l);
+    free(job->use);
+    freeChunks(chunks);
+    if(job->sites != NULL)
+        freeSites(job->sites);
+    if(cache != NULL)
+        closeCache(cache);
+    else
+        closeBgzf(vcf_file);
+}
+
+void addStage(Job_s *job, void *arg, void *(*open)(void *, Chunk_s *), void (*add)(void *, const Site_s *), void (*close)(void *, Chunk_s *)) {
+    Stage_s *stage = &job->stages[job->stage_n++];
+    stage->arg = arg;
+    stage->open = open;
+    stage->add = add;
+    stage->close = close;
+}
+
+/* Genotypes are parsed once per record, and each stage works from the counts of called and missing individuals,
+   haplotypes and alternative alleles of each population. Records outside -sites are still passed on (skip set), as the
+   LD window of -freq clears its pending slot on every record */
+void readChunk(Chunk_s *chunk, void *arg) {
+    int i, j, ind_i = 0, sample_n = 0, *pop_l = NULL, *v = NULL;
+    char *line = NULL, *use = NULL, **samples = NULL;
+    void *states[3] = {NULL};
+    Record_s rec = {0};
+    SiteCursor_s site_c = {0};
+    Geno_s *g = NULL;
+    Hash_s hash;
+    Count_s *counts = NULL, *c = NULL;
+    Site_s site = {0};
+    Job_s *job = arg;
+    Pop_s *pops = job->pops;
+    int ind_n = job->ind_n, pop_n = job->pop_n;
+    size_t len = 0;
+    ssize_t read;
+
+    if((counts = malloc(pop_n * sizeof(Count_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < job->stage_n; i++)
+        states[i] = job->stages[i].open(job->stages[i].arg, chunk);
+    sample_n = job->sample_n;
+    pop_l = job->pop_l;
+    use = job->use;
+    while((read = readSite(chunk, &line, &len, &rec)) != -1) {
+        if(read == 0 && strncmp(line, "#CHROM\t", 7) == 0) {
+            samples = parseSamples(line, &sample_n);
+            if((pop_l = calloc(sample_n + 1, sizeof(int))) == NULL || (use = calloc(sample_n + 1, sizeof(char))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+            initHash(&hash, ind_n);
+            for(i = 0; i < ind_n; i++)
+                *addHash(&hash, pops[i].ind) = i;
+            for(j = 0; j < sample_n; j++) {
+                if((v = findHash(&hash, samples[j])) != NULL) {
+                    pop_l[j] = pops[*v].idx;
+                    use[j] = 1;
+                    ind_i++;
+                }
+            }
+            freeHash(&hash);
+            free(samples);
+            if(ind_i == 0) {
+                fprintf(stderr, "\nERROR: Individuals in pops file were not found in the VCF file!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            if(ind_i < ind_n) {
+                fprintf(stderr, "Warning: pops file contains individuals that are not in the VCF file\n\n");
+                ind_n = ind_i;
+            }
+            job->ind_n = ind_n;
+            job->sample_n = sample_n;
+            job->pop_l = pop_l;
+            job->use = use;
+            continue;
+        }
+        if(read == 0)
+            continue;
+        site.skip = job->sites != NULL && findSite(job->sites, &site_c, rec.chr, rec.pos) == 0;
+        if(site.skip == 0) {
+            parseGenos(&rec, use, sample_n);
+            memset(counts, 0, pop_n * sizeof(Count_s));
+            for(i = 0; i < rec.ind_n && i < sample_n; i++) {
+                if(pop_l[i] == 0)
+                    continue;
+                g = &rec.geno[i];
+                c = &counts[pop_l[i] - 1];
+                c->ploidy += g->ploidy;
+                c->nul += g->ploidy == 0;
+                if(g->mis) {
+                    c->mis++;
+                    continue;
+                }
+                c->ind++;
+                c->hap += g->ploidy;
+                c->alt += g->alt;
+            }
+        }
+        site.ind_n = ind_n;
+        site.sample_n = sample_n;
+        site.use = use;
+        site.rec = &rec;
+        site.counts = counts;
+        for(i = 0; i < job->stage_n; i++)
+            job->stages[i].add(states[i], &site);
+    }
+    for(i = 0; i < job->stage_n; i++)
+        job->stages[i].close(states[i], chunk);
+
+    freeRecord(&rec);
+    free(line);
+    free(counts);
+}
+
+void *openFreq(void *arg, Chunk_s *chunk) {
+    int i;
+    FreqStage_s *s = NULL;
+    FreqJob_s *job = arg;
+
+    if((s = calloc(1, sizeof(FreqStage_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    s->job = job;
+    initWriter(&s->w[0], chunk->out[0], 0);
+    if(job->out > 0)
+        initWriter(&s->w[1], chunk->out[1], 0);
+    if(job->r2 < 1) {
+        if((s->snps = calloc(job->win, sizeof(SNP_s))) == NULL || (s->counts = calloc(job->win * job->pop_n * 2, sizeof(double))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        for(i = 0; i < job->win; i++)
+            s->snps[i].counts = s->counts + i * job->pop_n * 2;
+    } else if((s->counts = calloc(job->pop_n * 2, sizeof(double))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+
+    return s;
+}
+
+void addFreq(void *state, const Site_s *site) {
+    int i;
+    double mis_i = 0, alt_i = 0, hap_i = 0, *cur = NULL;
+    FreqStage_s *s = state;
+    FreqJob_s *job = s->job;
+    SNP_s *snps = s->snps;
+    const Record_s *rec = site->rec;
+    int win = job->win, step = job->step, pop_n = job->pop_n;
+    double mis = job->mis, maf = job->maf, r2 = job->r2;
+
+    if(r2 < 1) {
+        if(s->dose.dose == NULL)
+            initDosages(&s->dose, win, site->ind_n);
+        clearDosages(&s->dose, s->win_i);
+    }
+    if(site->skip)
+        return;
+    if(r2 < 1) {
+        if(s->win_n > 0 && strcmp(snps[0].chr, rec->chr) != 0) {
+            flushFreq(s);
+            s->win_n = 0;
+            s->win_i = 0;
+            s->step_i = 0;
+        }
+        strncpy(snps[s->win_i].chr, rec->chr, 99);
+        snps[s->win_i].pos = rec->pos;
+        snps[s->win_i].ok = -1;
+        snps[s->win_i].fresh = 1;
+        cur = snps[s->win_i].counts;
+        packDosages(&s->dose, s->win_i, rec->geno, site->use, rec->ind_n < site->sample_n ? rec->ind_n : site->sample_n);
+    } else
+        cur = s->counts;
+    for(i = 0; i < pop_n; i++) {
+        cur[i * 2] = site->counts[i].hap;
+        cur[i * 2 + 1] = site->counts[i].alt;
+        mis_i += site->counts[i].mis;
+        alt_i += site->counts[i].alt;
+        hap_i += site->counts[i].hap;
+    }
+    if(mis_i / site->ind_n > 1 - mis || mis_i == site->ind_n || alt_i / hap_i < maf || alt_i / hap_i > 1 - maf) {
+        if(r2 < 1)
+            snps[s->win_i].chr[0] = '\0';
+        return;
+    }
+    if(r2 == 1) {
+        printFreq(s->w, cur, rec->chr, rec->pos, job->out, pop_n);
+        s->snp_i++;
+        return;
+    }
+    if((s->win_n == win - 1 && s->step_i >= step) || (win == step && s->win_i == win - 1)) {
+        estLD(snps, &s->dose, s->win_n + 1, job->maxdist, r2, NULL);
+        s->step_i = 0;
+    }
+    if(s->win_n < win - 1)
+        s->win_n++;
+    s->step_i++;
+    s->win_i++;
+    if(s->win_i == win)
+        s->win_i = 0;
+    if(s->win_n == win - 1 && snps[s->win_i].ok == 1) {
+        printFreq(s->w, snps[s->win_i].counts, snps[s->win_i].chr, snps[s->win_i].pos, job->out, pop_n);
+        snps[s->win_i].ok = 0;
+        s->snp_i++;
+    }
+}
+
+/* Evaluates the sites left in the window and prints the ones that pass, in the order they were read */
+void flushFreq(FreqStage_s *s) {
+    int i;
+    SNP_s *snps = s->snps;
+
+    estLD(snps, &s->dose, s->win_n + 1, s->job->maxdist, s->job->r2, NULL);
+    for(i = 0; i < s->job->win; i++) {
+        if(snps[s->win_i].ok == 1) {
+            printFreq(s->w, snps[s->win_i].counts, snps[s->win_i].chr, snps[s->win_i].pos, s->job->out, s->job->pop_n);
+            snps[s->win_i].ok = 0;
+            s->snp_i++;
+        }
+        s->win_i++;
+        if(s->win_i == s->job->win)
+            s->win_i = 0;
+    }
+}
+
+void closeFreq(void *state, Chunk_s *chunk) {
+    FreqStage_s *s = state;
+
+    if(s->job->r2 < 1) {
+        /* In a single pass, the first line of the next chromosome clears the pending slot before this window is flushed */
+        if(s->dose.dose != NULL && chunk->last == 0)
+            clearDosages(&s->dose, s->win_i);
+        flushFreq(s);
+    }
+    s->job->snp_n[chunk->idx] = s->snp_i;
+
+    freeWriter(&s->w[0]);
+    if(s->job->out > 0)
+        freeWriter(&s->w[1]);
+    freeDosages(&s->dose);
+    free(s->snps);
+    free(s->counts);
+    free(s);
+}
+
+/* The SFS of each thread is kept in its own array, so the state of a chunk only records its thread */
+void *openSfs(void *arg, Chunk_s *chunk) {
+    SfsStage_s *s = NULL;
+
+    if((s = calloc(1, sizeof(SfsStage_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    s->thread = chunk->thread;
+    s->job = arg;
+
+    return s;
+}
+
+/* The number of haplotypes of each population comes from the first site, where missing genotypes still have a ploidy */
+void addSfs(void *state, const Site_s *site) {
+    int k, first = 1;
+    unsigned long int key = 0;
+    double p = 0, alt = 0, mis_i = 0;
+    const Count_s *c = NULL;
+    SfsStage_s *s = state;
+    SfsJob_s *job = s->job;
+    unsigned int *sfs = job->sfs[s->thread];
+
+    if(site->skip)
+        return;
+    if(sfs == NULL) {
+        for(k = 0; k < job->pop_n && job->split == 0; k++) {
+            if(site->counts[k].nul > 0) {
+                fprintf(stderr, "\nERROR: Allowed ploidy-levels are 2, 4, 6, and 8!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            job->hap_n[k] = site->counts[k].ploidy;
+        }
+        if(job->split == 0)
+            setOffsets(job->off, job->hap_n, NULL, job->pop_n, 0, 0);
+        if((sfs = calloc(job->off[job->pop_n], sizeof(unsigned int))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        job->sfs[s->thread] = sfs;
+    }
+    for(k = 0; k < job->pop_n; k++) {
+        c = &site->counts[k];
+        if(c->hap / job->hap_n[k] < job->mis)
+            continue;
+        alt = c->alt;
+        if(c->hap < job->hap_n[k]) {
+            p = c->alt / c->hap;
+            mis_i = job->hap_n[k] - c->hap;
+            if(p == 1)
+                alt += mis_i;
+            else if(p > 0) {
+                if(first) {
+                    key = siteKey(job->seed, site->rec->chr, site->rec->pos);
+                    first = 0;
+                }
+                alt += drawBinom(mis_i, p, drawUniform(key, k));
+            }
+        }
+        sfs[job->off[k] + (int)alt]++;
+    }
+}
+
+void closeSfs(void *state, Chunk_s *chunk) {
+    (void)chunk;
+    free(state);
+}
+
+void *openFst(void *arg, Chunk_s *chunk) {
+    FstStage_s *s = NULL;
+    FstJob_s *job = arg;
+
+    if((s = calloc(1, sizeof(FstStage_s))) == NULL || (s->freq = malloc(job->pop_n * sizeof(PopFreq_s))) == NULL || (s->site = malloc(job->pair_n * sizeof(Sum_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    s->job = job;
+    s->tot = job->tot + (size_t)chunk->idx * (job->pair_n + 1);
+
+    return s;
+}
+
+/* Population pairs are kept in the order (0,1), (0,2), ..., (1,2), ..., as in poly_fst */
+void addFst(void *state, const Site_s *site) {
+    int i, j, ok = 0, pair_i = 0;
+    double p1 = 0, p2 = 0, n1 = 0, n2 = 0;
+    FstStage_s *s = state;
+    FstJob_s *job = s->job;
+    PopFreq_s *freq = s->freq, *f = NULL;
+    Sum_s *sums = s->site;
+
+    if(site->skip)
+        return;
+    for(i = 0; i < job->pop_n; i++) {
+        f = &freq[i];
+        f->ok = 0;
+        f->ind = site->counts[i].ind;
+        f->mis = site->counts[i].mis;
+        f->n = site->counts[i].hap;
+        f->p = site->counts[i].alt;
+        if(f->ind == 0 || f->ind / (f->ind + f->mis) < job->mis)
+            continue;
+        f->p /= f->n;
+        f->ok = f->p >= job->maf && f->p <= 1 - job->maf;
+    }
+    for(i = 0; i < job->pop_n; i++) {
+        p1 = freq[i].p;
+        n1 = freq[i].n;
+        for(j = i + 1; j < job->pop_n; j++, pair_i++) {
+            p2 = freq[j].p;
+            n2 = freq[j].n;
+            sums[pair_i].n = freq[i].ok && freq[j].ok && (job->stat == 1 || p1 != 0 || p2 != 0);
+            sums[pair_i].hw = (p1 - p2) * (p1 - p2) - p1 * (1 - p1) / (n1 - 1) - p2 * (1 - p2) / (n2 - 1);
+            sums[pair_i].hb = p1 * (1 - p2) + p2 * (1 - p1);
+            ok += sums[pair_i].n > 0;
+        }
+    }
+    if(ok == 0)
+        return;
+    for(i = 0; i < job->pair_n; i++) {
+        if(sums[i].n > 0) {
+            s->tot[i].hw += sums[i].hw;
+            s->tot[i].hb += sums[i].hb;
+            s->tot[i].n++;
+        }
+    }
+    s->tot[job->pair_n].n++;
+}
+
+void closeFst(void *state, Chunk_s *chunk) {
+    FstStage_s *s = state;
+    (void)chunk;
+    free(s->freq);
+    free(s->site);
+    free(s);
+}
+
+int isNumeric(const char *s) {
+    char *p;
+    if(s == NULL || *s == '\0' || isspace(*s))
+        return 0;
+    strtod(s, &p);
+    return *p == '\0';
+}
+
+void stringTerminator(char *string) {
+    string[strcspn(string, "\n")] = 0;
+}
+
+void printHelp(void) {
+    fprintf(stderr, "\nProgram for estimating allele frequencies, SFS and Fst/Dxy from mixed ploidy VCF files in a single pass.\nEach stage writes the same output as poly_freq, poly_sfs (-pops) or poly_fst (-pops) into its own file.\n\n");
+    fprintf(stderr, "Usage:\n");
+    fprintf(stderr, "-vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8. Can be bgzip-compressed or a BCF file.\n");
+    fprintf(stderr, "-cache [file] Binary genotype cache. With -vcf, the VCF file is first converted into this file; without it, an existing cache is read instead of a VCF file. Optional.\n");
+    fprintf(stderr, "-pops [file] Tab delimited file listing individuals to use and their populations (format: individual id, population id).\n");
+    fprintf(stderr, "-sites [file] Tab delimited file listing sites to use (format: chr, pos). Optional.\n");
+    fprintf(stderr, "-freq [file] [double] [double] Writes the allele frequencies of each population into the file. Requires the proportion of missing data and the minimum minor allele frequency allowed (-mis and -maf of poly_freq). Optional.\n");
+    fprintf(stderr, "-r2 [int] [int] [double] Excludes sites of -freq based on squared genotypic correlation. Requires a window size in number of SNPs, a step size in number of SNPs, and a maximum r2 value. Optional.\n");
+    fprintf(stderr, "-r2bp [int] Maximum distance in bp between the sites of a pair compared with -r2. Pairs further apart are not compared. Optional.\n");
+    fprintf(stderr, "-out [int] Whether -freq outputs allele frequencies (0), allele counts in the BayPass format (1), or allele frequencies as binary 32-bit floats in native byte order, one row of populations per site (2). Default 0.\n");
+    fprintf(stderr, "-info [string] If -out is 1 or 2, records populations and locations of the SNPs of -freq into this file. Default 'info.txt'.\n");
+    fprintf(stderr, "-sfs [file] [double] Writes the SFS of each population into the file. Requires the proportion of missing data allowed (-mis of poly_sfs). Missing alleles are imputed by drawing them from a Bernoulli distribution. Optional.\n");
+    fprintf(stderr, "-seed [int] Seed number used for the imputation of -sfs. Default is a random seed.\n");
+    fprintf(stderr, "-fst [file] [double] [double] Writes the genome-wide matrix of Fst (or Dxy) between all population pairs into the file. Requires the proportion of missing data and the minimum minor allele frequency allowed (-mis and -maf of poly_fst). Optional.\n");
+    fprintf(stderr, "-stat [string] Whether -fst calculates 'fst' or 'dxy'. Default 'fst'. Note that dxy requires invariant sites to be included in the VCF file.\n");
+    fprintf(stderr, "-region [chr:start-end] Only uses sites within the region (for example chr1:1000-2000 or chr1). Uses the .tbi or .csi index of a bgzip-compressed VCF file to read only that part of the file. Optional.\n");
+    fprintf(stderr, "-threads [int] Number of threads used for processing parts of the VCF file (chromosomes with -r2) in parallel. A pipe, a gzip file or a single chromosome is read as one part, with its lines parsed on the threads. Default 1.\n\n");
+    fprintf(stderr, "Example:\n");
+    fprintf(stderr, "./poly_sv -vcf in.vcf -pops pops.txt -sites 4fold.sites -freq 4fold_ld_pruned.freq 0.8 0.05 -r2 100 50 0.1 -sfs 4fold.sfs 0.8 -fst 4fold.fst 0.8 0\n\n");
+}
@@ -17,17 +17,27 @@
 
  Program for conducting LD-pruning on mixed ploidy VCF files.
 
- Compiling: gcc prune_ld.c -o prune_ld -lm
+ Compiling: gcc prune_ld.c poly_ld.c vcf_parse.c vcf_thread.c vcf_cache.c vcf_bcf.c vcf_write.c vcf_stats.c bgzf.c -o prune_ld -lm -lpthread -lz
 
  Usage:
- -vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8.
+ -vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8. Can be bgzip-compressed or a BCF file.
+ -cache [file] Binary genotype cache. With -vcf, the VCF file is first converted into this file; without it, an existing cache is read instead of a VCF file. Optional.
  -sites [file] Tab delimited file listing sites to use (format: chr, pos). Optional.
  -r2 [int] [int] [double] Excludes sites based on squared genotypic correlation. Requires a window size in number of SNPs, a step size in number of SNPs, and a maximum r2 value.
+ -r2bp [int] Maximum distance in bp between the sites of a pair compared with -r2, -ldmatrix or -lddecay. Pairs further apart are not compared. Optional.
+ -ldmatrix [int] [double] Instead of LD-pruning, writes the r2 of each pair of sites within a window (in number of SNPs) with r2 of at least the given value, one pair per line (format: chr, pos1, id1, pos2, id2, r2). Optional.
+ -lddecay [int] [int] Instead of LD-pruning, writes the mean r2 of the pairs of sites within a window (in number of SNPs) in bins of distance of the given size in bp (format: start, end, pairs, r2). Optional.
  -mis [double] Excludes sites based of the proportion of missing data (0 = all missing allowed, 1 = no missing data allowed). Default 0.6.
  -maf [double] Minimum minor allele frequency allowed. Default 0.05.
+ -region [chr:start-end] Only uses sites within the region (for example chr1:1000-2000 or chr1). Uses the .tbi or .csi index of a bgzip-compressed VCF file to read only that part of the file. Optional.
+ -O [string] Output format: 'v' for VCF, 'z' for bgzip-compressed VCF or 'b' for BCF. BCF output requires ##contig lines in the VCF header. With -threads, the BGZF blocks of a single part are compressed on the threads. Default 'v'.
+ -index [file] Also writes a .tbi index (or a .csi index, if the file name ends with .csi) of the -O z output into this file, built while the output is written. Optional.
+ -threads [int] Number of threads used for processing chromosomes in parallel. A pipe, a gzip file or a single chromosome is read as one part, with its lines parsed on the threads. Default 1.
+ -stats [string] Writes a JSON report of the time spent in each stage, the numbers of sites read and dropped by each filter, the numbers of r2 estimates, and peak memory use into this file, or to stderr with 'stderr'. Optional.
 
  Example:
  ./prune_ld -vcf in.vcf -sites 4fold.sites -mis 0.8 -maf 0.05 -r2 100 50 0.1 > 4fold_ld_pruned.vcf
+ ./prune_ld -vcf in.vcf.gz -r2 100 50 0.1 -O z -index ld_pruned.vcf.gz.tbi -threads 8 > ld_pruned.vcf.gz
 */
 
 #include <ctype.h>
@@ -37,27 +47,46 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include "poly_ld.h"
+#include "vcf_parse.h"
+#include "vcf_thread.h"
+#include "vcf_write.h"
 #define merror "\nERROR: System out of memory\n\n"
 
 typedef struct {
-    int pos;
-    char chr[100];
-} Site_s;
+    int pos, ok, fresh;
+    char ref, alt, id[100], chr[100];
+} SNP_s;
 
 typedef struct {
-    int pos, ok;
-    double *geno;
-    char ref, alt, id[100], chr[100], **hap;
-} SNP_s;
+    int bin_n;
+    long int *n;
+    double *sum;
+} Decay_s;
+
+typedef struct {
+    int win, step, maxdist, out, mode, bin, pool_n, *snp_n;
+    double mis, maf, r2;
+    Sites_s *sites;
+    Bcf_s *bcf;
+    Decay_s *decay;
+    Index_s *index;
+} Job_s;
 
 void openFiles(int argc, char *argv[]);
-Site_s *readSites(FILE *site_file, int *n);
-void readVcf(FILE *vcf_file, Site_s *sites, int win, int step, int site_n, double mis, double maf, double r2);
-void estLD(SNP_s *snps, int win, int ind_n, double r2);
-double estR2(double geno1[], double geno2[], int n);
-void printOut(SNP_s snp, int n);
+void readVcf(Bgzf_s *vcf_file, Cache_s *cache, const char *vcf_name, const Region_s *region, Sites_s *sites, int win, int step, int maxdist, int out, int mode, int bin, int thread_n, double mis, double maf, double r2, const char *stats_name, const char *index_name);
+char *addHead(char *text, long int *n, long int *max, const char *line);
+char *startBcf(Job_s *job, Writer_s *w, char *text, long int n);
+void readChunk(Chunk_s *chunk, void *arg);
+void readLdChunk(Chunk_s *chunk, void *arg);
+int passSite(const Record_s *rec, int ind_n, double mis, double maf, Stats_s *st);
+void estLD(SNP_s *snps, Dosage_s *dose, int win, int maxdist, double r2, Stats_s *st);
+int estBlock(Job_s *job, Writer_s *w, const SNP_s *snps, Dosage_s *dose, int first, int *buf_n, int cap, double *r2s, Decay_s *decay, Stats_s *st);
+void addDecay(Decay_s *decay, int bin, long int n, double sum);
+void printDecay(const Decay_s *decay, int chunk_n, int bin);
+char *storeHaps(char *haps, int *hap_n, int win, int slot, Record_s *rec, int n);
+void printOut(Writer_s *w, const Bcf_s *bcf, const SNP_s *snp, const char *hap);
 int isNumeric(const char *s);
-void stringTerminator(char *string);
 void printHelp(void);
 
 int main(int argc, char *argv[]) {
@@ -84,10 +113,14 @@ int main(int argc, char *argv[]) {
 }
 
 void openFiles(int argc, char *argv[]) {
-    int i, win = 0, step = 0, out = 0, site_n = 0;
+    int i, win = 0, step = 0, maxdist = 0, out = 0, mode = 0, bin = 0, thread_n = 1;
     double mis = 0.6, maf = 0.05, r2 = -1;
-    Site_s *sites = NULL;
-    FILE *vcf_file = NULL, *site_file = NULL;
+    char temp[10], *vcf_name = NULL, *cache_name = NULL, *stats_name = NULL, *index_name = NULL;
+    Sites_s *sites = NULL;
+    Region_s region, *reg = NULL;
+    Bgzf_s *vcf_file = NULL;
+    Cache_s *cache = NULL;
+    FILE *site_file = NULL;
 
     if(argc == 1) {
         printHelp();
@@ -98,11 +131,15 @@ void openFiles(int argc, char *argv[]) {
 
     for(i = 1; i < argc; i++) {
         if(strcmp(argv[i], "-vcf") == 0) {
-            if((vcf_file = fopen(argv[++i], "r")) == NULL) {
+            if((vcf_file = openBgzf(argv[++i])) == NULL) {
                 fprintf(stderr, "\nERROR: Cannot open file %s\n\n", argv[i]);
                 exit(EXIT_FAILURE);
             }
+            vcf_name = argv[i];
             fprintf(stderr, "\t-vcf %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-cache") == 0) {
+            cache_name = argv[++i];
+            fprintf(stderr, "\t-cache %s\n", argv[i]);
         } else if(strcmp(argv[i], "-sites") == 0) {
             if((site_file = fopen(argv[++i], "r")) == NULL) {
                 fprintf(stderr, "\nERROR: Cannot open file %s\n\n", argv[i]);
@@ -134,6 +171,10 @@ void openFiles(int argc, char *argv[]) {
             }
             fprintf(stderr, "\t-maf %s\n", argv[i]);
         } else if(strcmp(argv[i], "-r2") == 0) {
+            if(mode != 0) {
+                fprintf(stderr, "\nERROR: Only one of -r2, -ldmatrix and -lddecay can be used!\n\n");
+                exit(EXIT_FAILURE);
+            }
             if(isNumeric(argv[++i])) {
                 win = atoi(argv[i]);
                 if(win < 1) {
@@ -159,6 +200,75 @@ void openFiles(int argc, char *argv[]) {
                 exit(EXIT_FAILURE);
             }
             fprintf(stderr, "\t-r2 %i %i %s\n", win, step, argv[i]);
+        } else if(strcmp(argv[i], "-ldmatrix") == 0 || strcmp(argv[i], "-lddecay") == 0) {
+            if(mode != 0 || step != 0) {
+                fprintf(stderr, "\nERROR: Only one of -r2, -ldmatrix and -lddecay can be used!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            mode = strcmp(argv[i], "-ldmatrix") == 0 ? 1 : 2;
+            if(isNumeric(argv[++i]))
+                win = atoi(argv[i]);
+            if(win < 2 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for the %s window size [int]!\n\n", mode == 1 ? "-ldmatrix" : "-lddecay");
+                exit(EXIT_FAILURE);
+            }
+            i++;
+            if(mode == 1 && isNumeric(argv[i]))
+                r2 = atof(argv[i]);
+            if(mode == 2 && isNumeric(argv[i]))
+                bin = atoi(argv[i]);
+            if(mode == 1 && (r2 < 0 || r2 > 1)) {
+                fprintf(stderr, "\nERROR: Invalid value for -ldmatrix [int] [double]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            if(mode == 2 && (bin < 1 || isNumeric(argv[i]) == 0)) {
+                fprintf(stderr, "\nERROR: Invalid value for the -lddecay bin size [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t%s %i %s\n", mode == 1 ? "-ldmatrix" : "-lddecay", win, argv[i]);
+        } else if(strcmp(argv[i], "-r2bp") == 0) {
+            if(isNumeric(argv[++i]))
+                maxdist = atoi(argv[i]);
+            if(maxdist < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -r2bp [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-r2bp %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-O") == 0) {
+            strncpy(temp, argv[++i], 9);
+            temp[9] = '\0';
+            if(strcmp(temp, "v") == 0)
+                out = 0;
+            else if(strcmp(temp, "b") == 0)
+                out = 1;
+            else if(strcmp(temp, "z") == 0)
+                out = 2;
+            else {
+                fprintf(stderr, "\nERROR: Invalid input for -O [string]! Allowed are 'v', 'z' and 'b'\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-O %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-index") == 0) {
+            index_name = argv[++i];
+            fprintf(stderr, "\t-index %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-region") == 0) {
+            if(parseRegion(argv[++i], &region) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -region [chr:start-end]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            reg = &region;
+            fprintf(stderr, "\t-region %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-threads") == 0) {
+            if(isNumeric(argv[++i]))
+                thread_n = atoi(argv[i]);
+            if(thread_n < 1 || isNumeric(argv[i]) == 0) {
+                fprintf(stderr, "\nERROR: Invalid value for -threads [int]!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "\t-threads %s\n", argv[i]);
+        } else if(strcmp(argv[i], "-stats") == 0) {
+            stats_name = argv[++i];
+            fprintf(stderr, "\t-stats %s\n", argv[i]);
         } else if(strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             fprintf(stderr, "\t%s\n", argv[i]);
             printHelp();
@@ -170,10 +280,30 @@ void openFiles(int argc, char *argv[]) {
     }
     fprintf(stderr, "\n");
 
-    if(vcf_file == NULL || win == 0 || step == 0 || r2 == -1) {
-        fprintf(stderr, "\nERROR: -vcf [file] and -r2 [int] [int] [double] are required!\n\n");
+    if((vcf_file == NULL && cache_name == NULL) || win == 0 || (mode == 0 && (step == 0 || r2 == -1))) {
+        fprintf(stderr, "\nERROR: -vcf [file] (or -cache [file]) and -r2 [int] [int] [double] (or -ldmatrix or -lddecay) are required!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(mode != 0 && out > 0) {
+        fprintf(stderr, "\nERROR: -O b and -O z cannot be used with -ldmatrix or -lddecay!\n\n");
+        exit(EXIT_FAILURE);
+    }
+    if(index_name != NULL && out != 2) {
+        fprintf(stderr, "\nERROR: -index [file] requires -O z!\n\n");
         exit(EXIT_FAILURE);
     }
+    if(cache_name != NULL) {
+        if(vcf_file != NULL) {
+            writeCache(vcf_file, cache_name);
+            closeBgzf(vcf_file);
+            vcf_file = NULL;
+            vcf_name = NULL;
+        }
+        if((cache = openCache(cache_name)) == NULL) {
+            fprintf(stderr, "\nERROR: Cannot open file %s\n\n", cache_name);
+            exit(EXIT_FAILURE);
+        }
+    }
     if(maf == 0) {
         fprintf(stderr, "Warning: Doing LD-pruning, setting -maf to 0.05\n\n");
         maf = 0.05;
@@ -183,229 +313,211 @@ void openFiles(int argc, char *argv[]) {
         mis = 0.6;
     }
     if(site_file != NULL)
-        sites = readSites(site_file, &site_n);
-    readVcf(vcf_file, sites, win, step, site_n, mis, maf, r2);
+        sites = readSites(site_file);
+    readVcf(vcf_file, cache, vcf_name, reg, sites, win, step, maxdist, out, mode, bin, thread_n, mis, maf, r2, stats_name, index_name);
 }
 
-Site_s *readSites(FILE *site_file, int *n) {
-    double list_i = 1e6;
-    char *line = NULL;
-    Site_s *list = NULL;
-    size_t len = 0;
-    ssize_t read;
+void readVcf(Bgzf_s *vcf_file, Cache_s *cache, const char *vcf_name, const Region_s *region, Sites_s *sites, int win, int step, int maxdist, int out, int mode, int bin, int thread_n, double mis, double maf, double r2, const char *stats_name, const char *index_name) {
+    int i, chunk_n = 0, snp_i = 0;
+    double start = clockStats(CLOCK_MONOTONIC);
+    FILE *outs[2] = {stdout, NULL};
+    Stats_s *stats = NULL;
+    Chunk_s *chunks = NULL;
+    Job_s job = {win, step, maxdist, out, mode, bin, 0, NULL, mis, maf, r2, sites, NULL, NULL, NULL};
 
-    if((list = malloc(list_i * sizeof(Site_s))) == NULL) {
+    if(cache != NULL)
+        chunks = splitCache(cache, region, thread_n, 1, &chunk_n);
+    else
+        chunks = splitVcf(vcf_file, vcf_name, region, thread_n, 1, &chunk_n);
+    if(chunk_n <= 2)
+        job.pool_n = thread_n;
+    if((job.snp_n = calloc(chunk_n, sizeof(int))) == NULL || (stats_name != NULL && (stats = calloc(chunk_n, sizeof(Stats_s))) == NULL) || (mode == 2 && (job.decay = calloc(chunk_n, sizeof(Decay_s))) == NULL) || (index_name != NULL && (job.index = calloc(chunk_n, sizeof(Index_s))) == NULL)) {
         fprintf(stderr, merror);
         exit(EXIT_FAILURE);
     }
-    while((read = getline(&line, &len, site_file)) != -1) {
-        if(line[0] == '\n' || line[0] == '#')
-            continue;
-        strncpy(list[*n].chr, strtok(line, "\t"), 99);
-        list[*n].pos = atoi(strtok(NULL, "\t"));
-        if(*n > 0) {
-            if(strcmp(list[*n].chr, list[*n - 1].chr) < 0) {
-                fprintf(stderr, "ERROR: Site file is not sorted. Use: sort -k1,1 -k2,2n list.sites > sorted.sites\n\n");
-                exit(EXIT_FAILURE);
-            } else if(strcmp(list[*n].chr, list[*n - 1].chr) == 0) {
-                if(list[*n].pos < list[*n - 1].pos) {
-                    fprintf(stderr, "ERROR: Site file is not sorted. Use: sort -k1,1 -k2,2n list.sites > sorted.sites\n\n");
-                    exit(EXIT_FAILURE);
-                }
-            }
-        }
-        *n = *n + 1;
-        if(*n >= list_i) {
-            list_i += 1e5;
-            if((list = realloc(list, list_i * sizeof(Site_s))) == NULL) {
-                fprintf(stderr, merror);
-                exit(EXIT_FAILURE);
-            }
+    for(i = 0; stats != NULL && i < chunk_n; i++)
+        chunks[i].stats = &stats[i];
+    runChunks(chunks, 1, 1, vcf_name, vcf_file, outs, mode == 0 ? readChunk : readLdChunk, &job);
+    runChunks(chunks + 1, chunk_n - 1, thread_n, vcf_name, vcf_file, outs, mode == 0 ? readChunk : readLdChunk, &job);
+    if(out > 0)
+        writeEof(stdout);
+    if(index_name != NULL) {
+        fflush(stdout);
+        writeIndex(index_name, job.index, chunk_n);
+    }
+    for(i = 0; i < chunk_n; i++)
+        snp_i += job.snp_n[i];
+
+    if(isatty(1))
+        fprintf(stderr, "\n");
+    if(mode == 0)
+        fprintf(stderr, "After pruning, kept %i variants\n\n", snp_i);
+    else
+        fprintf(stderr, "Estimated LD between %i variants\n\n", snp_i);
+    if(mode == 2)
+        printDecay(job.decay, chunk_n, bin);
+    if(stats != NULL)
+        printStats(stats_name, "prune_ld", stats, chunk_n, start);
+
+    for(i = 0; job.decay != NULL && i < chunk_n; i++) {
+        free(job.decay[i].n);
+        free(job.decay[i].sum);
+    }
+    for(i = 0; job.index != NULL && i < chunk_n; i++)
+        freeIndex(&job.index[i]);
+    free(job.decay);
+    free(job.index);
+    free(job.snp_n);
+    free(stats);
+    if(job.bcf != NULL)
+        freeBcf(job.bcf);
+    freeChunks(chunks);
+    if(sites != NULL)
+        freeSites(sites);
+    if(cache != NULL)
+        closeCache(cache);
+    else
+        closeBgzf(vcf_file);
+}
+
+char *addHead(char *text, long int *n, long int *max, const char *line) {
+    long int k = strlen(line);
+    if(*n + k + 1 > *max) {
+        *max = (*n + k + 1) * 2;
+        if((text = realloc(text, *max)) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
         }
     }
+    memcpy(text + *n, line, k + 1);
+    *n += k;
 
-    free(line);
-    fclose(site_file);
+    return text;
+}
+
+/* The BCF header (with the FORMAT lines of GT and FT) is written once the header lines of chunk 0 have been read */
+char *startBcf(Job_s *job, Writer_s *w, char *text, long int n) {
+    job->bcf = makeBcf(text, n, "GT:FT");
+    writeBcfHead(w, job->bcf);
+    free(text);
 
-    return list;
+    return NULL;
 }
 
-void readVcf(FILE *vcf_file, Site_s *sites, int win, int step, int site_n, double mis, double maf, double r2) {
-    int i, j = 0, k = 0, pos = 0, ok = 0, stop = 0, geno_n = 0, ind_i = 0, ind_n = 0, site_i = 0, win_n = 0, win_i = 0, step_i = 0, snp_i = 0;
-    double ploidy = 0, mis_i = 0, alt_i = 0, hap_i = 0;
-    char chr[100], *line = NULL, *temp = NULL, *end = NULL;
+void readChunk(Chunk_s *chunk, void *arg) {
+    int i, hap_n = 0, ind_n = 0, win_n = 0, win_i = 0, step_i = 0, snp_i = 0;
+    long int text_n = 0, text_max = 0;
+    char *line = NULL, *haps = NULL, *text = NULL;
+    Record_s rec = {0};
+    SiteCursor_s site_c = {0};
+    Dosage_s dose = {0};
     SNP_s *snps = NULL;
+    Writer_s w;
+    Job_s *job = arg;
+    Sites_s *sites = job->sites;
+    Stats_s *st = chunk->stats;
+    int win = job->win, step = job->step;
+    double mis = job->mis, maf = job->maf, r2 = job->r2;
     size_t len = 0;
     ssize_t read;
 
-    while((read = getline(&line, &len, vcf_file)) != -1) {
-        if(line[0] == '\n')
+    initWriter(&w, chunk->out[0], job->out > 0);
+    threadWriter(&w, job->pool_n);
+    if(job->index != NULL)
+        w.index = &job->index[chunk->idx];
+    while((read = readSite(chunk, &line, &len, &rec)) != -1) {
+        if(read == 0 && job->out == 1)
+            text = addHead(text, &text_n, &text_max, line);
+        else if(read == 0)
+            writeString(&w, line);
+        if(read == 0)
             continue;
-        if(line[0] == '#') {
-            printf("%s", line);
-            continue;
-        }
+        if(job->out == 1 && job->bcf == NULL)
+            text = startBcf(job, &w, text, text_n);
         if(snps == NULL) {
-            if((snps = malloc(win * sizeof(SNP_s))) == NULL) {
+            if((snps = calloc(win, sizeof(SNP_s))) == NULL) {
                 fprintf(stderr, merror);
                 exit(EXIT_FAILURE);
             }
-            geno_n = (int)read;
-            for(i = 0; i < win; i++) {
-                if((snps[i].geno = malloc(geno_n * sizeof(double))) == NULL) {
-                    fprintf(stderr, merror);
-                    exit(EXIT_FAILURE);
-                }
-                if((snps[i].hap = malloc(geno_n * sizeof(char *))) == NULL) {
-                    fprintf(stderr, merror);
-                    exit(EXIT_FAILURE);
-                }
-                for(j = 0; j < geno_n; j++) {
-                    if((snps[i].hap[j] = malloc(50 * sizeof(char))) == NULL) {
-                        fprintf(stderr, merror);
-                        exit(EXIT_FAILURE);
-                    }
-                }
-            }
         }
-        temp = strtok_r(line, "\t", &end);
-        k = 1;
-        ind_i = 0;
-        mis_i = 0;
-        alt_i = 0;
-        hap_i = 0;
-        memset(snps[win_i].geno, 0, geno_n * sizeof(double));
-        while(temp != NULL) {
-            if(k == 1)
-                strncpy(chr, temp, 99);
-            else if(k == 2) {
-                pos = atoi(temp);
-                if(site_n > 0) {
-                    ok = 0;
-                    while(site_i < site_n) {
-                        if(strcmp(chr, sites[site_i].chr) == 0) {
-                            if(pos == sites[site_i].pos) {
-                                ok = 1;
-                                break;
-                            } else if(pos < sites[site_i].pos)
-                                break;
-                        } else if(strcmp(chr, sites[site_i].chr) < 0)
-                            break;
-                        site_i++;
-                    }
-                    if(ok == 0)
-                        break;
-                }
-                if(win_n > 0 && strcmp(snps[0].chr, chr) != 0) {
-                    estLD(snps, win_n + 1, ind_n, r2);
-                    for(i = 0; i < win; i++) {
-                        if(snps[win_i].ok == 1) {
-                            printOut(snps[win_i], ind_n);
-                            snps[win_i].ok = 0;
-                            snp_i++;
-                        }
-                        win_i++;
-                        if(win_i == win)
-                            win_i = 0;
-                    }
-                    win_n = 0;
-                    win_i = 0;
-                    step_i = 0;
-                    memset(snps[win_i].geno, 0, geno_n * sizeof(double));
-                }
-                strcpy(snps[win_i].chr, chr);
-                snps[win_i].pos = pos;
-                snps[win_i].ok = -1;
-            } else if(k == 3)
-                strncpy(snps[win_i].id, temp, 99);
-            else if(k == 4)
-                snps[win_i].ref = temp[0];
-            else if(k == 5)
-                snps[win_i].alt = temp[0];
-            else if(k > 9) {
-                if(strchr(temp, ':') != NULL)
-                    strncpy(snps[win_i].hap[ind_i], strtok(temp, ":"), 49);
-                else {
-                    stringTerminator(temp);
-                    strncpy(snps[win_i].hap[ind_i], temp, 49);
-                }
-                if(snps[win_i].hap[ind_i][0] == '.') {
-                    snps[win_i].geno[ind_i++] = -1;
-                    mis_i++;
-                    temp = strtok_r(NULL, "\t", &end);
-                    k++;
-                    continue;
-                }
-                switch(strlen(snps[win_i].hap[ind_i])) {
-                    case 3:
-                        ploidy = 2;
-                        stop = 2;
-                        break;
-                    case 7:
-                        ploidy = 4;
-                        stop = 6;
-                        break;
-                    case 11:
-                        ploidy = 6;
-                        stop = 10;
-                        break;
-                    case 15:
-                        ploidy = 8;
-                        stop = 14;
-                        break;
-                    default:
-                        fprintf(stderr, "\nERROR: Allowed ploidy-levels are 2, 4, 6, and 8!\n\n");
-                        exit(EXIT_FAILURE);
-                }
-                for(i = 0; i <= stop; i += 2) {
-                    if(snps[win_i].hap[ind_i][i] == '0' || snps[win_i].hap[ind_i][i] == '1') {
-                        snps[win_i].geno[ind_i] += snps[win_i].hap[ind_i][i] - '0';
-                        alt_i += snps[win_i].hap[ind_i][i] - '0';
-                    } else {
-                        fprintf(stderr, "\nERROR: Unknown alleles found at site %s:%i! Only 0 and 1 are allowed.\n\n", chr, pos);
-                        exit(EXIT_FAILURE);
-                    }
-                }
-                hap_i += ploidy;
-                ind_i++;
-            }
-            temp = strtok_r(NULL, "\t", &end);
-            k++;
+        if(dose.dose != NULL)
+            clearDosages(&dose, win_i);
+        if(sites != NULL && findSite(sites, &site_c, rec.chr, rec.pos) == 0) {
+            if(st != NULL)
+                st->drop_sites++;
+            lapStats(st, STAT_SITES);
+            continue;
         }
-        if(temp == NULL) {
-            if(ind_n == 0)
-                ind_n = ind_i;
-            if(mis_i / ind_n > 1 - mis || mis_i == ind_n) {
-                snps[win_i].chr[0] = '\0';
-                continue;
-            }
-            if(alt_i / hap_i < maf || alt_i / hap_i > 1 - maf) {
-                snps[win_i].chr[0] = '\0';
-                continue;
-            }
-            if((win_n == win - 1 && step_i >= step) || (win == step && win_i == win - 1)) {
-                estLD(snps, win_n + 1, ind_n, r2);
-                step_i = 0;
-            }
-            if(win_n < win - 1)
-                win_n++;
-            step_i++;
-            win_i++;
-            if(win_i == win)
-                win_i = 0;
-            if(win_n == win - 1) {
+        if(sites != NULL)
+            lapStats(st, STAT_SITES);
+        if(win_n > 0 && strcmp(snps[0].chr, rec.chr) != 0) {
+            estLD(snps, &dose, win_n + 1, job->maxdist, r2, st);
+            lapStats(st, STAT_LD);
+            for(i = 0; i < win; i++) {
                 if(snps[win_i].ok == 1) {
-                    printOut(snps[win_i], ind_n);
+                    printOut(&w, job->bcf, &snps[win_i], haps + (size_t)win_i * hap_n);
                     snps[win_i].ok = 0;
                     snp_i++;
                 }
+                win_i++;
+                if(win_i == win)
+                    win_i = 0;
+            }
+            lapStats(st, STAT_OUT);
+            win_n = 0;
+            win_i = 0;
+            step_i = 0;
+        }
+        strncpy(snps[win_i].chr, rec.chr, 99);
+        strncpy(snps[win_i].id, rec.id, 99);
+        snps[win_i].pos = rec.pos;
+        snps[win_i].ref = rec.ref[0];
+        snps[win_i].alt = rec.alt[0];
+        snps[win_i].ok = -1;
+        snps[win_i].fresh = 1;
+        parseGenos(&rec, NULL, 0);
+        if(ind_n == 0) {
+            ind_n = rec.ind_n;
+            initDosages(&dose, win, ind_n);
+        }
+        packDosages(&dose, win_i, rec.geno, NULL, rec.ind_n);
+        haps = storeHaps(haps, &hap_n, win, win_i, &rec, ind_n);
+        lapStats(st, STAT_PARSE);
+        if(passSite(&rec, ind_n, mis, maf, st) == 0) {
+            snps[win_i].chr[0] = '\0';
+            lapStats(st, STAT_FILTER);
+            continue;
+        }
+        lapStats(st, STAT_FILTER);
+        if((win_n == win - 1 && step_i >= step) || (win == step && win_i == win - 1)) {
+            estLD(snps, &dose, win_n + 1, job->maxdist, r2, st);
+            lapStats(st, STAT_LD);
+            step_i = 0;
+        }
+        if(win_n < win - 1)
+            win_n++;
+        step_i++;
+        win_i++;
+        if(win_i == win)
+            win_i = 0;
+        if(win_n == win - 1) {
+            if(snps[win_i].ok == 1) {
+                printOut(&w, job->bcf, &snps[win_i], haps + (size_t)win_i * hap_n);
+                snps[win_i].ok = 0;
+                snp_i++;
+                lapStats(st, STAT_OUT);
             }
         }
     }
-    estLD(snps, win_n + 1, ind_n, r2);
-    for(i = 0; i < win; i++) {
+    /* In a single pass, the first line of the next chromosome clears the pending slot before this window is flushed */
+    if(dose.dose != NULL && chunk->last == 0)
+        clearDosages(&dose, win_i);
+    if(dose.dose != NULL)
+        estLD(snps, &dose, win_n + 1, job->maxdist, r2, st);
+    lapStats(st, STAT_LD);
+    for(i = 0; i < win && dose.dose != NULL; i++) {
         if(snps[win_i].ok == 1) {
-            printOut(snps[win_i], ind_n);
+            printOut(&w, job->bcf, &snps[win_i], haps + (size_t)win_i * hap_n);
             snps[win_i].ok = 0;
             snp_i++;
         }
@@ -413,83 +525,339 @@ void readVcf(FILE *vcf_file, Site_s *sites, int win, int step, int site_n, doubl
         if(win_i == win)
             win_i = 0;
     }
+    if(job->out == 1 && job->bcf == NULL)
+        text = startBcf(job, &w, text, text_n);
+    job->snp_n[chunk->idx] = snp_i;
+
+    freeWriter(&w);
+    lapStats(st, STAT_OUT);
+    if(st != NULL)
+        st->kept_n = snp_i;
+    free(snps);
+    free(haps);
+    freeDosages(&dose);
+    freeRecord(&rec);
+    free(line);
+}
 
-    if(isatty(1))
-        fprintf(stderr, "\n");
-    fprintf(stderr, "After pruning, kept %i variants\n\n", snp_i);
+/*
+ The LD buffer holds the window and one tile of SNPs (rounded up to whole tiles), so that each call of estBlock has the
+ window of every SNP of its tile. The buffer starts at a multiple of LD_TILE, so the tiles are never split at its end.
+*/
+void readLdChunk(Chunk_s *chunk, void *arg) {
+    int ind_n = 0, cap = 0, first = 0, buf_n = 0, slot = 0, snp_i = 0;
+    char *line = NULL;
+    double *r2s = NULL;
+    Record_s rec = {0};
+    SiteCursor_s site_c = {0};
+    Dosage_s dose = {0};
+    SNP_s *snps = NULL;
+    Writer_s w;
+    Job_s *job = arg;
+    Decay_s *decay = job->decay != NULL ? &job->decay[chunk->idx] : NULL;
+    Stats_s *st = chunk->stats;
+    size_t len = 0;
+    ssize_t read;
 
-    for(i = 0; i < win; i++) {
-        free(snps[i].geno);
-        for(j = 0; j < geno_n; j++)
-            free(snps[i].hap[j]);
-        free(snps[i].hap);
+    initWriter(&w, chunk->out[0], 0);
+    while((read = readSite(chunk, &line, &len, &rec)) != -1) {
+        if(read == 0 && job->mode == 1 && strncmp(line, "#CHROM", 6) == 0)
+            writeString(&w, "chr\tpos1\tid1\tpos2\tid2\tr2\n");
+        if(read == 0)
+            continue;
+        if(job->sites != NULL && findSite(job->sites, &site_c, rec.chr, rec.pos) == 0) {
+            if(st != NULL)
+                st->drop_sites++;
+            lapStats(st, STAT_SITES);
+            continue;
+        }
+        if(job->sites != NULL)
+            lapStats(st, STAT_SITES);
+        if(buf_n > 0 && strcmp(snps[first].chr, rec.chr) != 0) {
+            while(buf_n > 0)
+                first = estBlock(job, &w, snps, &dose, first, &buf_n, cap, r2s, decay, st);
+            lapStats(st, STAT_LD);
+        }
+        parseGenos(&rec, NULL, 0);
+        if(ind_n == 0) {
+            ind_n = rec.ind_n;
+            cap = (job->win + 2 * LD_TILE - 2) / LD_TILE * LD_TILE;
+            if((snps = calloc(cap, sizeof(SNP_s))) == NULL || (r2s = malloc((size_t)LD_TILE * cap * sizeof(double))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+            initDosages(&dose, cap, ind_n);
+            initTiles(&dose);
+        }
+        lapStats(st, STAT_PARSE);
+        if(passSite(&rec, ind_n, job->mis, job->maf, st) == 0) {
+            lapStats(st, STAT_FILTER);
+            continue;
+        }
+        slot = (first + buf_n) % cap;
+        strncpy(snps[slot].chr, rec.chr, 99);
+        strncpy(snps[slot].id, rec.id, 99);
+        snps[slot].pos = rec.pos;
+        packDosages(&dose, slot, rec.geno, NULL, rec.ind_n);
+        buf_n++;
+        snp_i++;
+        lapStats(st, STAT_FILTER);
+        if(buf_n == cap) {
+            first = estBlock(job, &w, snps, &dose, first, &buf_n, cap, r2s, decay, st);
+            lapStats(st, STAT_LD);
+        }
     }
+    while(buf_n > 0)
+        first = estBlock(job, &w, snps, &dose, first, &buf_n, cap, r2s, decay, st);
+    lapStats(st, STAT_LD);
+    job->snp_n[chunk->idx] = snp_i;
+
+    freeWriter(&w);
+    lapStats(st, STAT_OUT);
+    if(st != NULL)
+        st->kept_n = snp_i;
     free(snps);
-    if(site_n > 0)
-        free(sites);
+    free(r2s);
+    freeDosages(&dose);
+    freeRecord(&rec);
     free(line);
-    fclose(vcf_file);
 }
 
-void estLD(SNP_s *snps, int win, int ind_n, double r2) {
-    int i, j, k;
+/* Applies -mis and -maf to a site, counting the sites dropped by each filter in st */
+int passSite(const Record_s *rec, int ind_n, double mis, double maf, Stats_s *st) {
+    int i;
+    double mis_i = 0, alt_i = 0, hap_i = 0;
+    const Geno_s *g = NULL;
+
+    for(i = 0; i < rec->ind_n && i < ind_n; i++) {
+        g = &rec->geno[i];
+        if(g->mis) {
+            mis_i++;
+            continue;
+        }
+        alt_i += g->alt;
+        hap_i += g->ploidy;
+    }
+    if(mis_i / ind_n > 1 - mis || mis_i == ind_n) {
+        if(st != NULL)
+            st->drop_mis++;
+        return 0;
+    }
+    if(alt_i / hap_i < maf || alt_i / hap_i > 1 - maf) {
+        if(st != NULL)
+            st->drop_maf++;
+        return 0;
+    }
+    if(st != NULL)
+        st->pass_n++;
+
+    return 1;
+}
+
+/*
+ A SNP that still passes was already compared with every SNP that has stayed in the window since the previous call,
+ so only pairs involving SNPs written after that call (fresh) are evaluated. Removed SNPs are not revisited.
+ Pairs further apart than -r2bp are skipped, as are pairs whose r2 cannot exceed the maximum given the dosage
+ counts of the two SNPs (maxR2). The bound is dropped for the rest of the call if it skips less than one in eight
+ of the first 64 pairs, as it then costs more than the estR2 calls it saves. With -stats, the counts of the call are
+ added to st.
+*/
+void estLD(SNP_s *snps, Dosage_s *dose, int win, int maxdist, double r2, Stats_s *st) {
+    int i, j, try_n = 0, skip_n = 0, dist_n = 0, r2_n = 0, break_n = 0;
     for(i = 0; i < win; i++) {
-        if(snps[i].chr[0] == '\0')
+        if(snps[i].chr[0] == '\0' || snps[i].ok == 0)
             continue;
         for(j = i + 1; j < win; j++) {
             if(snps[j].chr[0] == '\0')
                 continue;
+            if(snps[i].fresh == 0 && snps[j].fresh == 0)
+                continue;
             if(strcmp(snps[i].chr, snps[j].chr) != 0)
                 continue;
-            /*
-            fprintf(stderr, "%s %i: ", snps[i].chr, snps[i].pos);
-            for(k = 0; k < ind_n; k++)
-                fprintf(stderr, "%.0f ", snps[i].geno[k]);
-            fprintf(stderr, "\n");
-            fprintf(stderr, "%s %i: ", snps[j].chr, snps[j].pos);
-            for(k = 0; k < ind_n; k++)
-                fprintf(stderr, "%.0f ", snps[j].geno[k]);
-            fprintf(stderr, "\n");
-            fprintf(stderr, "%f\n\n", estR2(snps[i].geno, snps[j].geno, ind_n));
-            */
-            if(estR2(snps[i].geno, snps[j].geno, ind_n) > r2)
+            if(maxdist > 0 && abs(snps[j].pos - snps[i].pos) > maxdist) {
+                dist_n++;
+                continue;
+            }
+            if(try_n < 64 || skip_n * 8 >= try_n) {
+                try_n++;
+                if(maxR2(dose, i, j) <= r2) {
+                    skip_n++;
+                    continue;
+                }
+            }
+            r2_n++;
+            if(estR2(dose, i, j) > r2) {
+                break_n++;
                 break;
+            }
         }
-        if(j == win && (snps[i].ok == -1 || snps[i].ok == 1))
+        if(j == win)
             snps[i].ok = 1;
         else
             snps[i].ok = 0;
     }
+    for(i = 0; i < win; i++)
+        snps[i].fresh = 0;
+    if(st != NULL) {
+        st->r2_n += r2_n;
+        st->break_n += break_n;
+        st->bound_n += try_n;
+        st->bound_skip += skip_n;
+        st->dist_skip += dist_n;
+    }
 }
 
-double estR2(double geno1[], double geno2[], int n) {
-    int i, m = 0;
-    double sum1 = 0, sum2 = 0, sum12 = 0, sqsum1 = 0, sqsum2 = 0, r = 0;
-    m = n;
-    for(i = 0; i < m; i++) {
-        if(geno1[i] == -1 || geno2[i] == -1) {
-            n--;
-            continue;
+/*
+ Estimates the r2 of the first LD_TILE SNPs of the buffer (or of all of them, if fewer) with the win - 1 SNPs that follow
+ each of them, one tile of SNPs at a time, and writes the pairs (-ldmatrix) or adds them to the distance bins
+ (-lddecay). With -r2bp, the tiles stop at the last SNP within the distance of the last SNP of the first tile, and
+ the pairs further apart are skipped. Returns the new start of the buffer, which is 0 once the buffer is empty.
+*/
+int estBlock(Job_s *job, Writer_s *w, const SNP_s *snps, Dosage_s *dose, int first, int *buf_n, int cap, double *r2s, Decay_s *decay, Stats_s *st) {
+    int i, j, dist = 0, pair_n = 0, dist_n = 0, n1 = *buf_n < LD_TILE ? *buf_n : LD_TILE, n2 = 0, span = 0;
+    double r2 = 0, tile[LD_TILE * LD_TILE];
+    const SNP_s *a = NULL, *b = NULL;
+
+    span = *buf_n < n1 + job->win - 1 ? *buf_n : n1 + job->win - 1;
+    while(job->maxdist > 0 && span > n1 && snps[(first + span - 1) % cap].pos - snps[first + n1 - 1].pos > job->maxdist)
+        span--;
+    for(j = 0; j < span; j += LD_TILE) {
+        n2 = span - j < LD_TILE ? span - j : LD_TILE;
+        estR2Tile(dose, first, n1, (first + j) % cap, n2, tile);
+        for(i = 0; i < n1; i++)
+            memcpy(r2s + (size_t)i * cap + j, tile + i * n2, n2 * sizeof(double));
+    }
+    for(i = 0; i < n1; i++) {
+        a = &snps[first + i];
+        for(j = i + 1; j < span && j < i + job->win; j++) {
+            b = &snps[(first + j) % cap];
+            dist = abs(b->pos - a->pos);
+            if(job->maxdist > 0 && dist > job->maxdist) {
+                dist_n++;
+                continue;
+            }
+            r2 = r2s[(size_t)i * cap + j];
+            pair_n++;
+            if(job->mode == 1 && r2 >= job->r2) {
+                writeString(w, a->chr);
+                writeChar(w, '\t');
+                writeInt(w, a->pos);
+                writeChar(w, '\t');
+                writeString(w, a->id);
+                writeChar(w, '\t');
+                writeInt(w, b->pos);
+                writeChar(w, '\t');
+                writeString(w, b->id);
+                writeChar(w, '\t');
+                writeFixed(w, r2, 6);
+                writeChar(w, '\n');
+            } else if(job->mode == 2 && isnan(r2) == 0)
+                addDecay(decay, dist / job->bin, 1, r2);
         }
-        sum1 += geno1[i];
-        sum2 += geno2[i];
-        sum12 += geno1[i] * geno2[i];
-        sqsum1 += geno1[i] * geno1[i];
-        sqsum2 += geno2[i] * geno2[i];
     }
-    r = (n * sum12 - sum1 * sum2) / sqrt((n * sqsum1 - sum1 * sum1) * (n * sqsum2 - sum2 * sum2));
-    return r * r;
+    if(st != NULL) {
+        st->r2_n += pair_n;
+        st->dist_skip += dist_n;
+    }
+    *buf_n -= n1;
+
+    return *buf_n > 0 ? (first + n1) % cap : 0;
 }
 
-void printOut(SNP_s snp, int n) {
-    int i;
-    printf("%s\t%i\t%s\t%c\t%c\t.\tPASS\t.\tGT:FT\t", snp.chr, snp.pos, snp.id, snp.ref, snp.alt);
-    for(i = 0; i < n; i++) {
-        if(i < n - 1)
-            printf("%s:PASS\t", snp.hap[i]);
+void addDecay(Decay_s *decay, int bin, long int n, double sum) {
+    int i, old = decay->bin_n;
+    if(bin >= decay->bin_n) {
+        decay->bin_n = (bin + 1) * 2;
+        if((decay->n = realloc(decay->n, decay->bin_n * sizeof(long int))) == NULL || (decay->sum = realloc(decay->sum, decay->bin_n * sizeof(double))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        for(i = old; i < decay->bin_n; i++) {
+            decay->n[i] = 0;
+            decay->sum[i] = 0;
+        }
+    }
+    decay->n[bin] += n;
+    decay->sum[bin] += sum;
+}
+
+/* The bins of the chunks are summed in chunk order. Bins up to the last one with pairs are written, empty ones with NA */
+void printDecay(const Decay_s *decay, int chunk_n, int bin) {
+    int i, j, last = -1;
+    Decay_s all = {0};
+
+    for(i = 0; i < chunk_n; i++) {
+        for(j = 0; j < decay[i].bin_n; j++) {
+            if(decay[i].n[j] > 0)
+                addDecay(&all, j, decay[i].n[j], decay[i].sum[j]);
+        }
+    }
+    for(j = 0; j < all.bin_n; j++) {
+        if(all.n[j] > 0)
+            last = j;
+    }
+    printf("start\tend\tpairs\tr2\n");
+    for(j = 0; j <= last; j++) {
+        printf("%li\t%li\t%li\t", (long int)j * bin, (long int)(j + 1) * bin - 1, all.n[j]);
+        if(all.n[j] > 0)
+            printf("%f\n", all.sum[j] / all.n[j]);
         else
-            printf("%s:PASS\n", snp.hap[i]);
+            printf("NA\n");
     }
+    free(all.n);
+    free(all.sum);
+}
+
+char *storeHaps(char *haps, int *hap_n, int win, int slot, Record_s *rec, int n) {
+    int i, need = 1, old = *hap_n;
+    char *p = NULL;
+
+    for(i = 0; i < n; i++)
+        need += (i < rec->ind_n ? rec->geno[i].len : 1) + 6;
+    if(need > *hap_n) {
+        *hap_n = need + need / 4;
+        if((haps = realloc(haps, (size_t)win * *hap_n)) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        for(i = win - 1; i > 0 && old > 0; i--)
+            memmove(haps + (size_t)i * *hap_n, haps + (size_t)i * old, old);
+    }
+    p = haps + (size_t)slot * *hap_n;
+    for(i = 0; i < n; i++) {
+        if(i < rec->ind_n) {
+            memcpy(p, rec->geno[i].gt, rec->geno[i].len);
+            p += rec->geno[i].len;
+        } else
+            *p++ = '.';
+        memcpy(p, ":PASS\t", 6);
+        p += 6;
+    }
+    if(n > 0)
+        p[-1] = '\n';
+    *p = '\0';
+
+    return haps;
+}
+
+void printOut(Writer_s *w, const Bcf_s *bcf, const SNP_s *snp, const char *hap) {
+    char ref[2] = {snp->ref, '\0'}, alt[2] = {snp->alt, '\0'};
+    if(bcf != NULL) {
+        writeBcfSite(w, bcf, snp->chr, snp->pos, snp->id, ref, alt, "GT:FT", hap);
+        return;
+    }
+    markWriter(w, snp->chr, snp->pos - 1, snp->pos);
+    writeString(w, snp->chr);
+    writeChar(w, '\t');
+    writeInt(w, snp->pos);
+    writeChar(w, '\t');
+    writeString(w, snp->id);
+    writeChar(w, '\t');
+    writeChar(w, snp->ref);
+    writeChar(w, '\t');
+    writeChar(w, snp->alt);
+    writeString(w, "\t.\tPASS\t.\tGT:FT\t");
+    writeString(w, hap);
 }
 
 int isNumeric(const char *s) {
@@ -500,18 +868,24 @@ int isNumeric(const char *s) {
     return *p == '\0';
 }
 
-void stringTerminator(char *string) {
-    string[strcspn(string, "\n")] = 0;
-}
-
 void printHelp(void) {
     fprintf(stderr, "\nProgram for conducting LD-pruning on mixed ploidy VCF files.\n\n");
     fprintf(stderr, "Usage:\n");
-    fprintf(stderr, "-vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8.\n");
+    fprintf(stderr, "-vcf [file] VCF file containing biallelic sites. Allowed ploidies are 2, 4, 6, and 8. Can be bgzip-compressed or a BCF file.\n");
+    fprintf(stderr, "-cache [file] Binary genotype cache. With -vcf, the VCF file is first converted into this file; without it, an existing cache is read instead of a VCF file. Optional.\n");
     fprintf(stderr, "-sites [file] Tab delimited file listing sites to use (format: chr, pos). Optional.\n");
     fprintf(stderr, "-r2 [int] [int] [double] Excludes sites based on squared genotypic correlation. Requires a window size in number of SNPs, a step size in number of SNPs, and a maximum r2 value.\n");
+    fprintf(stderr, "-r2bp [int] Maximum distance in bp between the sites of a pair compared with -r2, -ldmatrix or -lddecay. Pairs further apart are not compared. Optional.\n");
+    fprintf(stderr, "-ldmatrix [int] [double] Instead of LD-pruning, writes the r2 of each pair of sites within a window (in number of SNPs) with r2 of at least the given value, one pair per line (format: chr, pos1, id1, pos2, id2, r2). Optional.\n");
+    fprintf(stderr, "-lddecay [int] [int] Instead of LD-pruning, writes the mean r2 of the pairs of sites within a window (in number of SNPs) in bins of distance of the given size in bp (format: start, end, pairs, r2). Optional.\n");
     fprintf(stderr, "-mis [double] Excludes sites based of the proportion of missing data (0 = all missing allowed, 1 = no missing data allowed). Default 0.6.\n");
-    fprintf(stderr, "-maf [double] Minimum minor allele frequency allowed. Default 0.05.\n\n");
+    fprintf(stderr, "-maf [double] Minimum minor allele frequency allowed. Default 0.05.\n");
+    fprintf(stderr, "-region [chr:start-end] Only uses sites within the region (for example chr1:1000-2000 or chr1). Uses the .tbi or .csi index of a bgzip-compressed VCF file to read only that part of the file. Optional.\n");
+    fprintf(stderr, "-O [string] Output format: 'v' for VCF, 'z' for bgzip-compressed VCF or 'b' for BCF. BCF output requires ##contig lines in the VCF header. With -threads, the BGZF blocks of a single part are compressed on the threads. Default 'v'.\n");
+    fprintf(stderr, "-index [file] Also writes a .tbi index (or a .csi index, if the file name ends with .csi) of the -O z output into this file, built while the output is written. Optional.\n");
+    fprintf(stderr, "-threads [int] Number of threads used for processing chromosomes in parallel. A pipe, a gzip file or a single chromosome is read as one part, with its lines parsed on the threads. Default 1.\n");
+    fprintf(stderr, "-stats [string] Writes a JSON report of the time spent in each stage, the numbers of sites read and dropped by each filter, the numbers of r2 estimates, and peak memory use into this file, or to stderr with 'stderr'. Optional.\n\n");
     fprintf(stderr, "Example:\n");
-    fprintf(stderr, "./prune_ld -vcf in.vcf -sites 4fold.sites -mis 0.8 -maf 0.05 -r2 100 50 0.1 > 4fold_ld_pruned.vcf\n\n");
+    fprintf(stderr, "./prune_ld -vcf in.vcf -sites 4fold.sites -mis 0.8 -maf 0.05 -r2 100 50 0.1 > 4fold_ld_pruned.vcf\n");
+    fprintf(stderr, "./prune_ld -vcf in.vcf.gz -r2 100 50 0.1 -O z -index ld_pruned.vcf.gz.tbi -threads 8 > ld_pruned.vcf.gz\n\n");
 }
\ No newline at end of file
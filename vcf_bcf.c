@@ -0,0 +1,634 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ BCF (binary VCF) reading and writing. See vcf_bcf.h.
+
+ A BCF file is a BGZF stream of "BCF\2\2", the length and text of the VCF header, and the records. Each record has a
+ shared part (contig and position, the ID and alleles as typed strings, FILTER and INFO) and a per-sample part that
+ holds every FORMAT key as one typed array with the same number of values for each sample. Typed values start with a
+ byte holding their type and count, where a count of 15 is followed by the real count as a typed integer.
+ GT alleles are stored as (allele + 1) << 1 | phased, with 0 for a missing allele, and shorter genotypes (lower
+ ploidy) are padded with a vector end value.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vcf_bcf.h"
+#define merror "\nERROR: System out of memory\n\n"
+#define berror "\nERROR: Corrupted BCF record in the VCF file\n\n"
+#define KEY_MAX 32
+
+enum { BCF_INT8 = 1, BCF_INT16 = 2, BCF_INT32 = 3, BCF_FLOAT = 5, BCF_CHAR = 7 };
+
+static const char *known[][2] = {{"GT", "Genotype"}, {"FT", "Genotype filter"}};
+
+static int hasLine(const char *text, long int n, const char *start) {
+    long int i, k = strlen(start);
+    for(i = 0; i + k <= n; i++) {
+        if((i == 0 || text[i - 1] == '\n') && strncmp(text + i, start, k) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+static char *copyString(const char *s, int n) {
+    char *p = NULL;
+    if((p = malloc(n + 1)) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(p, s, n);
+    p[n] = '\0';
+    return p;
+}
+
+/* Copies the value of tag in a structured header line (##key=<ID=x,...>), skipping over quoted descriptions */
+static int getTag(const char *p, const char *tag, char *val, int max) {
+    int k = strlen(tag), quote = 0;
+    const char *q = NULL;
+
+    while(*p != '\0' && *p != '\n' && *p != '>') {
+        q = p;
+        while(*p != '\0' && *p != '\n' && (quote || (*p != ',' && *p != '>'))) {
+            if(*p == '"')
+                quote = !quote;
+            p++;
+        }
+        if(strncmp(q, tag, k) == 0 && q[k] == '=' && p - q - k - 1 < max) {
+            memcpy(val, q + k + 1, p - q - k - 1);
+            val[p - q - k - 1] = '\0';
+            return 1;
+        }
+        if(*p == ',')
+            p++;
+    }
+
+    return 0;
+}
+
+static void addKey(char ***list, int *n, Hash_s *hash, const char *line) {
+    int i, idx = -1;
+    char id[256], num[32];
+
+    if(getTag(line, "ID", id, sizeof(id)) == 0)
+        return;
+    if(getTag(line, "IDX", num, sizeof(num)))
+        idx = atoi(num);
+    if(findHash(hash, id) != NULL)
+        return;
+    if(idx < 0)
+        idx = *n;
+    if(idx >= *n) {
+        if((*list = realloc(*list, (idx + 1) * sizeof(char *))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        for(i = *n; i <= idx; i++)
+            (*list)[i] = NULL;
+        *n = idx + 1;
+    }
+    if((*list)[idx] != NULL)
+        return;
+    (*list)[idx] = copyString(id, strlen(id));
+    *addHash(hash, (*list)[idx]) = idx;
+}
+
+/* With format set, the FORMAT lines for its keys (and the PASS filter) are added to the header if it lacks them */
+Bcf_s *makeBcf(const char *text, long int n, const char *format) {
+    int i, k, found;
+    long int m = 0, max = n + 1;
+    const char *p = text, *q = NULL, *end = text + n;
+    char key[256], *lines = NULL;
+    Bcf_s *bcf = NULL;
+
+    if((bcf = calloc(1, sizeof(Bcf_s))) == NULL || (bcf->text = malloc(max)) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    while(p < end) {
+        q = memchr(p, '\n', end - p);
+        q = q != NULL ? q + 1 : end;
+        if(format != NULL && strncmp(p, "#CHROM", 6) == 0) {
+            if((lines = malloc(strlen(format) * 100 + 200)) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+            k = 0;
+            if(hasLine(text, n, "##FILTER=<ID=PASS,") == 0)
+                k += sprintf(lines + k, "##FILTER=<ID=PASS,Description=\"All filters passed\">\n");
+            for(i = 0; format[i] != '\0';) {
+                sscanf(format + i, "%255[^:]", key);
+                i += strlen(key) + (format[i + strlen(key)] == ':');
+                sprintf(lines + k, "##FORMAT=<ID=%s,", key);
+                if(hasLine(text, n, lines + k))
+                    continue;
+                for(found = 1; found < 3 && strcmp(known[found - 1][0], key) != 0; found++)
+                    ;
+                k += sprintf(lines + k, "##FORMAT=<ID=%s,Number=1,Type=String,Description=\"%s\">\n", key, found < 3 ? known[found - 1][1] : key);
+            }
+            max += k;
+            if((bcf->text = realloc(bcf->text, max)) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+            memcpy(bcf->text + m, lines, k);
+            m += k;
+            free(lines);
+        }
+        memcpy(bcf->text + m, p, q - p);
+        m += q - p;
+        p = q;
+    }
+    bcf->text[m] = '\0';
+    bcf->text_n = m;
+    bcf->gt = -1;
+    initHash(&bcf->contig_hash, 64);
+    initHash(&bcf->key_hash, 64);
+    bcf->keys = NULL;
+    addKey(&bcf->keys, &bcf->key_n, &bcf->key_hash, "ID=PASS>");
+    for(p = bcf->text; *p != '\0'; p = q) {
+        q = strchr(p, '\n');
+        q = q != NULL ? q + 1 : p + strlen(p);
+        if(strncmp(p, "##contig=<", 10) == 0)
+            addKey(&bcf->contigs, &bcf->contig_n, &bcf->contig_hash, p + 10);
+        else if(strncmp(p, "##FILTER=<", 10) == 0)
+            addKey(&bcf->keys, &bcf->key_n, &bcf->key_hash, p + 10);
+        else if(strncmp(p, "##INFO=<", 8) == 0)
+            addKey(&bcf->keys, &bcf->key_n, &bcf->key_hash, p + 8);
+        else if(strncmp(p, "##FORMAT=<", 10) == 0)
+            addKey(&bcf->keys, &bcf->key_n, &bcf->key_hash, p + 10);
+        else if(strncmp(p, "#CHROM\t", 7) == 0) {
+            for(i = 0; p + i < q; i++)
+                bcf->sample_n += p[i] == '\t';
+            bcf->sample_n = bcf->sample_n > 8 ? bcf->sample_n - 8 : 0;
+        }
+    }
+    if(findHash(&bcf->key_hash, "GT") != NULL)
+        bcf->gt = *findHash(&bcf->key_hash, "GT");
+
+    return bcf;
+}
+
+Bcf_s *openBcf(Bgzf_s *vcf_file) {
+    long int k = 0;
+    unsigned char magic[9];
+    char *text = NULL;
+    Bcf_s *bcf = NULL;
+
+    if(peekBgzf(vcf_file, magic, 5) < 5 || memcmp(magic, "BCF\2", 4) != 0)
+        return NULL;
+    if(readBgzf(vcf_file, magic, 9) != 9) {
+        fprintf(stderr, berror);
+        exit(EXIT_FAILURE);
+    }
+    k = magic[5] | magic[6] << 8 | magic[7] << 16 | (long int)magic[8] << 24;
+    if((text = malloc(k + 1)) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    if(readBgzf(vcf_file, text, k) != k) {
+        fprintf(stderr, berror);
+        exit(EXIT_FAILURE);
+    }
+    text[k] = '\0';
+    bcf = makeBcf(text, strlen(text), NULL);
+    free(text);
+
+    return bcf;
+}
+
+int readBcfHead(const Bcf_s *bcf, long int *pos, long int end, char **line, size_t *len) {
+    long int k = 0;
+    const char *p = NULL;
+
+    if(end < 0 || end > bcf->text_n)
+        end = bcf->text_n;
+    if(*pos >= end)
+        return -1;
+    p = memchr(bcf->text + *pos, '\n', end - *pos);
+    k = p != NULL ? p - bcf->text - *pos + 1 : end - *pos;
+    if(*line == NULL || (size_t)k + 1 > *len) {
+        *len = k + 1;
+        if((*line = realloc(*line, *len)) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+    }
+    memcpy(*line, bcf->text + *pos, k);
+    (*line)[k] = '\0';
+    *pos += k;
+
+    return 0;
+}
+
+static long int getInt(const unsigned char *p, int type) {
+    if(type == BCF_INT8)
+        return (int8_t)p[0];
+    if(type == BCF_INT16)
+        return (int16_t)(p[0] | p[1] << 8);
+    return (int32_t)(p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24);
+}
+
+static int typeSize(int type) {
+    switch(type) {
+    case BCF_INT8:
+    case BCF_CHAR:
+        return 1;
+    case BCF_INT16:
+        return 2;
+    case BCF_INT32:
+    case BCF_FLOAT:
+        return 4;
+    case 0:
+        return 0;
+    }
+    fprintf(stderr, berror);
+    exit(EXIT_FAILURE);
+}
+
+static const unsigned char *getTyped(const unsigned char *p, const unsigned char *end, int *type, long int *count) {
+    int k;
+    if(p >= end) {
+        fprintf(stderr, berror);
+        exit(EXIT_FAILURE);
+    }
+    *type = *p & 15;
+    *count = *p++ >> 4;
+    if(*count == 15) {
+        k = *p & 15;
+        if(p >= end || (*p >> 4) != 1 || k < BCF_INT8 || k > BCF_INT32 || p + 1 + typeSize(k) > end) {
+            fprintf(stderr, berror);
+            exit(EXIT_FAILURE);
+        }
+        *count = getInt(p + 1, k);
+        p += 1 + typeSize(k);
+    }
+    if(*count < 0 || p + *count * typeSize(*type) > end) {
+        fprintf(stderr, berror);
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static char *getString(const unsigned char **p, const unsigned char *end, char *out, int sep) {
+    int type;
+    long int k = 0, n = 0;
+
+    *p = getTyped(*p, end, &type, &n);
+    if(sep)
+        *out++ = ',';
+    for(k = 0; k < n && (*p)[k] != '\0'; k++)
+        *out++ = (*p)[k];
+    if(k == 0 && sep == 0)
+        *out++ = '.';
+    *p += n * typeSize(type);
+
+    return out;
+}
+
+static void unpackGt(Record_s *rec, const unsigned char *p, int type, long int n, unsigned char *pack) {
+    int i, k, ploidy, mis, phased, mask;
+    long int v, size = typeSize(type), vend = type == BCF_INT8 ? -127 : type == BCF_INT16 ? -32767 : -2147483647;
+
+    for(i = 0; i < rec->pack_n; i++, p += n * size) {
+        ploidy = mis = phased = mask = 0;
+        for(k = 0; k < n && (v = getInt(p + k * size, type)) != vend; k++) {
+            ploidy++;
+            if(k == 1)
+                phased = v & 1;
+            if(k == 0 && (v >> 1) <= 0)
+                mis = 1;
+            if(mis || k >= 8)
+                continue;
+            if((v >> 1) - 1 != 0 && (v >> 1) - 1 != 1) {
+                fprintf(stderr, "\nERROR: Unknown alleles found at site %s:%i! Only 0 and 1 are allowed.\n\n", rec->chr, rec->pos);
+                exit(EXIT_FAILURE);
+            }
+            mask |= ((v >> 1) - 1) << k;
+        }
+        if(ploidy != 2 && ploidy != 4 && ploidy != 6 && ploidy != 8) {
+            if(mis == 0) {
+                fprintf(stderr, "\nERROR: Allowed ploidy-levels are 2, 4, 6, and 8!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            ploidy = 0;
+        }
+        pack[i * 2] = mis ? 0 : mask;
+        pack[i * 2 + 1] = ploidy | mis << 4 | phased << 5;
+    }
+}
+
+int readBcf(Bgzf_s *vcf_file, const Bcf_s *bcf, char **line, size_t *len, Record_s *rec) {
+    int i, type, chr;
+    long int k, n, key, n_allele, n_fmt, l_shared, l_indiv;
+    unsigned char head[8], *raw = NULL, *pack = NULL;
+    const unsigned char *p = NULL, *end = NULL;
+    char *s = NULL;
+
+    if((k = readBgzf(vcf_file, head, 8)) == 0)
+        return -1;
+    l_shared = head[0] | head[1] << 8 | head[2] << 16 | (long int)head[3] << 24;
+    l_indiv = head[4] | head[5] << 8 | head[6] << 16 | (long int)head[7] << 24;
+    if(k != 8 || l_shared < 24) {
+        fprintf(stderr, berror);
+        exit(EXIT_FAILURE);
+    }
+    if(*line == NULL || (size_t)(l_shared * 2 + l_indiv + 32) > *len) {
+        *len = (l_shared * 2 + l_indiv + 32) * 2;
+        if((*line = realloc(*line, *len)) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+    }
+    raw = (unsigned char *)*line;
+    if(readBgzf(vcf_file, raw, l_shared + l_indiv) != l_shared + l_indiv) {
+        fprintf(stderr, berror);
+        exit(EXIT_FAILURE);
+    }
+    rec->pack_n = raw[20] | raw[21] << 8 | raw[22] << 16;
+    n_fmt = raw[23];
+    k = l_shared * 2 + l_indiv + 32 + rec->pack_n * 2;
+    if((size_t)k > *len) {
+        *len = k * 2;
+        if((*line = realloc(*line, *len)) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        raw = (unsigned char *)*line;
+    }
+    chr = getInt(raw, BCF_INT32);
+    if(chr < 0 || chr >= bcf->contig_n || bcf->contigs[chr] == NULL) {
+        fprintf(stderr, "\nERROR: A BCF record refers to contig %i, which is not in the header\n\n", chr);
+        exit(EXIT_FAILURE);
+    }
+    rec->chr = bcf->contigs[chr];
+    rec->pos = getInt(raw + 4, BCF_INT32) + 1;
+    n_allele = raw[18] | raw[19] << 8;
+    p = raw + 24;
+    end = raw + l_shared;
+    s = (char *)raw + l_shared + l_indiv;
+    rec->id = s;
+    s = getString(&p, end, s, 0);
+    *s++ = '\0';
+    rec->ref = s;
+    for(i = 0; i < n_allele; i++) {
+        if(i == 1) {
+            *s++ = '\0';
+            rec->alt = s;
+        }
+        s = getString(&p, end, s, i > 1);
+    }
+    if(n_allele == 0)
+        *s++ = '.';
+    if(n_allele < 2) {
+        *s++ = '\0';
+        rec->alt = s;
+        *s++ = '.';
+    }
+    *s++ = '\0';
+    pack = (unsigned char *)s;
+    for(i = 0; i < rec->pack_n; i++) {
+        pack[i * 2] = 0;
+        pack[i * 2 + 1] = 1 << 4;
+    }
+    p = raw + l_shared;
+    end = p + l_indiv;
+    for(i = 0; i < n_fmt; i++) {
+        p = getTyped(p, end, &type, &n);
+        if(n != 1 || type < BCF_INT8 || type > BCF_INT32) {
+            fprintf(stderr, berror);
+            exit(EXIT_FAILURE);
+        }
+        key = getInt(p, type);
+        p = getTyped(p + typeSize(type), end, &type, &n);
+        if(p + n * typeSize(type) * rec->pack_n > end) {
+            fprintf(stderr, berror);
+            exit(EXIT_FAILURE);
+        }
+        if(key == bcf->gt && type >= BCF_INT8 && type <= BCF_INT32)
+            unpackGt(rec, p, type, n, pack);
+        p += n * typeSize(type) * rec->pack_n;
+    }
+    rec->format = NULL;
+    rec->data = NULL;
+    rec->stride = 2;
+    rec->pack = pack;
+
+    return 1;
+}
+
+int findContig(const Bcf_s *bcf, const char *chr) {
+    int *v = findHash(&bcf->contig_hash, chr);
+    return v != NULL ? *v : -1;
+}
+
+static void writeU32(Writer_s *w, unsigned long int v) {
+    unsigned char b[4] = {v & 255, (v >> 8) & 255, (v >> 16) & 255, (v >> 24) & 255};
+    writeBytes(w, b, 4);
+}
+
+static int typedSize(long int n) {
+    return n < 15 ? 1 : n < 128 ? 3 : n < 32768 ? 4 : 6;
+}
+
+static void writeTyped(Writer_s *w, int type, long int n) {
+    if(n < 15) {
+        writeChar(w, n << 4 | type);
+        return;
+    }
+    writeChar(w, 15 << 4 | type);
+    if(n < 128) {
+        writeChar(w, 1 << 4 | BCF_INT8);
+        writeChar(w, n);
+    } else if(n < 32768) {
+        writeChar(w, 1 << 4 | BCF_INT16);
+        writeChar(w, n & 255);
+        writeChar(w, n >> 8);
+    } else {
+        writeChar(w, 1 << 4 | BCF_INT32);
+        writeU32(w, n);
+    }
+}
+
+static void writeKey(Writer_s *w, int key) {
+    writeTyped(w, key < 128 ? BCF_INT8 : key < 32768 ? BCF_INT16 : BCF_INT32, 1);
+    if(key < 128)
+        writeChar(w, key);
+    else if(key < 32768) {
+        writeChar(w, key & 255);
+        writeChar(w, key >> 8);
+    } else
+        writeU32(w, key);
+}
+
+static int keySize(int key) {
+    return key < 128 ? 2 : key < 32768 ? 3 : 5;
+}
+
+void writeBcfHead(Writer_s *w, const Bcf_s *bcf) {
+    writeBytes(w, "BCF\2\2", 5);
+    writeU32(w, bcf->text_n + 1);
+    writeBytes(w, bcf->text, bcf->text_n + 1);
+}
+
+/* Returns the value of FORMAT key k of a sample column, which ends at ':', '\t', '\n' or '\0' */
+static const char *getValue(const char *p, int k, int *n) {
+    for(; k > 0 && *p != '\t' && *p != '\n' && *p != '\0'; p++) {
+        if(*p == ':')
+            k--;
+    }
+    if(k > 0)
+        p = ".";
+    for(*n = 0; p[*n] != ':' && p[*n] != '\t' && p[*n] != '\n' && p[*n] != '\0'; *n = *n + 1)
+        ;
+    return p;
+}
+
+static int countAlleles(const char *p, int n) {
+    int i, k = 1;
+    for(i = 0; i < n; i++)
+        k += p[i] == '/' || p[i] == '|';
+    return k;
+}
+
+static void writeGt(Writer_s *w, const char *s, int n, int width) {
+    int i = 0, k = 0, v = 0;
+
+    while(n > 0) {
+        v = s[i] == '.' ? 0 : (atoi(s + i) + 1) << 1;
+        if(v > 127) {
+            fprintf(stderr, "\nERROR: BCF output supports at most 62 alternative alleles\n\n");
+            exit(EXIT_FAILURE);
+        }
+        writeChar(w, v | (k > 0 && s[i - 1] == '|'));
+        k++;
+        while(i < n && s[i] != '/' && s[i] != '|')
+            i++;
+        if(i++ >= n)
+            break;
+    }
+    if(k == 0) {
+        writeChar(w, 0);
+        k++;
+    }
+    for(; k < width; k++)
+        writeChar(w, (char)0x81);
+}
+
+/*
+ data holds the tab delimited sample columns (in the order of format), and the first pass over them finds the widest
+ value of each key, which sets the width of its typed array
+*/
+void writeBcfSite(Writer_s *w, const Bcf_s *bcf, const char *chr, int pos, const char *id, const char *ref, const char *alt, const char *format, const char *data) {
+    int i, j, k, n, key_n = 0, chr_i = 0, keys[KEY_MAX], width[KEY_MAX] = {0};
+    long int sample_n = 0, l_shared = 0, l_indiv = 0, allele_n = 2;
+    char key[256];
+    const char *p = NULL, *q = NULL;
+
+    if((chr_i = findContig(bcf, chr)) < 0) {
+        fprintf(stderr, "\nERROR: Contig %s is not defined by a ##contig line in the VCF header, which BCF output requires\n\n", chr);
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; format[i] != '\0' && format[i] != '\t'; key_n++) {
+        sscanf(format + i, "%255[^:\t]", key);
+        i += strlen(key);
+        i += format[i] == ':';
+        if(key_n == KEY_MAX || findHash(&bcf->key_hash, key) == NULL) {
+            fprintf(stderr, "\nERROR: FORMAT key %s is not defined in the VCF header, which BCF output requires\n\n", key);
+            exit(EXIT_FAILURE);
+        }
+        keys[key_n] = *findHash(&bcf->key_hash, key);
+    }
+    for(p = data; *p != '\0' && *p != '\n'; sample_n++) {
+        for(j = 0; j < key_n; j++) {
+            q = getValue(p, j, &n);
+            k = keys[j] == bcf->gt ? countAlleles(q, n) : n;
+            if(k > width[j])
+                width[j] = k;
+        }
+        while(*p != '\t' && *p != '\n' && *p != '\0')
+            p++;
+        if(*p == '\t')
+            p++;
+    }
+    for(q = alt; *q != '\0'; q++)
+        allele_n += *q == ',';
+    if(strcmp(alt, ".") == 0)
+        allele_n = 1;
+    l_shared = 24 + typedSize(strcmp(id, ".") == 0 ? 0 : strlen(id)) + (strcmp(id, ".") == 0 ? 0 : strlen(id)) + 2;
+    l_shared += typedSize(strlen(ref)) + strlen(ref);
+    for(q = alt; allele_n > 1 && q != NULL; q = strchr(q, ',') != NULL ? strchr(q, ',') + 1 : NULL) {
+        n = strchr(q, ',') != NULL ? strchr(q, ',') - q : (int)strlen(q);
+        l_shared += typedSize(n) + n;
+    }
+    for(j = 0; j < key_n; j++)
+        l_indiv += keySize(keys[j]) + typedSize(width[j]) + width[j] * sample_n;
+    writeU32(w, l_shared);
+    writeU32(w, l_indiv);
+    writeU32(w, chr_i);
+    writeU32(w, pos - 1);
+    writeU32(w, strlen(ref));
+    writeU32(w, 0x7f800001);
+    writeU32(w, allele_n << 16);
+    writeU32(w, (unsigned long int)key_n << 24 | sample_n);
+    n = strcmp(id, ".") == 0 ? 0 : strlen(id);
+    writeTyped(w, BCF_CHAR, n);
+    writeBytes(w, id, n);
+    writeTyped(w, BCF_CHAR, strlen(ref));
+    writeString(w, ref);
+    for(q = alt; allele_n > 1 && q != NULL; q = strchr(q, ',') != NULL ? strchr(q, ',') + 1 : NULL) {
+        n = strchr(q, ',') != NULL ? strchr(q, ',') - q : (int)strlen(q);
+        writeTyped(w, BCF_CHAR, n);
+        writeBytes(w, q, n);
+    }
+    writeTyped(w, BCF_INT8, 1);
+    writeChar(w, 0);
+    for(j = 0; j < key_n; j++) {
+        writeKey(w, keys[j]);
+        writeTyped(w, keys[j] == bcf->gt ? BCF_INT8 : BCF_CHAR, width[j]);
+        for(p = data; *p != '\0' && *p != '\n';) {
+            q = getValue(p, j, &n);
+            if(keys[j] == bcf->gt)
+                writeGt(w, q, n, width[j]);
+            else {
+                writeBytes(w, q, n);
+                for(k = n; k < width[j]; k++)
+                    writeChar(w, '\0');
+            }
+            while(*p != '\t' && *p != '\n' && *p != '\0')
+                p++;
+            if(*p == '\t')
+                p++;
+        }
+    }
+}
+
+void freeBcf(Bcf_s *bcf) {
+    int i;
+    for(i = 0; i < bcf->contig_n; i++)
+        free(bcf->contigs[i]);
+    for(i = 0; i < bcf->key_n; i++)
+        free(bcf->keys[i]);
+    free(bcf->contigs);
+    free(bcf->keys);
+    freeHash(&bcf->contig_hash);
+    freeHash(&bcf->key_hash);
+    free(bcf->text);
+    free(bcf);
+}
@@ -0,0 +1,55 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ BCF (binary VCF) reading and writing used by prune_ld, poly_freq, poly_fst, poly_sfs and poly_pca.
+
+ openBcf checks a VCF file for the BCF magic and reads its header: the VCF header text, from which makeBcf builds the
+ two dictionaries that records refer to by index (the contigs, and the FILTER, INFO and FORMAT keys with PASS as 0).
+ readBcf reads a record straight from its typed arrays without any text parsing. The strings of the site and the
+ genotypes are decoded into the line buffer after the record, the genotypes in the same two-byte form as a genotype
+ cache (see vcf_cache.h), so parseGenos unpacks them without looking at any text. Only GT is decoded, so the record
+ has no FORMAT text (findFormat returns -1). readBcfHead returns the header lines one at a time, as readCache does.
+ writeBcfHead and writeBcfSite write a BCF file through a Writer_s with bgzf set. GT is written as typed integers and
+ every other FORMAT value as a string, with the QUAL and INFO fields missing and the FILTER field set to PASS.
+*/
+
+#ifndef VCF_BCF_H
+#define VCF_BCF_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "bgzf.h"
+#include "vcf_parse.h"
+#include "vcf_write.h"
+
+typedef struct {
+    int contig_n, key_n, sample_n, gt;
+    long int text_n;
+    char *text, **contigs, **keys;
+    Hash_s contig_hash, key_hash;
+} Bcf_s;
+
+Bcf_s *openBcf(Bgzf_s *vcf_file);
+Bcf_s *makeBcf(const char *text, long int n, const char *format);
+int readBcfHead(const Bcf_s *bcf, long int *pos, long int end, char **line, size_t *len);
+int readBcf(Bgzf_s *vcf_file, const Bcf_s *bcf, char **line, size_t *len, Record_s *rec);
+int findContig(const Bcf_s *bcf, const char *chr);
+void writeBcfHead(Writer_s *w, const Bcf_s *bcf);
+void writeBcfSite(Writer_s *w, const Bcf_s *bcf, const char *chr, int pos, const char *id, const char *ref, const char *alt, const char *format, const char *data);
+void freeBcf(Bcf_s *bcf);
+
+#endif
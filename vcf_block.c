@@ -0,0 +1,187 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Block sums for the block-jackknife and bootstrap used by poly_fst and poly_sfs. See vcf_block.h.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vcf_block.h"
+#define merror "\nERROR: System out of memory\n\n"
+
+void initBlocks(Blocks_s *blocks, long int size, int field_n) {
+    memset(blocks, 0, sizeof(Blocks_s));
+    blocks->size = size;
+    blocks->field_n = field_n;
+}
+
+static double *newBlock(Blocks_s *blocks, const char *chr, long int idx) {
+    int k = blocks->n;
+
+    if(blocks->n == blocks->max) {
+        blocks->max = blocks->max > 0 ? blocks->max * 2 : 64;
+        if((blocks->idx = realloc(blocks->idx, blocks->max * sizeof(long int))) == NULL || (blocks->chr = realloc(blocks->chr, blocks->max * sizeof(char *))) == NULL || (blocks->sums = realloc(blocks->sums, (size_t)blocks->max * blocks->field_n * sizeof(double))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if(k > 0 && strcmp(blocks->chr[k - 1], chr) == 0)
+        blocks->chr[k] = blocks->chr[k - 1];
+    else if((blocks->chr[k] = strdup(chr)) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    blocks->idx[k] = idx;
+    memset(blocks->sums + (size_t)k * blocks->field_n, 0, blocks->field_n * sizeof(double));
+    blocks->n++;
+
+    return blocks->sums + (size_t)k * blocks->field_n;
+}
+
+/* Sites arrive in genome order within a chunk, so only the last block has to be checked */
+double *addBlock(Blocks_s *blocks, const char *chr, int pos) {
+    int k = blocks->n - 1;
+    long int idx = (pos - 1) / blocks->size;
+
+    if(k >= 0 && blocks->idx[k] == idx && strcmp(blocks->chr[k], chr) == 0)
+        return blocks->sums + (size_t)k * blocks->field_n;
+    return newBlock(blocks, chr, idx);
+}
+
+/* A block cut in two by a chunk boundary is joined again */
+void mergeBlocks(Blocks_s *to, const Blocks_s *from) {
+    int i, j, k;
+    double *sums = NULL;
+
+    for(i = 0; i < from->n; i++) {
+        k = to->n - 1;
+        if(i == 0 && k >= 0 && to->idx[k] == from->idx[0] && strcmp(to->chr[k], from->chr[0]) == 0)
+            sums = to->sums + (size_t)k * to->field_n;
+        else
+            sums = newBlock(to, from->chr[i], from->idx[i]);
+        for(j = 0; j < to->field_n; j++)
+            sums[j] += from->sums[(size_t)i * from->field_n + j];
+    }
+}
+
+void sumBlocks(const Blocks_s *blocks, double *tot) {
+    int i, j;
+    memset(tot, 0, blocks->field_n * sizeof(double));
+    for(i = 0; i < blocks->n; i++) {
+        for(j = 0; j < blocks->field_n; j++)
+            tot[j] += blocks->sums[(size_t)i * blocks->field_n + j];
+    }
+}
+
+/* With g blocks of weight m_j out of n, h_j = n / m_j, and the estimate without block j t_j, the pseudovalues are
+   h_j * t - (h_j - 1) * t_j, and the variance is the mean of their squared deviations from the jackknife estimate,
+   each divided by h_j - 1. Blocks with no weight are left out */
+double jackRatio(const Blocks_s *blocks, const double *tot, int num, int den, int weight) {
+    int i, g = 0;
+    double est, n = tot[weight], m, h, t, jack = 0, var = 0, *part = NULL;
+    const double *b = NULL;
+
+    if(n <= 0 || tot[den] == 0)
+        return NAN;
+    if((part = malloc(blocks->n * sizeof(double))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    est = tot[num] / tot[den];
+    for(i = 0; i < blocks->n; i++) {
+        b = blocks->sums + (size_t)i * blocks->field_n;
+        if(b[weight] <= 0)
+            continue;
+        if(b[weight] >= n || tot[den] - b[den] == 0) {
+            free(part);
+            return NAN;
+        }
+        part[g] = (tot[num] - b[num]) / (tot[den] - b[den]);
+        jack += est - part[g] + b[weight] * part[g] / n;
+        g++;
+    }
+    for(i = 0, g = 0; i < blocks->n; i++) {
+        b = blocks->sums + (size_t)i * blocks->field_n;
+        if((m = b[weight]) <= 0)
+            continue;
+        h = n / m;
+        t = h * est - (h - 1) * part[g++];
+        var += (t - jack) * (t - jack) / (h - 1);
+    }
+    free(part);
+
+    return g > 1 ? sqrt(var / g) : NAN;
+}
+
+/* Counter-based draw (splitmix64 finalizer) on the seed, replicate and draw index, so a replicate does not depend on the
+   platform or on the replicates drawn before it */
+static double drawBlock(unsigned long int seed, long int k) {
+    unsigned long int z = seed + (unsigned long int)(k + 1) * 0x9E3779B97F4A7C15UL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+    z ^= z >> 31;
+    return (double)(z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+void bootBlocks(const Blocks_s *blocks, long int seed, int rep, double *tot) {
+    int i, j, k;
+    memset(tot, 0, blocks->field_n * sizeof(double));
+    for(i = 0; i < blocks->n; i++) {
+        k = (int)(drawBlock((unsigned long int)seed, (long int)rep * blocks->n + i) * blocks->n);
+        for(j = 0; j < blocks->field_n; j++)
+            tot[j] += blocks->sums[(size_t)k * blocks->field_n + j];
+    }
+}
+
+static int cmpDouble(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Sorts vals, leaving out NaN values, and interpolates between the closest ranks */
+double getQuantile(double *vals, int n, double q) {
+    int i, k = 0;
+    double r;
+
+    for(i = 0; i < n; i++) {
+        if(isnan(vals[i]) == 0)
+            vals[k++] = vals[i];
+    }
+    if(k == 0)
+        return NAN;
+    qsort(vals, k, sizeof(double), cmpDouble);
+    r = q * (k - 1);
+    i = (int)r;
+    if(i + 1 >= k)
+        return vals[k - 1];
+
+    return vals[i] + (r - i) * (vals[i + 1] - vals[i]);
+}
+
+void freeBlocks(Blocks_s *blocks) {
+    int i;
+    for(i = 0; i < blocks->n; i++) {
+        if(i == 0 || blocks->chr[i] != blocks->chr[i - 1])
+            free(blocks->chr[i]);
+    }
+    free(blocks->chr);
+    free(blocks->idx);
+    free(blocks->sums);
+    memset(blocks, 0, sizeof(Blocks_s));
+}
@@ -0,0 +1,47 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Block sums for the block-jackknife (-jackknife) and bootstrap (-bootstrap) used by poly_fst and poly_sfs.
+
+ The genome is divided into blocks of a fixed number of base pairs, and each chunk adds the per-site values of a program
+ (for example hw, hb and sites for each pair, or the bins of a SFS) into the block of each site. Blocks of the chunks are
+ merged in genome order at the end, so both estimates come from the same single pass over the VCF file.
+ jackRatio returns the standard error of a ratio of sums with the weighted (delete-m) block-jackknife of Busing et al.
+ (1999), with the blocks weighted by the given field. bootBlocks adds up replicate rep of the bootstrap, drawn from
+ the seed alone so that the replicates are the same on any platform.
+*/
+
+#ifndef VCF_BLOCK_H
+#define VCF_BLOCK_H
+
+typedef struct {
+    int n, max, field_n;
+    long int size, *idx;
+    char **chr;
+    double *sums;
+} Blocks_s;
+
+void initBlocks(Blocks_s *blocks, long int size, int field_n);
+double *addBlock(Blocks_s *blocks, const char *chr, int pos);
+void mergeBlocks(Blocks_s *to, const Blocks_s *from);
+void sumBlocks(const Blocks_s *blocks, double *tot);
+double jackRatio(const Blocks_s *blocks, const double *tot, int num, int den, int weight);
+void bootBlocks(const Blocks_s *blocks, long int seed, int rep, double *tot);
+double getQuantile(double *vals, int n, double q);
+void freeBlocks(Blocks_s *blocks);
+
+#endif
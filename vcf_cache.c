@@ -0,0 +1,268 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Binary genotype cache used by prune_ld, poly_freq, poly_fst and poly_sfs. See vcf_cache.h.
+
+ The genotype blocks are written as the VCF is read, so only one block of sites is kept in memory. The chr/pos index,
+ the strings and the header follow the last block, and the file header with their offsets is written last.
+ A BCF file is converted in the same way, with its records decoded by readBcf instead of parseSite.
+ A new contig entry starts whenever the chromosome changes, so each entry is one run of consecutive sites.
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "vcf_cache.h"
+#define merror "\nERROR: System out of memory\n\n"
+#define CACHE_MAGIC "POLYGC1"
+
+static void *growArray(void *list, long int n, long int *max, size_t size) {
+    if(n < *max)
+        return list;
+    *max = *max > 0 ? *max * 2 : 1024;
+    if((list = realloc(list, *max * size)) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    return list;
+}
+
+static long int addString(char **strings, long int *n, long int *max, const char *s) {
+    long int off = *n, k = strlen(s) + 1;
+    while(*n + k > *max)
+        *strings = growArray(*strings, *max, max, 1);
+    memcpy(*strings + off, s, k);
+    *n += k;
+    return off;
+}
+
+static void writeBlock(FILE *out_file, const unsigned char *block, long int sample_n, int block_n) {
+    long int i;
+    for(i = 0; i < sample_n; i++)
+        fwrite(block + i * CACHE_BLOCK * 2, 2, block_n, out_file);
+}
+
+static void writeAligned(FILE *out_file, const void *data, long int size, long int *off) {
+    char pad[8] = {0};
+    long int pos = ftell(out_file);
+    fwrite(pad, 1, (8 - pos % 8) % 8, out_file);
+    *off = ftell(out_file);
+    fwrite(data, 1, size, out_file);
+}
+
+/* Returns the header lines (0) and then the records (1) of a VCF or BCF file, as readSite does for a chunk */
+static int nextRecord(Bgzf_s *vcf_file, const Bcf_s *bcf, long int *pos, char **line, size_t *len, Record_s *rec) {
+    if(bcf != NULL) {
+        if(readBcfHead(bcf, pos, -1, line, len) == 0)
+            return 0;
+        return readBcf(vcf_file, bcf, line, len, rec);
+    }
+    while(getBgzfLine(vcf_file, line, len) != -1) {
+        if((*line)[0] == '\n')
+            continue;
+        if((*line)[0] == '#')
+            return 0;
+        if(parseSite(*line, rec))
+            return 1;
+    }
+
+    return -1;
+}
+
+void writeCache(Bgzf_s *vcf_file, const char *name) {
+    int i, k, site, block_n = 0;
+    long int text_max = 0, string_max = 0, site_max = 0, contig_max = 0;
+    char *line = NULL, *text = NULL, *strings = NULL, **samples = NULL, pad[4096] = {0};
+    unsigned char *block = NULL, *p = NULL, mask = 0;
+    Record_s rec = {0};
+    Geno_s *g = NULL;
+    CacheHead_s head = {0};
+    CacheSite_s *sites = NULL;
+    CacheContig_s *contigs = NULL;
+    FILE *out_file = NULL;
+    Bcf_s *bcf = openBcf(vcf_file);
+    long int pos = 0;
+    size_t len = 0;
+    ssize_t read;
+
+    if((out_file = fopen(name, "wb")) == NULL) {
+        fprintf(stderr, "\nERROR: Cannot create file %s\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(head.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    fwrite(pad, 1, sizeof(pad), out_file);
+    head.genos = sizeof(pad);
+    while((site = nextRecord(vcf_file, bcf, &pos, &line, &len, &rec)) != -1) {
+        if(site == 0) {
+            read = strlen(line);
+            while(head.text_n + read > text_max)
+                text = growArray(text, text_max, &text_max, 1);
+            memcpy(text + head.text_n, line, read);
+            head.text_n += read;
+            if(strncmp(line, "#CHROM\t", 7) == 0 && head.sample_n == 0) {
+                samples = parseSamples(line, &k);
+                free(samples);
+                head.sample_n = k;
+                if((block = calloc((size_t)k * CACHE_BLOCK, 2)) == NULL) {
+                    fprintf(stderr, merror);
+                    exit(EXIT_FAILURE);
+                }
+            }
+            continue;
+        }
+        if(block == NULL) {
+            fprintf(stderr, "\nERROR: The VCF file has no #CHROM line\n\n");
+            exit(EXIT_FAILURE);
+        }
+        parseGenos(&rec, NULL, 0);
+        if(head.contig_n == 0 || strcmp(strings + contigs[head.contig_n - 1].name, rec.chr) != 0) {
+            contigs = growArray(contigs, head.contig_n, &contig_max, sizeof(CacheContig_s));
+            contigs[head.contig_n].name = addString(&strings, &head.string_n, &string_max, rec.chr);
+            contigs[head.contig_n].first = head.site_n;
+            contigs[head.contig_n].n = 0;
+            head.contig_n++;
+        }
+        contigs[head.contig_n - 1].n++;
+        sites = growArray(sites, head.site_n, &site_max, sizeof(CacheSite_s));
+        sites[head.site_n].contig = head.contig_n - 1;
+        sites[head.site_n].pos = rec.pos;
+        sites[head.site_n].id = addString(&strings, &head.string_n, &string_max, rec.id);
+        sites[head.site_n].ref = addString(&strings, &head.string_n, &string_max, rec.ref);
+        sites[head.site_n].alt = addString(&strings, &head.string_n, &string_max, rec.alt);
+        head.site_n++;
+        for(i = 0; i < head.sample_n; i++) {
+            p = block + ((size_t)i * CACHE_BLOCK + block_n) * 2;
+            if(i >= rec.ind_n) {
+                p[0] = 0;
+                p[1] = 1 << 4;
+                continue;
+            }
+            g = &rec.geno[i];
+            mask = 0;
+            for(k = 0; g->mis == 0 && k < g->ploidy; k++)
+                mask |= (g->gt[k * 2] == '1') << k;
+            p[0] = mask;
+            p[1] = g->ploidy | g->mis << 4 | (g->len > 1 && g->gt[1] == '|') << 5;
+        }
+        if(++block_n == CACHE_BLOCK) {
+            writeBlock(out_file, block, head.sample_n, block_n);
+            block_n = 0;
+        }
+    }
+    if(block_n > 0)
+        writeBlock(out_file, block, head.sample_n, block_n);
+    writeAligned(out_file, sites, head.site_n * sizeof(CacheSite_s), &head.sites);
+    writeAligned(out_file, contigs, head.contig_n * sizeof(CacheContig_s), &head.contigs);
+    writeAligned(out_file, strings, head.string_n, &head.strings);
+    writeAligned(out_file, text, head.text_n, &head.text);
+    rewind(out_file);
+    fwrite(&head, sizeof(CacheHead_s), 1, out_file);
+    if(fclose(out_file) != 0) {
+        fprintf(stderr, "\nERROR: Cannot write file %s\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "Wrote %li sites and %li samples to %s\n\n", head.site_n, head.sample_n, name);
+
+    if(bcf != NULL)
+        freeBcf(bcf);
+    freeRecord(&rec);
+    free(line);
+    free(text);
+    free(strings);
+    free(sites);
+    free(contigs);
+    free(block);
+}
+
+Cache_s *openCache(const char *name) {
+    int fd;
+    struct stat st;
+    Cache_s *cache = NULL;
+    const CacheHead_s *head = NULL;
+
+    if((fd = open(name, O_RDONLY)) < 0)
+        return NULL;
+    if((cache = calloc(1, sizeof(Cache_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(CacheHead_s) || (cache->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        fprintf(stderr, "\nERROR: Cannot read file %s\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    cache->size = st.st_size;
+    head = (const CacheHead_s *)cache->map;
+    if(memcmp(head->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || head->text < head->strings || head->text + head->text_n > (long int)cache->size) {
+        fprintf(stderr, "\nERROR: %s is not a genotype cache written with -cache\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+    cache->head = head;
+    cache->sites = (const CacheSite_s *)(cache->map + head->sites);
+    cache->contigs = (const CacheContig_s *)(cache->map + head->contigs);
+    cache->strings = (const char *)cache->map + head->strings;
+    cache->text = (const char *)cache->map + head->text;
+
+    return cache;
+}
+
+int readCache(const Cache_s *cache, int head, long int *pos, long int end, char **line, size_t *len, Record_s *rec) {
+    long int k = 0, block = 0;
+    const char *p = NULL;
+    const CacheSite_s *site = NULL;
+
+    if(*pos >= end)
+        return -1;
+    if(head) {
+        p = memchr(cache->text + *pos, '\n', end - *pos);
+        k = p != NULL ? p - cache->text - *pos + 1 : end - *pos;
+        if(*line == NULL || (size_t)k + 1 > *len) {
+            *len = k + 1;
+            if((*line = realloc(*line, *len)) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+        }
+        memcpy(*line, cache->text + *pos, k);
+        (*line)[k] = '\0';
+        *pos += k;
+        return 0;
+    }
+    site = &cache->sites[*pos];
+    block = *pos / CACHE_BLOCK * CACHE_BLOCK;
+    rec->chr = (char *)cache->strings + cache->contigs[site->contig].name;
+    rec->pos = site->pos;
+    rec->id = (char *)cache->strings + site->id;
+    rec->ref = (char *)cache->strings + site->ref;
+    rec->alt = (char *)cache->strings + site->alt;
+    rec->data = NULL;
+    rec->pack_n = cache->head->sample_n;
+    rec->stride = (cache->head->site_n - block < CACHE_BLOCK ? cache->head->site_n - block : CACHE_BLOCK) * 2;
+    rec->pack = cache->map + cache->head->genos + block * 2 * cache->head->sample_n + (*pos - block) * 2;
+    *pos = *pos + 1;
+
+    return 1;
+}
+
+void closeCache(Cache_s *cache) {
+    munmap(cache->map, cache->size);
+    free(cache);
+}
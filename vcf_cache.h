@@ -0,0 +1,65 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Binary genotype cache (-cache) used by prune_ld, poly_freq, poly_fst and poly_sfs.
+
+ writeCache converts a VCF file once into a columnar file, which the programs then memory-map instead of parsing text.
+ The file holds the VCF header, a chr/pos index of the sites, and the genotypes in blocks of CACHE_BLOCK sites. Within a
+ block, each sample has its own column of two bytes per site: a bitmask of its alternative alleles, and its ploidy with
+ a missing flag (bit 4) and a phased flag (bit 5). Runs that use a subset of the samples only read those columns.
+ readCache returns the header lines and the records of a site range in the same form as parseSite and parseGenos.
+*/
+
+#ifndef VCF_CACHE_H
+#define VCF_CACHE_H
+
+#include <stddef.h>
+#include "bgzf.h"
+#include "vcf_bcf.h"
+#include "vcf_parse.h"
+#define CACHE_BLOCK 4096
+
+typedef struct {
+    char magic[8];
+    long int site_n, sample_n, contig_n, text_n, string_n;
+    long int genos, sites, contigs, strings, text;
+} CacheHead_s;
+
+typedef struct {
+    int contig, pos;
+    long int id, ref, alt;
+} CacheSite_s;
+
+typedef struct {
+    long int name, first, n;
+} CacheContig_s;
+
+typedef struct {
+    size_t size;
+    unsigned char *map;
+    const CacheHead_s *head;
+    const CacheSite_s *sites;
+    const CacheContig_s *contigs;
+    const char *strings, *text;
+} Cache_s;
+
+void writeCache(Bgzf_s *vcf_file, const char *name);
+Cache_s *openCache(const char *name);
+int readCache(const Cache_s *cache, int head, long int *pos, long int end, char **line, size_t *len, Record_s *rec);
+void closeCache(Cache_s *cache);
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+ Allele frequency output and its LD pruning, shared by poly_freq and poly_sv. See vcf_freq.h.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "vcf_freq.h"
+
+/*
+ A SNP that still passes was already compared with every SNP that has stayed in the window since the previous call,
+ so only pairs involving SNPs written after that call (fresh) are evaluated. Removed SNPs are not revisited.
+ Pairs further apart than -r2bp are skipped, as are pairs whose r2 cannot exceed the maximum given the dosage
+ counts of the two SNPs (maxR2). The bound is dropped for the rest of the call if it skips less than one in eight
+ of the first 64 pairs, as it then costs more than the estR2 calls it saves. With -stats, the counts of the call are
+ added to st, which is NULL otherwise.
+*/
+void estLD(SNP_s *snps, Dosage_s *dose, int win, int maxdist, double r2, Stats_s *st) {
+    int i, j, try_n = 0, skip_n = 0, dist_n = 0, r2_n = 0, break_n = 0;
+    for(i = 0; i < win; i++) {
+        if(snps[i].chr[0] == '\0' || snps[i].ok == 0)
+            continue;
+        for(j = i + 1; j < win; j++) {
+            if(snps[j].chr[0] == '\0')
+                continue;
+            if(snps[i].fresh == 0 && snps[j].fresh == 0)
+                continue;
+            if(strcmp(snps[i].chr, snps[j].chr) != 0)
+                continue;
+            if(maxdist > 0 && abs(snps[j].pos - snps[i].pos) > maxdist) {
+                dist_n++;
+                continue;
+            }
+            if(try_n < 64 || skip_n * 8 >= try_n) {
+                try_n++;
+                if(maxR2(dose, i, j) <= r2) {
+                    skip_n++;
+                    continue;
+                }
+            }
+            r2_n++;
+            if(estR2(dose, i, j) > r2) {
+                break_n++;
+                break;
+            }
+        }
+        if(j == win)
+            snps[i].ok = 1;
+        else
+            snps[i].ok = 0;
+    }
+    for(i = 0; i < win; i++)
+        snps[i].fresh = 0;
+    if(st != NULL) {
+        st->r2_n += r2_n;
+        st->break_n += break_n;
+        st->bound_n += try_n;
+        st->bound_skip += skip_n;
+        st->dist_skip += dist_n;
+    }
+}
+
+void printFreq(Writer_s *w, double *counts, char chr[], int pos, int out, int n) {
+    int i;
+    float freq;
+    if(out == 0) {
+        writeString(&w[0], chr);
+        writeChar(&w[0], ':');
+        writeInt(&w[0], pos);
+        writeChar(&w[0], '\t');
+    } else {
+        writeString(&w[1], chr);
+        writeChar(&w[1], '\t');
+        writeInt(&w[1], pos);
+        writeChar(&w[1], '\n');
+    }
+    for(i = 0; i < n; i++) {
+        if(out == 0) {
+            writeFixed(&w[0], counts[i * 2 + 1] / counts[i * 2], 6);
+            writeChar(&w[0], i < n - 1 ? '\t' : '\n');
+        } else if(out == 1) {
+            writeFixed(&w[0], counts[i * 2] - counts[i * 2 + 1], 0);
+            writeChar(&w[0], ' ');
+            writeFixed(&w[0], counts[i * 2 + 1], 0);
+            writeChar(&w[0], i < n - 1 ? ' ' : '\n');
+        } else {
+            freq = counts[i * 2 + 1] / counts[i * 2];
+            writeBytes(&w[0], &freq, sizeof(float));
+        }
+    }
+}
@@ -0,0 +1,42 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+ Allele frequency output and its LD pruning (-r2), shared by poly_freq and poly_sv.
+
+ The SNPs of the -r2 window are kept in an array of SNP_s, with their genotypes in the same rows of a Dosage_s. estLD
+ drops (ok = 0) the SNPs whose r2 with a later SNP of the window exceeds the maximum, and adds its counts to st (-stats
+ of poly_freq) unless st is NULL.
+ printFreq writes the frequencies (-out 0), BayPass counts (-out 1) or binary floats (-out 2) of one site, with the
+ location of the site into the -info writer for -out 1 and 2.
+*/
+
+#ifndef VCF_FREQ_H
+#define VCF_FREQ_H
+
+#include "poly_ld.h"
+#include "vcf_stats.h"
+#include "vcf_write.h"
+
+typedef struct {
+    int pos, ok, fresh;
+    double *counts;
+    char chr[100];
+} SNP_s;
+
+void estLD(SNP_s *snps, Dosage_s *dose, int win, int maxdist, double r2, Stats_s *st);
+void printFreq(Writer_s *w, double *counts, char chr[], int pos, int out, int n);
+
+#endif
@@ -0,0 +1,698 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Shared VCF parsing used by prune_ld, poly_freq, poly_fst and poly_sfs. See vcf_parse.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vcf_parse.h"
+#define merror "\nERROR: System out of memory\n\n"
+
+static char gt_text[2][9][257][16];
+
+/* Entry [phased][ploidy][mask] holds the GT string of those alleles, and entry 256 the missing genotype */
+__attribute__((constructor)) static void makeGenos(void) {
+    int i, j, k, m;
+    char *p = NULL;
+    for(i = 0; i < 2; i++) {
+        for(j = 0; j < 9; j++) {
+            for(m = 0; m < 257; m++) {
+                p = gt_text[i][j][m];
+                for(k = 0; k < j || (k == 0 && j == 0); k++) {
+                    if(k > 0)
+                        *p++ = i ? '|' : '/';
+                    *p++ = m == 256 || j == 0 ? '.' : '0' + ((m >> k) & 1);
+                }
+                *p = '\0';
+            }
+        }
+    }
+}
+
+static char *nextField(char *s) {
+    char *p = s;
+    while(*p != '\t' && *p != '\n' && *p != '\0')
+        p++;
+    if(*p == '\t') {
+        *p = '\0';
+        return p + 1;
+    }
+    *p = '\0';
+    return NULL;
+}
+
+char **parseSamples(char *line, int *n) {
+    int i = 1, list_i = 100;
+    char *p = line, *temp = NULL, **list = NULL;
+
+    if((list = malloc(list_i * sizeof(char *))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    *n = 0;
+    while(p != NULL) {
+        temp = p;
+        p = nextField(p);
+        if(i++ < 10)
+            continue;
+        list[*n] = temp;
+        *n = *n + 1;
+        if(*n >= list_i) {
+            list_i += 100;
+            if((list = realloc(list, list_i * sizeof(char *))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    return list;
+}
+
+int parseSite(char *line, Record_s *rec) {
+    int i;
+    char *p = line;
+
+    rec->chr = p;
+    if((p = nextField(p)) == NULL)
+        return 0;
+    rec->pos = atoi(p);
+    if((p = strchr(p, '\t')) == NULL)
+        return 0;
+    rec->id = ++p;
+    if((p = nextField(p)) == NULL)
+        return 0;
+    rec->ref = p;
+    if((p = nextField(p)) == NULL)
+        return 0;
+    rec->alt = p;
+    if((p = nextField(p)) == NULL)
+        return 0;
+    for(i = 0; i < 4; i++) {
+        if((p = strchr(p, '\t')) == NULL)
+            return 0;
+        if(i == 2)
+            rec->format = p + 1;
+        p++;
+    }
+    rec->data = p;
+    rec->pack = NULL;
+    rec->ready = 0;
+
+    return 1;
+}
+
+int findFormat(const Record_s *rec, const char *key) {
+    int i = 0, n = strlen(key);
+    const char *p = rec->format;
+
+    if(p == NULL || rec->pack != NULL)
+        return -1;
+    while(*p != '\t' && *p != '\0') {
+        if(strncmp(p, key, n) == 0 && (p[n] == ':' || p[n] == '\t'))
+            return i;
+        while(*p != ':' && *p != '\t' && *p != '\0')
+            p++;
+        if(*p == ':')
+            p++;
+        i++;
+    }
+
+    return -1;
+}
+
+static void unpackGenos(Record_s *rec, const char *use, int use_n) {
+    int i, ploidy;
+    const unsigned char *p = NULL;
+    Geno_s *g = NULL;
+
+    if(rec->pack_n > rec->ind_max) {
+        rec->ind_max = rec->pack_n + 100;
+        if((rec->geno = realloc(rec->geno, rec->ind_max * sizeof(Geno_s))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for(i = 0; i < rec->pack_n; i++) {
+        g = &rec->geno[i];
+        if(use != NULL && (i >= use_n || use[i] == 0)) {
+            g->gt = NULL;
+            g->field = NULL;
+            g->alt = 0;
+            g->ploidy = 0;
+            g->mis = 1;
+            g->len = 0;
+            continue;
+        }
+        g->field = NULL;
+        p = rec->pack + i * rec->stride;
+        ploidy = p[1] & 15;
+        g->ploidy = ploidy;
+        g->mis = (p[1] >> 4) & 1;
+        g->alt = g->mis ? 0 : __builtin_popcount(p[0]);
+        g->gt = gt_text[(p[1] >> 5) & 1][ploidy][g->mis ? 256 : p[0]];
+        g->len = ploidy > 0 ? ploidy * 2 - 1 : 1;
+    }
+    rec->ind_n = rec->pack_n;
+}
+
+/* Reads a complete called genotype of the given ploidy at fixed offsets, for example 0/1/1/1 as the bytes 0, 2, 4 and 6.
+   Called with a constant ploidy, the loop is unrolled into a decoder for that ploidy. Each byte is only read after the
+   previous one was found to be part of the genotype, so the decoder never reads past the end of the line */
+static inline int fixedGt(const char *p, int ploidy, int *alt) {
+    int k, sum = 0;
+    unsigned int c;
+
+    for(k = 0; k < ploidy; k++) {
+        c = (unsigned char)p[k * 2] - '0';
+        if(c > 1)
+            return 0;
+        sum += c;
+        c = (unsigned char)p[k * 2 + 1];
+        if(k < ploidy - 1 && c != '/' && c != '|')
+            return 0;
+    }
+    if(c != ':' && c != '\t' && c != '\n' && c != '\0')
+        return 0;
+    *alt = sum;
+
+    return 1;
+}
+
+/* The ploidy of each sample is taken from its genotype in the previous record decoded into the same array, and a
+   genotype of that ploidy is read by the decoder of the ploidy. A missing genotype, a sample whose ploidy was not
+   known, or a genotype of another width goes through the general scan, which also finds the errors.
+   Returns 1 for a genotype of another ploidy and 2 for an allele other than 0 or 1, leaving the record partly decoded */
+static int scanGenos(Record_s *rec, const char *use, int use_n) {
+    int i = 0, k, len, alt = 0, ok = 0, prev_n = rec->ind_n;
+    char end, *p = rec->data, *q = NULL;
+    Geno_s *g = NULL;
+
+    while(p != NULL) {
+        if(i >= rec->ind_max) {
+            rec->ind_max += 100;
+            if((rec->geno = realloc(rec->geno, rec->ind_max * sizeof(Geno_s))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+        }
+        g = &rec->geno[i++];
+        if(use != NULL && (i > use_n || use[i - 1] == 0)) {
+            g->gt = NULL;
+            g->field = NULL;
+            g->alt = 0;
+            g->ploidy = 0;
+            g->mis = 1;
+            g->len = 0;
+            if((p = strchr(p, '\t')) != NULL)
+                p++;
+            continue;
+        }
+        switch(i <= prev_n ? g->ploidy : 0) {
+        case 2:
+            ok = fixedGt(p, 2, &alt);
+            break;
+        case 4:
+            ok = fixedGt(p, 4, &alt);
+            break;
+        case 6:
+            ok = fixedGt(p, 6, &alt);
+            break;
+        case 8:
+            ok = fixedGt(p, 8, &alt);
+            break;
+        default:
+            ok = 0;
+        }
+        if(ok) {
+            len = g->ploidy * 2 - 1;
+            q = p + len;
+            end = *q;
+            g->gt = p;
+            g->len = len;
+            g->alt = alt;
+            g->mis = 0;
+        } else {
+            q = p;
+            while(*q != ':' && *q != '\t' && *q != '\n' && *q != '\0')
+                q++;
+            len = q - p;
+            end = *q;
+            g->gt = p;
+            g->len = len > 255 ? 255 : len;
+            g->alt = 0;
+            g->ploidy = (len == 3 || len == 7 || len == 11 || len == 15) ? (len + 1) / 2 : 0;
+            g->mis = p[0] == '.';
+        }
+        if(ok == 0 && g->mis == 0) {
+            if(g->ploidy == 0)
+                return 1;
+            for(k = 0; k < len; k += 2) {
+                if(p[k] == '0' || p[k] == '1')
+                    g->alt += p[k] - '0';
+                else
+                    return 2;
+            }
+        }
+        g->field = NULL;
+        if(end == ':' && rec->field > 0) {
+            p = q + 1;
+            for(k = 1; k < rec->field && *p != '\t' && *p != '\n' && *p != '\0'; k++) {
+                while(*p != ':' && *p != '\t' && *p != '\n' && *p != '\0')
+                    p++;
+                if(*p == ':')
+                    p++;
+            }
+            if(k == rec->field && *p != '\t' && *p != '\n' && *p != '\0' && *p != ':')
+                g->field = p;
+            q = p - 1;
+        }
+        if(end == ':') {
+            if((p = strchr(q + 1, '\t')) != NULL)
+                p++;
+        } else if(end == '\t')
+            p = q + 1;
+        else
+            p = NULL;
+    }
+    rec->ind_n = i;
+
+    return 0;
+}
+
+void parseGenos(Record_s *rec, const char *use, int use_n) {
+    int k;
+
+    if(rec->ready && rec->use == use && rec->use_n == use_n && rec->field == 0) {
+        rec->ready = 0;
+        return;
+    }
+    rec->ready = 0;
+    rec->decoded = 1;
+    rec->use = use;
+    rec->use_n = use_n;
+    if(rec->pack != NULL) {
+        unpackGenos(rec, use, use_n);
+        return;
+    }
+    if((k = scanGenos(rec, use, use_n)) == 1) {
+        fprintf(stderr, "\nERROR: Allowed ploidy-levels are 2, 4, 6, and 8!\n\n");
+        exit(EXIT_FAILURE);
+    } else if(k == 2) {
+        fprintf(stderr, "\nERROR: Unknown alleles found at site %s:%i! Only 0 and 1 are allowed.\n\n", rec->chr, rec->pos);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Decodes the genotypes of a text record ahead of the program, which then calls parseGenos with the same use and use_n.
+   Invalid genotypes are not reported here, but again by parseGenos if the program uses the site */
+void readyGenos(Record_s *rec, const char *use, int use_n) {
+    rec->use = use;
+    rec->use_n = use_n;
+    rec->ready = rec->pack == NULL && scanGenos(rec, use, use_n) == 0;
+}
+
+void freeRecord(Record_s *rec) {
+    free(rec->geno);
+    rec->geno = NULL;
+    rec->ind_n = 0;
+    rec->ind_max = 0;
+}
+
+static unsigned int hashKey(const char *key) {
+    unsigned int h = 2166136261u;
+    while(*key != '\0')
+        h = (h ^ (unsigned char)*key++) * 16777619u;
+    return h;
+}
+
+void initHash(Hash_s *hash, int n) {
+    hash->size = 16;
+    while(hash->size < n * 2)
+        hash->size *= 2;
+    hash->n = 0;
+    if((hash->keys = calloc(hash->size, sizeof(char *))) == NULL || (hash->vals = malloc(hash->size * sizeof(int))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Open addressing with linear probing, kept at most half full */
+int *addHash(Hash_s *hash, const char *key) {
+    int i, size = hash->size, *vals = hash->vals;
+    unsigned int k;
+    const char **keys = hash->keys;
+
+    if((hash->n + 1) * 2 > size) {
+        initHash(hash, size);
+        for(i = 0; i < size; i++) {
+            if(keys[i] != NULL)
+                *addHash(hash, keys[i]) = vals[i];
+        }
+        free(keys);
+        free(vals);
+    }
+    k = hashKey(key) & (hash->size - 1);
+    while(hash->keys[k] != NULL) {
+        if(strcmp(hash->keys[k], key) == 0)
+            return &hash->vals[k];
+        k = (k + 1) & (hash->size - 1);
+    }
+    hash->keys[k] = key;
+    hash->vals[k] = -1;
+    hash->n++;
+
+    return &hash->vals[k];
+}
+
+int *findHash(const Hash_s *hash, const char *key) {
+    unsigned int k = hashKey(key) & (hash->size - 1);
+    while(hash->keys[k] != NULL) {
+        if(strcmp(hash->keys[k], key) == 0)
+            return &hash->vals[k];
+        k = (k + 1) & (hash->size - 1);
+    }
+    return NULL;
+}
+
+void freeHash(Hash_s *hash) {
+    free(hash->keys);
+    free(hash->vals);
+    hash->keys = NULL;
+    hash->vals = NULL;
+}
+
+static int cmpPos(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+Sites_s *readSites(FILE *site_file) {
+    int i, *v = NULL;
+    char *line = NULL, *chr = NULL, *pos = NULL;
+    Sites_s *sites = NULL;
+    SiteList_s *list = NULL;
+    size_t len = 0;
+
+    if((sites = calloc(1, sizeof(Sites_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    initHash(&sites->hash, 64);
+    while(getline(&line, &len, site_file) != -1) {
+        if(line[0] == '\n' || line[0] == '#')
+            continue;
+        if((chr = strtok(line, "\t")) == NULL || (pos = strtok(NULL, "\t")) == NULL)
+            continue;
+        if(list == NULL || strcmp(list->chr, chr) != 0) {
+            if((v = findHash(&sites->hash, chr)) == NULL) {
+                if(sites->n == sites->max) {
+                    sites->max = sites->max > 0 ? sites->max * 2 : 64;
+                    if((sites->lists = realloc(sites->lists, sites->max * sizeof(SiteList_s))) == NULL) {
+                        fprintf(stderr, merror);
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                list = &sites->lists[sites->n];
+                memset(list, 0, sizeof(SiteList_s));
+                if((list->chr = strdup(chr)) == NULL) {
+                    fprintf(stderr, merror);
+                    exit(EXIT_FAILURE);
+                }
+                *addHash(&sites->hash, list->chr) = sites->n++;
+            } else
+                list = &sites->lists[*v];
+        }
+        if(list->n == list->max) {
+            list->max = list->max > 0 ? list->max * 2 : 1024;
+            if((list->pos = realloc(list->pos, list->max * sizeof(int))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+        }
+        list->pos[list->n++] = atoi(pos);
+        sites->site_n++;
+    }
+    for(i = 0; i < sites->n; i++) {
+        list = &sites->lists[i];
+        if(list->n > 0 && list->n < list->max && (list->pos = realloc(list->pos, list->n * sizeof(int))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        list->max = list->n;
+        qsort(list->pos, list->n, sizeof(int), cmpPos);
+    }
+
+    free(line);
+    fclose(site_file);
+
+    return sites;
+}
+
+/* The cursor moves forward through the positions of the current contig, and only falls back to a binary search
+   when a chunk starts, or the VCF file jumps back */
+int findSite(const Sites_s *sites, SiteCursor_s *cur, const char *chr, int pos) {
+    int lo, hi, mid, *v = NULL;
+    const SiteList_s *list = NULL;
+
+    if(cur->chr == NULL || strcmp(cur->chr, chr) != 0) {
+        v = findHash(&sites->hash, chr);
+        cur->list = v != NULL ? *v : -1;
+        cur->chr = v != NULL ? sites->lists[*v].chr : NULL;
+        cur->k = 0;
+    }
+    if(cur->list < 0)
+        return 0;
+    list = &sites->lists[cur->list];
+    if(cur->k == 0 || list->pos[cur->k - 1] >= pos) {
+        lo = 0;
+        hi = list->n;
+        while(lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if(list->pos[mid] < pos)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        cur->k = lo;
+    }
+    while(cur->k < list->n && list->pos[cur->k] < pos)
+        cur->k++;
+
+    return cur->k < list->n && list->pos[cur->k] == pos;
+}
+
+void freeSites(Sites_s *sites) {
+    int i;
+    for(i = 0; i < sites->n; i++) {
+        free(sites->lists[i].chr);
+        free(sites->lists[i].pos);
+    }
+    free(sites->lists);
+    freeHash(&sites->hash);
+    free(sites);
+}
+
+static int cmpFeature(const void *a, const void *b) {
+    const Feature_s *x = a, *y = b;
+    if(x->start != y->start)
+        return (x->start > y->start) - (x->start < y->start);
+    return (x->idx > y->idx) - (x->idx < y->idx);
+}
+
+/* Node i at level k has its children at i - 2^(k-1) and i + 2^(k-1), the leaves being the even indices. Nodes past the
+   end of the array are missing, so the largest end of the last real subtree is carried upwards instead */
+static int indexFeatures(Feature_s *list, int n) {
+    int i, k, x, last_i = 0, last = 0, e;
+
+    if(n == 0)
+        return -1;
+    for(i = 0; i < n; i += 2) {
+        last_i = i;
+        last = list[i].max = list[i].end;
+    }
+    for(k = 1; 1L << k <= n; k++) {
+        x = 1 << (k - 1);
+        for(i = (x << 1) - 1; i < n; i += x << 2) {
+            e = list[i].end;
+            if(list[i - x].max > e)
+                e = list[i - x].max;
+            if(i + x < n ? list[i + x].max > e : last > e)
+                e = i + x < n ? list[i + x].max : last;
+            list[i].max = e;
+        }
+        last_i = (last_i >> k & 1) ? last_i - x : last_i + x;
+        if(last_i < n && list[last_i].max > last)
+            last = list[last_i].max;
+    }
+
+    return k - 1;
+}
+
+Features_s *readFeatures(FILE *feature_file) {
+    int i, k, *v = NULL;
+    char *line = NULL, *chr = NULL, *start = NULL, *end = NULL, *id = NULL, name[300];
+    Features_s *features = NULL;
+    FeatureList_s *list = NULL;
+    size_t len = 0;
+
+    if((features = calloc(1, sizeof(Features_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    initHash(&features->hash, 64);
+    while(getline(&line, &len, feature_file) != -1) {
+        if(line[0] == '\n' || line[0] == '#')
+            continue;
+        if((chr = strtok(line, "\t\r\n")) == NULL || (start = strtok(NULL, "\t\r\n")) == NULL || (end = strtok(NULL, "\t\r\n")) == NULL)
+            continue;
+        if((id = strtok(NULL, "\t\r\n")) == NULL) {
+            snprintf(name, sizeof(name), "%s:%s-%s", chr, start, end);
+            id = name;
+        }
+        if(list == NULL || strcmp(list->chr, chr) != 0) {
+            if((v = findHash(&features->hash, chr)) == NULL) {
+                if(features->n == features->max) {
+                    features->max = features->max > 0 ? features->max * 2 : 64;
+                    if((features->lists = realloc(features->lists, features->max * sizeof(FeatureList_s))) == NULL) {
+                        fprintf(stderr, merror);
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                list = &features->lists[features->n];
+                memset(list, 0, sizeof(FeatureList_s));
+                if((list->chr = strdup(chr)) == NULL) {
+                    fprintf(stderr, merror);
+                    exit(EXIT_FAILURE);
+                }
+                *addHash(&features->hash, list->chr) = features->n++;
+            } else
+                list = &features->lists[*v];
+        }
+        if(list->n == list->max) {
+            list->max = list->max > 0 ? list->max * 2 : 256;
+            if((list->list = realloc(list->list, list->max * sizeof(Feature_s))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+        }
+        if(features->feature_n == features->id_max) {
+            features->id_max = features->id_max > 0 ? features->id_max * 2 : 1024;
+            if((features->ids = realloc(features->ids, features->id_max * sizeof(char *))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+        }
+        if((features->ids[features->feature_n] = strdup(id)) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        k = list->n++;
+        list->list[k].start = atoi(start);
+        list->list[k].end = atoi(end);
+        list->list[k].idx = features->feature_n++;
+    }
+    for(i = 0; i < features->n; i++) {
+        list = &features->lists[i];
+        qsort(list->list, list->n, sizeof(Feature_s), cmpFeature);
+        list->level = indexFeatures(list->list, list->n);
+    }
+
+    free(line);
+    fclose(feature_file);
+
+    return features;
+}
+
+static void addHit(FeatureCursor_s *cur, int idx) {
+    if(cur->n == cur->max) {
+        cur->max = cur->max > 0 ? cur->max * 2 : 16;
+        if((cur->hits = realloc(cur->hits, cur->max * sizeof(int))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+    }
+    cur->hits[cur->n++] = idx;
+}
+
+/* Subtrees of at most 16 features are scanned linearly, larger ones are only entered if their largest end reaches pos.
+   The hits are returned in cur->hits as indices to features->ids, in the order of the feature starts */
+int findFeatures(const Features_s *features, FeatureCursor_s *cur, const char *chr, int pos) {
+    int i, i0, i1, t = 0, y, *v = NULL, stack[64][3];
+    const FeatureList_s *list = NULL;
+    const Feature_s *a = NULL;
+
+    if(cur->chr == NULL || strcmp(cur->chr, chr) != 0) {
+        v = findHash(&features->hash, chr);
+        cur->list = v != NULL ? *v : -1;
+        cur->chr = v != NULL ? features->lists[*v].chr : NULL;
+    }
+    cur->n = 0;
+    if(cur->list < 0 || features->lists[cur->list].n == 0)
+        return 0;
+    list = &features->lists[cur->list];
+    a = list->list;
+    stack[t][0] = (1 << list->level) - 1;
+    stack[t][1] = list->level;
+    stack[t++][2] = 0;
+    while(t > 0) {
+        t--;
+        if(stack[t][1] <= 3) {
+            i0 = stack[t][0] >> stack[t][1] << stack[t][1];
+            i1 = i0 + (1 << (stack[t][1] + 1)) - 1;
+            if(i1 >= list->n)
+                i1 = list->n;
+            for(i = i0; i < i1 && a[i].start <= pos; i++) {
+                if(pos <= a[i].end)
+                    addHit(cur, a[i].idx);
+            }
+        } else if(stack[t][2] == 0) {
+            y = stack[t][0] - (1 << (stack[t][1] - 1));
+            stack[t++][2] = 1;
+            if(y >= list->n || a[y].max >= pos) {
+                stack[t][0] = y;
+                stack[t][1] = stack[t - 1][1] - 1;
+                stack[t++][2] = 0;
+            }
+        } else if(stack[t][0] < list->n && a[stack[t][0]].start <= pos) {
+            i = stack[t][0];
+            if(pos <= a[i].end)
+                addHit(cur, a[i].idx);
+            stack[t][0] = i + (1 << (stack[t][1] - 1));
+            stack[t][1]--;
+            stack[t++][2] = 0;
+        }
+    }
+
+    return cur->n;
+}
+
+void freeFeatures(Features_s *features) {
+    int i;
+    for(i = 0; i < features->n; i++) {
+        free(features->lists[i].chr);
+        free(features->lists[i].list);
+    }
+    for(i = 0; i < features->feature_n; i++)
+        free(features->ids[i]);
+    free(features->ids);
+    free(features->lists);
+    freeHash(&features->hash);
+    free(features);
+}
@@ -0,0 +1,122 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Shared VCF parsing used by prune_ld, poly_freq, poly_fst and poly_sfs.
+
+ Lines are scanned once and in place: field separators are overwritten with '\0', so all returned
+ strings point into the line buffer and stay valid until the next line is read into it.
+ The GT field of each sample is decoded straight into an alternative allele count, a ploidy level and a missing flag.
+ The sample columns are left as they are (the GT strings are given by their length), so a line can be decoded again.
+ A GT string is first read at fixed offsets with a decoder for the ploidy that the sample had in the previous record,
+ and only missing genotypes and changes of ploidy go through the general scan.
+ readyGenos lets the reading pipeline (see vcf_thread.h) decode a record on another thread: it sets ready, and the next
+ parseGenos call with the same use, use_n and no extra field returns at once. parseGenos records its use and use_n in
+ the record, and sets decoded, so that the pipeline learns the mask of the program from its first decoded site.
+ When rec->field is set to the index of another FORMAT key (see findFormat), the same scan also points the field of
+ each Geno_s to that value of the sample (for example its PL), which is left unterminated and ends at ':' or '\t'.
+ Records read from a genotype cache (see vcf_cache.h) or a BCF file (see vcf_bcf.h) have pack set instead of data,
+ and parseGenos decodes their genotype columns. The GT strings of such records point to a shared table of the possible genotypes.
+ Hash_s maps sample and population names to integers, for matching the #CHROM line against the population files.
+ It stores the key pointers, not copies, so the keys must stay valid while the table is used.
+ Sites_s holds a -sites file as one sorted array of positions per contig, with the contigs found through a Hash_s.
+ findSite keeps its place in a SiteCursor_s, so a chunk of sorted VCF records is matched with integer comparisons.
+ Features_s holds a -genes file (chr, start, end, id) as an implicit interval tree per contig: the features of a contig
+ are sorted by start, and each node of a balanced tree laid over the array stores the largest end in its subtree.
+ findFeatures returns every feature that overlaps a position in O(log n + k), whether or not the features overlap.
+*/
+
+#ifndef VCF_PARSE_H
+#define VCF_PARSE_H
+
+#include <stdio.h>
+
+typedef struct {
+    char *gt, *field;
+    unsigned char alt, ploidy, mis, len;
+} Geno_s;
+
+typedef struct {
+    int pos, ind_n, ind_max, pack_n, field, ready, decoded, use_n;
+    long int stride;
+    char *chr, *id, *ref, *alt, *format, *data;
+    const char *use;
+    const unsigned char *pack;
+    Geno_s *geno;
+} Record_s;
+
+typedef struct {
+    int size, n, *vals;
+    const char **keys;
+} Hash_s;
+
+typedef struct {
+    char *chr;
+    int n, max, *pos;
+} SiteList_s;
+
+typedef struct {
+    int n, max;
+    long int site_n;
+    SiteList_s *lists;
+    Hash_s hash;
+} Sites_s;
+
+typedef struct {
+    int list, k;
+    const char *chr;
+} SiteCursor_s;
+
+typedef struct {
+    int start, end, max, idx;
+} Feature_s;
+
+typedef struct {
+    char *chr;
+    int n, max, level;
+    Feature_s *list;
+} FeatureList_s;
+
+typedef struct {
+    int n, max, feature_n, id_max;
+    char **ids;
+    FeatureList_s *lists;
+    Hash_s hash;
+} Features_s;
+
+typedef struct {
+    int list, n, max, *hits;
+    const char *chr;
+} FeatureCursor_s;
+
+char **parseSamples(char *line, int *n);
+int parseSite(char *line, Record_s *rec);
+int findFormat(const Record_s *rec, const char *key);
+void parseGenos(Record_s *rec, const char *use, int use_n);
+void readyGenos(Record_s *rec, const char *use, int use_n);
+void freeRecord(Record_s *rec);
+void initHash(Hash_s *hash, int n);
+int *addHash(Hash_s *hash, const char *key);
+int *findHash(const Hash_s *hash, const char *key);
+void freeHash(Hash_s *hash);
+Sites_s *readSites(FILE *site_file);
+int findSite(const Sites_s *sites, SiteCursor_s *cur, const char *chr, int pos);
+void freeSites(Sites_s *sites);
+Features_s *readFeatures(FILE *feature_file);
+int findFeatures(const Features_s *features, FeatureCursor_s *cur, const char *chr, int pos);
+void freeFeatures(Features_s *features);
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+ Population summaries shared by poly_sfs, poly_fst, poly_sv and poly_query. See vcf_pop.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "vcf_pop.h"
+#define merror "\nERROR: System out of memory\n\n"
+
+void setOffsets(long int *off, const double *hap_n, const int *pairs, int pop_n, int pair_n, long int n) {
+    int i;
+    for(i = 0; i < pop_n; i++)
+        off[i + 1] = off[i] + (n > 0 ? n : (long int)hap_n[i]) + 1;
+    for(i = 0; i < pair_n; i++)
+        off[pop_n + i + 1] = off[pop_n + i] + (n > 0 ? (n + 1) * (n + 1) : ((long int)hap_n[pairs[i * 2]] + 1) * ((long int)hap_n[pairs[i * 2 + 1]] + 1));
+}
+
+double countHaps(Bgzf_s *vcf_file, Chunk_s *chunks, int chunk_n, Sites_s *sites, const char *use, const int *pop_l, int sample_n, double *hap_n) {
+    int i;
+    double tot = 0;
+    char *line = NULL;
+    Record_s rec = {0};
+    SiteCursor_s site_c = {0};
+    Geno_s *g = NULL;
+    Chunk_s chunk = chunks[0];
+    size_t len = 0;
+    ssize_t read;
+
+    chunk.in = vcf_file;
+    chunk.pos = chunk.start;
+    chunk.end = chunks[chunk_n - 1].end;
+    if(vcf_file != NULL)
+        seekBgzf(vcf_file, chunk.start);
+    while((read = readSite(&chunk, &line, &len, &rec)) != -1) {
+        if(read == 0)
+            continue;
+        if(sites != NULL && findSite(sites, &site_c, rec.chr, rec.pos) == 0)
+            continue;
+        parseGenos(&rec, use, sample_n);
+        for(i = 0; i < rec.ind_n; i++) {
+            if(use != NULL && (i >= sample_n || use[i] == 0))
+                continue;
+            g = &rec.geno[i];
+            if(g->ploidy == 0) {
+                fprintf(stderr, "\nERROR: Allowed ploidy-levels are 2, 4, 6, and 8!\n\n");
+                exit(EXIT_FAILURE);
+            }
+            hap_n[pop_l != NULL ? pop_l[i] - 1 : 0] += g->ploidy;
+            tot += g->ploidy;
+        }
+        break;
+    }
+
+    freeRecord(&rec);
+    free(line);
+
+    return tot;
+}
+
+/* The bins are site counts, except for the fractional counts of -project */
+void printSfs(FILE *out_file, const double *sfs, long int n, int frac) {
+    long int i;
+    for(i = 0; i < n; i++) {
+        if(i < n - 1)
+            fprintf(out_file, frac ? "%f," : "%.0f,", sfs[i]);
+        else
+            fprintf(out_file, frac ? "%f\n" : "%.0f\n", sfs[i]);
+    }
+}
+
+void printMatrix(FILE *out_file, const char *name, char **names, const Sum_s *sum, int pop_n, int stat) {
+    int i;
+    double *vals = NULL;
+
+    if((vals = malloc(pop_n * (pop_n - 1) / 2 * sizeof(double))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < pop_n * (pop_n - 1) / 2; i++)
+        vals[i] = stat == 1 ? sum[i].hb / sum[i].n : sum[i].hw / sum[i].hb;
+    printValues(out_file, name, names, vals, pop_n);
+    free(vals);
+}
+
+void printValues(FILE *out_file, const char *name, char **names, const double *vals, int pop_n) {
+    int i, j, a, b;
+
+    fprintf(out_file, "%s", name);
+    for(i = 0; i < pop_n; i++)
+        fprintf(out_file, "\t%s", names[i]);
+    fprintf(out_file, "\n");
+    for(i = 0; i < pop_n; i++) {
+        fprintf(out_file, "%s", names[i]);
+        for(j = 0; j < pop_n; j++) {
+            if(i == j) {
+                fprintf(out_file, "\tNA");
+                continue;
+            }
+            a = i < j ? i : j;
+            b = i < j ? j : i;
+            fprintf(out_file, "\t%f", vals[a * (2 * pop_n - a - 1) / 2 + b - a - 1]);
+        }
+        fprintf(out_file, "\n");
+    }
+}
@@ -0,0 +1,45 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+ Population summaries shared by poly_sfs, poly_fst, poly_sv and poly_query.
+
+ Histograms of all spectra share one array: setOffsets gives the offset of the 1D SFS of each population, followed by
+ the joint SFS of each pair, with n haplotypes in every spectrum when n > 0 (-project of poly_sfs). When a VCF file is
+ read in several chunks, countHaps reads the haplotype numbers of the populations from the first site before the
+ threads start. pop_l gives the population of each sample counting from 1, or is NULL when all samples belong to one.
+ printSfs prints one spectrum as comma separated bins. printMatrix prints Fst (sum(hw) / sum(hb)) or Dxy
+ (sum(hb) / sites) between all pairs of populations as a symmetric matrix, and printValues any other per-pair values,
+ with the pairs in the order (0,1), (0,2), ..., (1,2), ...
+*/
+
+#ifndef VCF_POP_H
+#define VCF_POP_H
+
+#include <stdio.h>
+#include "vcf_parse.h"
+#include "vcf_thread.h"
+
+typedef struct {
+    double hw, hb, n;
+} Sum_s;
+
+void setOffsets(long int *off, const double *hap_n, const int *pairs, int pop_n, int pair_n, long int n);
+double countHaps(Bgzf_s *vcf_file, Chunk_s *chunks, int chunk_n, Sites_s *sites, const char *use, const int *pop_l, int sample_n, double *hap_n);
+void printSfs(FILE *out_file, const double *sfs, long int n, int frac);
+void printMatrix(FILE *out_file, const char *name, char **names, const Sum_s *sum, int pop_n, int stat);
+void printValues(FILE *out_file, const char *name, char **names, const double *vals, int pop_n);
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+ Counter-based random numbers for the imputation of poly_sfs, poly_sv and poly_query. See vcf_rand.h.
+*/
+
+#include <math.h>
+#include "vcf_rand.h"
+
+/* FNV-1a hash of the chromosome, keyed on the seed, with the position in the upper half */
+unsigned long int siteKey(long int seed, const char *chr, int pos) {
+    unsigned long int h = 14695981039346656037UL ^ (unsigned long int)seed;
+    while(*chr != '\0') {
+        h ^= (unsigned char)*chr++;
+        h *= 1099511628211UL;
+    }
+    return h ^ ((unsigned long int)pos << 32);
+}
+
+double drawUniform(unsigned long int key, int k) {
+    unsigned long int z = key + (unsigned long int)(k + 1) * 0x9E3779B97F4A7C15UL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+    z ^= z >> 31;
+    return (double)(z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Binomial draw by inversion of a single uniform number. The outcomes are visited outwards from the mode, whose probability
+   comes from lgamma, so the search takes O(sqrt(npq)) steps and does not underflow with large numbers of trials */
+int drawBinom(int n, double p, double u) {
+    int m = 0, lo = 0, hi = 0;
+    double r = p / (1 - p), f = 0, f_lo = 0, f_hi = 0, sum = 0;
+
+    if(n <= 0 || p <= 0)
+        return 0;
+    if(p >= 1)
+        return n;
+    m = (int)((n + 1) * p);
+    if(m > n)
+        m = n;
+    f = exp(lgamma(n + 1) - lgamma(m + 1) - lgamma(n - m + 1) + m * log(p) + (n - m) * log(1 - p));
+    sum = f_lo = f_hi = f;
+    lo = hi = m;
+    if(u < sum)
+        return m;
+    while(lo > 0 || hi < n) {
+        if(hi < n) {
+            f_hi *= (double)(n - hi) / (hi + 1) * r;
+            hi++;
+            if(u < (sum += f_hi))
+                return hi;
+        }
+        if(lo > 0) {
+            f_lo *= (double)lo / (n - lo + 1) / r;
+            lo--;
+            if(u < (sum += f_lo))
+                return lo;
+        }
+    }
+
+    return m;
+}
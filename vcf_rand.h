@@ -0,0 +1,32 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+ Counter-based random numbers for the imputation of missing haplotypes in poly_sfs, poly_sv and poly_query.
+
+ A hash of the seed, chromosome and position gives the key of each site (siteKey), and the k:th number of a site is the
+ splitmix64 finalizer of key + k (drawUniform). Any thread that reads the site draws the same numbers, without a shared
+ generator state, so the three programs impute the same alleles for the same seed. drawBinom turns one uniform number
+ into a binomial draw by inversion.
+*/
+
+#ifndef VCF_RAND_H
+#define VCF_RAND_H
+
+unsigned long int siteKey(long int seed, const char *chr, int pos);
+double drawUniform(unsigned long int key, int k);
+int drawBinom(int n, double p, double u);
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Partial state files (-state and -merge) used by poly_fst and poly_sfs. See vcf_state.h.
+
+ The sums are kept as doubles, which hold site counts exactly up to 2^53.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vcf_state.h"
+#define merror "\nERROR: System out of memory\n\n"
+
+static void readData(FILE *file, const char *name, void *data, size_t size, size_t n) {
+    if(n > 0 && fread(data, size, n, file) != n) {
+        fprintf(stderr, "\nERROR: %s is truncated\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void readState(const char *name, const char *tag, State_s *state) {
+    long int i, len = 0, counts[3];
+    char head[8];
+    FILE *file = NULL;
+
+    if((file = fopen(name, "rb")) == NULL) {
+        fprintf(stderr, "\nERROR: Cannot open file %s\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+    if(fread(head, 1, 8, file) != 8 || memcmp(head, tag, 8) != 0) {
+        fprintf(stderr, "\nERROR: %s is not a state file written with -state by this program\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+    readData(file, name, counts, sizeof(long int), 3);
+    if(counts[0] < 0 || counts[1] < 0 || counts[2] < 0) {
+        fprintf(stderr, "\nERROR: %s is not a state file written with -state by this program\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+    state->int_n = counts[0];
+    state->str_n = counts[1];
+    state->val_n = counts[2];
+    if((state->ints = malloc((state->int_n + 1) * sizeof(long int))) == NULL || (state->strs = calloc(state->str_n + 1, sizeof(char *))) == NULL || (state->vals = malloc((state->val_n + 1) * sizeof(double))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    readData(file, name, state->ints, sizeof(long int), state->int_n);
+    for(i = 0; i < state->str_n; i++) {
+        readData(file, name, &len, sizeof(long int), 1);
+        if(len < 0 || (state->strs[i] = malloc(len + 1)) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        readData(file, name, state->strs[i], 1, len);
+        state->strs[i][len] = '\0';
+    }
+    readData(file, name, state->vals, sizeof(double), state->val_n);
+    fclose(file);
+}
+
+static int sameState(const State_s *a, const State_s *b) {
+    long int i;
+    if(a->int_n != b->int_n || a->str_n != b->str_n || a->val_n != b->val_n)
+        return 0;
+    if(a->int_n > 0 && memcmp(a->ints, b->ints, a->int_n * sizeof(long int)) != 0)
+        return 0;
+    for(i = 0; i < a->str_n; i++) {
+        if(strcmp(a->strs[i], b->strs[i]) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+void writeState(const char *name, const char *tag, const State_s *state) {
+    long int i, len = 0, counts[3] = {state->int_n, state->str_n, state->val_n};
+    FILE *file = NULL;
+
+    if((file = fopen(name, "wb")) == NULL) {
+        fprintf(stderr, "\nERROR: Cannot create file '%s'\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+    fwrite(tag, 1, 8, file);
+    fwrite(counts, sizeof(long int), 3, file);
+    fwrite(state->ints, sizeof(long int), state->int_n, file);
+    for(i = 0; i < state->str_n; i++) {
+        len = strlen(state->strs[i]);
+        fwrite(&len, sizeof(long int), 1, file);
+        fwrite(state->strs[i], 1, len, file);
+    }
+    fwrite(state->vals, sizeof(double), state->val_n, file);
+    if(fclose(file) != 0) {
+        fprintf(stderr, "\nERROR: Cannot write file '%s'\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Reads the state files listed in list_file (one per line) and sums them into state. Returns the number of states that were summed */
+int readStates(FILE *list_file, const char *tag, State_s *state) {
+    int n = 0;
+    long int i;
+    char *line = NULL, *first = NULL;
+    State_s part = {0};
+    size_t len = 0;
+    ssize_t read;
+
+    memset(state, 0, sizeof(State_s));
+    while((read = getline(&line, &len, list_file)) != -1) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if(line[0] == '\0' || line[0] == '#')
+            continue;
+        readState(line, tag, &part);
+        if(part.val_n == 0) {
+            freeState(&part);
+            continue;
+        }
+        if(n == 0) {
+            *state = part;
+            memset(&part, 0, sizeof(State_s));
+            if((first = strdup(line)) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+        } else if(sameState(state, &part) == 0) {
+            fprintf(stderr, "\nERROR: %s and %s were written with different settings or input files\n\n", first, line);
+            exit(EXIT_FAILURE);
+        } else {
+            for(i = 0; i < state->val_n; i++)
+                state->vals[i] += part.vals[i];
+            freeState(&part);
+        }
+        n++;
+    }
+    fclose(list_file);
+    free(line);
+    free(first);
+
+    return n;
+}
+
+void freeState(State_s *state) {
+    long int i;
+    for(i = 0; state->strs != NULL && i < state->str_n; i++)
+        free(state->strs[i]);
+    free(state->ints);
+    free(state->strs);
+    free(state->vals);
+    memset(state, 0, sizeof(State_s));
+}
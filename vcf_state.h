@@ -0,0 +1,44 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Partial state files (-state and -merge) used by poly_fst and poly_sfs.
+
+ A run over a part of the genome writes its additive sums into a state file instead of the output, and -merge sums
+ the states of all parts and prints the output of the whole genome. A state holds the settings that the parts have to
+ share (ints) and the population and gene names (strs), which must be the same in every file, and the sums (vals),
+ which are added up. The file is an 8 byte program tag followed by the three counts and the arrays, in native byte
+ order. readStates skips a state without vals. Only poly_sfs writes one, for a part without any sites, whose haplotype
+ numbers are unknown. poly_fst always writes its vals, so an empty part is merged as sums of zero.
+*/
+
+#ifndef VCF_STATE_H
+#define VCF_STATE_H
+
+#include <stdio.h>
+
+typedef struct {
+    long int int_n, str_n, val_n;
+    long int *ints;
+    char **strs;
+    double *vals;
+} State_s;
+
+void writeState(const char *name, const char *tag, const State_s *state);
+int readStates(FILE *list_file, const char *tag, State_s *state);
+void freeState(State_s *state);
+
+#endif
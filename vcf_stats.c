@@ -0,0 +1,77 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Run statistics (-stats) used by prune_ld and poly_freq. See vcf_stats.h.
+
+ The stage times are summed over the chunks, so with -threads they are thread-seconds and can exceed the wall-clock
+ time of the run. Process CPU time and peak memory come from getrusage.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "vcf_stats.h"
+
+void printStats(const char *name, const char *prog, const Stats_s *stats, int n, double start) {
+    int i, k;
+    const char *stages[STAT_N] = {"read", "parse", "sites", "filter", "ld", "output"};
+    Stats_s tot = {0};
+    struct rusage usage;
+    FILE *out_file = NULL;
+
+    for(i = 0; i < n; i++) {
+        tot.cpu += stats[i].cpu;
+        for(k = 0; k < STAT_N; k++)
+            tot.wall[k] += stats[i].wall[k];
+        tot.site_n += stats[i].site_n;
+        tot.byte_n += stats[i].byte_n;
+        tot.drop_sites += stats[i].drop_sites;
+        tot.drop_mis += stats[i].drop_mis;
+        tot.drop_maf += stats[i].drop_maf;
+        tot.pass_n += stats[i].pass_n;
+        tot.kept_n += stats[i].kept_n;
+        tot.r2_n += stats[i].r2_n;
+        tot.break_n += stats[i].break_n;
+        tot.bound_n += stats[i].bound_n;
+        tot.bound_skip += stats[i].bound_skip;
+        tot.dist_skip += stats[i].dist_skip;
+    }
+    getrusage(RUSAGE_SELF, &usage);
+    if(strcmp(name, "stderr") == 0)
+        out_file = stderr;
+    else if((out_file = fopen(name, "w")) == NULL) {
+        fprintf(stderr, "\nERROR: Cannot create file '%s'\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(out_file, "{\n  \"program\": \"%s\",\n", prog);
+    fprintf(out_file, "  \"wall_s\": %.6f,\n", clockStats(CLOCK_MONOTONIC) - start);
+    fprintf(out_file, "  \"cpu_user_s\": %.6f,\n", usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6);
+    fprintf(out_file, "  \"cpu_sys_s\": %.6f,\n", usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6);
+    fprintf(out_file, "  \"chunk_cpu_s\": %.6f,\n", tot.cpu);
+    fprintf(out_file, "  \"peak_rss_kb\": %ld,\n", usage.ru_maxrss);
+    fprintf(out_file, "  \"stages_s\": {");
+    for(k = 0; k < STAT_N; k++)
+        fprintf(out_file, "%s\"%s\": %.6f", k > 0 ? ", " : "", stages[k], tot.wall[k]);
+    fprintf(out_file, "},\n");
+    fprintf(out_file, "  \"sites\": {\"read\": %ld, \"bytes\": %ld, \"dropped_sites\": %ld, \"dropped_missing\": %ld, \"dropped_maf\": %ld, \"dropped_r2\": %ld, \"kept\": %ld},\n", tot.site_n, tot.byte_n, tot.drop_sites, tot.drop_mis, tot.drop_maf, tot.pass_n - tot.kept_n, tot.kept_n);
+    fprintf(out_file, "  \"ld\": {\"estR2\": %ld, \"breaks\": %ld, \"bound_checks\": %ld, \"bound_skips\": %ld, \"distance_skips\": %ld}\n}\n", tot.r2_n, tot.break_n, tot.bound_n, tot.bound_skip, tot.dist_skip);
+    if(out_file != stderr && fclose(out_file) != 0) {
+        fprintf(stderr, "\nERROR: Cannot write file '%s'\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+}
@@ -0,0 +1,75 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Run statistics (-stats) used by prune_ld and poly_freq.
+
+ Each chunk has its own Stats_s, so the counters need no locking. lapStats adds the time since the previous lap to
+ the given stage, so every stretch of a chunk is counted in exactly one stage and a lap costs one clock read. With a
+ NULL Stats_s, the functions return without reading the clock. runChunks starts and stops the clocks of the chunks,
+ and readSite records the time spent reading and parsing lines. The bytes read are those of the decompressed VCF
+ lines, so BCF and -cache input report none. printStats sums the chunks and writes the JSON report.
+*/
+
+#ifndef VCF_STATS_H
+#define VCF_STATS_H
+
+#include <time.h>
+#define STAT_READ 0
+#define STAT_PARSE 1
+#define STAT_SITES 2
+#define STAT_FILTER 3
+#define STAT_LD 4
+#define STAT_OUT 5
+#define STAT_N 6
+
+typedef struct {
+    double mark, cpu, wall[STAT_N];
+    long int site_n, byte_n, drop_sites, drop_mis, drop_maf, pass_n, kept_n;
+    long int r2_n, break_n, bound_n, bound_skip, dist_skip;
+} Stats_s;
+
+static inline double clockStats(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline void startStats(Stats_s *st) {
+    if(st == NULL)
+        return;
+    st->cpu -= clockStats(CLOCK_THREAD_CPUTIME_ID);
+    st->mark = clockStats(CLOCK_MONOTONIC);
+}
+
+static inline void lapStats(Stats_s *st, int stage) {
+    double t = 0;
+    if(st == NULL)
+        return;
+    t = clockStats(CLOCK_MONOTONIC);
+    st->wall[stage] += t - st->mark;
+    st->mark = t;
+}
+
+static inline void stopStats(Stats_s *st) {
+    if(st == NULL)
+        return;
+    st->cpu += clockStats(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void printStats(const char *name, const char *prog, const Stats_s *stats, int n, double start);
+
+#endif
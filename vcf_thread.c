@@ -0,0 +1,754 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Multithreaded processing of VCF files used by prune_ld, poly_freq, poly_fst and poly_sfs. See vcf_thread.h.
+
+ Chunk boundaries are first placed at even byte offsets and moved to the next line start. With contig set, each
+ boundary is then moved back to the first line of its chromosome with a binary search over byte offsets, so
+ only a few lines are read per boundary. In BGZF files the searches run over compressed offsets, where each
+ offset stands for the first line after the next block start, so the search ends with a scan of one block. Chunks are handed out largest first to balance
+ the threads. A single chunk is read on the calling thread, with the BGZF blocks inflated on the pool instead.
+ Cache chunks are placed at even site indexes, and with contig set, moved back to the first site of the contig run.
+ The pipeline passes batches of PIPE_LINES lines through a ring of slots, which are filled by the reader in input
+ order, parsed by whichever parser thread is free, and emptied by readSite in input order. A slot is only refilled
+ after readSite has moved past it, so the lines of a batch stay valid while the program uses them.
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vcf_thread.h"
+#define merror "\nERROR: System out of memory\n\n"
+#define PIPE_LINES 64
+
+typedef struct {
+    int next, chunk_n, *order;
+    const char *vcf_name;
+    Chunk_s *chunks;
+    FILE **out;
+    void (*work)(Chunk_s *chunk, void *arg);
+    void *arg;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} Pool_s;
+
+typedef struct {
+    int thread;
+    Pool_s *pool;
+} Worker_s;
+
+typedef struct {
+    int site;
+    char *line;
+    size_t len;
+    ssize_t read;
+    Record_s rec;
+} PipeLine_s;
+
+typedef struct {
+    int state, n;
+    PipeLine_s *lines;
+} Batch_s;
+
+typedef struct {
+    int thread_n, slot_n, line_i, decode, use_n;
+    long int fill, parse, take, end;
+    const char *use;
+    Chunk_s *chunk;
+    Batch_s *slots;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} Pipe_s;
+
+static long int findData(Bgzf_s *vcf_file) {
+    long int off = tellBgzf(vcf_file);
+    char *line = NULL;
+    size_t len = 0;
+
+    while(getBgzfLine(vcf_file, &line, &len) != -1) {
+        if(line[0] != '#')
+            break;
+        off = tellBgzf(vcf_file);
+    }
+    free(line);
+
+    return off;
+}
+
+static void lineChr(Bgzf_s *vcf_file, long int off, char *chr) {
+    int i = 0;
+    char c = '\0';
+    seekBgzf(vcf_file, off);
+    while(i < 99 && readBgzf(vcf_file, &c, 1) == 1 && c != '\t' && c != '\n')
+        chr[i++] = c;
+    chr[i] = '\0';
+}
+
+static int atChr(Bgzf_s *vcf_file, long int coord, const char *chr, long int *off) {
+    char temp[100];
+    if((*off = syncBgzf(vcf_file, coord)) < 0)
+        return 1;
+    lineChr(vcf_file, *off, temp);
+    return strcmp(temp, chr) == 0;
+}
+
+static long int firstLine(Bgzf_s *vcf_file, long int off, const char *chr) {
+    size_t k = strlen(chr), len = 0;
+    char *line = NULL;
+
+    if(off < 0 || seekBgzf(vcf_file, off) != 0)
+        return -1;
+    while(getBgzfLine(vcf_file, &line, &len) != -1) {
+        if(strncmp(line, chr, k) == 0 && line[k] == '\t')
+            break;
+        off = tellBgzf(vcf_file);
+    }
+    free(line);
+
+    return off;
+}
+
+static int cmpSize(const void *a, const void *b) {
+    const long int *x = a, *y = b;
+    if(x[0] != y[0])
+        return x[0] < y[0] ? 1 : -1;
+    return (x[1] > y[1]) - (x[1] < y[1]);
+}
+
+int parseRegion(const char *str, Region_s *region) {
+    int k = 0;
+    char *end = NULL, num[100];
+    const char *sep = strrchr(str, ':');
+
+    region->beg = 1;
+    region->end = 1L << 40;
+    if(sep == NULL)
+        sep = str + strlen(str);
+    if(sep == str || sep - str > 99)
+        return 0;
+    memcpy(region->chr, str, sep - str);
+    region->chr[sep - str] = '\0';
+    if(*sep == '\0')
+        return 1;
+    for(sep++; *sep != '\0' && k < 99; sep++) {
+        if(*sep != ',')
+            num[k++] = *sep;
+    }
+    num[k] = '\0';
+    region->beg = strtol(num, &end, 10);
+    if(*end == '-' && end[1] != '\0')
+        region->end = strtol(end + 1, &end, 10);
+    else if(*end == '-')
+        end++;
+    if(end == num || *end != '\0' || region->beg < 1 || region->end < region->beg)
+        return 0;
+
+    return 1;
+}
+
+static Chunk_s *splitBcf(Bgzf_s *vcf_file, Bcf_s *bcf, const char *vcf_name, const Region_s *region, Chunk_s *chunks, int *n) {
+    int found = -1;
+    long int first = 0, last = 0;
+
+    *n = 2;
+    chunks[0].end = bcf->text_n;
+    chunks[1].start = tellBgzf(vcf_file);
+    chunks[1].end = -1;
+    chunks[1].last = 1;
+    chunks[1].idx = 1;
+    if(region != NULL && findContig(bcf, region->chr) < 0)
+        chunks[1].end = chunks[1].start;
+    else if(region != NULL && (found = queryIndex(vcf_name, region->chr, findContig(bcf, region->chr), region->beg - 1, region->end, &first, &last)) == -1)
+        fprintf(stderr, "Warning: No .csi index for %s, reading the whole file for -region\n\n", vcf_name);
+    if(found == 0)
+        chunks[1].end = chunks[1].start;
+    else if(found == 1) {
+        if(first > chunks[1].start)
+            chunks[1].start = first;
+        chunks[1].end = last;
+    }
+    chunks[0].bcf = chunks[1].bcf = bcf;
+    chunks[1].region = region;
+
+    return chunks;
+}
+
+Chunk_s *splitVcf(Bgzf_s *vcf_file, const char *vcf_name, const Region_s *region, int thread_n, int contig, int *n) {
+    int i, part_n = thread_n > 1 ? thread_n * 4 : 1, found = -1, shift = isBgzf(vcf_file) ? 16 : 0;
+    long int pos = 0, head = 0, data = 0, size = 0, first = 0, last = 0, off = 0, lo = 0, hi = 0, mid = 0, prev = 0, target = 0;
+    char chr[100], temp[100];
+    Chunk_s *chunks = NULL;
+    Bcf_s *bcf = NULL;
+
+    if((chunks = calloc(part_n + 2, sizeof(Chunk_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    if((bcf = openBcf(vcf_file)) != NULL)
+        return splitBcf(vcf_file, bcf, vcf_name, region, chunks, n);
+    *n = 1;
+    chunks[0].end = -1;
+    chunks[0].last = 1;
+    chunks[0].pipe_n = thread_n;
+    chunks[0].region = region;
+    if(region != NULL && isBgzf(vcf_file))
+        found = queryIndex(vcf_name, region->chr, -1, region->beg - 1, region->end, &first, &last);
+    if(region != NULL && found == -1)
+        fprintf(stderr, "Warning: No .tbi or .csi index for %s, reading the whole file for -region\n\n", vcf_name);
+    if(part_n == 1 && found == -1)
+        return chunks;
+    if((size = sizeBgzf(vcf_file)) < 0 || (pos = tellBgzf(vcf_file)) < 0) {
+        fprintf(stderr, "Warning: The VCF file cannot be split for -threads, parsing its lines on the threads instead\n\n");
+        return chunks;
+    }
+    head = data = findData(vcf_file);
+    if(found == 0)
+        size = data;
+    else if(found == 1) {
+        if(first > data)
+            data = first;
+        size = last;
+    }
+    if(data < 0 || data >= size) {
+        if(found == 0)
+            chunks[0].end = head;
+        seekBgzf(vcf_file, pos);
+        return chunks;
+    }
+    prev = data;
+    for(i = 1; i < part_n; i++) {
+        target = (data >> shift) + ((size >> shift) - (data >> shift)) / part_n * i;
+        off = syncBgzf(vcf_file, target);
+        if(off < 0 || off >= size || off <= prev)
+            continue;
+        if(contig) {
+            lineChr(vcf_file, off, chr);
+            lineChr(vcf_file, prev, temp);
+            if(strcmp(chr, temp) == 0)
+                continue;
+            lo = prev >> shift;
+            hi = target;
+            if(atChr(vcf_file, lo, chr, &off) == 0) {
+                while(hi - lo > 1) {
+                    mid = lo + (hi - lo) / 2;
+                    if(atChr(vcf_file, mid, chr, &off))
+                        hi = mid;
+                    else
+                        lo = mid;
+                }
+            }
+            off = firstLine(vcf_file, syncBgzf(vcf_file, lo), chr);
+            if(off <= prev || off >= size)
+                continue;
+        }
+        chunks[*n].start = prev;
+        chunks[*n].end = off;
+        chunks[*n].region = region;
+        *n = *n + 1;
+        prev = off;
+    }
+    chunks[*n].start = prev;
+    chunks[*n].end = size;
+    chunks[*n].last = 1;
+    chunks[*n].region = region;
+    *n = *n + 1;
+    chunks[0].end = head;
+    chunks[0].last = 0;
+    chunks[0].pipe_n = 0;
+    if(*n == 2)
+        chunks[1].pipe_n = thread_n;
+    for(i = 0; i < *n; i++)
+        chunks[i].idx = i;
+    seekBgzf(vcf_file, pos);
+
+    return chunks;
+}
+
+static long int findPos(const CacheSite_s *sites, long int lo, long int hi, long int pos) {
+    long int mid = 0;
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if(sites[mid].pos < pos)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+Chunk_s *splitCache(const Cache_s *cache, const Region_s *region, int thread_n, int contig, int *n) {
+    int i, part_n = thread_n > 1 ? thread_n * 4 : 1;
+    long int lo = 0, hi = cache->head->site_n, off = 0, prev = 0;
+    Chunk_s *chunks = NULL;
+
+    if((chunks = calloc(part_n + 1, sizeof(Chunk_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    chunks[0].end = cache->head->text_n;
+    if(region != NULL) {
+        lo = hi = 0;
+        for(i = 0; i < cache->head->contig_n; i++) {
+            if(strcmp(cache->strings + cache->contigs[i].name, region->chr) == 0) {
+                lo = cache->contigs[i].first;
+                hi = findPos(cache->sites, lo, lo + cache->contigs[i].n, region->end + 1);
+                lo = findPos(cache->sites, lo, hi, region->beg);
+                break;
+            }
+        }
+    }
+    *n = 1;
+    prev = lo;
+    for(i = 1; i < part_n; i++) {
+        off = lo + (hi - lo) / part_n * i;
+        if(contig && off < hi)
+            off = cache->contigs[cache->sites[off].contig].first;
+        if(off <= prev || off >= hi)
+            continue;
+        chunks[*n].start = prev;
+        chunks[*n].end = off;
+        *n = *n + 1;
+        prev = off;
+    }
+    chunks[*n].start = prev;
+    chunks[*n].end = hi;
+    chunks[*n].last = 1;
+    *n = *n + 1;
+    for(i = 0; i < *n; i++) {
+        chunks[i].idx = i;
+        chunks[i].region = region;
+        chunks[i].cache = cache;
+    }
+
+    return chunks;
+}
+
+static void copyFile(FILE *from, FILE *to) {
+    size_t k;
+    char buf[65536];
+
+    rewind(from);
+    while((k = fread(buf, 1, sizeof(buf), from)) > 0)
+        fwrite(buf, 1, k, to);
+    fclose(from);
+}
+
+static void *runWorker(void *arg) {
+    int i, k;
+    Worker_s *worker = arg;
+    Pool_s *pool = worker->pool;
+    Chunk_s *chunk = NULL;
+    Bgzf_s *in = NULL;
+
+    if(pool->vcf_name != NULL && (in = openBgzf(pool->vcf_name)) == NULL) {
+        fprintf(stderr, "\nERROR: Cannot open file %s\n\n", pool->vcf_name);
+        exit(EXIT_FAILURE);
+    }
+    while(1) {
+        pthread_mutex_lock(&pool->lock);
+        i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        if(i >= pool->chunk_n)
+            break;
+        chunk = &pool->chunks[pool->order[i]];
+        chunk->thread = worker->thread;
+        chunk->in = in;
+        chunk->pos = chunk->start;
+        if(in != NULL)
+            seekBgzf(in, chunk->start);
+        for(k = 0; k < 2; k++) {
+            if(pool->out[k] != NULL && (chunk->out[k] = tmpfile()) == NULL) {
+                fprintf(stderr, "\nERROR: Cannot create temporary files\n\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        startStats(chunk->stats);
+        pool->work(chunk, pool->arg);
+        stopStats(chunk->stats);
+        pthread_mutex_lock(&pool->lock);
+        chunk->done = 1;
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    if(in != NULL)
+        closeBgzf(in);
+
+    return NULL;
+}
+
+void runChunks(Chunk_s *chunks, int chunk_n, int thread_n, const char *vcf_name, Bgzf_s *vcf_file, FILE *out[2], void (*work)(Chunk_s *chunk, void *arg), void *arg) {
+    int i, k;
+    long int *size = NULL;
+    pthread_t *threads = NULL;
+    Worker_s *workers = NULL;
+    Pool_s pool = {0};
+
+    if(chunk_n < 1)
+        return;
+    if(thread_n < 2 || chunk_n == 1) {
+        if(vcf_file != NULL)
+            threadBgzf(vcf_file, thread_n > chunks[0].pipe_n ? thread_n : chunks[0].pipe_n);
+        for(i = 0; i < chunk_n; i++) {
+            chunks[i].in = vcf_file;
+            chunks[i].pos = chunks[i].start;
+            if(chunks[i].start > 0 && vcf_file != NULL)
+                seekBgzf(vcf_file, chunks[i].start);
+            for(k = 0; k < 2; k++)
+                chunks[i].out[k] = out[k];
+            startStats(chunks[i].stats);
+            work(&chunks[i], arg);
+            stopStats(chunks[i].stats);
+            chunks[i].done = 1;
+        }
+        return;
+    }
+    if(thread_n > chunk_n)
+        thread_n = chunk_n;
+    if((size = malloc(chunk_n * 2 * sizeof(long int))) == NULL || (pool.order = malloc(chunk_n * sizeof(int))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    if((threads = malloc(thread_n * sizeof(pthread_t))) == NULL || (workers = malloc(thread_n * sizeof(Worker_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < chunk_n; i++) {
+        size[i * 2] = chunks[i].end - chunks[i].start;
+        size[i * 2 + 1] = i;
+    }
+    qsort(size, chunk_n, 2 * sizeof(long int), cmpSize);
+    for(i = 0; i < chunk_n; i++)
+        pool.order[i] = size[i * 2 + 1];
+    pool.chunk_n = chunk_n;
+    pool.vcf_name = vcf_name;
+    pool.chunks = chunks;
+    pool.out = out;
+    pool.work = work;
+    pool.arg = arg;
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.cond, NULL);
+    for(i = 0; i < thread_n; i++) {
+        workers[i].thread = i;
+        workers[i].pool = &pool;
+        if(pthread_create(&threads[i], NULL, runWorker, &workers[i]) != 0) {
+            fprintf(stderr, "\nERROR: Cannot create threads\n\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for(i = 0; i < chunk_n; i++) {
+        pthread_mutex_lock(&pool.lock);
+        while(chunks[i].done == 0)
+            pthread_cond_wait(&pool.cond, &pool.lock);
+        pthread_mutex_unlock(&pool.lock);
+        for(k = 0; k < 2; k++) {
+            if(out[k] != NULL)
+                copyFile(chunks[i].out[k], out[k]);
+        }
+    }
+    for(i = 0; i < thread_n; i++)
+        pthread_join(threads[i], NULL);
+
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.cond);
+    free(size);
+    free(pool.order);
+    free(threads);
+    free(workers);
+}
+
+static int inRegion(const char *line, const Region_s *region) {
+    long int pos = 0;
+    size_t k = strlen(region->chr);
+
+    if(strncmp(line, region->chr, k) != 0 || line[k] != '\t')
+        return 0;
+    pos = atol(line + k + 1);
+
+    return pos >= region->beg && pos <= region->end;
+}
+
+ssize_t readLine(Chunk_s *chunk, char **line, size_t *len) {
+    ssize_t read;
+
+    while(chunk->end < 0 || chunk->pos < chunk->end) {
+        if((read = getBgzfLine(chunk->in, line, len)) == -1)
+            return -1;
+        chunk->pos = tellBgzf(chunk->in);
+        if(chunk->region == NULL || (*line)[0] == '#' || inRegion(*line, chunk->region))
+            return read;
+    }
+
+    return -1;
+}
+
+static void *readPipe(void *arg) {
+    int i, done = 0;
+    Pipe_s *pipe = arg;
+    Batch_s *batch = NULL;
+
+    while(done == 0) {
+        pthread_mutex_lock(&pipe->lock);
+        batch = &pipe->slots[pipe->fill % pipe->slot_n];
+        while(batch->state != 0)
+            pthread_cond_wait(&pipe->cond, &pipe->lock);
+        pthread_mutex_unlock(&pipe->lock);
+        for(i = 0; i < PIPE_LINES; i++) {
+            if((batch->lines[i].read = readLine(pipe->chunk, &batch->lines[i].line, &batch->lines[i].len)) == -1) {
+                done = 1;
+                break;
+            }
+        }
+        pthread_mutex_lock(&pipe->lock);
+        batch->n = i;
+        batch->state = 1;
+        pipe->fill++;
+        if(done)
+            pipe->end = pipe->fill;
+        pthread_cond_broadcast(&pipe->cond);
+        pthread_mutex_unlock(&pipe->lock);
+    }
+
+    return NULL;
+}
+
+static void *parsePipe(void *arg) {
+    int i;
+    long int k;
+    Pipe_s *pipe = arg;
+    PipeLine_s *l = NULL;
+    Batch_s *batch = NULL;
+
+    while(1) {
+        pthread_mutex_lock(&pipe->lock);
+        while(pipe->parse == pipe->fill && pipe->end < 0)
+            pthread_cond_wait(&pipe->cond, &pipe->lock);
+        if(pipe->parse == pipe->fill) {
+            pthread_mutex_unlock(&pipe->lock);
+            break;
+        }
+        k = pipe->parse++;
+        pthread_mutex_unlock(&pipe->lock);
+        batch = &pipe->slots[k % pipe->slot_n];
+        for(i = 0; i < batch->n; i++) {
+            l = &batch->lines[i];
+            if(l->line[0] == '\n')
+                l->site = -1;
+            else if(l->line[0] == '#')
+                l->site = 0;
+            else if(parseSite(l->line, &l->rec) == 0)
+                l->site = -1;
+            else {
+                l->site = 1;
+                if(pipe->decode)
+                    readyGenos(&l->rec, pipe->use, pipe->use_n);
+            }
+        }
+        pthread_mutex_lock(&pipe->lock);
+        batch->state = 2;
+        pthread_cond_broadcast(&pipe->cond);
+        pthread_mutex_unlock(&pipe->lock);
+    }
+
+    return NULL;
+}
+
+static void startPipe(Chunk_s *chunk, const Record_s *rec) {
+    int i;
+    Pipe_s *pipe = NULL;
+
+    if((pipe = calloc(1, sizeof(Pipe_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    pipe->thread_n = chunk->pipe_n;
+    pipe->slot_n = pipe->thread_n * 2 + 2;
+    pipe->end = -1;
+    pipe->chunk = chunk;
+    pipe->decode = rec->field == 0;
+    pipe->use = rec->use;
+    pipe->use_n = rec->use_n;
+    if((pipe->slots = calloc(pipe->slot_n, sizeof(Batch_s))) == NULL || (pipe->threads = malloc(pipe->thread_n * sizeof(pthread_t))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < pipe->slot_n; i++) {
+        if((pipe->slots[i].lines = calloc(PIPE_LINES, sizeof(PipeLine_s))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+    }
+    pthread_mutex_init(&pipe->lock, NULL);
+    pthread_cond_init(&pipe->cond, NULL);
+    for(i = 0; i < pipe->thread_n; i++) {
+        if(pthread_create(&pipe->threads[i], NULL, i == 0 ? readPipe : parsePipe, pipe) != 0) {
+            fprintf(stderr, "\nERROR: Cannot create threads\n\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    chunk->pipe = pipe;
+}
+
+static void stopPipe(Chunk_s *chunk) {
+    int i, j;
+    Pipe_s *pipe = chunk->pipe;
+
+    for(i = 0; i < pipe->thread_n; i++)
+        pthread_join(pipe->threads[i], NULL);
+    for(i = 0; i < pipe->slot_n; i++) {
+        for(j = 0; j < PIPE_LINES; j++) {
+            free(pipe->slots[i].lines[j].line);
+            freeRecord(&pipe->slots[i].lines[j].rec);
+        }
+        free(pipe->slots[i].lines);
+    }
+    pthread_mutex_destroy(&pipe->lock);
+    pthread_cond_destroy(&pipe->cond);
+    free(pipe->slots);
+    free(pipe->threads);
+    free(pipe);
+    chunk->pipe = NULL;
+    chunk->pipe_n = 0;
+}
+
+/* The line buffer and the genotype array of the program are swapped with those of the pipeline, so no line is copied */
+static int takePipe(Chunk_s *chunk, char **line, size_t *len, Record_s *rec) {
+    int max;
+    char *temp = NULL;
+    size_t size;
+    Pipe_s *pipe = chunk->pipe;
+    Batch_s *batch = NULL;
+    PipeLine_s *l = NULL;
+    Geno_s *geno = NULL;
+    Stats_s *st = chunk->stats;
+
+    while(1) {
+        batch = &pipe->slots[pipe->take % pipe->slot_n];
+        if(pipe->line_i == 0) {
+            pthread_mutex_lock(&pipe->lock);
+            while(batch->state != 2 && pipe->take != pipe->end)
+                pthread_cond_wait(&pipe->cond, &pipe->lock);
+            pthread_mutex_unlock(&pipe->lock);
+            if(batch->state != 2) {
+                stopPipe(chunk);
+                return -1;
+            }
+        }
+        if(pipe->line_i == batch->n) {
+            pthread_mutex_lock(&pipe->lock);
+            batch->state = 0;
+            pipe->take++;
+            pipe->line_i = 0;
+            pthread_cond_broadcast(&pipe->cond);
+            pthread_mutex_unlock(&pipe->lock);
+            continue;
+        }
+        l = &batch->lines[pipe->line_i++];
+        lapStats(st, STAT_READ);
+        if(st != NULL)
+            st->byte_n += l->read;
+        if(l->site == -1)
+            continue;
+        temp = *line;
+        size = *len;
+        *line = l->line;
+        *len = l->len;
+        l->line = temp;
+        l->len = size;
+        if(l->site == 0)
+            return 0;
+        geno = rec->geno;
+        max = rec->ind_max;
+        rec->geno = l->rec.geno;
+        rec->ind_max = l->rec.ind_max;
+        l->rec.geno = geno;
+        l->rec.ind_max = max;
+        rec->pos = l->rec.pos;
+        rec->ind_n = l->rec.ind_n;
+        rec->chr = l->rec.chr;
+        rec->id = l->rec.id;
+        rec->ref = l->rec.ref;
+        rec->alt = l->rec.alt;
+        rec->format = l->rec.format;
+        rec->data = l->rec.data;
+        rec->pack = NULL;
+        rec->ready = l->rec.ready;
+        rec->use = l->rec.use;
+        rec->use_n = l->rec.use_n;
+        if(st != NULL)
+            st->site_n++;
+        return 1;
+    }
+}
+
+int readSite(Chunk_s *chunk, char **line, size_t *len, Record_s *rec) {
+    int k;
+    ssize_t read;
+    Stats_s *st = chunk->stats;
+
+    if(chunk->cache != NULL) {
+        k = readCache(chunk->cache, chunk->idx == 0, &chunk->pos, chunk->end, line, len, rec);
+        lapStats(st, STAT_READ);
+        if(st != NULL && k == 1)
+            st->site_n++;
+        return k;
+    }
+    if(chunk->bcf != NULL && chunk->idx == 0)
+        return readBcfHead(chunk->bcf, &chunk->pos, chunk->end, line, len);
+    while(chunk->bcf != NULL && (chunk->end < 0 || chunk->pos < chunk->end)) {
+        if(readBcf(chunk->in, chunk->bcf, line, len, rec) == -1)
+            return -1;
+        chunk->pos = tellBgzf(chunk->in);
+        lapStats(st, STAT_READ);
+        if(chunk->region == NULL || (strcmp(rec->chr, chunk->region->chr) == 0 && rec->pos >= chunk->region->beg && rec->pos <= chunk->region->end)) {
+            if(st != NULL)
+                st->site_n++;
+            return 1;
+        }
+    }
+    if(chunk->bcf != NULL)
+        return -1;
+    if(chunk->pipe == NULL && chunk->pipe_n > 1 && rec->decoded)
+        startPipe(chunk, rec);
+    if(chunk->pipe != NULL)
+        return takePipe(chunk, line, len, rec);
+    while((read = readLine(chunk, line, len)) != -1) {
+        lapStats(st, STAT_READ);
+        if(st != NULL)
+            st->byte_n += read;
+        if((*line)[0] == '\n')
+            continue;
+        if((*line)[0] == '#')
+            return 0;
+        k = parseSite(*line, rec);
+        lapStats(st, STAT_PARSE);
+        if(k) {
+            if(st != NULL)
+                st->site_n++;
+            return 1;
+        }
+    }
+
+    return -1;
+}
+
+void freeChunks(Chunk_s *chunks) {
+    if(chunks != NULL && chunks[0].bcf != NULL)
+        freeBcf((Bcf_s *)chunks[0].bcf);
+    free(chunks);
+}
@@ -0,0 +1,77 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Multithreaded processing of VCF files used by prune_ld, poly_freq, poly_fst and poly_sfs.
+
+ splitVcf divides a VCF file into byte ranges (chunks). Chunk 0 always holds the header, and the remaining
+ chunks hold the data lines. With contig set, every data chunk starts at the first line of a chromosome, so
+ window-based statistics never span two chunks. Without it, chunks may also split a long chromosome.
+ runChunks processes chunks on a pool of threads, each reading the file through its own handle. Output
+ written to chunk->out[] goes to temporary files, which are copied to the real outputs in input order.
+ If the file cannot be split (-threads 1, or a pipe), the whole file is returned as a single chunk.
+ With a region (-region chr:start-end), the data chunks only cover the part of a bgzip-compressed file that
+ its .tbi or .csi index points to, and readLine skips the data lines outside the region.
+ splitCache does the same for a genotype cache (-cache), with chunks that are ranges of site indexes. readSite
+ returns the header lines and the parsed sites of a chunk from either source.
+ A BCF file is split into the header and a single data chunk (a .csi index only narrows it down to a region), as
+ records cannot be found from arbitrary offsets; -threads then inflates its BGZF blocks on the pool instead.
+ freeChunks frees the chunks with the BCF header that they share.
+ With -stats, chunk->stats points to the run statistics of the chunk (see vcf_stats.h), and is NULL otherwise.
+ A text chunk that is read alone (a pipe, a gzip file, or a file with a single data chunk, such as one chromosome with
+ contig set) gets pipe_n threads. readSite then reads its lines through a pipeline: a reader thread fills batches of
+ lines, a pool of threads parses them and decodes the genotypes with the mask of the program (see readyGenos), and
+ readSite hands the parsed lines over in input order. The pipeline starts after the first site that the program has
+ decoded, and stops at the end of the chunk, so the chunk has to be read to the end. With -stats, the time spent
+ waiting for the pipeline is counted as reading.
+*/
+
+#ifndef VCF_THREAD_H
+#define VCF_THREAD_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "bgzf.h"
+#include "vcf_bcf.h"
+#include "vcf_cache.h"
+#include "vcf_stats.h"
+
+typedef struct {
+    char chr[100];
+    long int beg, end;
+} Region_s;
+
+typedef struct {
+    int idx, thread, last, done, pipe_n;
+    long int start, end, pos;
+    const Region_s *region;
+    Bgzf_s *in;
+    const Cache_s *cache;
+    const Bcf_s *bcf;
+    Stats_s *stats;
+    void *pipe;
+    FILE *out[2];
+} Chunk_s;
+
+int parseRegion(const char *str, Region_s *region);
+Chunk_s *splitVcf(Bgzf_s *vcf_file, const char *vcf_name, const Region_s *region, int thread_n, int contig, int *n);
+Chunk_s *splitCache(const Cache_s *cache, const Region_s *region, int thread_n, int contig, int *n);
+void runChunks(Chunk_s *chunks, int chunk_n, int thread_n, const char *vcf_name, Bgzf_s *vcf_file, FILE *out[2], void (*work)(Chunk_s *chunk, void *arg), void *arg);
+ssize_t readLine(Chunk_s *chunk, char **line, size_t *len);
+int readSite(Chunk_s *chunk, char **line, size_t *len, Record_s *rec);
+void freeChunks(Chunk_s *chunks);
+
+#endif
@@ -0,0 +1,580 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Buffered output writer used by prune_ld and poly_freq. See vcf_write.h.
+*/
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bgzf.h"
+#include "vcf_parse.h"
+#include "vcf_write.h"
+#define merror "\nERROR: System out of memory\n\n"
+
+typedef struct {
+    int state, raw_n, block_n;
+    char *raw;
+    unsigned char *block;
+} Slot_s;
+
+typedef struct {
+    int slot_n, head, used, stop, thread_n;
+    Slot_s *slots;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} Pool_s;
+
+typedef struct {
+    int ref, bin;
+    long int beg, end, vbeg, vend;
+} Span_s;
+
+static const double powers[] = {1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+
+void initWriter(Writer_s *w, FILE *file, int bgzf) {
+    w->n = 0;
+    w->done = 0;
+    w->bgzf = bgzf;
+    w->file = file;
+    w->block = NULL;
+    w->pool = NULL;
+    w->index = NULL;
+    if((w->buf = malloc(WRITE_BUFFER)) == NULL || (bgzf && (w->block = malloc(65536)) == NULL)) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void writeFile(FILE *file, const void *data, size_t n) {
+    if(n > 0 && fwrite(data, 1, n, file) != n) {
+        fprintf(stderr, "\nERROR: Cannot write the output\n\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* The blocks of a thread pool are compressed in any order, and written from the head of the ring in output order */
+static void *runDeflate(void *arg) {
+    int i;
+    Slot_s *slot = NULL;
+    Pool_s *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while(1) {
+        slot = NULL;
+        for(i = 0; i < pool->used; i++) {
+            if(pool->slots[(pool->head + i) % pool->slot_n].state == 1) {
+                slot = &pool->slots[(pool->head + i) % pool->slot_n];
+                break;
+            }
+        }
+        if(slot == NULL) {
+            if(pool->stop)
+                break;
+            pthread_cond_wait(&pool->cond, &pool->lock);
+            continue;
+        }
+        slot->state = 2;
+        pthread_mutex_unlock(&pool->lock);
+        slot->block_n = deflateBgzf(slot->raw, slot->raw_n, slot->block);
+        pthread_mutex_lock(&pool->lock);
+        slot->state = 3;
+        pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+void threadWriter(Writer_s *w, int thread_n) {
+    int i;
+    Pool_s *pool = NULL;
+
+    if(w->bgzf == 0 || w->pool != NULL || thread_n < 2)
+        return;
+    if((pool = calloc(1, sizeof(Pool_s))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    pool->thread_n = thread_n;
+    pool->slot_n = thread_n * 4;
+    if((pool->slots = calloc(pool->slot_n, sizeof(Slot_s))) == NULL || (pool->threads = malloc(pool->thread_n * sizeof(pthread_t))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < pool->slot_n; i++) {
+        if((pool->slots[i].raw = malloc(BGZF_DATA)) == NULL || (pool->slots[i].block = malloc(65536)) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    for(i = 0; i < pool->thread_n; i++) {
+        if(pthread_create(&pool->threads[i], NULL, runDeflate, pool) != 0) {
+            fprintf(stderr, "\nERROR: Cannot create threads\n\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    w->pool = pool;
+}
+
+/* The index keeps the uncompressed and the compressed end offset of every block of the writer */
+static void putBlock(Writer_s *w, const unsigned char *block, long int raw_n, long int block_n) {
+    Index_s *x = w->index;
+
+    writeFile(w->file, block, block_n);
+    if(x == NULL)
+        return;
+    if(x->block_n == x->block_max) {
+        x->block_max = x->block_max > 0 ? x->block_max * 2 : 1024;
+        if((x->blocks = realloc(x->blocks, x->block_max * 2 * sizeof(long int))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+    }
+    x->blocks[x->block_n * 2] = raw_n + (x->block_n > 0 ? x->blocks[x->block_n * 2 - 2] : 0);
+    x->blocks[x->block_n * 2 + 1] = block_n + (x->block_n > 0 ? x->blocks[x->block_n * 2 - 1] : 0);
+    x->block_n++;
+}
+
+/* Writes the block at the head of the ring, waiting for it to be compressed if wait is set. Returns 0 if it was not ready */
+static int takeBlock(Writer_s *w, int wait) {
+    Pool_s *pool = w->pool;
+    Slot_s *slot = &pool->slots[pool->head];
+
+    pthread_mutex_lock(&pool->lock);
+    while(wait && slot->state != 3)
+        pthread_cond_wait(&pool->cond, &pool->lock);
+    if(slot->state != 3) {
+        pthread_mutex_unlock(&pool->lock);
+        return 0;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    putBlock(w, slot->block, slot->raw_n, slot->block_n);
+    pthread_mutex_lock(&pool->lock);
+    slot->state = 0;
+    pool->head = (pool->head + 1) % pool->slot_n;
+    pool->used--;
+    pthread_mutex_unlock(&pool->lock);
+
+    return 1;
+}
+
+static void queueBlock(Writer_s *w, const char *data, int n) {
+    Pool_s *pool = w->pool;
+    Slot_s *slot = NULL;
+
+    if(pool->used == pool->slot_n)
+        takeBlock(w, 1);
+    slot = &pool->slots[(pool->head + pool->used) % pool->slot_n];
+    memcpy(slot->raw, data, n);
+    slot->raw_n = n;
+    pthread_mutex_lock(&pool->lock);
+    slot->state = 1;
+    pool->used++;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    while(pool->used > 0 && takeBlock(w, 0))
+        ;
+}
+
+void flushWriter(Writer_s *w) {
+    size_t i, k;
+    for(i = 0; w->bgzf && i < w->n; i += k) {
+        k = w->n - i < BGZF_DATA ? w->n - i : BGZF_DATA;
+        if(w->pool != NULL)
+            queueBlock(w, w->buf + i, k);
+        else
+            putBlock(w, w->block, k, deflateBgzf(w->buf + i, k, w->block));
+    }
+    if(w->bgzf == 0)
+        writeFile(w->file, w->buf, w->n);
+    w->done += w->n;
+    w->n = 0;
+}
+
+void freeWriter(Writer_s *w) {
+    int i;
+    Pool_s *pool = w->pool;
+
+    flushWriter(w);
+    if(pool != NULL) {
+        while(pool->used > 0)
+            takeBlock(w, 1);
+        pthread_mutex_lock(&pool->lock);
+        pool->stop = 1;
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+        for(i = 0; i < pool->thread_n; i++)
+            pthread_join(pool->threads[i], NULL);
+        for(i = 0; i < pool->slot_n; i++) {
+            free(pool->slots[i].raw);
+            free(pool->slots[i].block);
+        }
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->cond);
+        free(pool->slots);
+        free(pool->threads);
+        free(pool);
+        w->pool = NULL;
+    }
+    free(w->buf);
+    free(w->block);
+    w->buf = NULL;
+    w->block = NULL;
+}
+
+/* The empty block that bgzip writes at the end of a file */
+void writeEof(FILE *file) {
+    static const unsigned char eof[28] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 66, 67, 2, 0, 27, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    writeFile(file, eof, sizeof(eof));
+}
+
+void writeBytes(Writer_s *w, const void *data, size_t n) {
+    size_t k;
+    const char *p = data;
+
+    while(w->n + n > WRITE_BUFFER) {
+        k = WRITE_BUFFER - w->n;
+        memcpy(w->buf + w->n, p, k);
+        w->n += k;
+        flushWriter(w);
+        p += k;
+        n -= k;
+    }
+    memcpy(w->buf + w->n, p, n);
+    w->n += n;
+}
+
+/* Digits are written backwards into a small buffer, so a number costs one pass over its digits */
+static void writeDigits(Writer_s *w, unsigned long int v, int min_n) {
+    int k = 24;
+    char s[24];
+
+    while(v > 0 || 24 - k < min_n) {
+        s[--k] = '0' + v % 10;
+        v /= 10;
+    }
+    writeBytes(w, s + k, 24 - k);
+}
+
+void writeInt(Writer_s *w, long int v) {
+    if(v < 0) {
+        writeChar(w, '-');
+        writeDigits(w, -(unsigned long int)v, 1);
+    } else
+        writeDigits(w, v, 1);
+}
+
+/*
+ a * 10^prec is exact to within half an ulp, so its rounding is only ambiguous when the fraction is that close to 0.5.
+ Those values (ties included, as printf rounds them by the exact binary value) go to snprintf with everything beyond
+ 15 significant digits, so the output always matches printf.
+*/
+void writeFixed(Writer_s *w, double v, int prec) {
+    int n;
+    unsigned long int r, scale;
+    double a = fabs(v), s = 0, f = 0;
+    char temp[400];
+
+    if(isfinite(v) && prec >= 0 && prec <= 15 && a * powers[prec] < 1e15) {
+        s = a * powers[prec];
+        f = s - floor(s);
+        if(fabs(f - 0.5) > s * 4.5e-16 + 1e-300) {
+            r = (unsigned long int)floor(s) + (f > 0.5);
+            scale = (unsigned long int)powers[prec];
+            if(signbit(v))
+                writeChar(w, '-');
+            writeDigits(w, r / scale, 1);
+            if(prec > 0) {
+                writeChar(w, '.');
+                writeDigits(w, r % scale, prec);
+            }
+            return;
+        }
+    }
+    n = snprintf(temp, sizeof(temp), "%.*f", prec, v);
+    if(n >= (int)sizeof(temp)) {
+        fprintf(stderr, "\nERROR: Cannot format the value %g\n\n", v);
+        exit(EXIT_FAILURE);
+    }
+    writeBytes(w, temp, n);
+}
+
+/* markWriter is called before the record is written, so its offset is the number of bytes written so far */
+void markWriter(Writer_s *w, const char *chr, long int beg, long int end) {
+    Index_s *x = w->index;
+    Mark_s *m = NULL;
+
+    if(x == NULL)
+        return;
+    if(x->ref_n == 0 || strcmp(x->refs[x->ref_n - 1], chr) != 0) {
+        if(x->ref_n == x->ref_max) {
+            x->ref_max = x->ref_max > 0 ? x->ref_max * 2 : 16;
+            if((x->refs = realloc(x->refs, x->ref_max * sizeof(char *))) == NULL) {
+                fprintf(stderr, merror);
+                exit(EXIT_FAILURE);
+            }
+        }
+        if((x->refs[x->ref_n++] = strdup(chr)) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if(end <= beg)
+        end = beg + 1;
+    if(x->mark_n > 0)
+        m = &x->marks[x->mark_n - 1];
+    if(m != NULL && m->ref == x->ref_n - 1 && beg < m->beg) {
+        fprintf(stderr, "\nERROR: Sites are not sorted by position at %s:%li, so the output cannot be indexed\n\n", chr, beg + 1);
+        exit(EXIT_FAILURE);
+    }
+    if(m != NULL && m->ref == x->ref_n - 1 && m->beg >> 14 == beg >> 14 && (m->end - 1) >> 14 == beg >> 14 && (end - 1) >> 14 == beg >> 14) {
+        if(end > m->end)
+            m->end = end;
+        return;
+    }
+    if(x->mark_n == x->mark_max) {
+        x->mark_max = x->mark_max > 0 ? x->mark_max * 2 : 1024;
+        if((x->marks = realloc(x->marks, x->mark_max * sizeof(Mark_s))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+    }
+    m = &x->marks[x->mark_n++];
+    m->ref = x->ref_n - 1;
+    m->beg = beg;
+    m->end = end;
+    m->off = w->done + w->n;
+}
+
+/* Virtual offset (compressed offset of the block << 16 | offset within the block) of the uncompressed offset u of a part.
+   b is the block of the previous call, as the offsets are converted in increasing order */
+static long int toVirtual(const Index_s *x, long int *b, long int u, long int base) {
+    while(*b < x->block_n && x->blocks[*b * 2] <= u)
+        *b = *b + 1;
+    if(*b == x->block_n)
+        return (base + (x->block_n > 0 ? x->blocks[x->block_n * 2 - 1] : 0)) << 16;
+    if(*b == 0)
+        return base << 16 | u;
+
+    return (base + x->blocks[*b * 2 - 1]) << 16 | (u - x->blocks[*b * 2 - 2]);
+}
+
+/* The same binning scheme as htslib: bins of 2^14 bp at the deepest level, each level up 8 times wider */
+static int findBin(long int beg, long int end, int depth) {
+    int l, s = 14, t = ((1 << depth * 3) - 1) / 7;
+    for(end--, l = depth; l > 0; l--, s += 3, t -= 1 << l * 3) {
+        if(beg >> s == end >> s)
+            return t + (beg >> s);
+    }
+    return 0;
+}
+
+/* First 16 kb window covered by a bin, which the CSI index stores the linear offset of */
+static long int binStart(int bin, int depth) {
+    int l, b;
+    for(l = 0, b = bin; b > 0; l++, b = (b - 1) >> 3)
+        ;
+    return (long int)(bin - ((1 << l * 3) - 1) / 7) << (depth - l) * 3;
+}
+
+static int cmpSpan(const void *a, const void *b) {
+    const Span_s *x = a, *y = b;
+    if(x->bin != y->bin)
+        return x->bin < y->bin ? -1 : 1;
+    return (x->vbeg > y->vbeg) - (x->vbeg < y->vbeg);
+}
+
+static void putInt(Writer_s *w, unsigned long int v, int bytes) {
+    int i;
+    unsigned char b[8];
+    for(i = 0; i < bytes; i++)
+        b[i] = v >> (i * 8);
+    writeBytes(w, b, bytes);
+}
+
+/*
+ The parts are the indexes of the chunks in the order of their output, so each part starts at the compressed end of the
+ previous one. Every record is added to the chunk list of its bin (records that follow each other are merged), and to
+ the linear index of each 16 kb window that it overlaps, which holds the offset of the first record of the window.
+ Windows without records get the offset of the previous one. The index is written for VCF (columns 1 and 2, meta '#').
+*/
+void writeIndex(const char *name, Index_s *parts, int part_n) {
+    int i, j, csi = 0, depth = 5, ref_n = 0, last = -1, name_n = 0, bin_n = 0, *map = NULL, *v = NULL;
+    long int c, k, s, e, b = 0, base = 0, span_n = 0, max = 0, intv_n = 0, l_nm = 0, *lin = NULL;
+    size_t len = strlen(name);
+    char **names = NULL;
+    Span_s *spans = NULL, *p = NULL;
+    Index_s *x = NULL;
+    Hash_s hash;
+    Writer_s w;
+    FILE *file = NULL;
+
+    csi = len >= 4 && strcmp(name + len - 4, ".csi") == 0;
+    for(i = 0; i < part_n; i++) {
+        span_n += parts[i].mark_n;
+        name_n += parts[i].ref_n;
+    }
+    if((spans = malloc((span_n + 1) * sizeof(Span_s))) == NULL || (names = malloc((name_n + 1) * sizeof(char *))) == NULL) {
+        fprintf(stderr, merror);
+        exit(EXIT_FAILURE);
+    }
+    initHash(&hash, name_n + 1);
+    for(i = 0, p = spans; i < part_n; i++) {
+        x = &parts[i];
+        if((map = realloc(map, (x->ref_n + 1) * sizeof(int))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        for(j = 0; j < x->ref_n; j++) {
+            if((v = findHash(&hash, x->refs[j])) != NULL)
+                map[j] = *v;
+            else {
+                names[ref_n] = x->refs[j];
+                l_nm += strlen(x->refs[j]) + 1;
+                map[j] = *addHash(&hash, x->refs[j]) = ref_n++;
+            }
+        }
+        for(k = 0, b = 0; k < x->mark_n; k++, p++) {
+            p->ref = map[x->marks[k].ref];
+            if(p->ref < last) {
+                fprintf(stderr, "\nERROR: Sites of %s are not together in the output, so it cannot be indexed\n\n", names[p->ref]);
+                exit(EXIT_FAILURE);
+            }
+            last = p->ref;
+            p->beg = x->marks[k].beg;
+            p->end = x->marks[k].end;
+            p->vbeg = toVirtual(x, &b, x->marks[k].off, base);
+            p->vend = toVirtual(x, &b, k + 1 < x->mark_n ? x->marks[k + 1].off : (x->block_n > 0 ? x->blocks[x->block_n * 2 - 2] : 0), base);
+            if(p->end > max)
+                max = p->end;
+        }
+        if(x->block_n > 0)
+            base += x->blocks[x->block_n * 2 - 1];
+    }
+    if(csi == 0 && max > 1L << 29) {
+        fprintf(stderr, "\nERROR: Positions beyond 2^29 cannot be indexed in a .tbi index, use a .csi index instead\n\n");
+        exit(EXIT_FAILURE);
+    }
+    while(max > 1L << (14 + depth * 3))
+        depth++;
+    for(k = 0; k < span_n; k++)
+        spans[k].bin = findBin(spans[k].beg, spans[k].end, depth);
+
+    if((file = fopen(name, "wb")) == NULL) {
+        fprintf(stderr, "\nERROR: Cannot create file '%s'\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+    initWriter(&w, file, 1);
+    writeBytes(&w, csi ? "CSI\1" : "TBI\1", 4);
+    if(csi) {
+        putInt(&w, 14, 4);
+        putInt(&w, depth, 4);
+        putInt(&w, 28 + l_nm, 4);
+    } else
+        putInt(&w, ref_n, 4);
+    putInt(&w, 2, 4);
+    putInt(&w, 1, 4);
+    putInt(&w, 2, 4);
+    putInt(&w, 0, 4);
+    putInt(&w, '#', 4);
+    putInt(&w, 0, 4);
+    putInt(&w, l_nm, 4);
+    for(i = 0; i < ref_n; i++)
+        writeBytes(&w, names[i], strlen(names[i]) + 1);
+    if(csi)
+        putInt(&w, ref_n, 4);
+    for(s = 0; s < span_n; s = e) {
+        for(e = s, max = 0; e < span_n && spans[e].ref == spans[s].ref; e++) {
+            if(spans[e].end > max)
+                max = spans[e].end;
+        }
+        intv_n = ((max - 1) >> 14) + 1;
+        if((lin = realloc(lin, intv_n * sizeof(long int))) == NULL) {
+            fprintf(stderr, merror);
+            exit(EXIT_FAILURE);
+        }
+        for(k = 0; k < intv_n; k++)
+            lin[k] = -1;
+        for(k = s; k < e; k++) {
+            for(b = spans[k].beg >> 14; b <= (spans[k].end - 1) >> 14; b++) {
+                if(lin[b] < 0)
+                    lin[b] = spans[k].vbeg;
+            }
+        }
+        for(k = 0; k < intv_n; k++) {
+            if(lin[k] < 0)
+                lin[k] = k > 0 ? lin[k - 1] : spans[s].vbeg;
+        }
+        qsort(spans + s, e - s, sizeof(Span_s), cmpSpan);
+        for(k = s + 1, j = s, bin_n = 1; k < e; k++) {
+            if(spans[k].bin == spans[j].bin && spans[k].vbeg <= spans[j].vend) {
+                if(spans[k].vend > spans[j].vend)
+                    spans[j].vend = spans[k].vend;
+                continue;
+            }
+            bin_n += spans[k].bin != spans[j].bin;
+            spans[++j] = spans[k];
+        }
+        putInt(&w, bin_n, 4);
+        for(k = s; k <= j; k = b) {
+            for(b = k; b <= j && spans[b].bin == spans[k].bin; b++)
+                ;
+            putInt(&w, spans[k].bin, 4);
+            if(csi)
+                putInt(&w, binStart(spans[k].bin, depth) < intv_n ? lin[binStart(spans[k].bin, depth)] : 0, 8);
+            putInt(&w, b - k, 4);
+            for(c = k; c < b; c++) {
+                putInt(&w, spans[c].vbeg, 8);
+                putInt(&w, spans[c].vend, 8);
+            }
+        }
+        if(csi == 0) {
+            putInt(&w, intv_n, 4);
+            for(k = 0; k < intv_n; k++)
+                putInt(&w, lin[k], 8);
+        }
+    }
+    putInt(&w, 0, 8);
+    freeWriter(&w);
+    writeEof(file);
+    if(fclose(file) != 0) {
+        fprintf(stderr, "\nERROR: Cannot write file '%s'\n\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    freeHash(&hash);
+    free(names);
+    free(spans);
+    free(map);
+    free(lin);
+}
+
+void freeIndex(Index_s *index) {
+    int i;
+    for(i = 0; i < index->ref_n; i++)
+        free(index->refs[i]);
+    free(index->refs);
+    free(index->marks);
+    free(index->blocks);
+    memset(index, 0, sizeof(Index_s));
+}
@@ -0,0 +1,86 @@
+/*
+ Copyright (C) 2023 Tuomas Hamala
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ For any other inquiries, send an email to tuomas.hamala@gmail.com
+
+ ––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––––
+
+ Buffered output writer used by prune_ld and poly_freq.
+
+ Each chunk formats its lines into its own WRITE_BUFFER sized buffer, which is handed to fwrite only when it is full or
+ at the end of the chunk, so the output of one site costs a few memcpy calls instead of a printf call per value.
+ writeFixed produces the same text as printf("%.*f"): values are rounded in integer arithmetic, and the few whose
+ rounding could differ from the exact decimal expansion (or that are too large, or not finite) are left to snprintf.
+ With bgzf set, the buffer is written as BGZF blocks instead (BCF output and -O z), and writeEof ends such a file
+ after the output of the last chunk. threadWriter starts a pool that compresses the blocks of the writer in parallel,
+ while they are still written in order, for a chunk that holds all the output of the run.
+ With index set, markWriter records each record of a chunk as its region and the offset of the record in the output
+ of the writer, and the sizes of the written blocks are kept as well. Records of the same 16 kb window that follow
+ each other are recorded as one, and a record ends where the next one starts. writeIndex turns the records of the
+ chunks, in output order, into a .tbi or a .csi index (by the extension of the file name) of the output file.
+*/
+
+#ifndef VCF_WRITE_H
+#define VCF_WRITE_H
+
+#include <stdio.h>
+#include <string.h>
+#define WRITE_BUFFER (1 << 20)
+
+typedef struct {
+    int ref;
+    long int beg, end, off;
+} Mark_s;
+
+typedef struct {
+    int ref_n, ref_max;
+    long int mark_n, mark_max, block_n, block_max;
+    long int *blocks;
+    char **refs;
+    Mark_s *marks;
+} Index_s;
+
+typedef struct {
+    int bgzf;
+    size_t n;
+    long int done;
+    char *buf;
+    unsigned char *block;
+    void *pool;
+    Index_s *index;
+    FILE *file;
+} Writer_s;
+
+void initWriter(Writer_s *w, FILE *file, int bgzf);
+void threadWriter(Writer_s *w, int thread_n);
+void flushWriter(Writer_s *w);
+void freeWriter(Writer_s *w);
+void writeEof(FILE *file);
+void markWriter(Writer_s *w, const char *chr, long int beg, long int end);
+void writeIndex(const char *name, Index_s *parts, int part_n);
+void freeIndex(Index_s *index);
+void writeBytes(Writer_s *w, const void *data, size_t n);
+void writeInt(Writer_s *w, long int v);
+void writeFixed(Writer_s *w, double v, int prec);
+
+static inline void writeChar(Writer_s *w, char c) {
+    if(w->n == WRITE_BUFFER)
+        flushWriter(w);
+    w->buf[w->n++] = c;
+}
+
+static inline void writeString(Writer_s *w, const char *s) {
+    writeBytes(w, s, strlen(s));
+}
+
+#endif